@@ -3,21 +3,54 @@
 #include "robotic_arm.h"
 #include "string.h"
 #include "get_input_string.h"
+#include "motion_timeline.h"
+#include "arm_scheduler.h"
+#include "telemetry.h"
+#include "console.h"
+#include "task.h"
+#include "motion_script.h"
+#include "profiler.h"
+#include "servo_feedback.h"
+#include "arm_description.h"
+#include "cdc_transport.h"
 #include <stdlib.h>
 
 #define INPUT_UINT_EXIT -1
 #define INPUT_UINT_INVALID -2
 #define INPUT_UINT_PRINT -3
+
+// Number of robotic arms, each arm uses 6 GPIO pins from its first pin
+#ifndef ROBOTIC_ARM_COUNT
+#define ROBOTIC_ARM_COUNT 1
+#endif
+
+// First GPIO pins of the arms, chosen so no two arms share a PWM channel
+const uint robotic_arm_first_pins[] = {16, 6};
+
+#if ROBOTIC_ARM_COUNT > 2
+#error "ROBOTIC_ARM_COUNT must be 1 or 2, the RP2040 has PWM channels for two 6-servo arms"
+#endif
+
+#ifdef SERVO_FEEDBACK
+// ADC inputs of the potentiometers of the servos of arm 0, -1 without feedback
+const int8_t servo_feedback_inputs[] = {0, 1, 2, -1, -1, -1};
+
+// Largest difference in degrees between measured and target angles of an arrived servo
+#define SERVO_FEEDBACK_TOLERANCE 2.0f
+#endif
+
+#ifdef EMERGENCY_STOP
+// GPIO of the emergency stop button, pulled up, pressing the button pulls it low
+#define EMERGENCY_STOP_GPIO 15
+#endif
 /**
- * Get input and transform to number.
+ * Transform an input word to number.
  * returns INPUT_UINT_EXIT (-1) if input is 'q' or 'Q' to indicate exit,
  * INPUT_UINT_INVALID (-2) for invalid input, and INPUT_UINT_PRINT (-3) for
  * printing current angles when input is 'p' or 'P'.
  */
-int get_input_uint() {
+int parse_input_uint(const char* input) {
     int number = 0;
-    char input[10];
-    int len = get_string(input, 10);
     switch (input[0]) {
     case '0' ... '9': // If input is a digit, start forming the number
         number = atoi(input);
@@ -33,13 +66,11 @@ int get_input_uint() {
 }
 
 /**
- * Get input and transform to float.
+ * Transform an input word to float.
  * Returns -1.0f if input is 'q' or 'Q' to indicate exit, -2.0f for invalid input.
  */
-float get_input_float() {
+float parse_input_float(const char* input) {
     float number = 0.0f;
-    char input[16];
-    int len = get_string(input, 16);
     switch (input[0]) {
     case '-':
     case '0' ... '9':
@@ -59,221 +90,1215 @@ float get_input_float() {
  * 
  * @robot_arm: Pointer to the robotic arm structure, should be created with robotic_arm_create.
  * @motor: Pointer to the servo motor structure to be used for all servos in the robotic arm.
+ * @first_pin: GPIO pin of servo 0, the following servos use the following pins.
  */
-void robotic_arm_starter(robotic_arm* robot_arm, servo* motor) {
+void robotic_arm_starter(robotic_arm* robot_arm, servo* motor, uint first_pin) {
     if (!robot_arm || !motor) {
-        fprintf(stderr, "Invalid robotic arm or servo pointer.\n");
+        console_error("Invalid robotic arm or servo pointer.\n");
         return;
     }
     for (uint8_t i = 0; i < robot_arm->number; i++) {
         memcpy(&robot_arm->servos[i], motor, sizeof(servo));
-        robotic_arm_set_servo_pin(robot_arm, i, i + 16); // Assuming GPIO pins 16 to 21 for servos
+        robotic_arm_set_servo_pin(robot_arm, i, i + first_pin); // GPIO pins 16 to 21 for servos of the first arm
     }
     robotic_arm_set_servo_limits(robot_arm, 1, 3.0f, 177.0f); // Set limits for servo 1
-    robotic_arm_start(robot_arm);
+    if (!robotic_arm_start(robot_arm)) {
+        console_error("Failed to start robotic arm, check servo periods of shared PWM slices.\n");
+    }
+}
+
+// Longest binary command frame: arm, number, 3 bytes per servo, duration and profile
+#define MENU_FRAME_SIZE (2 + SERVO_BANK_MAX_CHANNELS * 3 + 3)
+
+// Longest time between two bytes of a binary command frame
+#define MENU_FRAME_TIMEOUT_US 10000
+
+// Pause between the actions of the custom control mode
+#define MENU_ACTION_PAUSE_US 100000
+
+// Most script instructions run per round of the task runtime
+#define MENU_SCRIPT_BUDGET 16
+
+// Change of the feed rate override per '+' or '-' key, in percent
+#define MENU_FEED_STEP 10
+
+typedef enum menu_mode {
+    MENU_MAIN,
+    MENU_SINGLE_SERVO,
+    MENU_MULTIPLE_SERVO,
+    MENU_CUSTOM_CONTROL,
+    MENU_CALIBRATION,
+    MENU_SPEED_PRESET,
+    MENU_SCHEDULER,
+    MENU_TELEMETRY,
+    MENU_SCRIPT
+} menu_mode;
+
+/**
+ * State of the console menu. The menu never blocks: menu_input() handles one input
+ * character and returns, moves are queued to the scheduler of the main loop.
+ * 
+ * @mode: Mode handling the input (menu_mode)
+ * @robot: Robotic arm of the single arm modes, arm 0 of scheduler (robotic_arm*)
+ * @scheduler: Scheduler executing all moves (arm_scheduler*)
+ * @stream: Telemetry of the scheduler (telemetry*)
+ * @runtime: Task runtime of the main loop (task_runtime*)
+ * @script: Motion script uploaded in script mode (motion_script*)
+ * @compiler: Compiler of the script being uploaded (motion_script_compiler*)
+ * @vm: Virtual machine running the script (motion_script_vm*)
+ * @compiling: True while script lines are uploaded (bool)
+ * @word: Word being typed, words end at a space or when input pauses (char[])
+ * @word_length: Number of characters in word (uint8_t)
+ * @word_end: Character that ended the last word (int)
+ * @discard: True to drop input until it pauses, after invalid input (bool)
+ * @selected: True if a servo is selected in single servo or calibration mode (bool)
+ * @index: Selected servo (uint8_t)
+ * @angle: Target angle of the selected servo (float)
+ * @delta_angle: Angle step of single servo mode (float)
+ * @pulse: Pulse width of the selected servo in calibration mode (uint)
+ * @delta_pulse: Pulse step of calibration mode (uint)
+ * @measuring: True if calibration mode waits for a measured angle (bool)
+ * @signal: Control signal being typed in multiple servo mode (robotic_arm_signal)
+ * @signal_servos: Indexes of signal (uint8_t[])
+ * @signal_angles: Angles of signal (float[])
+ * @received: Number of words of signal received after its number (uint8_t)
+ * @action: Custom action running, 0 to start, -1 if no action is running (int)
+ * @line: Line being typed in multiple arm or script mode (char[])
+ * @line_length: Number of characters in line (uint)
+ * @framing: True while a binary command frame is received (bool)
+ * @frame: Binary command frame (uint8_t[])
+ * @frame_length: Length of frame, 0 until the length byte arrives (uint)
+ * @frame_received: Number of frame bytes received (uint)
+ * @frame_time_us: Time of the last frame byte (uint64_t)
+ * @input_us: Time the last input character arrived (uint64_t)
+ * @probe_us: Arrival of the keypress waiting for its first PWM update, 0 if none (uint64_t)
+ * @latency_last_us: Last keypress to PWM update latency (uint32_t)
+ * @latency_max_us: Longest keypress to PWM update latency (uint32_t)
+ * @latency_total_us: Sum of all keypress to PWM update latencies (uint32_t)
+ * @latency_count: Number of latencies measured (uint)
+ * @stop_reported: True once the last emergency stop was reported (bool)
+ */
+typedef struct menu_state {
+    menu_mode mode;
+    robotic_arm* robot;
+    arm_scheduler* scheduler;
+    telemetry* stream;
+    task_runtime* runtime;
+    motion_script* script;
+    motion_script_compiler* compiler;
+    motion_script_vm* vm;
+    bool compiling;
+    char word[16];
+    uint8_t word_length;
+    int word_end;
+    bool discard;
+    bool selected;
+    uint8_t index;
+    float angle;
+    float delta_angle;
+    uint pulse;
+    uint delta_pulse;
+    bool measuring;
+    robotic_arm_signal signal;
+    uint8_t signal_servos[SERVO_BANK_MAX_CHANNELS];
+    float signal_angles[SERVO_BANK_MAX_CHANNELS];
+    uint8_t received;
+    int action;
+    char line[128];
+    uint line_length;
+    bool framing;
+    uint8_t frame[MENU_FRAME_SIZE];
+    uint frame_length;
+    uint frame_received;
+    uint64_t frame_time_us;
+    uint64_t input_us;
+    uint64_t probe_us;
+    uint32_t latency_last_us;
+    uint32_t latency_max_us;
+    uint32_t latency_total_us;
+    uint latency_count;
+    bool stop_reported;
+} menu_state;
+
+const char mode_tip[] = "Enter 's' for single servo control, 'm' for multiple servos control,\n"
+                        "    'c' for costom control, 'k' for servo calibration, 'v' for speed presets,\n"
+                        "    'a' for multiple arms control, 't' for telemetry, 'r' for task run times,\n"
+                        "    'x' for motion scripts, 'f' for the profile, 'e' to release an emergency stop,\n"
+                        "    or 'p' to print current angles.\n";
+const char single_select_tip[] = "Enter servo index (0 to %d) to control, or 'q' to exit: ";
+const char multiple_command_tip[] = "Enter command format: 'number index angle index angle ...',\n"
+                                    "    'number' is the number of servos to control,\n"
+                                    "    'index' is the servo index (0 to %d),\n"
+                                    "    'angle' is the target angle for that servo.\n"
+                                    "Enter 'p' to print current angles, or 'q' to exit.\n";
+const char custom_action_tip[] = "Enter 'a' to do exam_action, 'd' to dry run exam_action,\n"
+                                 "    'e' to export exam_action timeline as CSV, '+' or '-' to change the feed rate\n"
+                                 "    by 10%, '=' to reset it, or 'q' to exit.\n";
+const char calibration_select_tip[] = "Enter servo index (0 to %d) to calibrate, or 'q' to exit: ";
+const char scheduler_command_tip[] = "Enter command format: '@arm number index angle index angle ... [d<ms>] [s<speed>] [p<profile>]',\n"
+                                     "    'arm' is the arm id (0 to %d), one line per command.\n"
+                                     "Enter 'p' to print queues and tick statistics, '+', '-' or '=' to change\n"
+                                     "    the feed rate, or 'q' to exit.\n";
+const char script_command_tip[] = "Enter script lines (see motion_script.h), '.' to end the upload and compile,\n"
+                                  "    'run' to run the script, 'stop' to stop it, or 'q' to exit.\n";
+
+// Example custom action
+// These actions can be modified or extended as needed
+// String format: "number index angle index angle ..."
+char exam_action[][40] = {
+    "3 0 60 1 60 2 60",
+    "2 3 60 4 60",
+    "1 5 120",
+    "5 0 90 1 90 2 90 3 90 4 90",
+    "3 0 120 1 60 2 60",
+    "2 3 60 4 60",
+    "1 5 90",
+    "6 0 90 1 90 2 90 3 90 4 90 5 90"
+};
+
+// Also run by the golden PWM trace check of the simulator, sim/trace_check.c
+const uint exam_action_count = sizeof(exam_action) / sizeof(exam_action[0]);
+
+/**
+ * Collect input characters into a word without blocking, ending at a space or line end.
+ * 
+ * @menu: Pointer to the menu state.
+ * @input: Input character, PICO_ERROR_TIMEOUT if input paused.
+ * @return True if a word is complete in menu->word.
+ */
+bool menu_read_word(menu_state* menu, int input) {
+    if (!is_space(input)) {
+        if (menu->word_length < sizeof(menu->word) - 1) {
+            menu->word[menu->word_length++] = input;
+        }
+        return false;
+    }
+    if (menu->word_length == 0) {
+        return false;
+    }
+    menu->word[menu->word_length] = '\0';
+    menu->word_length = 0;
+    menu->word_end = input;
+    return true;
+}
+
+/**
+ * Drop the rest of the input after an invalid word, until input pauses.
+ * 
+ * @menu: Pointer to the menu state.
+ */
+void menu_discard_input(menu_state* menu) {
+    menu->discard = menu->word_end != PICO_ERROR_TIMEOUT;
+}
+
+/**
+ * Leave the current mode and prompt for the next one.
+ * 
+ * @menu: Pointer to the menu state.
+ */
+void menu_return(menu_state* menu) {
+    menu->mode = MENU_MAIN;
+    console_printf(mode_tip);
+}
+
+/**
+ * Start measuring the latency from the last keypress to the PWM update of the move it queued.
+ * Only moves of an idle arm are measured, queued moves wait for the moves before them.
+ * 
+ * @menu: Pointer to the menu state.
+ */
+void menu_probe_latency(menu_state* menu) {
+    if (!menu->probe_us && arm_scheduler_queue_depth(menu->scheduler, 0) == 1) {
+        menu->probe_us = menu->input_us;
+    }
+}
+
+/**
+ * Change the feed rate override of all arms, moves in progress slow down or speed up at once.
+ * 
+ * @menu: Pointer to the menu state.
+ * @input: '+' to speed up, '-' to slow down by MENU_FEED_STEP, '=' for the planned speed.
+ */
+void menu_adjust_feed(menu_state* menu, int input) {
+    int percent = menu->scheduler->feed_percent;
+    if (input == '+') {
+        percent += MENU_FEED_STEP;
+    } else if (input == '-') {
+        percent -= MENU_FEED_STEP;
+    } else {
+        percent = 100;
+    }
+    if (percent < ARM_SCHEDULER_FEED_MIN) {
+        percent = ARM_SCHEDULER_FEED_MIN;
+    } else if (percent > ARM_SCHEDULER_FEED_MAX) {
+        percent = ARM_SCHEDULER_FEED_MAX;
+    }
+    arm_scheduler_set_feed(menu->scheduler, percent);
+    console_printf("Feed rate %d%%\n", percent);
+}
+
+/**
+ * Print the angles of the first arm from one snapshot of the motion code, interpolated mid-move.
+ * 
+ * @menu: Pointer to the menu state.
+ */
+void menu_print_angles(menu_state* menu) {
+    arm_state state;
+    if (!arm_scheduler_snapshot(menu->scheduler, 0, &state)) {
+        robotic_arm_print(menu->robot);
+        return;
+    }
+    for (uint8_t i = 0; i < state.number; i++) {
+        console_printf("Robotic arm servo %d : %f degrees\n", i, state.angles[i]);
+    }
+}
+
+/**
+ * Print keypress to PWM update latencies.
+ * 
+ * @menu: Pointer to the menu state.
+ */
+void menu_print_latency(menu_state* menu) {
+    if (!menu->latency_count) {
+        return;
+    }
+    console_printf("Keypress to PWM latency: last %d us, longest %d us, average %d us\n", menu->latency_last_us,
+                   menu->latency_max_us, menu->latency_total_us / menu->latency_count);
+}
+
+/**
+ * Queue a move of one servo of the first robotic arm.
+ * 
+ * @menu: Pointer to the menu state.
+ * @index: Index of servo to move.
+ * @angle: Target angle.
+ * @return False if the move is invalid or the queue is full.
+ */
+bool menu_queue_servo(menu_state* menu, uint8_t index, float angle) {
+    robotic_arm_signal signal = {
+        .indexes = &index,
+        .angles = &angle,
+        .number = 1
+    };
+    if (!arm_scheduler_submit(menu->scheduler, 0, &signal)) {
+        return false;
+    }
+    menu_probe_latency(menu);
+    return true;
 }
 
 /**
  * Single servo control mode for the robotic arm.
  * Allows user to control a single servo by selecting its index and adjusting its angle.
  * 
- * @robotic_arm: Pointer to the robotic arm structure.
- */
-void robotic_arm_single_servo_mode(robotic_arm* robot_arm) {
-    char select_tip[] = "Enter servo index (0 to %d) to control, or 'q' to exit: ";
-    char angle_tip[] = "Enter 'i' to increase angle, 'd' to decrease angle, 'r' to reselect servo,\n"
-                        "    '*' to multiply delta angle by 2, '/' to divide delta angle by 2,\n"
-                        "    'p' to print current angles, or 'q' to exit: ";
-    char show_delta[] = "Delta angle: %.2f\n";
-    printf(select_tip, robot_arm->number - 1);
-    while (true) {
-        int input = get_input_uint();
-        uint8_t index = 0;
-        float angle = 0;
-        if(input == -1) {
-            printf("Exiting single servo mode.\n");
-            return; // Exit on 'q' or 'Q'
-        } else if(input >= 0 && input < robot_arm->number) {
-            index = (uint8_t)input; // Valid servo index
+ * @menu: Pointer to the menu state.
+ * @input: Input character.
+ */
+void robotic_arm_single_servo_mode(menu_state* menu, int input) {
+    const char angle_tip[] = "Enter 'i' to increase angle, 'd' to decrease angle, 'r' to reselect servo,\n"
+                             "    '*' to multiply delta angle by 2, '/' to divide delta angle by 2,\n"
+                             "    'p' to print current angles, or 'q' to exit: ";
+    const char show_delta[] = "Delta angle: %.2f\n";
+    robotic_arm* robot_arm = menu->robot;
+    if (!menu->selected) {
+        if (!menu_read_word(menu, input)) {
+            return;
+        }
+        int index = parse_input_uint(menu->word);
+        if (index == INPUT_UINT_EXIT) {
+            console_printf("Exiting single servo mode.\n");
+            menu_return(menu); // Exit on 'q' or 'Q'
+        } else if (index >= 0 && index < robot_arm->number) {
+            menu->index = (uint8_t)index; // Valid servo index
+            menu->selected = true;
+            menu->delta_angle = 1.0f; // Default angle change step
+            console_printf(show_delta, menu->delta_angle);
+            menu->angle = robot_arm->servos[index].angle; // Get current angle of the servo
+            console_printf(angle_tip);
         } else {
-            printf("Invalid input. Please try again.\n");
-            do { input = getchar_timeout_us(0); } while (input != PICO_ERROR_TIMEOUT); // Clear input buffer
-            printf(select_tip, robot_arm->number - 1);
-            continue; // Invalid input, prompt again
-        }
-        bool servo_selected = true;
-        float delta_angle = 1.0f; // Default angle change step
-        printf(show_delta, delta_angle);
-        angle = robot_arm->servos[index].angle; // Get current angle of the servo
-        printf(angle_tip);
-        while (servo_selected) {
-            int command = getchar();
-            switch (command) {
-            case 'i': case 'I':
-                angle += delta_angle;
-                if (angle > robot_arm->servos[index].angle_upper_bound) {
-                    angle = robot_arm->servos[index].angle_upper_bound; // Clamp to upper bound
-                }
-                robotic_arm_move_servo(robot_arm, index, angle);
-                printf("Angle increased to: %.2f\n", angle);
-                break;
-            case 'd': case 'D':
-                angle -= delta_angle;
-                if (angle < robot_arm->servos[index].angle_lower_bound) {
-                    angle = robot_arm->servos[index].angle_lower_bound; // Clamp to lower bound
-                }
-                robotic_arm_move_servo(robot_arm, index, angle);
-                printf("Angle decreased to: %.2f\n", angle);
-                break;
-            case 'p': case 'P':
-                robotic_arm_print(robot_arm);
-                printf("Current selected servo: %d\n", index);
-                printf(show_delta, delta_angle);
-                break;
-            case '*': // Multiply delta angle by 2
-                delta_angle *= 2.0f;
-                printf("Delta angle multiplied to: %.2f\n", delta_angle);
-                break;
-            case '/': // Divide delta angle by 2
-                delta_angle /= 2.0f;
-                printf("Delta angle divided to: %.2f\n", delta_angle);
-                break;
-            case 'r': case 'R':
-                servo_selected = false; // Exit the inner loop to reselect servo
-                printf(select_tip, robot_arm->number - 1);
-                break;
-            case 'q': case 'Q':
-                printf("Exiting single servo mode.\n");
-                return;
-            default:
-                printf("Invalid command.\n");
-                printf(angle_tip); // Prompt again for valid command
-            }
-            sleep_ms(10);
+            console_printf("Invalid input. Please try again.\n");
+            menu_discard_input(menu);
+            console_printf(single_select_tip, robot_arm->number - 1);
+        }
+        return;
+    }
+    servo* motor = &robot_arm->servos[menu->index];
+    float angle = menu->angle;
+    switch (input) {
+    case 'i': case 'I':
+        angle += menu->delta_angle;
+        if (angle > motor->angle_upper_bound) {
+            angle = motor->angle_upper_bound; // Clamp to upper bound
+        }
+        if (menu_queue_servo(menu, menu->index, angle)) {
+            menu->angle = angle;
+            console_printf("Angle increased to: %.2f\n", angle);
         }
+        break;
+    case 'd': case 'D':
+        angle -= menu->delta_angle;
+        if (angle < motor->angle_lower_bound) {
+            angle = motor->angle_lower_bound; // Clamp to lower bound
+        }
+        if (menu_queue_servo(menu, menu->index, angle)) {
+            menu->angle = angle;
+            console_printf("Angle decreased to: %.2f\n", angle);
+        }
+        break;
+    case 'p': case 'P':
+        menu_print_angles(menu);
+        console_printf("Current selected servo: %d\n", menu->index);
+        console_printf(show_delta, menu->delta_angle);
+        menu_print_latency(menu);
+        break;
+    case '*': // Multiply delta angle by 2
+        menu->delta_angle *= 2.0f;
+        console_printf("Delta angle multiplied to: %.2f\n", menu->delta_angle);
+        break;
+    case '/': // Divide delta angle by 2
+        menu->delta_angle /= 2.0f;
+        console_printf("Delta angle divided to: %.2f\n", menu->delta_angle);
+        break;
+    case 'r': case 'R':
+        menu->selected = false; // Reselect servo
+        console_printf(single_select_tip, robot_arm->number - 1);
+        break;
+    case 'q': case 'Q':
+        console_printf("Exiting single servo mode.\n");
+        menu_return(menu);
+        break;
+    case '\n': case '\r':
+        break; // Enter after a command
+    default:
+        console_printf("Invalid command.\n");
+        console_printf(angle_tip); // Prompt again for valid command
     }
-    
 }
 
 /**
  * Multiple servo control mode for the robotic arm.
  * Allows user to control multiple servos by specifying their indexes and target angles.
  * 
- * @robot_arm: Pointer to the robotic arm structure.
+ * @menu: Pointer to the menu state.
+ * @input: Input character.
  */
-void robotic_arm_multiple_servo_mode(robotic_arm* robot_arm) {
-    // Initialize control signal for robotic arm
-    uint8_t control_servos[robot_arm->number];
-    float target_angles[robot_arm->number];
+void robotic_arm_multiple_servo_mode(menu_state* menu, int input) {
+    robotic_arm* robot_arm = menu->robot;
+    robotic_arm_signal* control_signal = &menu->signal;
+    if (!menu_read_word(menu, input)) {
+        return;
+    }
+    if (control_signal->number == 0) {
+        int number = parse_input_uint(menu->word);
+        if (number == INPUT_UINT_EXIT) {
+            console_printf("Exiting multiple servo mode.\n");
+            menu_return(menu); // Exit on 'q' or 'Q'
+            return;
+        } else if (number == INPUT_UINT_PRINT) {
+            menu_print_angles(menu); // Print current angles and prompt again
+        } else if (number < 1 || number > robot_arm->number) {
+            console_printf("Invalid number of servos. Please the number should between 1 and %d.\n", robot_arm->number);
+            menu_discard_input(menu);
+        } else {
+            control_signal->number = (uint8_t)number; // Set number of servos to control
+            control_signal->options = (motion_options){0};
+            menu->received = 0;
+            return;
+        }
+        console_printf(multiple_command_tip, robot_arm->number - 1);
+        return;
+    }
+    uint8_t i = menu->received / 2;
+    if (menu->received % 2 == 0) {
+        int index = parse_input_uint(menu->word);
+        console_printf("Selected servo index: %d\n", index);
+        if (index < 0 || index >= robot_arm->number) {
+            console_printf("Invalid servo index %d. Please enter an index between 0 and %d.\n", index, robot_arm->number - 1);
+            menu_discard_input(menu);
+            control_signal->number = 0; // Invalid index, prompt again
+            console_printf(multiple_command_tip, robot_arm->number - 1);
+            return;
+        }
+        control_signal->indexes[i] = (uint8_t)index; // Store servo index
+        menu->received++;
+        return;
+    }
+    servo* motor = &robot_arm->servos[control_signal->indexes[i]];
+    float angle = parse_input_float(menu->word);
+    if (angle < 0.0f) {
+        console_printf("Nagetive angle is not allowed.\n");
+        menu_discard_input(menu);
+        control_signal->number = 0; // Invalid angle, prompt again
+        console_printf(multiple_command_tip, robot_arm->number - 1);
+        return;
+    } else if (angle < motor->angle_lower_bound) {
+        angle = motor->angle_lower_bound; // Clamp to lower bound
+    } else if (angle > motor->angle_upper_bound) {
+        angle = motor->angle_upper_bound; // Clamp to upper bound
+    }
+    console_printf("Selected target angle: %.2f\n", angle);
+    control_signal->angles[i] = angle; // Store target angle
+    menu->received++;
+    if (i + 1 < control_signal->number) {
+        return;
+    }
+    // Move servos to target angles
+    if (arm_scheduler_submit(menu->scheduler, 0, control_signal)) {
+        console_printf("Moving servos to target angles...\n");
+        menu_probe_latency(menu);
+    }
+    control_signal->number = 0;
+    console_printf(multiple_command_tip, robot_arm->number - 1);
+}
+
+/**
+ * Costom control mode for the robotic arm.
+ * Actions are queued one after another by robotic_arm_custom_control_task().
+ * 
+ * @menu: Pointer to the menu state.
+ * @input: Input character.
+ */
+void robotic_arm_custom_control_mode(menu_state* menu, int input) {
+    robotic_arm* robot_arm = menu->robot;
+    uint action_count = sizeof(exam_action) / sizeof(exam_action[0]);
+
+    switch (input) {
+    case 'a': case 'A':
+        if (menu->action >= 0) {
+            console_printf("Action A is already running.\n");
+            break;
+        }
+        console_printf("Moving action A.\n");
+        menu->action = 0; // Started by robotic_arm_custom_control_task()
+        break;
+    case '+': case '-': case '=':
+        menu_adjust_feed(menu, input); // Also while an action is running
+        return;
+    case 'd': case 'D':
+    case 'e': case 'E': {
+        // Rendering and the CSV run in one menu round, not while the arm has to be ticked
+        if (menu->action >= 0 || !arm_scheduler_idle(menu->scheduler)) {
+            console_printf("Wait until the robotic arm stopped to dry run or export.\n");
+            break;
+        }
+        // Render all actions without moving the robotic arm
+        uint8_t action_servos[action_count][robot_arm->number];
+        float action_angles[action_count][robot_arm->number];
+        robotic_arm_signal action_signals[action_count];
+        for (uint i = 0; i < action_count; i++) {
+            action_signals[i].indexes = action_servos[i];
+            action_signals[i].angles = action_angles[i];
+            robotic_arm_signal_from_string(&action_signals[i], exam_action[i], robot_arm->number);
+        }
+        motion_timeline* timeline = motion_timeline_create(robot_arm->number);
+        if (!timeline) {
+            break;
+        }
+        if (motion_timeline_render(timeline, robot_arm, action_signals, action_count, MENU_ACTION_PAUSE_US)) {
+            if (input == 'e' || input == 'E') {
+                console_drain(); // Keep queued text before the CSV
+                motion_timeline_write_csv(timeline, stdout);
+            } else {
+                motion_timeline_print_report(timeline);
+            }
+        }
+        motion_timeline_free(timeline);
+        break;
+    }
+    case 'q': case 'Q':
+        console_printf("Exiting custom control mode.\n");
+        menu_return(menu); // Exit on 'q' or 'Q', a running action continues
+        return;
+    case '\n': case '\r':
+        return; // Enter after a command
+    default:
+        console_printf("Invalid command. Please enter 'a', 'd', 'e', '+', '-', '=' or 'q'.\n");
+    }
+    console_printf(custom_action_tip);
+}
+
+/**
+ * Queue one custom action.
+ * 
+ * @menu: Pointer to the menu state.
+ * @action: Index of the action in exam_action.
+ * @return False if the action is invalid or the queue is full.
+ */
+bool robotic_arm_queue_action(menu_state* menu, int action) {
+    uint8_t control_servos[menu->robot->number];
+    float target_angles[menu->robot->number];
     robotic_arm_signal control_signal = {
         .indexes = control_servos,
         .angles = target_angles,
         .number = 0
     };
-    char command_tip[] = "Enter command format: 'number index angle index angle ...',\n"
-                         "    'number' is the number of servos to control,\n"
-                         "    'index' is the servo index (0 to %d),\n"
-                         "    'angle' is the target angle for that servo.\n"
-                         "Enter 'p' to print current angles, or 'q' to exit.\n";
+    return robotic_arm_signal_from_string(&control_signal, exam_action[action], menu->robot->number) &&
+           arm_scheduler_submit(menu->scheduler, 0, &control_signal);
+}
+
+/**
+ * Task running the custom actions started by 'a', one after another with a pause between them.
+ * 
+ * @self: Task with the menu state as data.
+ */
+int robotic_arm_custom_control_task(task* self) {
+    menu_state* menu = self->data;
+    int action_count = sizeof(exam_action) / sizeof(exam_action[0]);
+    TASK_BEGIN(self);
     while (true) {
-        printf(command_tip, robot_arm->number - 1);
-        int input = get_input_uint();
-        if (input == INPUT_UINT_EXIT) {
-            printf("Exiting multiple servo mode.\n");
-            return; // Exit on 'q' or 'Q'
-        } else if(input == INPUT_UINT_PRINT) {
-            robotic_arm_print(robot_arm);
-            continue; // Print current angles and prompt again
-        } else if (input < 1 || input > robot_arm->number) {
-            printf("Invalid number of servos. Please the number should between 1 and %d.\n", robot_arm->number);
-            do { input = getchar_timeout_us(0); } while (input != PICO_ERROR_TIMEOUT); // Clear input buffer
-            continue; // Invalid input, prompt again
-        }
-        control_signal.number = (uint8_t)input; // Set number of servos to control
-        bool isFailed = false;
-        for (uint8_t i = 0; i < control_signal.number; i++) {
-            int index = get_input_uint();
-            printf("Selected servo index: %d\n", index);
-            if (index < 0 || index >= robot_arm->number) {
-                isFailed = true;
-                printf("Invalid servo index %d. Please enter an index between 0 and %d.\n", index, robot_arm->number - 1);
-                do { index = getchar_timeout_us(0); } while (index != PICO_ERROR_TIMEOUT); // Clear input buffer
-                break; // Invalid index, prompt again
+        TASK_WAIT_UNTIL(self, menu->action == 0);
+        for (; menu->action < action_count; menu->action++) {
+            if (!robotic_arm_queue_action(menu, menu->action)) {
+                console_printf("Action A stopped at step %d.\n", menu->action);
+                break;
             }
-            control_signal.indexes[i] = (uint8_t)index; // Store servo index
-            float angle = get_input_float();
-            if(angle < 0.0f) {
-                isFailed = true;
-                printf("Nagetive angle is not allowed.\n");
-                do { index = getchar_timeout_us(0); } while (index != PICO_ERROR_TIMEOUT); // Clear input buffer
-                break; // Invalid angle, prompt again
-            } else if (angle < robot_arm->servos[index].angle_lower_bound) {
-                angle = robot_arm->servos[index].angle_lower_bound; // Clamp to lower bound
-            } else if (angle > robot_arm->servos[index].angle_upper_bound) {
-                angle = robot_arm->servos[index].angle_upper_bound; // Clamp to upper bound
+            TASK_WAIT_UNTIL(self, arm_scheduler_queue_depth(menu->scheduler, 0) == 0);
+            // With feedback the move already waited for the servos to arrive
+            if (!menu->scheduler->arms[0].feedback) {
+                TASK_SLEEP_US(self, MENU_ACTION_PAUSE_US);
             }
-            printf("Selected target angle: %.2f\n", angle);
-            control_signal.angles[i] = angle; // Store target angle
         }
-        if(isFailed)
-            continue;
-        // Move servos to target angles
-        printf("Moving servos to target angles...\n");
-        robotic_arm_move(robot_arm, &control_signal);
+        if (menu->action == action_count) {
+            console_printf("Action A complete.\n");
+        }
+        menu->action = -1;
     }
+    TASK_END(self);
 }
 
 /**
- * Costom control mode for the robotic arm.
+ * Calibration mode for the robotic arm.
+ * Allows user to move a servo by pulse width and record the measured angle of pulses,
+ * recorded points are compiled into the calibration table of the servo.
+ * With servo feedback the recorded angles calibrate the potentiometer of the servo as well.
  * 
- * @robot_arm: Pointer to the robotic arm structure.
+ * @menu: Pointer to the menu state.
+ * @input: Input character.
  */
-void robotic_arm_custom_control_mode(robotic_arm* robot_arm) {
-    // Initialize control signal for robotic arm
-    uint8_t control_servos[robot_arm->number];
-    float target_angles[robot_arm->number];
-    robotic_arm_signal control_signal = {
-        .indexes = control_servos,
-        .angles = target_angles,
-        .number = 0
-    };
-    // Example custom action
-    // These actions can be modified or extended as needed
-    // String format: "number index angle index angle ..."
-    char exam_action[][40] = {
-        "3 0 60 1 60 2 60",
-        "2 3 60 4 60",
-        "1 5 120",
-        "5 0 90 1 90 2 90 3 90 4 90",
-        "3 0 120 1 60 2 60",
-        "2 3 60 4 60",
-        "1 5 90",
-        "6 0 90 1 90 2 90 3 90 4 90 5 90"
-    };
-    char action_tip[] = "Enter 'a' to do exam_action, or 'q' to exit.\n";
+void robotic_arm_calibration_mode(menu_state* menu, int input) {
+    const char pulse_tip[] = "Enter 'i' to increase pulse, 'd' to decrease pulse, 'a' to record measured angle,\n"
+                             "    '*' to multiply delta pulse by 2, '/' to divide delta pulse by 2,\n"
+                             "    'c' to compile and apply calibration, 'x' to clear points, 'p' to print points,\n"
+                             "    'r' to reselect servo, or 'q' to exit: ";
+    robotic_arm* robot_arm = menu->robot;
+    if (!menu->selected) {
+        if (!menu_read_word(menu, input)) {
+            return;
+        }
+        int index = parse_input_uint(menu->word);
+        if (index == INPUT_UINT_EXIT) {
+            console_printf("Exiting calibration mode.\n");
+            menu_return(menu); // Exit on 'q' or 'Q'
+            return;
+        } else if (index < 0 || index >= robot_arm->number) {
+            console_printf("Invalid input. Please try again.\n");
+            menu_discard_input(menu);
+        } else if (arm_scheduler_queue_depth(menu->scheduler, 0)) {
+            console_printf("Robotic arm is moving, wait for queued moves.\n"); // Pulses would fight the moves
+        } else if (robotic_arm_get_servo_calibration(robot_arm, index)) {
+            servo* motor = &robot_arm->servos[index];
+            menu->index = (uint8_t)index; // Valid servo index
+            menu->selected = true;
+            menu->measuring = false;
+            // Start from the pulse width of the current angle
+            menu->pulse = (float)servo_angle_to_level(motor, motor->angle) * motor->period / SERVO_WRAP(motor);
+            menu->delta_pulse = 10; // Default pulse change step (us)
+            console_printf("Pulse: %d us, delta pulse: %d us\n", menu->pulse, menu->delta_pulse);
+            console_printf(pulse_tip);
+            return;
+        }
+        console_printf(calibration_select_tip, robot_arm->number - 1);
+        return;
+    }
+    servo* motor = &robot_arm->servos[menu->index];
+    servo_calibration* calibration = motor->calibration;
+    servo_feedback* feedback = menu->scheduler->arms[0].feedback;
+    if (menu->measuring) {
+        if (!menu_read_word(menu, input)) {
+            return;
+        }
+        float angle = parse_input_float(menu->word);
+        if (angle < 0.0f) {
+            console_printf("Invalid angle, point not recorded.\n");
+        } else if (!servo_calibration_add_point(calibration, angle, menu->pulse)) {
+            console_printf("Calibration is full, at most %d points.\n", SERVO_CALIBRATION_MAX_POINTS);
+        } else {
+            console_printf("Recorded %.2f degrees at %d us.\n", angle, menu->pulse);
+            // The potentiometer is calibrated against the same measured angle
+            if (feedback && servo_feedback_has(feedback, menu->index)
+                && !servo_feedback_add_point(feedback, menu->index, angle)) {
+                console_printf("Feedback calibration is full, at most %d points.\n", SERVO_FEEDBACK_MAX_POINTS);
+            }
+        }
+        menu->measuring = false;
+        return;
+    }
+    switch (input) {
+    case 'i': case 'I':
+        menu->pulse += menu->delta_pulse;
+        if (menu->pulse > motor->period) {
+            menu->pulse = motor->period;
+        }
+        servo_set_pulse_us(motor, menu->pulse);
+        console_printf("Pulse increased to: %d us\n", menu->pulse);
+        break;
+    case 'd': case 'D':
+        menu->pulse = menu->pulse > menu->delta_pulse ? menu->pulse - menu->delta_pulse : 0;
+        servo_set_pulse_us(motor, menu->pulse);
+        console_printf("Pulse decreased to: %d us\n", menu->pulse);
+        break;
+    case '*': // Multiply delta pulse by 2
+        menu->delta_pulse *= 2;
+        console_printf("Delta pulse multiplied to: %d us\n", menu->delta_pulse);
+        break;
+    case '/': // Divide delta pulse by 2
+        if (menu->delta_pulse > 1) {
+            menu->delta_pulse /= 2;
+        }
+        console_printf("Delta pulse divided to: %d us\n", menu->delta_pulse);
+        break;
+    case 'a': case 'A':
+        console_printf("Enter measured angle of %d us: ", menu->pulse);
+        menu->measuring = true;
+        break;
+    case 'c': case 'C':
+        if (servo_calibration_compile(motor)) {
+            servo_set_angle(motor, motor->angle); // Return to current angle with new table
+            console_printf("Calibration of servo %d applied with %d points.\n", menu->index, calibration->number);
+        } else {
+            console_printf("At least 2 points are needed to compile calibration.\n");
+        }
+        if (feedback && servo_feedback_compile(feedback, menu->index)) {
+            console_printf("Feedback calibration of servo %d applied.\n", menu->index);
+        }
+        break;
+    case 'x': case 'X':
+        calibration->number = 0;
+        calibration->positions_per_degree = 0.0f; // Back to linear datasheet mapping
+        if (feedback) {
+            servo_feedback_clear_points(feedback, menu->index);
+        }
+        console_printf("Calibration points of servo %d cleared.\n", menu->index);
+        break;
+    case 'p': case 'P':
+        for (uint8_t i = 0; i < calibration->number; i++) {
+            console_printf("Point %d: %.2f degrees at %d us\n", i, calibration->angles[i], calibration->pulses[i]);
+        }
+        console_printf("Pulse: %d us, delta pulse: %d us\n", menu->pulse, menu->delta_pulse);
+        if (feedback) {
+            servo_feedback_print(feedback);
+        }
+        break;
+    case 'r': case 'R':
+        servo_set_angle(motor, motor->angle); // Return to the angle before calibration
+        menu->selected = false; // Reselect servo
+        console_printf(calibration_select_tip, robot_arm->number - 1);
+        break;
+    case 'q': case 'Q':
+        servo_set_angle(motor, motor->angle);
+        console_printf("Exiting calibration mode.\n");
+        menu_return(menu);
+        break;
+    case '\n': case '\r':
+        break; // Enter after a command
+    default:
+        console_printf("Invalid command.\n");
+        console_printf(pulse_tip); // Prompt again for valid command
+    }
+}
 
-    while (true) {
-        printf(action_tip);
-        int input = getchar();
-        switch (input) {
-        case 'a': case 'A':
-            printf("Moving action A.\n");
-            for(int i = 0; i < sizeof(exam_action) / sizeof(exam_action[0]); i++) {
-                robotic_arm_signal_from_string(&control_signal, exam_action[i]);
-                robotic_arm_move(robot_arm, &control_signal);
-                sleep_ms(100);
+/**
+ * Speed preset selection for the robotic arm.
+ * Moves without duration or speed take the time of the selected preset.
+ * 
+ * @menu: Pointer to the menu state.
+ * @input: Input character.
+ */
+void robotic_arm_speed_preset_mode(menu_state* menu, int input) {
+    if (!menu_read_word(menu, input)) {
+        return;
+    }
+    int index = parse_input_uint(menu->word);
+    if (index == INPUT_UINT_EXIT) {
+        console_printf("Preset unchanged.\n");
+    } else if (index >= 0 && motion_select_preset(index)) {
+        console_printf("Speed preset %s selected.\n", motion_presets[index].name);
+    } else {
+        console_printf("Invalid preset index.\n");
+    }
+    menu_return(menu);
+}
+
+/**
+ * Acknowledge a queued command with the queue depth of its arm.
+ * Host clients use the depth for flow control, see tools/arm_link.h.
+ * 
+ * @menu: Pointer to the menu state.
+ * @arm: Arm id of the command.
+ */
+void menu_ack_command(menu_state* menu, uint8_t arm) {
+    console_printf("Command queued for arm %d, %d of %d.\n", arm,
+                   arm_scheduler_queue_depth(menu->scheduler, arm), ARM_SCHEDULER_QUEUE_SIZE);
+}
+
+/**
+ * Multiple arm control mode.
+ * Queues control signals addressed by arm id, all arms move at the same time.
+ * Text lines are "[@arm] number index angle ... [options]", binary frames start with
+ * ARM_SCHEDULER_FRAME_START followed by the frame length and the frame.
+ * 
+ * @menu: Pointer to the menu state.
+ * @input: Input character.
+ */
+void robotic_arm_scheduler_mode(menu_state* menu, int input) {
+    arm_scheduler* scheduler = menu->scheduler;
+    if (menu->framing) {
+        // Binary frame: length byte then frame bytes
+        menu->frame_time_us = time_us_64();
+        if (menu->frame_length == 0) {
+            menu->frame_length = input;
+            menu->frame_received = 0;
+            if (menu->frame_length == 0 || menu->frame_length > sizeof(menu->frame)) {
+                menu->framing = false;
+                console_printf("Binary command rejected.\n");
             }
-            printf("Action A complete.\n");
-            break;
-        case 'q': case 'Q':
-            printf("Exiting custom control mode.\n");
-            return; // Exit on 'q' or 'Q'
-        default:
-            printf("Invalid command. Please enter 'a' for action or 'q' to exit.\n");
+            return;
         }
+        menu->frame[menu->frame_received++] = input;
+        if (menu->frame_received == menu->frame_length) {
+            menu->framing = false;
+            if (arm_scheduler_submit_binary(scheduler, menu->frame, menu->frame_length)) {
+                menu_ack_command(menu, menu->frame[0]);
+            } else {
+                console_printf("Binary command rejected.\n");
+            }
+        }
+        return;
+    }
+    if (menu->line_length == 0 && input == ARM_SCHEDULER_FRAME_START) {
+        menu->framing = true;
+        menu->frame_length = 0;
+        menu->frame_time_us = time_us_64();
+        return;
+    }
+    if (menu->line_length == 0 && (input == 'q' || input == 'Q')) {
+        console_printf("Exiting multiple arm mode.\n"); // Queued moves continue in the main loop
+        menu_return(menu);
+        return;
+    }
+    if (menu->line_length == 0 && (input == 'p' || input == 'P')) {
+        arm_scheduler_print(scheduler);
+        const cdc_transport_stats* transport = cdc_transport_get_stats();
+        console_printf("Transport: %lu bytes in %lu reads, %lu bytes sent, %lu frames dropped.\n",
+                       (unsigned long)transport->received, (unsigned long)transport->reads,
+                       (unsigned long)transport->sent, (unsigned long)transport->dropped);
+        return;
+    }
+    if (menu->line_length == 0 && (input == '+' || input == '-' || input == '=')) {
+        menu_adjust_feed(menu, input);
+        return;
+    }
+    if (input == '\n' || input == '\r') {
+        if (menu->line_length == 0) {
+            return;
+        }
+        menu->line[menu->line_length] = '\0';
+        menu->line_length = 0;
+        // Parse the arm id before submitting, the string is tokenized in place
+        uint8_t arm = menu->line[0] == '@' ? atoi(&menu->line[1]) : 0;
+        if (arm_scheduler_submit_string(scheduler, menu->line)) {
+            menu_ack_command(menu, arm);
+        } else {
+            console_printf(scheduler_command_tip, scheduler->number - 1);
+        }
+    } else if (menu->line_length < sizeof(menu->line) - 1) {
+        menu->line[menu->line_length++] = input;
     }
 }
 
+/**
+ * Queue a move of the running script on the first robotic arm.
+ * 
+ * @context: Scheduler of the arm.
+ * @signal: Move to queue.
+ * @return 1 if queued, 0 if the queue is full, -1 if the move is invalid.
+ */
+int menu_script_submit(void* context, robotic_arm_signal* signal) {
+    arm_scheduler* scheduler = context;
+    if (arm_scheduler_queue_depth(scheduler, 0) == ARM_SCHEDULER_QUEUE_SIZE) {
+        return 0;
+    }
+    return arm_scheduler_submit(scheduler, 0, signal) ? 1 : -1;
+}
+
+/**
+ * @context: Scheduler of the first robotic arm.
+ * @return True if the moves queued by the script finished.
+ */
+bool menu_script_idle(void* context) {
+    return arm_scheduler_queue_depth(context, 0) == 0;
+}
+
+/**
+ * Motion script mode.
+ * Script lines are compiled into bytecode as they arrive, '.' ends the upload,
+ * the compiled script runs in script_task() until it ends or is stopped.
+ * 
+ * @menu: Pointer to the menu state.
+ * @input: Input character.
+ */
+void robotic_arm_script_mode(menu_state* menu, int input) {
+    if (input != '\n' && input != '\r') {
+        if (menu->line_length < sizeof(menu->line) - 1) {
+            menu->line[menu->line_length++] = input;
+        }
+        return;
+    }
+    menu->line[menu->line_length] = '\0';
+    menu->line_length = 0;
+    char* command = menu->line;
+    while (is_space(*command)) {
+        command++;
+    }
+    if (strcmp(command, "q") == 0 || strcmp(command, "Q") == 0) {
+        console_printf("Exiting script mode.\n"); // A running script continues in the main loop
+        menu_return(menu);
+    } else if (strcmp(command, ".") == 0 || strcmp(command, "run") == 0) {
+        if (menu->compiling) {
+            menu->compiling = false;
+            if (motion_script_compile_end(menu->compiler)) {
+                console_printf("Script compiled: %d bytes of bytecode, %d poses, %d variables.\n",
+                               menu->script->length, menu->script->pose_count, menu->script->variable_count);
+            } else {
+                console_printf("Script has errors, upload it again.\n");
+            }
+        }
+        if (command[0] == '.') {
+            return;
+        }
+        if (menu->vm->running) {
+            console_printf("Script already running.\n");
+        } else if (motion_script_start(menu->vm, menu->script, menu_script_submit, menu_script_idle, menu->scheduler)) {
+            console_printf("Script started.\n");
+        }
+    } else if (strcmp(command, "stop") == 0) {
+        if (menu->vm->running) {
+            menu->vm->running = false; // Moves already queued finish
+            console_printf("Script stopped after %d moves.\n", menu->vm->moves);
+        }
+    } else if (*command) {
+        if (!menu->compiling) {
+            motion_script_compile_begin(menu->compiler, menu->script);
+            menu->compiling = true;
+        }
+        motion_script_compile_line(menu->compiler, command);
+    }
+}
+
+/**
+ * Telemetry rate selection.
+ * Binary telemetry frames are mixed into the console output, see telemetry.h.
+ * 
+ * @menu: Pointer to the menu state.
+ * @input: Input character.
+ */
+void robotic_arm_telemetry_mode(menu_state* menu, int input) {
+    if (!menu_read_word(menu, input)) {
+        return;
+    }
+    int rate = parse_input_uint(menu->word);
+    if (rate == INPUT_UINT_EXIT) {
+        console_printf("Telemetry unchanged.\n");
+    } else if (rate >= 0 && telemetry_set_rate(menu->stream, rate)) {
+        console_printf("Telemetry at %d frames per second and arm.\n", rate);
+    } else {
+        console_printf("Invalid telemetry rate.\n");
+    }
+    menu_return(menu);
+}
+
+/**
+ * Main menu selecting the control mode.
+ * 
+ * @menu: Pointer to the menu state.
+ * @input: Input character.
+ */
+void robotic_arm_main_menu(menu_state* menu, int input) {
+    robotic_arm* robot_arm = menu->robot;
+    menu->selected = false;
+    menu->signal.number = 0;
+    switch (input) {
+    // Single servo control commands
+    case 's': case 'S':
+        menu->mode = MENU_SINGLE_SERVO;
+        console_printf(single_select_tip, robot_arm->number - 1);
+        return;
+    // Multiple servo control commands
+    case 'm': case 'M':
+        menu->mode = MENU_MULTIPLE_SERVO;
+        console_printf(multiple_command_tip, robot_arm->number - 1);
+        return;
+    // Costom servo control commands
+    case 'c': case 'C':
+        menu->mode = MENU_CUSTOM_CONTROL;
+        console_printf(custom_action_tip);
+        return;
+    // Servo calibration commands
+    case 'k': case 'K':
+        menu->mode = MENU_CALIBRATION;
+        console_printf(calibration_select_tip, robot_arm->number - 1);
+        return;
+    // Multiple arm control commands
+    case 'a': case 'A':
+        menu->mode = MENU_SCHEDULER;
+        menu->line_length = 0;
+        menu->framing = false;
+        console_printf(scheduler_command_tip, menu->scheduler->number - 1);
+        return;
+    // Speed preset selection
+    case 'v': case 'V':
+        menu->mode = MENU_SPEED_PRESET;
+        for (uint i = 0; i < MOTION_PRESET_COUNT; i++) {
+            console_printf("%c %d: %s, %d ms for full range\n", i == motion_selected_preset() ? '*' : ' ',
+                   i, motion_presets[i].name, motion_presets[i].full_range_ms);
+        }
+        console_printf("Enter preset index (0 to %d), or 'q' to keep current preset: ", MOTION_PRESET_COUNT - 1);
+        return;
+    // Telemetry rate selection
+    case 't': case 'T':
+        menu->mode = MENU_TELEMETRY;
+        console_printf("Telemetry: %d frames sent, %d dropped.\n", menu->stream->frames, menu->stream->dropped);
+        console_printf("Enter telemetry rate (0 to %d frames per second and arm, 0 for off), or 'q' to keep current rate: ",
+               TELEMETRY_MAX_RATE);
+        return;
+    // Motion scripts
+    case 'x': case 'X':
+        menu->mode = MENU_SCRIPT;
+        menu->line_length = 0;
+        console_printf(script_command_tip);
+        return;
+    // Task run times since the last print
+    case 'r': case 'R':
+        task_runtime_print(menu->runtime);
+        task_runtime_reset(menu->runtime);
+        break;
+    // Profile samples and loop histograms since the last print
+    case 'f': case 'F':
+#ifdef SAMPLING_PROFILER
+        profiler_print();
+#else
+        console_printf("Profiler not built, configure with -DSAMPLING_PROFILER=ON.\n");
+#endif
+        break;
+    // Release an emergency stop, stopped arms reject commands until then
+    case 'e': case 'E':
+        if (arm_scheduler_release_stop(menu->scheduler)) {
+            menu->stop_reported = false;
+            console_printf("Emergency stop released.\n");
+        }
+        break;
+    // Print current angles of all servos
+    case 'p': case 'P':
+        menu_print_angles(menu);
+        menu_print_latency(menu);
+        break;
+    case '\n': case '\r':
+        return; // Enter after a command
+    default:
+        console_printf("Invalid command. Please try again.\n");
+    }
+    console_printf(mode_tip); // Prompt again for valid command
+}
+
+/**
+ * Handle one input event of the menu, never blocks.
+ * 
+ * @menu: Pointer to the menu state.
+ * @input: Input character, PICO_ERROR_TIMEOUT if no input is available.
+ */
+void menu_input(menu_state* menu, int input) {
+    if (input != PICO_ERROR_TIMEOUT) {
+        menu->input_us = time_us_64();
+    }
+    // Reserved stop bytes act in every mode, only binary frames carry them as data
+    if ((input == ARM_SCHEDULER_STOP_HOLD_BYTE || input == ARM_SCHEDULER_STOP_DECELERATE_BYTE) && !menu->framing) {
+        arm_scheduler_emergency_stop(menu->scheduler,
+                                     input == ARM_SCHEDULER_STOP_HOLD_BYTE ? ARM_STOP_HOLD : ARM_STOP_DECELERATE);
+        return;
+    }
+    if (menu->discard) {
+        menu->discard = input != PICO_ERROR_TIMEOUT; // Clear input buffer
+        return;
+    }
+    if (input == PICO_ERROR_TIMEOUT && menu->word_length == 0) {
+        return; // A pause in input only ends a word being typed
+    }
+    switch (menu->mode) {
+    case MENU_MAIN:
+        robotic_arm_main_menu(menu, input);
+        break;
+    case MENU_SINGLE_SERVO:
+        robotic_arm_single_servo_mode(menu, input);
+        break;
+    case MENU_MULTIPLE_SERVO:
+        robotic_arm_multiple_servo_mode(menu, input);
+        break;
+    case MENU_CUSTOM_CONTROL:
+        robotic_arm_custom_control_mode(menu, input);
+        break;
+    case MENU_CALIBRATION:
+        robotic_arm_calibration_mode(menu, input);
+        break;
+    case MENU_SPEED_PRESET:
+        robotic_arm_speed_preset_mode(menu, input);
+        break;
+    case MENU_SCHEDULER:
+        robotic_arm_scheduler_mode(menu, input);
+        break;
+    case MENU_TELEMETRY:
+        robotic_arm_telemetry_mode(menu, input);
+        break;
+    case MENU_SCRIPT:
+        robotic_arm_script_mode(menu, input);
+        break;
+    }
+}
+
+/**
+ * Run the time-driven work of the menu: measure keypress latencies, drop stalled binary frames
+ * and report emergency stops, from the stop input or the console.
+ * 
+ * @menu: Pointer to the menu state.
+ */
+void menu_poll(menu_state* menu) {
+    if (menu->probe_us && menu->scheduler->write_us >= menu->probe_us) {
+        menu->latency_last_us = menu->scheduler->write_us - menu->probe_us;
+        if (menu->latency_last_us > menu->latency_max_us) {
+            menu->latency_max_us = menu->latency_last_us;
+        }
+        menu->latency_total_us += menu->latency_last_us;
+        menu->latency_count++;
+        menu->probe_us = 0;
+    }
+    if (menu->framing && time_us_64() - menu->frame_time_us > MENU_FRAME_TIMEOUT_US) {
+        menu->framing = false;
+        console_printf("Binary command rejected.\n");
+    }
+    if (menu->scheduler->stopped && !menu->stop_reported) {
+        console_printf("Emergency stop: moves preempted after %lu us, all arms at rest after %lu us.\n"
+                       "Enter 'e' in the main menu to release the stop.\n",
+                       (unsigned long)menu->scheduler->stop_latency_us, (unsigned long)menu->scheduler->stop_time_us);
+        menu->stop_reported = true;
+    }
+}
+
+/**
+ * Feed protocol traffic of multiple arm and script mode to the menu, a block at a time.
+ * 
+ * @menu: Pointer to the menu state.
+ */
+void menu_input_block(menu_state* menu) {
+    uint8_t block[CDC_TRANSPORT_BLOCK];
+    uint length = cdc_transport_read(block, sizeof(block));
+    if (length == 0) {
+        menu_input(menu, PICO_ERROR_TIMEOUT);
+        return;
+    }
+    for (uint i = 0; i < length; i++) {
+        menu_input(menu, block[i]);
+    }
+}
+
+/**
+ * Task feeding console input to the menu.
+ * Protocol modes read the CDC endpoint in blocks, see cdc_transport.h, the interactive
+ * modes read stdio once the bytes taken by the transport are used up.
+ * 
+ * @self: Task with the menu state as data.
+ */
+int menu_task(task* self) {
+    menu_state* menu = self->data;
+    TASK_BEGIN(self);
+    while (true) {
+        if (menu->mode == MENU_SCHEDULER || menu->mode == MENU_SCRIPT) {
+            menu_input_block(menu);
+        } else if (cdc_transport_available()) {
+            menu_input(menu, cdc_transport_getc());
+        } else {
+            menu_input(menu, getchar_timeout_us(0));
+        }
+        menu_poll(menu);
+        TASK_YIELD(self);
+    }
+    TASK_END(self);
+}
+
+/**
+ * Task running the scheduler ticks raised by its timer.
+ * 
+ * @self: Task with the scheduler as data.
+ */
+int motion_task(task* self) {
+    arm_scheduler* scheduler = self->data;
+    TASK_BEGIN(self);
+    while (true) {
+        TASK_WAIT_UNTIL(self, scheduler->pending_ticks);
+        arm_scheduler_poll(scheduler);
+    }
+    TASK_END(self);
+}
+
+/**
+ * Task sending telemetry frames at the selected rate.
+ * 
+ * @self: Task with the telemetry as data.
+ */
+int telemetry_task(task* self) {
+    telemetry* stream = self->data;
+    TASK_BEGIN(self);
+    while (true) {
+        TASK_WAIT_UNTIL(self, stream->period_us);
+        telemetry_poll(stream);
+        TASK_SLEEP_UNTIL(self, stream->next_us);
+    }
+    TASK_END(self);
+}
+
+/**
+ * Task running the motion script started in script mode.
+ * 
+ * @self: Task with the menu state as data.
+ */
+int script_task(task* self) {
+    menu_state* menu = self->data;
+    TASK_BEGIN(self);
+    while (true) {
+        TASK_WAIT_UNTIL(self, menu->vm->running);
+        int result = motion_script_run(menu->vm, MENU_SCRIPT_BUDGET);
+        if (result == MOTION_SCRIPT_DONE) {
+            console_printf("Script complete, %d moves in %d steps.\n", menu->vm->moves, menu->vm->steps);
+        } else if (result == MOTION_SCRIPT_FAILED) {
+            console_printf("Script failed after %d moves.\n", menu->vm->moves);
+        }
+        TASK_YIELD(self);
+    }
+    TASK_END(self);
+}
+
+/**
+ * Task sending queued console text.
+ * 
+ * @self: Unused task.
+ */
+int console_task(task* self) {
+    TASK_BEGIN(self);
+    while (true) {
+        console_flush();
+        TASK_YIELD(self);
+    }
+    TASK_END(self);
+}
+
 int main()
 {
     stdio_init_all();
@@ -290,45 +1315,102 @@ int main()
         .max_duty = 2500,           // Maximum duty cycle for 180 degrees in microseconds
         .angle = 90.0f,             // Initial angle set to 90 degrees
         .angle_lower_bound = 0.0f,  // Lower bound of angle
-        .angle_upper_bound = 180.0f // Upper bound of angle
+        .angle_upper_bound = 180.0f,// Upper bound of angle
+        .max_speed = 300.0f         // MG996R moves 60 degrees in about 0.17 s at 4.8 V
     };
 
-    // Initialize the robotic arm that has 6 servos
-    robotic_arm* robot_arm = robotic_arm_create(6);
-    if (!robot_arm) {
-        fprintf(stderr, "Failed to create robotic arm.\n");
+    // Initialize the robotic arms that have 6 servos each
+    robotic_arm* robot_arms[ROBOTIC_ARM_COUNT];
+    static arm_scheduler scheduler;
+    arm_scheduler_init(&scheduler, SERVO_BANK_MAX_CHANNELS);
+    for (uint8_t i = 0; i < ROBOTIC_ARM_COUNT; i++) {
+#ifdef ARM_DESCRIPTION
+        // Arm 0 starts from the compile-time description of arm_description.cpp
+        robot_arms[i] = robotic_arm_create(i == 0 ? arm_description_number : 6);
+#else
+        robot_arms[i] = robotic_arm_create(6);
+#endif
+        if (!robot_arms[i]) {
+            console_error("Failed to create robotic arm.\n");
+            return 1;
+        }
+#ifdef ARM_DESCRIPTION
+        if (i == 0) {
+            if (!robotic_arm_start_description(robot_arms[i])) {
+                console_error("Failed to start robotic arm from its description.\n");
+                return 1;
+            }
+        } else
+#endif
+        robotic_arm_starter(robot_arms[i], &mg996r, robotic_arm_first_pins[i]);
+        if (arm_scheduler_add_arm(&scheduler, robot_arms[i]) < 0) {
+            console_error("Failed to add robotic arm %d to the scheduler.\n", i);
+            return 1;
+        }
+        console_printf("Robotic arm %d initialized with %d servos.\n", i, robot_arms[i]->number);
+    }
+#ifdef SERVO_FEEDBACK
+    static servo_feedback feedback;
+    if (servo_feedback_start(&feedback, servo_feedback_inputs, robot_arms[0]->number, mg996r.angle_range,
+                             SERVO_FEEDBACK_TOLERANCE)) {
+        arm_scheduler_set_feedback(&scheduler, 0, &feedback);
+        console_printf("Servo feedback on %d ADC inputs.\n", feedback.number);
+    }
+#endif
+    if (!arm_scheduler_start(&scheduler)) {
+        console_error("No timer available for the arm scheduler.\n");
         return 1;
     }
-    robotic_arm_starter(robot_arm, &mg996r);
-    printf("Robotic arm initialized with %d servos.\n", robot_arm->number);
+#ifdef EMERGENCY_STOP
+    arm_scheduler_set_stop_input(&scheduler, EMERGENCY_STOP_GPIO);
+    console_printf("Emergency stop input on GPIO %d.\n", EMERGENCY_STOP_GPIO);
+#endif
 
-    char mode_tip[] = "Enter 's' for single servo control, 'm' for multiple servos control,\n"
-                      "    'c' for costom control, or 'p' to print current angles.\n";
-    printf(mode_tip);
+    static telemetry stream;
+    telemetry_init(&stream, &scheduler);
 
-    while (true) {
-        int command = getchar();
+    static task_runtime runtime;
+    task_runtime_init(&runtime);
 
-        switch (command) {
-        // Single servo control commands
-        case 's': case 'S':
-            robotic_arm_single_servo_mode(robot_arm);
-            break;
-        // Multiple servo control commands
-        case 'm': case 'M':
-            robotic_arm_multiple_servo_mode(robot_arm);
-            break;
-        // Costom servo control commands
-        case 'c': case 'C':
-            robotic_arm_custom_control_mode(robot_arm);
-            break;
-        // Print current angles of all servos
-        case 'p': case 'P':
-            robotic_arm_print(robot_arm);
-            break;
-        default:
-            printf("Invalid command. Please try again.\n");
-        }
-        printf(mode_tip); // Prompt again for valid command
+    static motion_script script;
+    static motion_script_compiler compiler;
+    static motion_script_vm vm;
+
+    static menu_state menu;
+    menu.robot = robot_arms[0]; // Single arm modes control the first arm
+    menu.scheduler = &scheduler;
+    menu.stream = &stream;
+    menu.runtime = &runtime;
+    menu.script = &script;
+    menu.compiler = &compiler;
+    menu.vm = &vm;
+    menu.signal.indexes = menu.signal_servos;
+    menu.signal.angles = menu.signal_angles;
+    menu.action = -1;
+    console_printf(mode_tip);
+
+#ifdef SAMPLING_PROFILER
+    profiler_start(PROFILER_PERIOD_US);
+#endif
+
+    static task tasks[6];
+    task_init(&tasks[0], "menu", menu_task, &menu);
+    task_init(&tasks[1], "motion", motion_task, &scheduler);
+    task_init(&tasks[2], "actions", robotic_arm_custom_control_task, &menu);
+    task_init(&tasks[3], "telemetry", telemetry_task, &stream);
+    task_init(&tasks[4], "script", script_task, &menu);
+    task_init(&tasks[5], "console", console_task, NULL);
+    for (uint i = 0; i < sizeof(tasks) / sizeof(tasks[0]); i++) {
+        task_start(&runtime, &tasks[i]);
+    }
+
+    // Every round runs each ready task once: the menu handles one input character, or one block
+    // of protocol traffic, and the motion task one scheduler tick, so no task waits long
+    uint64_t loop_start_us = time_us_64();
+    while (true) {
+        task_runtime_poll(&runtime);
+        uint64_t now_us = time_us_64();
+        telemetry_record_loop(&stream, now_us - loop_start_us);
+        loop_start_us = now_us;
     }
 }
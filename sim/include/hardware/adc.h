@@ -0,0 +1,28 @@
+#ifndef SIM_HARDWARE_ADC_H
+#define SIM_HARDWARE_ADC_H
+
+#include "pico/stdlib.h"
+
+// ADC registers read by the firmware, conversions come from the servo model of sim_adc.c
+
+#define ADC_CS_READY_BITS 0x00000100u
+
+typedef struct {
+    volatile uint32_t cs;
+    volatile uint32_t fifo;
+} adc_hw_t;
+
+extern adc_hw_t sim_adc_hw;
+#define adc_hw (&sim_adc_hw)
+
+void adc_init(void);
+void adc_gpio_init(uint gpio);
+void adc_select_input(uint input);
+void adc_set_round_robin(uint input_mask);
+void adc_fifo_setup(bool en, bool dreq_en, uint16_t dreq_thresh, bool err_in_fifo, bool byte_shift);
+void adc_set_clkdiv(float clkdiv);
+void adc_run(bool run);
+void adc_fifo_drain(void);
+
+
+#endif // SIM_HARDWARE_ADC_H
@@ -0,0 +1,75 @@
+#ifndef SIM_HARDWARE_DMA_H
+#define SIM_HARDWARE_DMA_H
+
+#include "pico/stdlib.h"
+
+// DMA channels paced by the ADC, the only data request the simulator raises
+
+#define DREQ_ADC 36
+
+enum dma_channel_transfer_size {
+    DMA_SIZE_8 = 0,
+    DMA_SIZE_16 = 1,
+    DMA_SIZE_32 = 2
+};
+
+/**
+ * @size: Bytes of one transfer, 1 << size (enum dma_channel_transfer_size)
+ * @read_increment: True to advance the read address (bool)
+ * @write_increment: True to advance the write address (bool)
+ * @ring_write: True if the ring wraps the write address, else the read address (bool)
+ * @ring_bits: Size of the ring in bytes, 1 << bits, 0 for no ring (uint)
+ * @dreq: Data request pacing the transfers (uint)
+ */
+typedef struct {
+    enum dma_channel_transfer_size size;
+    bool read_increment;
+    bool write_increment;
+    bool ring_write;
+    uint ring_bits;
+    uint dreq;
+} dma_channel_config;
+
+// Addresses are host pointers in the simulator
+typedef struct {
+    volatile uintptr_t read_addr;
+    volatile uintptr_t write_addr;
+    volatile uint32_t transfer_count;
+    volatile uint32_t ctrl_trig;
+} dma_channel_hw_t;
+
+int dma_claim_unused_channel(bool required);
+dma_channel_config dma_channel_get_default_config(uint channel);
+
+static inline void channel_config_set_transfer_data_size(dma_channel_config* c, enum dma_channel_transfer_size size) {
+    c->size = size;
+}
+
+static inline void channel_config_set_read_increment(dma_channel_config* c, bool incr) {
+    c->read_increment = incr;
+}
+
+static inline void channel_config_set_write_increment(dma_channel_config* c, bool incr) {
+    c->write_increment = incr;
+}
+
+static inline void channel_config_set_ring(dma_channel_config* c, bool write, uint size_bits) {
+    c->ring_write = write;
+    c->ring_bits = size_bits;
+}
+
+static inline void channel_config_set_dreq(dma_channel_config* c, uint dreq) {
+    c->dreq = dreq;
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config* config, volatile void* write_addr,
+                           const volatile void* read_addr, uint transfer_count, bool trigger);
+void dma_channel_set_write_addr(uint channel, volatile void* write_addr, bool trigger);
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger);
+void dma_channel_abort(uint channel);
+
+// Registers of a channel, brought up to date with the ADC conversions due at the simulated time
+dma_channel_hw_t* dma_channel_hw_addr(uint channel);
+
+
+#endif // SIM_HARDWARE_DMA_H
@@ -0,0 +1,11 @@
+#ifndef SIM_HARDWARE_SYNC_H
+#define SIM_HARDWARE_SYNC_H
+
+#include "pico/stdlib.h"
+
+// Timer and GPIO callbacks of the simulator wait until interrupts are restored
+uint32_t save_and_disable_interrupts(void);
+void restore_interrupts(uint32_t status);
+
+
+#endif // SIM_HARDWARE_SYNC_H
@@ -0,0 +1,98 @@
+#ifndef SIM_PICO_STDLIB_H
+#define SIM_PICO_STDLIB_H
+
+// Subset of the Pico SDK used by the firmware, implemented by sim.c on Linux
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef unsigned int uint;
+
+// Microseconds since boot on the simulated clock
+typedef uint64_t absolute_time_t;
+
+#define PICO_ERROR_TIMEOUT -1
+
+#define GPIO_FUNC_PWM 4
+
+#define GPIO_IN false
+#define GPIO_OUT true
+
+#define GPIO_IRQ_LEVEL_LOW 0x1u
+#define GPIO_IRQ_LEVEL_HIGH 0x2u
+#define GPIO_IRQ_EDGE_FALL 0x4u
+#define GPIO_IRQ_EDGE_RISE 0x8u
+
+bool stdio_init_all(void);
+bool stdio_usb_connected(void);
+
+// Read a character from the pseudo-terminal, waiting at most timeout_us of simulated time
+int getchar_timeout_us(uint32_t timeout_us);
+
+// getchar() of pico_stdio blocks until the pseudo-terminal has a character
+int sim_getchar(void);
+#undef getchar
+#define getchar() sim_getchar()
+
+uint64_t time_us_64(void);
+uint32_t time_us_32(void);
+absolute_time_t get_absolute_time(void);
+absolute_time_t make_timeout_time_us(uint64_t us);
+absolute_time_t make_timeout_time_ms(uint32_t ms);
+bool time_reached(absolute_time_t t);
+
+static inline uint64_t to_us_since_boot(absolute_time_t t) {
+    return t;
+}
+
+static inline int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to) {
+    return (int64_t)(to - from);
+}
+
+void sleep_us(uint64_t us);
+void sleep_ms(uint32_t ms);
+
+void gpio_set_function(uint gpio, int function);
+
+// GPIO inputs are pulled up until sim_gpio_set() drives them
+void gpio_init(uint gpio);
+void gpio_set_dir(uint gpio, bool out);
+void gpio_pull_up(uint gpio);
+bool gpio_get(uint gpio);
+
+typedef void (*gpio_irq_callback_t)(uint gpio, uint32_t event_mask);
+
+// Edges driven by sim_gpio_set() call the callback, like the IO_IRQ_BANK0 handler of the SDK
+void gpio_set_irq_enabled_with_callback(uint gpio, uint32_t event_mask, bool enabled, gpio_irq_callback_t callback);
+
+// Body of busy-wait loops, nothing to do on the host
+static inline void tight_loop_contents(void) {
+}
+
+typedef struct repeating_timer repeating_timer_t;
+
+typedef bool (*repeating_timer_callback_t)(repeating_timer_t* rt);
+
+/**
+ * @delay_us: Period, negative to count from the start of the previous callback (int64_t)
+ * @callback: Function called every period (repeating_timer_callback_t)
+ * @user_data: Data of callback (void*)
+ * @next_us: Simulated time of the next callback (uint64_t)
+ * @active: True until cancelled or callback returns false (bool)
+ */
+struct repeating_timer {
+    int64_t delay_us;
+    repeating_timer_callback_t callback;
+    void* user_data;
+    uint64_t next_us;
+    bool active;
+};
+
+bool add_repeating_timer_us(int64_t delay_us, repeating_timer_callback_t callback, void* user_data,
+                            repeating_timer_t* out);
+bool cancel_repeating_timer(repeating_timer_t* timer);
+
+
+#endif // SIM_PICO_STDLIB_H
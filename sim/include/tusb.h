@@ -0,0 +1,20 @@
+#ifndef SIM_TUSB_H
+#define SIM_TUSB_H
+
+// TinyUSB CDC device calls used by the firmware, backed by the pseudo-terminal
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Size of the CDC TX FIFO, set by the tusb_config.h of pico_stdio_usb
+#define CFG_TUD_CDC_TX_BUFSIZE 256
+
+bool tud_cdc_connected(void);
+uint32_t tud_cdc_write_available(void);
+uint32_t tud_cdc_write(const void* buffer, uint32_t bufsize);
+uint32_t tud_cdc_write_flush(void);
+uint32_t tud_cdc_available(void);
+uint32_t tud_cdc_read(void* buffer, uint32_t bufsize);
+
+
+#endif // SIM_TUSB_H
@@ -0,0 +1,216 @@
+#include "sim.h"
+#include "robotic_arm.h"
+#include "arm_description.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * Host benchmark of the compile-time arm description against the runtime path.
+ * Inverse kinematics of the same random points goes through cylindrical_to_robotic_arm_signal()
+ * with the position_required of the description and through arm_description_inverse();
+ * both must agree on reachability and angles, and the angles must reach the point again.
+ * Starting the arm compares robotic_arm_start() with robotic_arm_start_description().
+ *     kinematics-bench [points] [rounds]
+ */
+
+// Largest difference of angles in degrees and of a reached point in mm that still agree
+#define BENCH_ANGLE_TOLERANCE 0.01f
+#define BENCH_POINT_TOLERANCE 0.05f
+
+static uint64_t bench_real_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * Random points around the arm, some out of reach.
+ *
+ * @param points: Points to fill
+ * @param number: Number of points
+ * @param reach: Sum of the link lengths in mm
+ */
+static void bench_points(cylindrical_point* points, uint number, float reach) {
+    srand(1);
+    for(uint i = 0; i < number; i++) {
+        points[i].angle = 180.0f * rand() / RAND_MAX;
+        points[i].radius = 1.1f * reach * rand() / RAND_MAX;
+        points[i].height = 2.2f * reach * rand() / RAND_MAX - 0.6f * reach;
+    }
+}
+
+/**
+ * Compare the solutions of both paths for every point.
+ *
+ * @param required: Geometry of the description
+ * @param points: Points to solve
+ * @param number: Number of points
+ * @return False if the paths disagree
+ */
+static bool bench_check(position_required* required, cylindrical_point* points, uint number) {
+    uint8_t angles_size = required->servos_from_base_size + 1;
+    uint8_t indexes[angles_size];
+    float angles[angles_size];
+    uint8_t description_indexes[angles_size];
+    float description_angles[angles_size];
+    robotic_arm_signal signal = {.indexes = indexes, .angles = angles};
+    float pose[arm_description_number];
+    float worst_angle = 0.0f;
+    float worst_point = 0.0f;
+    uint reachable = 0;
+    for(uint i = 0; i < number; i++) {
+        cylindrical_to_robotic_arm_signal(&signal, required, &points[i]);
+        uint8_t solved = arm_description_inverse(&points[i], description_indexes, description_angles);
+        if(signal.number != solved) {
+            fprintf(stderr, "Point %u (%.1f, %.1f, %.1f) solved with %d and %d angles.\n", i, points[i].radius,
+                    points[i].angle, points[i].height, signal.number, solved);
+            return false;
+        }
+        if(!solved)
+            continue;
+        reachable++;
+        for(uint8_t j = 0; j < solved; j++) {
+            if(indexes[j] != description_indexes[j]) {
+                fprintf(stderr, "Point %u solved for servos %d and %d.\n", i, indexes[j], description_indexes[j]);
+                return false;
+            }
+            float difference = fabsf(angles[j] - description_angles[j]);
+            if(difference > worst_angle)
+                worst_angle = difference;
+        }
+        for(uint8_t j = 0; j < arm_description_number; j++)
+            pose[j] = 90.0f;
+        for(uint8_t j = 0; j < solved; j++)
+            pose[indexes[j]] = angles[j];
+        cylindrical_point reached;
+        arm_description_forward(pose, &reached);
+        float distance = hypotf(reached.radius - points[i].radius, reached.height - points[i].height);
+        if(distance > worst_point)
+            worst_point = distance;
+    }
+    printf("%u of %u points reachable, angles differ by %.5f degrees, reached within %.5f mm\n", reachable, number,
+           worst_angle, worst_point);
+    return worst_angle <= BENCH_ANGLE_TOLERANCE && worst_point <= BENCH_POINT_TOLERANCE;
+}
+
+/**
+ * Time inverse kinematics of every point by both paths.
+ *
+ * @param required: Geometry of the description
+ * @param points: Points to solve
+ * @param number: Number of points
+ * @param rounds: Times to solve every point
+ */
+static void bench_inverse(position_required* required, cylindrical_point* points, uint number, uint rounds) {
+    uint8_t angles_size = required->servos_from_base_size + 1;
+    uint8_t indexes[angles_size];
+    float angles[angles_size];
+    robotic_arm_signal signal = {.indexes = indexes, .angles = angles};
+    volatile float sink = 0.0f;
+    uint64_t start = bench_real_ns();
+    for(uint round = 0; round < rounds; round++) {
+        for(uint i = 0; i < number; i++) {
+            cylindrical_to_robotic_arm_signal(&signal, required, &points[i]);
+            sink += angles[1];
+        }
+    }
+    uint64_t runtime_ns = bench_real_ns() - start;
+    start = bench_real_ns();
+    for(uint round = 0; round < rounds; round++) {
+        for(uint i = 0; i < number; i++) {
+            arm_description_inverse(&points[i], indexes, angles);
+            sink += angles[1];
+        }
+    }
+    uint64_t description_ns = bench_real_ns() - start;
+    double calls = (double)number * rounds;
+    printf("%-28s %10.1f ns/point\n", "runtime position_required", runtime_ns / calls);
+    printf("%-28s %10.1f ns/point %9.2fx\n", "compile-time description", description_ns / calls,
+           (double)runtime_ns / description_ns);
+    (void)sink;
+}
+
+/**
+ * Start the arm by both paths and compare the PWM settings and pulse widths.
+ *
+ * @param rounds: Times to start the arm by every path
+ * @return False if the settings differ
+ */
+static bool bench_start(uint rounds) {
+    const arm_description_servo* settings = arm_description_servos();
+    robotic_arm* runtime = robotic_arm_create(arm_description_number);
+    robotic_arm* description = robotic_arm_create(arm_description_number);
+    if(!runtime || !description)
+        return false;
+    uint64_t runtime_ns = 0;
+    uint64_t description_ns = 0;
+    bool ok = true;
+    for(uint round = 0; round < rounds && ok; round++) {
+        for(uint8_t i = 0; i < arm_description_number; i++) {
+            servo* motor = &runtime->servos[i];
+            motor->pin = settings[i].pin;
+            motor->angle_range = settings[i].angle_range;
+            motor->period = settings[i].period;
+            motor->min_duty = settings[i].min_duty;
+            motor->max_duty = settings[i].max_duty;
+            motor->angle = settings[i].angle;
+            motor->angle_lower_bound = settings[i].angle_lower_bound;
+            motor->angle_upper_bound = settings[i].angle_upper_bound;
+            motor->max_speed = settings[i].max_speed;
+        }
+        uint64_t start = bench_real_ns();
+        ok = robotic_arm_start(runtime);
+        runtime_ns += bench_real_ns() - start;
+        double pulses_us[arm_description_number];
+        for(uint8_t i = 0; i < arm_description_number; i++)
+            pulses_us[i] = sim_pwm_pulse_us(settings[i].pin);
+        start = bench_real_ns();
+        ok = ok && robotic_arm_start_description(description);
+        description_ns += bench_real_ns() - start;
+        for(uint8_t i = 0; i < arm_description_number && ok; i++) {
+            if(runtime->servos[i].pwm_wrap != description->servos[i].pwm_wrap
+               || pulses_us[i] != sim_pwm_pulse_us(settings[i].pin)) {
+                fprintf(stderr, "Servo %d starts with wrap %u pulse %.3f us, described wrap %u pulse %.3f us.\n", i,
+                        runtime->servos[i].pwm_wrap, pulses_us[i], description->servos[i].pwm_wrap,
+                        sim_pwm_pulse_us(settings[i].pin));
+                ok = false;
+            }
+        }
+    }
+    if(ok) {
+        printf("%-28s %10.1f ns/start\n", "robotic_arm_start", (double)runtime_ns / rounds);
+        printf("%-28s %10.1f ns/start %9.2fx\n", "robotic_arm_start_description", (double)description_ns / rounds,
+               (double)runtime_ns / description_ns);
+    }
+    robotic_arm_free(runtime);
+    robotic_arm_free(description);
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    uint number = argc > 1 ? atoi(argv[1]) : 10000;
+    uint rounds = argc > 2 ? atoi(argv[2]) : 100;
+    if(number == 0 || rounds == 0) {
+        fprintf(stderr, "Usage: kinematics-bench [points] [rounds]\n");
+        return 2;
+    }
+    position_required required;
+    arm_description_position_required(&required);
+    float reach = 0.0f;
+    for(uint8_t i = 0; i < required.servos_from_base_size; i++)
+        reach += required.arm_lengths[i];
+    cylindrical_point* points = malloc(number * sizeof(cylindrical_point));
+    if(!points)
+        return 1;
+    bench_points(points, number, reach);
+    printf("%d servos, %d links of %.0f mm, %u points, %u rounds\n", arm_description_number,
+           required.servos_from_base_size, reach, number, rounds);
+    bool ok = bench_check(&required, points, number);
+    if(ok)
+        bench_inverse(&required, points, number, rounds);
+    ok = ok && bench_start(rounds);
+    free(points);
+    return ok ? 0 : 1;
+}
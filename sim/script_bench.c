@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "pico/stdlib.h"
+#include "motion_script.h"
+
+/**
+ * Host benchmark of the motion script VM: instructions and moves per second with a queue
+ * that never fills and moves that finish at once, so only the VM is measured.
+ *     script-bench [seconds]
+ */
+
+static const char bench_source[] =
+    "pose pick 1 120 2 60 3 45\n"
+    "pose place 1 90 2 90 3 30\n"
+    "var turn 30\n"
+    "var lift\n"
+    "repeat 10000000\n"
+    "    set turn 30\n"
+    "    repeat 20\n"
+    "        move pick 0 turn d400 plin\n"
+    "        move place 0 turn+90 4 lift d400\n"
+    "        add turn 5\n"
+    "        add lift 0.5\n"
+    "    end\n"
+    "    wait 0\n"
+    "end\n";
+
+// Clock of the wait instructions, the firmware reads the timer instead
+uint64_t time_us_64(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+// Script errors of the firmware, sent after the queued console text there
+void console_error(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+/**
+ * Accept every move, summing angles so the moves are not optimized away.
+ *
+ * @param context: Sum of the angles (double*)
+ * @param signal: Move to queue
+ * @return 1
+ */
+static int bench_submit(void* context, robotic_arm_signal* signal) {
+    double* sum = context;
+    for(uint8_t i = 0; i < signal->number; i++)
+        *sum += signal->angles[i];
+    return 1;
+}
+
+static bool bench_idle(void* context) {
+    (void)context;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    double seconds = argc > 1 ? atof(argv[1]) : 2.0;
+    static motion_script script;
+    char source[sizeof(bench_source)];
+    memcpy(source, bench_source, sizeof(source));
+    if(!motion_script_compile(&script, source))
+        return 1;
+    printf("Script: %u bytes of bytecode, %u poses, %u variables.\n", script.length, script.pose_count,
+           script.variable_count);
+
+    double sum = 0;
+    motion_script_vm vm;
+    motion_script_start(&vm, &script, bench_submit, bench_idle, &sum);
+    uint64_t start_us = time_us_64();
+    uint64_t end_us = start_us + (uint64_t)(seconds * 1e6);
+    uint64_t now_us = start_us;
+    uint calls = 0;
+    while(now_us < end_us) {
+        // Same budget as the firmware task, the clock is read every 1024 calls
+        for(int i = 0; i < 1024; i++)
+            if(motion_script_run(&vm, 16) >= MOTION_SCRIPT_DONE)
+                return 1;
+        calls += 1024;
+        now_us = time_us_64();
+    }
+    double elapsed = (now_us - start_us) / 1e6;
+    printf("%u steps, %u moves, %u calls in %.3f s (checksum %.0f)\n", vm.steps, vm.moves, calls, elapsed, sum);
+    printf("%.2f M steps/s, %.2f M moves/s, %.1f ns per step\n", vm.steps / elapsed / 1e6,
+           vm.moves / elapsed / 1e6, elapsed * 1e9 / vm.steps);
+    return 0;
+}
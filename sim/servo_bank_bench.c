@@ -0,0 +1,152 @@
+#include "sim.h"
+#include "servo_bank.h"
+#include "servo_control.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * Host benchmark of the servo bank against the servo pointer path it replaced.
+ * Both run the ticks of the same random moves without sleeping: the bank through
+ * servos_smooth_tick() and servo_bank_write(), its kernel servo_bank_update() alone,
+ * and the old servos_smooth() loop calling servo_set_angle() through every servo pointer.
+ * Prints ticks per second of every path for a 6-servo arm and a full bank.
+ *     servo-bank-bench [seconds per path]
+ */
+
+#define BENCH_TICK_US 20000
+
+// Random moves run again and again by every path
+#define BENCH_MOVES 64
+
+// Easing of the old servos_smooth(), not declared in servo_control.h
+float calculate_smooth_ratio(float ratio_of_steps);
+
+typedef enum bench_path {
+    BENCH_BANK,
+    BENCH_BANK_UPDATE,
+    BENCH_POINTERS
+} bench_path;
+
+static const char* path_names[] = {"servos_smooth_tick", "servo_bank_update", "servo pointers"};
+
+static uint64_t bench_real_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * Run all ticks of one move.
+ *
+ * @param path: Path to run the move
+ * @param number: Number of servos
+ * @param motors: Servos to move, at the start angles
+ * @param angles: Target angles in degrees
+ * @return Number of ticks run
+ */
+static uint bench_move(bench_path path, uint number, servo** motors, float* angles) {
+    servo_bank bank;
+    servos_smooth_plan(&bank, number, motors, angles, NULL);
+    uint ticks = 0;
+    switch(path) {
+    case BENCH_BANK:
+        do {
+            ticks++;
+            servo_bank_write(&bank);
+        } while(servos_smooth_tick(&bank));
+        break;
+    case BENCH_BANK_UPDATE:
+        for(uint step = 1; step <= bank.steps; step++, ticks++)
+            servo_bank_update(&bank, (int32_t)((uint64_t)step * SERVO_BANK_RATIO_ONE / bank.steps));
+        break;
+    case BENCH_POINTERS: {
+        // servos_smooth() before the servo bank
+        float start_angles[number];
+        float angle_differences[number];
+        for(uint i = 0; i < number; i++) {
+            start_angles[i] = motors[i]->angle;
+            angle_differences[i] = angles[i] - start_angles[i];
+        }
+        for(uint step = 1; step < bank.steps; step++, ticks++) {
+            float ratio = calculate_smooth_ratio((float)step / bank.steps);
+            for(uint i = 0; i < number; i++)
+                servo_set_angle(motors[i], start_angles[i] + angle_differences[i] * ratio);
+        }
+        servos_set_angle(number, motors, angles);
+        ticks++;
+        break;
+    }
+    }
+    return ticks;
+}
+
+/**
+ * Run the moves again and again for a while.
+ *
+ * @param path: Path to run the moves
+ * @param number: Number of servos
+ * @param motors: Servos to move
+ * @param moves: Target angles of BENCH_MOVES moves, number per move
+ * @param seconds: Time to run
+ * @return Ticks per second
+ */
+static double bench_run(bench_path path, uint number, servo** motors, float* moves, double seconds) {
+    uint64_t ticks = 0;
+    uint64_t start_ns = bench_real_ns();
+    uint64_t end_ns = start_ns + (uint64_t)(seconds * 1e9);
+    uint64_t now_ns;
+    do {
+        for(uint move = 0; move < BENCH_MOVES; move++) {
+            float* angles = &moves[move * number];
+            ticks += bench_move(path, number, motors, angles);
+            // Every path starts the next move from the same angles
+            servos_smooth_finish(number, motors, angles);
+        }
+        now_ns = bench_real_ns();
+    } while(now_ns < end_ns);
+    return ticks * 1e9 / (now_ns - start_ns);
+}
+
+int main(int argc, char* argv[]) {
+    double seconds = argc > 1 ? atof(argv[1]) : 1.0;
+    if(seconds <= 0.0) {
+        fprintf(stderr, "Usage: servo-bank-bench [seconds per path]\n");
+        return 2;
+    }
+    servo mg996r = {
+        .angle_range = 180.0f,
+        .period = BENCH_TICK_US,
+        .min_duty = 500,
+        .max_duty = 2500,
+        .angle = 90.0f,
+        .angle_lower_bound = 0.0f,
+        .angle_upper_bound = 180.0f,
+        .max_speed = 300.0f
+    };
+    servo servos[SERVO_BANK_MAX_CHANNELS];
+    servo* motors[SERVO_BANK_MAX_CHANNELS];
+    for(uint i = 0; i < SERVO_BANK_MAX_CHANNELS; i++) {
+        memcpy(&servos[i], &mg996r, sizeof(servo));
+        servos[i].pin = i;
+        motors[i] = &servos[i];
+    }
+    if(!servos_init(SERVO_BANK_MAX_CHANNELS, motors))
+        return 1;
+    static float moves[BENCH_MOVES * SERVO_BANK_MAX_CHANNELS];
+    srand(1);
+    for(uint i = 0; i < BENCH_MOVES * SERVO_BANK_MAX_CHANNELS; i++)
+        moves[i] = 10.0f + rand() % 161;
+    printf("%.1f s per path, %d random moves\n", seconds, BENCH_MOVES);
+    printf("%-20s %8s %14s %10s\n", "path", "servos", "ticks/s", "ns/tick");
+    const uint numbers[] = {6, SERVO_BANK_MAX_CHANNELS};
+    for(uint n = 0; n < sizeof(numbers) / sizeof(numbers[0]); n++) {
+        for(bench_path path = BENCH_BANK; path <= BENCH_POINTERS; path++) {
+            for(uint i = 0; i < numbers[n]; i++)
+                servos[i].angle = 90.0f;
+            double rate = bench_run(path, numbers[n], motors, moves, seconds);
+            printf("%-20s %8u %14.0f %10.1f\n", path_names[path], numbers[n], rate, 1e9 / rate);
+        }
+    }
+    return 0;
+}
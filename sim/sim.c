@@ -0,0 +1,526 @@
+#include "sim.h"
+#include "hardware/pwm.h"
+#include "hardware/clocks.h"
+#include "hardware/sync.h"
+#include "tusb.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * State of one PWM slice.
+ *
+ * @div_int: Integer part of the clock divider (uint8_t)
+ * @div_frac: Fraction of the clock divider in 1/16 (uint8_t)
+ * @wrap: Counter top (uint16_t)
+ * @enabled: True if the slice counts (bool)
+ */
+typedef struct sim_pwm_slice {
+    uint8_t div_int;
+    uint8_t div_frac;
+    uint16_t wrap;
+    bool enabled;
+} sim_pwm_slice;
+
+// Simulated time of a poll of the console finding no input, one idle round of the main loop
+#define SIM_POLL_US 100
+
+// Shortest real sleep keeping the simulated clock at its speed, shorter leads are caught up later
+#define SIM_SLEEP_MIN_NS 1000000
+
+static sim_options options;
+static uint64_t real_start_ns;
+// Simulated time since boot, moved only by waits, empty polls and sim_advance_us(): firmware code
+// takes no simulated time, the run times of tasks and ticks it reports stay 0
+static uint64_t clock_us;
+static int terminal = -1;
+static FILE* log_file;
+static FILE* pwm_log_file;
+static repeating_timer_t* timers[SIM_MAX_TIMERS];
+static bool in_timer;
+static volatile sig_atomic_t interrupted;
+
+// GPIO inputs driven low by sim_gpio_set(), and the interrupts enabled on them
+static bool gpio_low[SIM_GPIO_COUNT];
+static uint32_t gpio_irq_events[SIM_GPIO_COUNT];
+static gpio_irq_callback_t gpio_callback;
+
+static sim_pwm_slice slices[SIM_PWM_SLICES];
+static uint16_t levels[SIM_GPIO_COUNT];
+static uint pwm_writes[SIM_GPIO_COUNT];
+static uint64_t timer_callbacks;
+
+
+/**
+ * @return Real monotonic time in nanoseconds
+ */
+static uint64_t sim_real_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * @return Simulated time since boot in microseconds
+ */
+static uint64_t sim_now_us(void) {
+    return clock_us;
+}
+
+/**
+ * Run the callbacks of due timers, like the timer IRQ of the SDK alarm pool.
+ * Exits the simulator once its duration is over or it was interrupted.
+ */
+static void sim_run_timers(void) {
+    if(in_timer)
+        return;
+    uint64_t now_us = sim_now_us();
+    if(interrupted || (options.duration_us && now_us >= options.duration_us)) {
+        sim_print_report(log_file);
+        exit(0);
+    }
+    in_timer = true;
+    // The GPIO interrupt runs like the timer ones
+    if(options.press_us && now_us >= options.press_us) {
+        options.press_us = 0;
+        sim_gpio_set(options.press_gpio, false);
+    }
+    for(int i = 0; i < SIM_MAX_TIMERS; i++) {
+        repeating_timer_t* timer = timers[i];
+        // Late periods run back to back, as they do after a long critical section
+        while(timer && timer->active && timer->next_us <= now_us) {
+            uint64_t start_us = timer->next_us;
+            timer_callbacks++;
+            if(!timer->callback(timer)) {
+                timer->active = false;
+                break;
+            }
+            if(timer->delay_us < 0)
+                timer->next_us = start_us - timer->delay_us;
+            else
+                timer->next_us = sim_now_us() + timer->delay_us;
+        }
+        if(timer && !timer->active)
+            timers[i] = NULL;
+    }
+    in_timer = false;
+}
+
+/**
+ * @param limit_us: Latest simulated time of interest
+ * @return Earliest of limit_us and the next timer callback
+ */
+static uint64_t sim_next_event_us(uint64_t limit_us) {
+    for(int i = 0; i < SIM_MAX_TIMERS; i++)
+        if(timers[i] && timers[i]->active && timers[i]->next_us < limit_us)
+            limit_us = timers[i]->next_us;
+    if(options.duration_us && options.duration_us < limit_us)
+        limit_us = options.duration_us;
+    if(options.press_us && options.press_us < limit_us)
+        limit_us = options.press_us;
+    return limit_us;
+}
+
+/**
+ * Wait until a simulated time, running timer callbacks on the way.
+ * The clock jumps from event to event, the real sleeps only pace it to its speed,
+ * so a run without input is the same every time whatever the load of the host.
+ *
+ * @param end_us: Simulated time to wait for
+ * @param input: True to stop early when the pseudo-terminal has input
+ * @return True if input is ready
+ */
+static bool sim_wait_until(uint64_t end_us, bool input) {
+    while(true) {
+        sim_run_timers();
+        struct pollfd device = {.fd = terminal, .events = input ? POLLIN : 0};
+        uint64_t wake_us = sim_next_event_us(end_us);
+        int64_t real_ns = real_start_ns ? sim_real_ns() - real_start_ns : 0;
+        int64_t lead_ns = real_start_ns ? (int64_t)(wake_us * 1000.0 / options.speed) - real_ns : 0;
+        if(lead_ns < SIM_SLEEP_MIN_NS)
+            lead_ns = 0;
+        struct timespec timeout = {.tv_sec = lead_ns / 1000000000, .tv_nsec = lead_ns % 1000000000};
+        int ready = input ? ppoll(&device, 1, &timeout, NULL) : 0;
+        if(ready > 0 && (device.revents & POLLIN)) {
+            // Input comes at a real time, the clock follows it as far as the wait goes
+            uint64_t input_us = real_start_ns ? (sim_real_ns() - real_start_ns) * options.speed / 1000.0 : 0;
+            if(input_us > clock_us)
+                clock_us = input_us < wake_us ? input_us : wake_us;
+            return true;
+        }
+        // Without a client the terminal hangs up at once, sleep instead of spinning
+        if(!input || ready > 0)
+            nanosleep(&timeout, NULL);
+        if(wake_us > clock_us)
+            clock_us = wake_us;
+        if(clock_us >= end_us) {
+            sim_run_timers();
+            return false;
+        }
+    }
+}
+
+/**
+ * Let the time of an empty poll pass, the main loop spinning with nothing to do.
+ */
+static void sim_idle(void) {
+    sim_wait_until(sim_now_us() + SIM_POLL_US, true);
+}
+
+/**
+ * Open the pseudo-terminal, bind stdio to it and start the simulated clock.
+ *
+ * @param sim: Options of the simulator
+ * @return False if the pseudo-terminal cannot be opened
+ */
+bool sim_init(const sim_options* sim) {
+    options = *sim;
+    log_file = fdopen(dup(STDERR_FILENO), "w");
+    setvbuf(log_file, NULL, _IOLBF, 0);
+    terminal = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if(terminal < 0 || grantpt(terminal) || unlockpt(terminal)) {
+        fprintf(log_file, "Cannot open a pseudo-terminal: %s\n", strerror(errno));
+        return false;
+    }
+    const char* path = ptsname(terminal);
+    // Raw mode is set on the client side, closing it leaves the terminal hung up until a client opens it
+    int client = open(path, O_RDWR | O_NOCTTY);
+    if(client >= 0) {
+        struct termios attributes;
+        tcgetattr(client, &attributes);
+        cfmakeraw(&attributes);
+        tcsetattr(client, TCSANOW, &attributes);
+        close(client);
+    }
+    if(options.link) {
+        unlink(options.link);
+        if(symlink(path, options.link))
+            fprintf(log_file, "Cannot link %s: %s\n", options.link, strerror(errno));
+    }
+    if(options.pwm_log) {
+        pwm_log_file = fopen(options.pwm_log, "w");
+        if(!pwm_log_file) {
+            fprintf(log_file, "Cannot open %s.\n", options.pwm_log);
+            return false;
+        }
+        fprintf(pwm_log_file, "time_us,gpio,level,pulse_us\n");
+    }
+    fprintf(log_file, "Firmware console on %s, %.1fx real time.\n", options.link ? options.link : path,
+            options.speed);
+    // Everything the firmware prints goes over USB on the Pico
+    dup2(terminal, STDOUT_FILENO);
+    dup2(terminal, STDERR_FILENO);
+    setvbuf(stdout, NULL, _IONBF, 0);
+    real_start_ns = sim_real_ns();
+    return true;
+}
+
+/**
+ * Advance the clock of benchmarks that link the shims without sim_init().
+ *
+ * @param us: Simulated microseconds to add
+ */
+void sim_advance_us(uint64_t us) {
+    clock_us += us;
+}
+
+/**
+ * Print simulated and real time and PWM statistics.
+ *
+ * @param file: File to print to
+ */
+void sim_print_report(FILE* file) {
+    double real_s = (sim_real_ns() - real_start_ns) / 1e9;
+    fprintf(file, "Simulated %.3f s in %.3f s real time, %llu timer callbacks.\n", sim_now_us() / 1e6, real_s,
+            (unsigned long long)timer_callbacks);
+    for(uint gpio = 0; gpio < SIM_GPIO_COUNT; gpio++)
+        if(pwm_writes[gpio])
+            fprintf(file, "GPIO %u: %u PWM writes, level %u\n", gpio, pwm_writes[gpio], levels[gpio]);
+    sim_adc_print_report(file);
+    if(pwm_log_file)
+        fflush(pwm_log_file);
+}
+
+bool stdio_init_all(void) {
+    return true;
+}
+
+bool stdio_usb_connected(void) {
+    return tud_cdc_connected();
+}
+
+int getchar_timeout_us(uint32_t timeout_us) {
+    uint8_t input;
+    uint64_t wait_us = timeout_us ? timeout_us : SIM_POLL_US;
+    if(sim_wait_until(sim_now_us() + wait_us, true) && read(terminal, &input, 1) == 1)
+        return input;
+    return PICO_ERROR_TIMEOUT;
+}
+
+int sim_getchar(void) {
+    int input;
+    while((input = getchar_timeout_us(1000000)) == PICO_ERROR_TIMEOUT)
+        ;
+    return input;
+}
+
+uint64_t time_us_64(void) {
+    sim_run_timers();
+    return sim_now_us();
+}
+
+uint32_t time_us_32(void) {
+    return time_us_64();
+}
+
+absolute_time_t get_absolute_time(void) {
+    return time_us_64();
+}
+
+absolute_time_t make_timeout_time_us(uint64_t us) {
+    return time_us_64() + us;
+}
+
+absolute_time_t make_timeout_time_ms(uint32_t ms) {
+    return time_us_64() + ms * 1000ull;
+}
+
+bool time_reached(absolute_time_t t) {
+    return time_us_64() >= t;
+}
+
+void sleep_us(uint64_t us) {
+    // Benchmarks without sim_init() sleep on their manual clock
+    if(!real_start_ns) {
+        sim_advance_us(us);
+        return;
+    }
+    sim_wait_until(sim_now_us() + us, false);
+}
+
+void sleep_ms(uint32_t ms) {
+    sleep_us(ms * 1000ull);
+}
+
+void gpio_set_function(uint gpio, int function) {
+    (void)gpio;
+    (void)function;
+}
+
+void gpio_init(uint gpio) {
+    gpio_low[gpio] = false;
+}
+
+void gpio_set_dir(uint gpio, bool out) {
+    (void)gpio;
+    (void)out;
+}
+
+void gpio_pull_up(uint gpio) {
+    (void)gpio;
+}
+
+bool gpio_get(uint gpio) {
+    return !gpio_low[gpio];
+}
+
+void gpio_set_irq_enabled_with_callback(uint gpio, uint32_t event_mask, bool enabled, gpio_irq_callback_t callback) {
+    if(enabled)
+        gpio_irq_events[gpio] |= event_mask;
+    else
+        gpio_irq_events[gpio] &= ~event_mask;
+    gpio_callback = callback;
+}
+
+/**
+ * Drive a GPIO input, calling the GPIO interrupt callback on an enabled edge.
+ *
+ * @param gpio: GPIO input
+ * @param level: False to pull the input low, true to let it go back up
+ */
+void sim_gpio_set(uint gpio, bool level) {
+    if(gpio >= SIM_GPIO_COUNT || gpio_low[gpio] == !level)
+        return;
+    gpio_low[gpio] = !level;
+    uint32_t events = gpio_irq_events[gpio] & (level ? GPIO_IRQ_EDGE_RISE : GPIO_IRQ_EDGE_FALL);
+    if(events && gpio_callback)
+        gpio_callback(gpio, events);
+}
+
+uint32_t save_and_disable_interrupts(void) {
+    uint32_t status = in_timer;
+    in_timer = true;
+    return status;
+}
+
+void restore_interrupts(uint32_t status) {
+    in_timer = status;
+}
+
+bool add_repeating_timer_us(int64_t delay_us, repeating_timer_callback_t callback, void* user_data,
+                            repeating_timer_t* out) {
+    for(int i = 0; i < SIM_MAX_TIMERS; i++) {
+        if(timers[i])
+            continue;
+        out->delay_us = delay_us;
+        out->callback = callback;
+        out->user_data = user_data;
+        out->next_us = sim_now_us() + (delay_us < 0 ? -delay_us : delay_us);
+        out->active = true;
+        timers[i] = out;
+        return true;
+    }
+    return false;
+}
+
+bool cancel_repeating_timer(repeating_timer_t* timer) {
+    for(int i = 0; i < SIM_MAX_TIMERS; i++) {
+        if(timers[i] == timer) {
+            timer->active = false;
+            timers[i] = NULL;
+            return true;
+        }
+    }
+    return false;
+}
+
+void pwm_set_clkdiv_int_frac(uint slice_num, uint8_t integer, uint8_t fract) {
+    slices[slice_num].div_int = integer;
+    slices[slice_num].div_frac = fract;
+}
+
+void pwm_set_wrap(uint slice_num, uint16_t wrap) {
+    slices[slice_num].wrap = wrap;
+}
+
+void pwm_set_enabled(uint slice_num, bool enabled) {
+    slices[slice_num].enabled = enabled;
+}
+
+void pwm_set_gpio_level(uint gpio, uint16_t level) {
+    levels[gpio] = level;
+    pwm_writes[gpio]++;
+    if(!pwm_log_file)
+        return;
+    fprintf(pwm_log_file, "%llu,%u,%u,%.2f\n", (unsigned long long)sim_now_us(), gpio, level,
+            sim_pwm_pulse_us(gpio));
+}
+
+/**
+ * @param gpio: PWM pin
+ * @return Pulse width last written to the pin in microseconds, negative if never written
+ */
+double sim_pwm_pulse_us(int gpio) {
+    if(gpio < 0 || gpio >= SIM_GPIO_COUNT || !pwm_writes[gpio])
+        return -1.0;
+    sim_pwm_slice* slice = &slices[pwm_gpio_to_slice_num(gpio)];
+    double divider = slice->div_int + slice->div_frac / 16.0;
+    return levels[gpio] * divider / (SIM_SYS_CLOCK_HZ / 1e6);
+}
+
+uint32_t clock_get_hz(enum clock_index clk_index) {
+    return clk_index == clk_sys ? SIM_SYS_CLOCK_HZ : 0;
+}
+
+bool tud_cdc_connected(void) {
+    struct pollfd device = {.fd = terminal, .events = 0};
+    return poll(&device, 1, 0) == 0 || !(device.revents & POLLHUP);
+}
+
+uint32_t tud_cdc_write_available(void) {
+    struct pollfd device = {.fd = terminal, .events = POLLOUT};
+    if(poll(&device, 1, 0) > 0 && !(device.revents & POLLHUP) && (device.revents & POLLOUT))
+        return SIM_CDC_FIFO_SIZE;
+    // Waits for the client to read its terminal take simulated time
+    sim_idle();
+    return 0;
+}
+
+uint32_t tud_cdc_write(const void* buffer, uint32_t bufsize) {
+    ssize_t written = write(terminal, buffer, bufsize);
+    return written > 0 ? written : 0;
+}
+
+uint32_t tud_cdc_write_flush(void) {
+    return 0;
+}
+
+uint32_t tud_cdc_available(void) {
+    int waiting = 0;
+    if(ioctl(terminal, FIONREAD, &waiting) || waiting <= 0) {
+        sim_idle();
+        return 0;
+    }
+    return waiting > SIM_CDC_FIFO_SIZE ? SIM_CDC_FIFO_SIZE : waiting;
+}
+
+uint32_t tud_cdc_read(void* buffer, uint32_t bufsize) {
+    ssize_t received = read(terminal, buffer, bufsize);
+    return received > 0 ? received : 0;
+}
+
+// Benchmarks link the shims without the simulator and bring their own main()
+#ifndef SIM_NO_MAIN
+
+/**
+ * Stop at the next timer check, so the report is printed.
+ */
+static void sim_interrupt(int signal_number) {
+    (void)signal_number;
+    interrupted = 1;
+}
+
+static const char usage[] =
+    "Usage: pico-robotic-arm-sim [-s speed] [-d seconds] [-l link] [-p pwm.csv] [-a gpios] [-e gpio,seconds]\n"
+    "    -s <speed>    Simulated seconds per real second at most (default 1)\n"
+    "    -d <seconds>  Simulated time to run, then exit (default forever)\n"
+    "    -l <link>     Symbolic link to the firmware console pseudo-terminal\n"
+    "    -p <file>     Write every PWM level written to a CSV file\n"
+    "    -a <gpios>    PWM pins of the servos feeding ADC inputs 0, 1, ..., -1 for none (default 16,17,18,-1)\n"
+    "    -e <gpio,s>   Pull a GPIO input low at a simulated time, e.g. the emergency stop button\n";
+
+int main(int argc, char* argv[]) {
+    sim_options sim = {.speed = 1.0};
+    int option;
+    char* gpio;
+    while((option = getopt(argc, argv, "s:d:l:p:a:e:h")) != -1) {
+        switch(option) {
+        case 's': sim.speed = atof(optarg); break;
+        case 'd': sim.duration_us = (uint64_t)(atof(optarg) * 1e6); break;
+        case 'l': sim.link = optarg; break;
+        case 'p': sim.pwm_log = optarg; break;
+        case 'a':
+            gpio = strtok(optarg, ",");
+            for(uint input = 0; input < SIM_ADC_INPUTS; input++, gpio = gpio ? strtok(NULL, ",") : NULL)
+                sim_adc_connect(input, gpio ? atoi(gpio) : -1);
+            break;
+        case 'e':
+            sim.press_gpio = atoi(optarg);
+            sim.press_us = strchr(optarg, ',') ? (uint64_t)(atof(strchr(optarg, ',') + 1) * 1e6) : 0;
+            break;
+        default:
+            fputs(usage, option == 'h' ? stdout : stderr);
+            return option == 'h' ? 0 : 2;
+        }
+    }
+    if(sim.speed <= 0.0 || sim.press_gpio >= SIM_GPIO_COUNT) {
+        fputs(usage, stderr);
+        return 2;
+    }
+    if(!sim_init(&sim))
+        return 1;
+    signal(SIGINT, sim_interrupt);
+    signal(SIGTERM, sim_interrupt);
+    int result = firmware_main();
+    sim_print_report(log_file);
+    return result;
+}
+
+#endif // SIM_NO_MAIN
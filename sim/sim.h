@@ -0,0 +1,111 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include "pico/stdlib.h"
+#include "tusb.h"
+
+// Clock of the simulated RP2040
+#define SIM_SYS_CLOCK_HZ 125000000
+
+// Free space reported by tud_cdc_write_available(), the CDC FIFO of pico_stdio_usb
+#define SIM_CDC_FIFO_SIZE CFG_TUD_CDC_TX_BUFSIZE
+
+// Number of GPIOs and PWM slices of the RP2040
+#define SIM_GPIO_COUNT 30
+#define SIM_PWM_SLICES 8
+
+// Most repeating timers running at the same time
+#define SIM_MAX_TIMERS 16
+
+// ADC inputs and DMA channels of the RP2040, and the clock of its ADC
+#define SIM_ADC_INPUTS 4
+#define SIM_DMA_CHANNELS 12
+#define SIM_ADC_CLOCK_HZ 48000000.0
+
+// Servo model behind the ADC inputs: shaft lag time constant, fastest turn in pulse
+// microseconds per second (MG996R, 60 degrees in 0.17 s) and pulse range of the potentiometer
+#define SIM_SERVO_LAG_US 30000.0
+#define SIM_SERVO_MAX_RATE 3900.0
+#define SIM_SERVO_MIN_PULSE_US 500.0
+#define SIM_SERVO_MAX_PULSE_US 2500.0
+
+// Largest noise of an ADC conversion in counts
+#define SIM_ADC_NOISE 3
+
+/**
+ * Options of the simulator.
+ *
+ * @speed: Simulated seconds per real second (double)
+ * @duration_us: Simulated time to run before exiting, 0 to run forever (uint64_t)
+ * @link: Path of a symbolic link to the pseudo-terminal, NULL for none (const char*)
+ * @pwm_log: Path of the CSV file of PWM writes, NULL for none (const char*)
+ * @press_gpio: GPIO input pulled low at press_us, like a button (uint)
+ * @press_us: Simulated time to pull press_gpio low, 0 for never (uint64_t)
+ */
+typedef struct sim_options {
+    double speed;
+    uint64_t duration_us;
+    const char* link;
+    const char* pwm_log;
+    uint press_gpio;
+    uint64_t press_us;
+} sim_options;
+
+/**
+ * Open the pseudo-terminal, bind stdio to it and start the simulated clock.
+ *
+ * @param options Options of the simulator
+ * @return False if the pseudo-terminal cannot be opened
+ */
+bool sim_init(const sim_options* options);
+
+/**
+ * Print simulated and real time and PWM statistics.
+ *
+ * @param file File to print to
+ */
+void sim_print_report(FILE* file);
+
+/**
+ * @param gpio PWM pin
+ * @return Pulse width last written to the pin in microseconds, negative if never written
+ */
+double sim_pwm_pulse_us(int gpio);
+
+/**
+ * Drive a GPIO input, calling the GPIO interrupt callback on an enabled edge.
+ *
+ * @param gpio GPIO input
+ * @param level False to pull the input low, true to let it go back up
+ */
+void sim_gpio_set(uint gpio, bool level);
+
+/**
+ * Route an ADC input to the potentiometer of the servo on a PWM pin.
+ * Inputs 0 to 2 follow GPIO 16 to 18, the first three servos of arm 0, by default.
+ *
+ * @param adc_input ADC input, 0 to SIM_ADC_INPUTS - 1
+ * @param gpio PWM pin of the servo, -1 to leave the input unconnected
+ */
+void sim_adc_connect(uint adc_input, int gpio);
+
+/**
+ * Print ADC conversions and DMA transfers, nothing if the ADC never ran.
+ *
+ * @param file File to print to
+ */
+void sim_adc_print_report(FILE* file);
+
+/**
+ * Advance the clock of benchmarks that link the shims without sim_init(), it stands still otherwise.
+ * sleep_us() advances it as well.
+ *
+ * @param us Simulated microseconds to add
+ */
+void sim_advance_us(uint64_t us);
+
+// main() of main.c, renamed by the build
+int firmware_main(void);
+
+
+#endif // SIM_H
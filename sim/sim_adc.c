@@ -0,0 +1,271 @@
+#include "sim.h"
+#include "hardware/adc.h"
+#include "hardware/dma.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Potentiometer of a servo following its PWM pulse, sampled by one ADC input.
+ *
+ * @gpio: PWM pin of the servo, -1 if nothing is wired to the input (int)
+ * @pulse_us: Pulse width the servo shaft currently stands at, negative before the first PWM write (double)
+ * @update_us: Simulated time of pulse_us (double)
+ */
+typedef struct sim_servo_pot {
+    int gpio;
+    double pulse_us;
+    double update_us;
+} sim_servo_pot;
+
+/**
+ * One DMA channel.
+ *
+ * @claimed: True if claimed by the firmware (bool)
+ * @busy: True while transfers remain (bool)
+ * @config: Configuration of the channel (dma_channel_config)
+ * @write: Write address, a host pointer (uintptr_t)
+ * @hw: Registers read by the firmware (dma_channel_hw_t)
+ */
+typedef struct sim_dma_channel {
+    bool claimed;
+    bool busy;
+    dma_channel_config config;
+    uintptr_t write;
+    dma_channel_hw_t hw;
+} sim_dma_channel;
+
+adc_hw_t sim_adc_hw = {.cs = ADC_CS_READY_BITS};
+
+static sim_servo_pot pots[SIM_ADC_INPUTS] = {{16, -1.0, 0.0}, {17, -1.0, 0.0}, {18, -1.0, 0.0}, {-1, -1.0, 0.0}};
+static sim_dma_channel channels[SIM_DMA_CHANNELS];
+static uint input;
+static uint round_robin;
+static bool fifo_dreq;
+static float divider = 95.0f;
+static bool running;
+static uint64_t run_start_us;
+static uint64_t run_conversions;
+static uint64_t conversions;
+static uint64_t transfers;
+
+
+/**
+ * Route an ADC input to the potentiometer of the servo on a PWM pin.
+ *
+ * @param adc_input: ADC input, 0 to SIM_ADC_INPUTS - 1
+ * @param gpio: PWM pin of the servo, -1 to leave the input unconnected
+ */
+void sim_adc_connect(uint adc_input, int gpio) {
+    if(adc_input < SIM_ADC_INPUTS)
+        pots[adc_input].gpio = gpio;
+}
+
+/**
+ * Move the shaft of a servo towards its commanded pulse until a simulated time.
+ * The shaft lags the pulse like a first-order system, no faster than the servo can turn.
+ *
+ * @param pot: Potentiometer to update
+ * @param now_us: Simulated time
+ */
+static void sim_servo_follow(sim_servo_pot* pot, double now_us) {
+    double target_us = sim_pwm_pulse_us(pot->gpio);
+    double dt_us = now_us - pot->update_us;
+    pot->update_us = now_us;
+    if(target_us < 0.0)
+        return;
+    // A servo powered up at its first pulse starts there
+    if(pot->pulse_us < 0.0) {
+        pot->pulse_us = target_us;
+        return;
+    }
+    double step_us = (target_us - pot->pulse_us) * (1.0 - exp(-dt_us / SIM_SERVO_LAG_US));
+    double max_step_us = SIM_SERVO_MAX_RATE * dt_us / 1e6;
+    if(step_us > max_step_us)
+        step_us = max_step_us;
+    else if(step_us < -max_step_us)
+        step_us = -max_step_us;
+    pot->pulse_us += step_us;
+}
+
+/**
+ * Convert one sample of an ADC input at a simulated time.
+ *
+ * @param adc_input: Input to convert
+ * @param now_us: Simulated time of the conversion
+ * @return 12-bit count, potentiometer voltage plus noise
+ */
+static uint16_t sim_adc_convert(uint adc_input, double now_us) {
+    sim_servo_pot* pot = &pots[adc_input];
+    double count = 0.0;
+    if(pot->gpio >= 0) {
+        sim_servo_follow(pot, now_us);
+        if(pot->pulse_us >= 0.0)
+            count = (pot->pulse_us - SIM_SERVO_MIN_PULSE_US) / (SIM_SERVO_MAX_PULSE_US - SIM_SERVO_MIN_PULSE_US) * 4095.0;
+    }
+    count += rand() % (2 * SIM_ADC_NOISE + 1) - SIM_ADC_NOISE;
+    return count < 0.0 ? 0 : count > 4095.0 ? 4095 : (uint16_t)count;
+}
+
+/**
+ * Hand an ADC sample to the DMA channel paced by the ADC, dropped if none is busy.
+ *
+ * @param sample: ADC count
+ */
+static void sim_dma_transfer(uint16_t sample) {
+    for(uint i = 0; i < SIM_DMA_CHANNELS; i++) {
+        sim_dma_channel* channel = &channels[i];
+        if(!channel->busy || channel->config.dreq != DREQ_ADC)
+            continue;
+        uint size = 1u << channel->config.size;
+        memcpy((void*)channel->write, &sample, size);
+        if(channel->config.write_increment) {
+            // A ring only advances the low bits of the address, the buffer must be aligned to its size
+            uintptr_t mask = channel->config.ring_write && channel->config.ring_bits
+                             ? ((uintptr_t)1 << channel->config.ring_bits) - 1 : UINTPTR_MAX;
+            channel->write = (channel->write & ~mask) | ((channel->write + size) & mask);
+        }
+        channel->hw.write_addr = channel->write;
+        transfers++;
+        if(!--channel->hw.transfer_count)
+            channel->busy = false;
+        return;
+    }
+}
+
+/**
+ * Run the ADC conversions due at the current simulated time, in round-robin order.
+ */
+static void sim_adc_update(void) {
+    if(!running)
+        return;
+    // A conversion takes 1 + divider cycles of the 48 MHz ADC clock, at least 96
+    double period_us = (1.0 + (divider < 95.0f ? 95.0f : divider)) * 1e6 / SIM_ADC_CLOCK_HZ;
+    uint64_t now_us = time_us_64();
+    uint64_t due = (uint64_t)((now_us - run_start_us) / period_us);
+    for(; run_conversions < due; run_conversions++) {
+        uint16_t sample = sim_adc_convert(input, run_start_us + (run_conversions + 1) * period_us);
+        conversions++;
+        if(fifo_dreq)
+            sim_dma_transfer(sample);
+        // Next enabled input above the current one, wrapping around
+        for(uint i = 1; round_robin && i <= SIM_ADC_INPUTS; i++) {
+            if(round_robin & 1u << ((input + i) % SIM_ADC_INPUTS)) {
+                input = (input + i) % SIM_ADC_INPUTS;
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * Print ADC conversions and DMA transfers.
+ *
+ * @param file: File to print to
+ */
+void sim_adc_print_report(FILE* file) {
+    if(conversions)
+        fprintf(file, "ADC: %llu conversions, %llu transferred by DMA.\n", (unsigned long long)conversions,
+                (unsigned long long)transfers);
+}
+
+void adc_init(void) {
+    running = false;
+    round_robin = 0;
+    fifo_dreq = false;
+}
+
+void adc_gpio_init(uint gpio) {
+    (void)gpio;
+}
+
+void adc_select_input(uint adc_input) {
+    sim_adc_update();
+    input = adc_input % SIM_ADC_INPUTS;
+}
+
+void adc_set_round_robin(uint input_mask) {
+    sim_adc_update();
+    round_robin = input_mask & ((1u << SIM_ADC_INPUTS) - 1);
+}
+
+void adc_fifo_setup(bool en, bool dreq_en, uint16_t dreq_thresh, bool err_in_fifo, bool byte_shift) {
+    (void)dreq_thresh;
+    (void)err_in_fifo;
+    (void)byte_shift;
+    sim_adc_update();
+    fifo_dreq = en && dreq_en;
+}
+
+void adc_set_clkdiv(float clkdiv) {
+    sim_adc_update();
+    divider = clkdiv;
+    run_start_us = time_us_64();
+    run_conversions = 0;
+}
+
+void adc_run(bool run) {
+    sim_adc_update();
+    if(run && !running) {
+        run_start_us = time_us_64();
+        run_conversions = 0;
+    }
+    running = run;
+}
+
+void adc_fifo_drain(void) {
+}
+
+int dma_claim_unused_channel(bool required) {
+    for(uint i = 0; i < SIM_DMA_CHANNELS; i++) {
+        if(!channels[i].claimed) {
+            channels[i].claimed = true;
+            return i;
+        }
+    }
+    if(required) {
+        fprintf(stderr, "No DMA channels are available\n");
+        abort();
+    }
+    return -1;
+}
+
+dma_channel_config dma_channel_get_default_config(uint channel) {
+    (void)channel;
+    dma_channel_config config = {.size = DMA_SIZE_32, .read_increment = true, .write_increment = false};
+    return config;
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config* config, volatile void* write_addr,
+                           const volatile void* read_addr, uint transfer_count, bool trigger) {
+    sim_adc_update();
+    channels[channel].config = *config;
+    channels[channel].hw.read_addr = (uintptr_t)read_addr;
+    dma_channel_set_write_addr(channel, write_addr, false);
+    dma_channel_set_trans_count(channel, transfer_count, trigger);
+}
+
+void dma_channel_set_write_addr(uint channel, volatile void* write_addr, bool trigger) {
+    sim_adc_update();
+    channels[channel].write = (uintptr_t)write_addr;
+    channels[channel].hw.write_addr = (uintptr_t)write_addr;
+    if(trigger)
+        channels[channel].busy = channels[channel].hw.transfer_count > 0;
+}
+
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger) {
+    sim_adc_update();
+    channels[channel].hw.transfer_count = trans_count;
+    if(trigger)
+        channels[channel].busy = trans_count > 0;
+}
+
+void dma_channel_abort(uint channel) {
+    sim_adc_update();
+    channels[channel].busy = false;
+}
+
+dma_channel_hw_t* dma_channel_hw_addr(uint channel) {
+    sim_adc_update();
+    return &channels[channel].hw;
+}
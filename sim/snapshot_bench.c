@@ -0,0 +1,171 @@
+#include "arm_snapshot.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * Host stress test of arm snapshots with concurrent threads.
+ * One writer thread publishes states as fast as it can, every field derived from a
+ * generation number, while reader threads copy states and check that every field belongs
+ * to the same generation and generations never go back. The same readers copying the
+ * state of the writer without the snapshot show how often plain reads tear.
+ *     snapshot-bench [seconds] [readers]
+ */
+
+#define BENCH_MAX_READERS 16
+
+/**
+ * Counters of one reader.
+ *
+ * @reads: States copied (uint64_t)
+ * @failed: Reads giving up after ARM_SNAPSHOT_READ_TRIES (uint64_t)
+ * @torn: States mixing generations or going back (uint64_t)
+ */
+typedef struct bench_reader {
+    uint64_t reads;
+    uint64_t failed;
+    uint64_t torn;
+} bench_reader;
+
+static arm_snapshot snapshot;
+// State written in place by the writer, read without protection by the plain readers
+static arm_state shared;
+static atomic_bool running;
+static atomic_bool plain;
+static uint64_t publishes;
+
+static uint64_t bench_real_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * @param state: State to fill with every field derived from a generation
+ * @param generation: Generation of the state
+ */
+static void bench_fill(arm_state* state, uint32_t generation) {
+    state->time_us = generation;
+    state->number = SERVO_BANK_MAX_CHANNELS;
+    state->queued = generation % ARM_SNAPSHOT_READ_TRIES;
+    state->moving = generation & 1;
+    state->move_number = SERVO_BANK_MAX_CHANNELS;
+    state->step = generation;
+    state->steps = generation >> 16;
+    state->profile = generation % 4;
+    for(uint k = 0; k < SERVO_BANK_MAX_CHANNELS; k++) {
+        state->levels[k] = generation + k;
+        state->angles[k] = (float)(generation % (1 << 20)) + k;
+        state->move_indexes[k] = generation + k;
+        state->move_targets[k] = (float)(generation % (1 << 20)) - k;
+    }
+}
+
+/**
+ * @param state: State to check
+ * @param last: Generation of the last state read, updated
+ * @return True if every field belongs to one generation, not older than the last one
+ */
+static bool bench_consistent(const arm_state* state, uint64_t* last) {
+    arm_state expected;
+    memset(&expected, 0, sizeof(arm_state));
+    bench_fill(&expected, (uint32_t)state->time_us);
+    bool ok = memcmp(&expected, state, sizeof(arm_state)) == 0 && state->time_us >= *last;
+    *last = state->time_us;
+    return ok;
+}
+
+static void* bench_writer(void* data) {
+    (void)data;
+    arm_state state;
+    memset(&state, 0, sizeof(arm_state));
+    uint32_t generation = 0;
+    while(atomic_load_explicit(&running, memory_order_relaxed)) {
+        generation++;
+        if(atomic_load_explicit(&plain, memory_order_relaxed)) {
+            bench_fill(&shared, generation);
+        } else {
+            bench_fill(&state, generation);
+            arm_snapshot_publish(&snapshot, &state);
+        }
+    }
+    publishes = generation;
+    return NULL;
+}
+
+static void* bench_read(void* data) {
+    bench_reader* reader = data;
+    arm_state state;
+    uint64_t last = 0;
+    bool unprotected = atomic_load_explicit(&plain, memory_order_relaxed);
+    while(atomic_load_explicit(&running, memory_order_relaxed)) {
+        reader->reads++;
+        if(unprotected) {
+            memcpy(&state, (const void*)&shared, sizeof(arm_state));
+        } else if(!arm_snapshot_read(&snapshot, &state)) {
+            reader->failed++;
+            continue;
+        }
+        if(!bench_consistent(&state, &last))
+            reader->torn++;
+    }
+    return NULL;
+}
+
+/**
+ * Run the writer and readers for a while.
+ *
+ * @param seconds: Time to run
+ * @param readers: Number of reader threads
+ * @param unprotected: True to read the state of the writer without the snapshot
+ * @return Torn reads
+ */
+static uint64_t bench_run(double seconds, uint readers, bool unprotected) {
+    static bench_reader counters[BENCH_MAX_READERS];
+    pthread_t threads[BENCH_MAX_READERS + 1];
+    memset(counters, 0, sizeof(counters));
+    memset(&shared, 0, sizeof(arm_state));
+    bench_fill(&shared, 0);
+    arm_snapshot_init(&snapshot, &shared);
+    atomic_store(&plain, unprotected);
+    atomic_store(&running, true);
+    uint started = 0;
+    if(pthread_create(&threads[started], NULL, bench_writer, NULL) == 0)
+        started++;
+    while(started && started <= readers
+          && pthread_create(&threads[started], NULL, bench_read, &counters[started - 1]) == 0)
+        started++;
+    uint64_t start_ns = bench_real_ns();
+    struct timespec pause = {.tv_sec = (time_t)seconds, .tv_nsec = (long)((seconds - (time_t)seconds) * 1e9)};
+    nanosleep(&pause, NULL);
+    atomic_store(&running, false);
+    for(uint i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+    double elapsed_s = (bench_real_ns() - start_ns) / 1e9;
+    bench_reader total = {0};
+    for(uint i = 0; i + 1 < started; i++) {
+        total.reads += counters[i].reads;
+        total.failed += counters[i].failed;
+        total.torn += counters[i].torn;
+    }
+    printf("%-9s %6u %14.0f %14.0f %12llu %12llu\n", unprotected ? "plain" : "snapshot", started ? started - 1 : 0,
+           publishes / elapsed_s, total.reads / elapsed_s, (unsigned long long)total.failed,
+           (unsigned long long)total.torn);
+    return started == readers + 1 ? total.torn : UINT64_MAX;
+}
+
+int main(int argc, char* argv[]) {
+    double seconds = argc > 1 ? atof(argv[1]) : 2.0;
+    uint readers = argc > 2 ? atoi(argv[2]) : 3;
+    if(seconds <= 0.0 || readers < 1 || readers > BENCH_MAX_READERS) {
+        fprintf(stderr, "Usage: snapshot-bench [seconds] [readers, 1 to %d]\n", BENCH_MAX_READERS);
+        return 2;
+    }
+    printf("%zu byte states, %.1f s per run\n", sizeof(arm_state), seconds);
+    printf("%-9s %6s %14s %14s %12s %12s\n", "reads", "readers", "publishes/s", "reads/s", "failed", "torn");
+    uint64_t torn = bench_run(seconds, readers, false);
+    bench_run(seconds, readers, true);
+    // Plain reads may tear, snapshot reads never
+    return torn == 0 ? 0 : 1;
+}
@@ -0,0 +1,150 @@
+#include "sim.h"
+#include "arm_scheduler.h"
+#include "robotic_arm_servo.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * Host benchmark of spline keyframes against streaming raw angles.
+ * Both feed binary frames of the same smooth path into the arm scheduler on a manual clock:
+ * raw angles send one frame per tick, splines one keyframe per interval,
+ * with linear moves between the same keyframes for reference.
+ * Prints link bandwidth, CPU time of the scheduler and the largest error from the path.
+ *     spline-bench [seconds of path, a multiple of 20] [keyframe interval ms ...]
+ */
+
+#define BENCH_SERVOS 6
+#define BENCH_TICK_US 20000
+
+// Binary frame of arm_scheduler_submit_binary(), plus the start and length bytes on the link
+#define BENCH_FRAME_SIZE (2 + BENCH_SERVOS * 3 + 3)
+#define BENCH_LINK_FRAME_SIZE (BENCH_FRAME_SIZE + 2)
+
+/**
+ * Path of every servo: cosine waves of different frequencies from 90 degrees.
+ * Every wave starts at rest and is at rest again after whole multiples of 20 s.
+ *
+ * @param index: Servo index
+ * @param time_s: Time from the start of the path
+ * @return Angle in degrees
+ */
+static float bench_path(uint index, double time_s) {
+    double frequency = 0.15 + 0.05 * index;
+    double amplitude = 80.0 - 8.0 * index;
+    return (float)(90.0 + amplitude * (1.0 - cos(2 * M_PI * frequency * time_s)) / 2);
+}
+
+static uint64_t bench_real_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * Encode the move to the path at a time as a binary command frame.
+ *
+ * @param frame: Frame to fill, BENCH_FRAME_SIZE bytes
+ * @param time_s: Time of the path the move reaches
+ * @param duration_ms: Duration of the move
+ * @param profile: Velocity profile of the move
+ */
+static void bench_frame(uint8_t* frame, double time_s, uint duration_ms, motion_profile profile) {
+    uint8_t* field = frame;
+    *field++ = 0;
+    *field++ = BENCH_SERVOS;
+    for(uint i = 0; i < BENCH_SERVOS; i++) {
+        uint16_t angle = (uint16_t)(bench_path(i, time_s) * 100.0f + 0.5f);
+        *field++ = i;
+        *field++ = angle & 0xFF;
+        *field++ = angle >> 8;
+    }
+    *field++ = duration_ms & 0xFF;
+    *field++ = duration_ms >> 8;
+    *field++ = profile;
+}
+
+/**
+ * Run the path through the scheduler with moves of a fixed duration.
+ *
+ * @param robot: Robotic arm, back at 90 degrees after the run
+ * @param duration_s: Length of the path
+ * @param interval_ms: Duration of every move, BENCH_TICK_US / 1000 for raw angles
+ * @param profile: Velocity profile of the moves
+ */
+static void bench_run(robotic_arm* robot, double duration_s, uint interval_ms, motion_profile profile) {
+    static arm_scheduler scheduler;
+    for(uint i = 0; i < robot->number; i++)
+        robot->servos[i].angle = 90.0f;
+    arm_scheduler_init(&scheduler, SERVO_BANK_MAX_CHANNELS);
+    arm_scheduler_add_arm(&scheduler, robot);
+    arm_channel* arm = &scheduler.arms[0];
+    uint frames = (uint)(duration_s * 1e3 / interval_ms);
+    uint ticks = frames * (interval_ms * 1000 / BENCH_TICK_US);
+    uint sent = 0;
+    float max_error = 0.0f;
+    double sum_error = 0.0;
+    uint64_t cpu_ns = 0;
+    for(uint tick = 1; tick <= ticks; tick++) {
+        sim_advance_us(BENCH_TICK_US);
+        uint64_t start_ns = bench_real_ns();
+        // Keep the queue full, as a streaming client does
+        while(sent < frames && arm_scheduler_queue_depth(&scheduler, 0) < ARM_SCHEDULER_QUEUE_SIZE) {
+            uint8_t frame[BENCH_FRAME_SIZE];
+            sent++;
+            bench_frame(frame, sent * interval_ms / 1e3, interval_ms, profile);
+            arm_scheduler_submit_binary(&scheduler, frame, sizeof(frame));
+        }
+        arm_scheduler_tick(&scheduler);
+        cpu_ns += bench_real_ns() - start_ns;
+        for(uint i = 0; i < BENCH_SERVOS; i++) {
+            float error = fabsf(servo_bank_angle(&arm->bank, i) - bench_path(i, tick * BENCH_TICK_US / 1e6));
+            if(error > max_error)
+                max_error = error;
+            sum_error += error;
+        }
+    }
+    double link_bytes = (double)frames * BENCH_LINK_FRAME_SIZE / duration_s;
+    printf("%-6s %5u ms %6u frames %8.0f B/s %8.1f ns/tick %7.3f deg max %7.3f deg mean\n",
+           interval_ms * 1000 == BENCH_TICK_US ? "raw" : profile == MOTION_PROFILE_SPLINE ? "spline" : "lin", interval_ms, frames, link_bytes,
+           (double)cpu_ns / ticks, max_error, sum_error / ((double)ticks * BENCH_SERVOS));
+}
+
+int main(int argc, char* argv[]) {
+    double duration_s = argc > 1 ? atof(argv[1]) : 60.0;
+    servo mg996r = {
+        .angle_range = 180.0f,
+        .period = BENCH_TICK_US,
+        .min_duty = 500,
+        .max_duty = 2500,
+        .angle = 90.0f,
+        .angle_lower_bound = 0.0f,
+        .angle_upper_bound = 180.0f
+    };
+    robotic_arm* robot = robotic_arm_create(BENCH_SERVOS);
+    if(!robot)
+        return 1;
+    for(uint8_t i = 0; i < BENCH_SERVOS; i++) {
+        memcpy(&robot->servos[i], &mg996r, sizeof(servo));
+        robotic_arm_set_servo_pin(robot, i, i);
+    }
+    if(!robotic_arm_start(robot))
+        return 1;
+    printf("%u servos, %.0f s of path, one tick every %u us\n", BENCH_SERVOS, duration_s, BENCH_TICK_US);
+    bench_run(robot, duration_s, BENCH_TICK_US / 1000, MOTION_PROFILE_LINEAR);
+    if(argc > 2) {
+        for(int i = 2; i < argc; i++) {
+            bench_run(robot, duration_s, atoi(argv[i]), MOTION_PROFILE_LINEAR);
+            bench_run(robot, duration_s, atoi(argv[i]), MOTION_PROFILE_SPLINE);
+        }
+    } else {
+        static const uint intervals_ms[] = {100, 200, 400, 800};
+        for(uint i = 0; i < sizeof(intervals_ms) / sizeof(intervals_ms[0]); i++) {
+            bench_run(robot, duration_s, intervals_ms[i], MOTION_PROFILE_LINEAR);
+            bench_run(robot, duration_s, intervals_ms[i], MOTION_PROFILE_SPLINE);
+        }
+    }
+    robotic_arm_free(robot);
+    return 0;
+}
@@ -0,0 +1,305 @@
+#include "sim.h"
+#include "arm_scheduler.h"
+#include "motion_timeline.h"
+#include "robotic_arm_servo.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Host benchmark of the emergency stop latency of the arm scheduler on a manual clock.
+ * The scheduler runs from its repeating timer and a main loop polling it, as in the firmware.
+ * Every trial queues moves, then requests a stop at a random time of the first move: from the
+ * GPIO interrupt of the stop input between main loop rounds, inside a running tick or while the
+ * main loop is blocked in its longest menu round, or as the menu does for the reserved console bytes.
+ * The longest menu round is the dry-run render and CSV export of exam_action in main.c,
+ * refused while arms move, so every round allowed then is shorter.
+ * Prints the time from the request to the tick preempting the moves and to all servos at rest.
+ * Checks that no PWM level changes after a hold request, and none after a deceleration stopped.
+ *     stop-bench [trials] [main loop round us] [blocked round us]
+ */
+
+#define BENCH_SERVOS 6
+#define BENCH_TICK_US 20000
+#define BENCH_STOP_GPIO 15
+
+// Ticks watched after the stop for PWM levels that still change
+#define BENCH_WATCH_TICKS 25
+
+// Pause between actions of robotic_arm_custom_control_task() in main.c
+#define BENCH_ACTION_PAUSE_US 100000
+
+typedef enum bench_path {
+    BENCH_GPIO_HOLD,
+    BENCH_GPIO_HOLD_IN_TICK,
+    BENCH_GPIO_HOLD_IN_EXPORT,
+    BENCH_BYTE_HOLD,
+    BENCH_BYTE_DECELERATE
+} bench_path;
+
+static const char* path_names[] = {"gpio hold", "gpio hold tick", "gpio hold export", "byte hold",
+                                   "byte decelerate"};
+
+// Actions of the custom control mode, see main.c
+extern char exam_action[][40];
+extern const uint exam_action_count;
+
+/**
+ * Results of the trials of one path.
+ *
+ * @trials: Trials run (uint)
+ * @max_latency_us: Longest time from request to the preempting tick (uint32_t)
+ * @total_latency_us: Sum of the latencies (uint64_t)
+ * @max_stop_us: Longest time from request to all servos at rest (uint32_t)
+ * @total_stop_us: Sum of the times to rest (uint64_t)
+ * @max_step_us: Largest pulse change of one tick after the request (double)
+ * @moved: Trials with a pulse changing after a hold request or once the arm stopped (uint)
+ */
+typedef struct bench_result {
+    uint trials;
+    uint32_t max_latency_us;
+    uint64_t total_latency_us;
+    uint32_t max_stop_us;
+    uint64_t total_stop_us;
+    double max_step_us;
+    uint moved;
+} bench_result;
+
+/**
+ * @param pulses: Set to the pulse widths of the servos
+ */
+static void bench_pulses(double* pulses) {
+    for(uint i = 0; i < BENCH_SERVOS; i++)
+        pulses[i] = sim_pwm_pulse_us(i);
+}
+
+/**
+ * Run the main loop for a while: the timer raises ticks, the loop polls the scheduler.
+ *
+ * @param scheduler: Scheduler to poll
+ * @param us: Time to run
+ * @param round_us: Time of one round of the main loop
+ */
+static void bench_loop(arm_scheduler* scheduler, uint64_t us, uint round_us) {
+    for(uint64_t done = 0; done < us; done += round_us) {
+        sim_advance_us(round_us);
+        // Runs the due timers, like the timer interrupt
+        time_us_64();
+        arm_scheduler_poll(scheduler);
+    }
+}
+
+/**
+ * Repeating timer callback pressing the stop button once, like the GPIO interrupt.
+ *
+ * @param timer: Timer to press from
+ * @return False, the timer runs once
+ */
+static bool bench_press_callback(repeating_timer_t* timer) {
+    (void)timer;
+    sim_gpio_set(BENCH_STOP_GPIO, false);
+    return false;
+}
+
+/**
+ * Dry run and export exam_action as the custom control mode of main.c does on 'e'.
+ *
+ * @param robot: Robotic arm to render
+ * @param csv: File to write the CSV
+ */
+static void bench_export(robotic_arm* robot, FILE* csv) {
+    uint8_t action_servos[exam_action_count][robot->number];
+    float action_angles[exam_action_count][robot->number];
+    robotic_arm_signal action_signals[exam_action_count];
+    for(uint i = 0; i < exam_action_count; i++) {
+        action_signals[i].indexes = action_servos[i];
+        action_signals[i].angles = action_angles[i];
+        robotic_arm_signal_from_string(&action_signals[i], exam_action[i], robot->number);
+    }
+    motion_timeline* timeline = motion_timeline_create(robot->number);
+    if(!timeline)
+        return;
+    if(motion_timeline_render(timeline, robot, action_signals, exam_action_count, BENCH_ACTION_PAUSE_US))
+        motion_timeline_write_csv(timeline, csv);
+    motion_timeline_free(timeline);
+}
+
+/**
+ * Request the stop on a path, the main loop resumes after the call.
+ *
+ * @param scheduler: Scheduler to stop
+ * @param robot: Robotic arm of the scheduler
+ * @param path: Path of the stop request
+ * @param round_us: Time of one round of the main loop
+ * @param block_us: Time of the blocked round of BENCH_GPIO_HOLD_IN_EXPORT
+ * @param csv: File to write the export
+ * @param before: Set to the pulse widths at the request
+ */
+static void bench_request(arm_scheduler* scheduler, robotic_arm* robot, bench_path path, uint round_us,
+                          uint block_us, FILE* csv, double* before) {
+    static repeating_timer_t press_timer;
+    switch(path) {
+    case BENCH_GPIO_HOLD:
+        sim_advance_us(rand() % round_us);
+        bench_pulses(before);
+        sim_gpio_set(BENCH_STOP_GPIO, false);
+        break;
+    case BENCH_GPIO_HOLD_IN_TICK:
+        // Press from a timer due at once: it fires at the first time_us_64() of the tick,
+        // after the tick read the stop mode
+        do {
+            sim_advance_us(round_us);
+            time_us_64();
+        } while(!scheduler->pending_ticks);
+        bench_pulses(before);
+        add_repeating_timer_us(0, bench_press_callback, NULL, &press_timer);
+        arm_scheduler_poll(scheduler);
+        break;
+    case BENCH_GPIO_HOLD_IN_EXPORT: {
+        // The timer keeps raising ticks, the main loop polls again after the whole round
+        uint press_us = rand() % block_us;
+        sim_advance_us(press_us);
+        time_us_64();
+        bench_pulses(before);
+        sim_gpio_set(BENCH_STOP_GPIO, false);
+        bench_export(robot, csv);
+        sim_advance_us(block_us - press_us);
+        time_us_64();
+        arm_scheduler_poll(scheduler);
+        break;
+    }
+    case BENCH_BYTE_HOLD:
+        sim_advance_us(rand() % round_us);
+        bench_pulses(before);
+        arm_scheduler_emergency_stop(scheduler, ARM_STOP_HOLD);
+        break;
+    case BENCH_BYTE_DECELERATE:
+        sim_advance_us(rand() % round_us);
+        bench_pulses(before);
+        arm_scheduler_emergency_stop(scheduler, ARM_STOP_DECELERATE);
+        break;
+    }
+}
+
+/**
+ * Run one trial: queue moves, stop during the first one and watch the PWM levels.
+ *
+ * @param robot: Robotic arm, at rest
+ * @param path: Path of the stop request
+ * @param round_us: Time of one round of the main loop
+ * @param block_us: Time of the blocked round of BENCH_GPIO_HOLD_IN_EXPORT
+ * @param csv: File to write exports
+ * @param result: Results to add the trial to
+ */
+static void bench_trial(robotic_arm* robot, bench_path path, uint round_us, uint block_us, FILE* csv,
+                        bench_result* result) {
+    static arm_scheduler scheduler;
+    uint8_t indexes[BENCH_SERVOS];
+    float angles[BENCH_SERVOS];
+    robotic_arm_signal signal = {.indexes = indexes, .angles = angles, .number = BENCH_SERVOS};
+    arm_scheduler_init(&scheduler, SERVO_BANK_MAX_CHANNELS);
+    arm_scheduler_add_arm(&scheduler, robot);
+    arm_scheduler_set_stop_input(&scheduler, BENCH_STOP_GPIO);
+    arm_scheduler_start(&scheduler);
+    uint first_ms = 0;
+    for(uint move = 0; move < 3; move++) {
+        for(uint i = 0; i < BENCH_SERVOS; i++) {
+            indexes[i] = i;
+            angles[i] = 30.0f + rand() % 121;
+        }
+        signal.options.duration_ms = 500 + rand() % 1501;
+        signal.options.profile = rand() % 3;
+        if(!first_ms)
+            first_ms = signal.options.duration_ms;
+        arm_scheduler_submit(&scheduler, 0, &signal);
+    }
+    // Request the stop at any time of the first move, not only on tick boundaries
+    bench_loop(&scheduler, (uint64_t)(rand() % (first_ms * 1000 / round_us)) * round_us, round_us);
+    double request[BENCH_SERVOS];
+    double before[BENCH_SERVOS];
+    double after[BENCH_SERVOS];
+    bench_request(&scheduler, robot, path, round_us, block_us, csv, request);
+    memcpy(before, request, sizeof(before));
+    while(!scheduler.stopped) {
+        bench_loop(&scheduler, BENCH_TICK_US, round_us);
+        bench_pulses(after);
+        for(uint i = 0; i < BENCH_SERVOS; i++) {
+            if(fabs(after[i] - before[i]) > result->max_step_us)
+                result->max_step_us = fabs(after[i] - before[i]);
+            before[i] = after[i];
+        }
+    }
+    bench_loop(&scheduler, BENCH_WATCH_TICKS * BENCH_TICK_US, round_us);
+    bench_pulses(after);
+    // A hold freezes the levels at the request, a deceleration once it stopped
+    if(memcmp(path == BENCH_BYTE_DECELERATE ? before : request, after, sizeof(after)))
+        result->moved++;
+    result->trials++;
+    result->total_latency_us += scheduler.stop_latency_us;
+    if(scheduler.stop_latency_us > result->max_latency_us)
+        result->max_latency_us = scheduler.stop_latency_us;
+    result->total_stop_us += scheduler.stop_time_us;
+    if(scheduler.stop_time_us > result->max_stop_us)
+        result->max_stop_us = scheduler.stop_time_us;
+    arm_scheduler_stop(&scheduler);
+    sim_gpio_set(BENCH_STOP_GPIO, true);
+    arm_scheduler_release_stop(&scheduler);
+}
+
+int main(int argc, char* argv[]) {
+    uint trials = argc > 1 ? atoi(argv[1]) : 1000;
+    uint round_us = argc > 2 ? atoi(argv[2]) : 250;
+    uint block_us = argc > 3 ? atoi(argv[3]) : 10 * BENCH_TICK_US;
+    if(trials == 0 || round_us == 0 || round_us > BENCH_TICK_US || block_us == 0) {
+        fprintf(stderr, "Usage: stop-bench [trials] [main loop round us, at most %d] [blocked round us]\n",
+                BENCH_TICK_US);
+        return 2;
+    }
+    FILE* csv = fopen("/dev/null", "w");
+    if(!csv)
+        return 1;
+    servo mg996r = {
+        .angle_range = 180.0f,
+        .period = BENCH_TICK_US,
+        .min_duty = 500,
+        .max_duty = 2500,
+        .angle = 90.0f,
+        .angle_lower_bound = 0.0f,
+        .angle_upper_bound = 180.0f,
+        .max_speed = 300.0f
+    };
+    robotic_arm* robot = robotic_arm_create(BENCH_SERVOS);
+    if(!robot)
+        return 1;
+    for(uint8_t i = 0; i < BENCH_SERVOS; i++) {
+        memcpy(&robot->servos[i], &mg996r, sizeof(servo));
+        robotic_arm_set_servo_pin(robot, i, i);
+    }
+    if(!robotic_arm_start(robot))
+        return 1;
+    srand(1);
+    printf("%u trials per path, PWM period and tick %d us, main loop round %u us, blocked round %u us\n", trials,
+           BENCH_TICK_US, round_us, block_us);
+    printf("%-16s %12s %12s %12s %12s %12s %6s\n", "path", "latency avg", "latency max", "rest avg", "rest max",
+           "step max", "moved");
+    bool ok = true;
+    for(bench_path path = BENCH_GPIO_HOLD; path <= BENCH_BYTE_DECELERATE; path++) {
+        bench_result result = {0};
+        for(uint i = 0; i < trials; i++)
+            bench_trial(robot, path, round_us, block_us, csv, &result);
+        printf("%-16s %9.0f us %9lu us %9.0f us %9lu us %9.1f us %6u\n", path_names[path],
+               (double)result.total_latency_us / result.trials, (unsigned long)result.max_latency_us,
+               (double)result.total_stop_us / result.trials, (unsigned long)result.max_stop_us, result.max_step_us,
+               result.moved);
+        // Every stop preempts within one PWM period and the round of the main loop it lands in,
+        // and no hold moves a servo after its request
+        uint request_round_us = path == BENCH_GPIO_HOLD_IN_EXPORT ? block_us : round_us;
+        if(result.max_latency_us > BENCH_TICK_US + request_round_us || result.moved)
+            ok = false;
+        if(path != BENCH_BYTE_DECELERATE && result.max_step_us > 0.0)
+            ok = false;
+    }
+    fclose(csv);
+    robotic_arm_free(robot);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,258 @@
+#include "sim.h"
+#include "arm_scheduler.h"
+#include "pwm_trace.h"
+#include "robotic_arm_servo.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Golden PWM trace check of the servo control paths on a manual clock.
+ * Every case moves a fresh arm with PWM write tracing on and compares the trace against
+ * the golden CSV of the case in the golden directory; --update writes the golden CSVs instead.
+ * Exits with 1 on the first case not matching its golden trace, run by ctest.
+ *     trace-check <golden directory> [--update]
+ */
+
+#define CHECK_SERVOS 6
+#define CHECK_TICK_US 20000
+
+// Records of the longest case
+#define CHECK_TRACE_CAPACITY 16384
+
+// Pause between actions of robotic_arm_custom_control_task() in main.c
+#define CHECK_ACTION_PAUSE_US 100000
+
+// Time of one round of the main loop polling the scheduler
+#define CHECK_ROUND_US 250
+
+// Longest wait for the queue of the scheduler to empty
+#define CHECK_QUEUE_TIMEOUT_US 60000000
+
+// Levels may differ by rounding of the float math between compilers, times not at all
+static pwm_trace_tolerance check_tolerance = {.time_us = 0, .level = 1};
+
+// Actions of the custom control mode, see main.c
+extern char exam_action[][40];
+extern const uint exam_action_count;
+
+/**
+ * Run the main loop for a while: the timer raises ticks, the loop polls the scheduler.
+ *
+ * @param scheduler: Scheduler to poll
+ * @param us: Time to run
+ */
+static void check_loop(arm_scheduler* scheduler, uint64_t us) {
+    for(uint64_t done = 0; done < us; done += CHECK_ROUND_US) {
+        sim_advance_us(CHECK_ROUND_US);
+        // Runs the due timers, like the timer interrupt
+        time_us_64();
+        arm_scheduler_poll(scheduler);
+    }
+}
+
+/**
+ * Run the main loop until the queue of the arm is empty, its last move finished.
+ *
+ * @param scheduler: Scheduler to poll
+ */
+static void check_loop_queue(arm_scheduler* scheduler) {
+    for(uint64_t done = 0; arm_scheduler_queue_depth(scheduler, 0) && done < CHECK_QUEUE_TIMEOUT_US;
+        done += CHECK_ROUND_US)
+        check_loop(scheduler, CHECK_ROUND_US);
+}
+
+/**
+ * @param scheduler: Scheduler to submit to
+ * @param str: Command string of arm_scheduler_submit_string()
+ */
+static void check_submit_string(arm_scheduler* scheduler, const char* str) {
+    char command[64];
+    strncpy(command, str, sizeof(command) - 1);
+    command[sizeof(command) - 1] = '\0';
+    arm_scheduler_submit_string(scheduler, command);
+}
+
+/**
+ * Start a scheduler driving one arm, as main.c does.
+ *
+ * @param robot: Robotic arm to drive
+ * @return Started scheduler, NULL if the arm cannot be added or no timer is available
+ */
+static arm_scheduler* check_scheduler_start(robotic_arm* robot) {
+    static arm_scheduler scheduler;
+    arm_scheduler_init(&scheduler, SERVO_BANK_MAX_CHANNELS);
+    if(arm_scheduler_add_arm(&scheduler, robot) < 0 || !arm_scheduler_start(&scheduler))
+        return NULL;
+    return &scheduler;
+}
+
+/**
+ * Moves with the default and every velocity profile, each started once the last one finished.
+ *
+ * @param robot: Robotic arm to move
+ */
+static void check_motion_profiles(robotic_arm* robot) {
+    static const char* moves[] = {
+        "6 0 30 1 150 2 45 3 135 4 60 5 120",
+        "3 0 120 2 100 4 20 d800 plin",
+        "2 1 60 3 90 s90 pjerk",
+        "6 0 90 1 90 2 90 3 90 4 90 5 90 d600 pcos"
+    };
+    arm_scheduler* scheduler = check_scheduler_start(robot);
+    if(!scheduler)
+        return;
+    for(uint i = 0; i < sizeof(moves) / sizeof(moves[0]); i++) {
+        check_submit_string(scheduler, moves[i]);
+        check_loop_queue(scheduler);
+    }
+    arm_scheduler_stop(scheduler);
+}
+
+/**
+ * Moves of the arm scheduler as the firmware runs them from its timer and main loop:
+ * every step of exam_action queued by the custom control task with its pause,
+ * streamed spline keyframes joined without stopping, and a feed override ramping within a move.
+ *
+ * @param robot: Robotic arm to move
+ */
+static void check_arm_scheduler(robotic_arm* robot) {
+    arm_scheduler* scheduler = check_scheduler_start(robot);
+    if(!scheduler)
+        return;
+    for(uint i = 0; i < exam_action_count; i++) {
+        check_submit_string(scheduler, exam_action[i]);
+        check_loop_queue(scheduler);
+        check_loop(scheduler, CHECK_ACTION_PAUSE_US);
+    }
+    check_submit_string(scheduler, "3 0 60 1 120 2 45 d400 pspline");
+    check_submit_string(scheduler, "3 0 90 1 100 2 80 d300 pspline");
+    check_submit_string(scheduler, "2 0 130 2 60 d500 pspline");
+    check_submit_string(scheduler, "3 0 90 1 90 2 90 d400 pspline");
+    check_loop_queue(scheduler);
+    check_submit_string(scheduler, "6 0 30 1 150 2 45 3 135 4 60 5 120 d1200 plin");
+    check_loop(scheduler, 200000);
+    arm_scheduler_set_feed(scheduler, 150);
+    check_loop(scheduler, 300000);
+    arm_scheduler_set_feed(scheduler, 100);
+    check_loop_queue(scheduler);
+    arm_scheduler_stop(scheduler);
+}
+
+typedef struct check_case {
+    const char* name;
+    void (*run)(robotic_arm* robot);
+} check_case;
+
+static const check_case check_cases[] = {
+    {"motion_profiles", check_motion_profiles},
+    {"arm_scheduler", check_arm_scheduler}
+};
+
+/**
+ * Record the trace of a case on a fresh arm at 90 degrees.
+ *
+ * @param check: Case to run
+ * @param trace: Trace to record into
+ * @return False if the arm cannot be started or the trace overflowed
+ */
+static bool check_record(const check_case* check, pwm_trace* trace) {
+    servo mg996r = {
+        .angle_range = 180.0f,
+        .period = CHECK_TICK_US,
+        .min_duty = 500,
+        .max_duty = 2500,
+        .angle = 90.0f,
+        .angle_lower_bound = 0.0f,
+        .angle_upper_bound = 180.0f,
+        .max_speed = 300.0f
+    };
+    robotic_arm* robot = robotic_arm_create(CHECK_SERVOS);
+    if(!robot)
+        return false;
+    for(uint8_t i = 0; i < CHECK_SERVOS; i++) {
+        memcpy(&robot->servos[i], &mg996r, sizeof(servo));
+        robotic_arm_set_servo_pin(robot, i, i);
+    }
+    bool started = robotic_arm_start(robot);
+    if(started) {
+        pwm_trace_start(trace);
+        check->run(robot);
+        pwm_trace_stop();
+    }
+    robotic_arm_free(robot);
+    if(trace->dropped) {
+        fprintf(stderr, "%s: %u PWM writes beyond the trace capacity.\n", check->name, trace->dropped);
+        return false;
+    }
+    return started;
+}
+
+/**
+ * Compare the trace of a case against its golden CSV, or write the golden CSV.
+ *
+ * @param check: Case to run
+ * @param directory: Directory of the golden CSVs
+ * @param update: Write the golden CSV instead of comparing
+ * @return False on a mismatch or error
+ */
+static bool check_run(const check_case* check, const char* directory, bool update) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s.csv", directory, check->name);
+    pwm_trace* actual = pwm_trace_create(CHECK_TRACE_CAPACITY);
+    pwm_trace* expected = pwm_trace_create(CHECK_TRACE_CAPACITY);
+    if(!actual || !expected)
+        return false;
+    bool ok = check_record(check, actual);
+    FILE* file = ok ? fopen(path, update ? "w" : "r") : NULL;
+    if(ok && !file) {
+        fprintf(stderr, "%s: cannot open %s.\n", check->name, path);
+        ok = false;
+    }
+    if(file && update) {
+        pwm_trace_write_csv(actual, file);
+        printf("%-16s %6u writes, written to %s\n", check->name, actual->number, path);
+    } else if(file) {
+        if(!pwm_trace_read_csv(expected, file) || expected->dropped) {
+            fprintf(stderr, "%s: %s is not a golden trace.\n", check->name, path);
+            ok = false;
+        } else {
+            int mismatch = pwm_trace_compare(expected, actual, &check_tolerance);
+            if(mismatch < 0) {
+                printf("%-16s %6u writes, match\n", check->name, actual->number);
+            } else {
+                printf("%-16s %6u writes, %u expected, first mismatch at write %d:\n", check->name,
+                       actual->number, expected->number, mismatch);
+                pwm_trace* traces[] = {expected, actual};
+                const char* labels[] = {"expected", "actual"};
+                for(uint i = 0; i < 2; i++) {
+                    if((uint)mismatch >= traces[i]->number) {
+                        printf("    %-8s end of trace\n", labels[i]);
+                        continue;
+                    }
+                    pwm_trace_record* record = &traces[i]->records[mismatch];
+                    printf("    %-8s %lu us, pin %d, level %d\n", labels[i],
+                           (unsigned long)(record->time_us - traces[i]->records[0].time_us), record->pin,
+                           record->level);
+                }
+                ok = false;
+            }
+        }
+    }
+    if(file)
+        fclose(file);
+    pwm_trace_free(actual);
+    pwm_trace_free(expected);
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    bool update = argc > 2 && !strcmp(argv[2], "--update");
+    if(argc < 2 || (argc > 2 && !update)) {
+        fprintf(stderr, "Usage: trace-check <golden directory> [--update]\n");
+        return 2;
+    }
+    bool ok = true;
+    for(uint i = 0; i < sizeof(check_cases) / sizeof(check_cases[0]); i++)
+        ok = check_run(&check_cases[i], argv[1], update) && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,160 @@
+#include "sim.h"
+#include "cdc_transport.h"
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Host benchmark of input throughput over the pseudo-terminal of the simulator.
+ * A child process writes a known byte pattern to the terminal as fast as it takes it,
+ * the firmware side reads it byte by byte through getchar_timeout_us() like the menu did,
+ * byte by byte through cdc_transport_getc() and in blocks through cdc_transport_read().
+ * Every path must receive the pattern unchanged.
+ *     transport-bench [kilobytes]
+ */
+
+// Longest pause of the input before a path gives up
+#define BENCH_STALL_NS 2000000000ull
+
+typedef enum bench_path {
+    BENCH_STDIO,
+    BENCH_TRANSPORT_GETC,
+    BENCH_TRANSPORT_READ
+} bench_path;
+
+static const char* path_names[] = {"stdio getchar_timeout_us", "cdc_transport_getc", "cdc_transport_read"};
+
+static uint64_t bench_real_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * @param index: Position in the stream
+ * @return Byte of the pattern at the position
+ */
+static uint8_t bench_pattern(uint index) {
+    return (uint8_t)(index * 7 % 251);
+}
+
+/**
+ * Write the pattern to the terminal from a child process.
+ *
+ * @param link: Path of the terminal
+ * @param size: Number of bytes to write
+ * @return Process id of the writer, negative on failure
+ */
+static pid_t bench_writer(const char* link, uint size) {
+    pid_t pid = fork();
+    if(pid != 0)
+        return pid;
+    FILE* terminal = fopen(link, "wb");
+    if(!terminal)
+        _exit(1);
+    uint8_t block[4096];
+    for(uint sent = 0; sent < size;) {
+        uint length = size - sent < sizeof(block) ? size - sent : sizeof(block);
+        for(uint i = 0; i < length; i++)
+            block[i] = bench_pattern(sent + i);
+        if(fwrite(block, 1, length, terminal) != length)
+            _exit(1);
+        sent += length;
+    }
+    fclose(terminal);
+    _exit(0);
+}
+
+/**
+ * Receive the pattern by one path.
+ *
+ * @param path: Path to read by
+ * @param size: Number of bytes to receive
+ * @param elapsed_ns: Set to the time from the first to the last byte
+ * @return Number of bytes received in order, less than size on error or stall
+ */
+static uint bench_receive(bench_path path, uint size, uint64_t* elapsed_ns) {
+    uint8_t block[CDC_TRANSPORT_BLOCK];
+    uint received = 0;
+    uint64_t start_ns = 0;
+    uint64_t input_ns = bench_real_ns();
+    while(received < size && bench_real_ns() - input_ns < BENCH_STALL_NS) {
+        uint length = 0;
+        int input;
+        switch(path) {
+        case BENCH_STDIO:
+            input = getchar_timeout_us(0);
+            if(input != PICO_ERROR_TIMEOUT) {
+                block[0] = input;
+                length = 1;
+            }
+            break;
+        case BENCH_TRANSPORT_GETC:
+            input = cdc_transport_getc();
+            if(input != PICO_ERROR_TIMEOUT) {
+                block[0] = input;
+                length = 1;
+            }
+            break;
+        case BENCH_TRANSPORT_READ:
+            length = cdc_transport_read(block, sizeof(block));
+            break;
+        }
+        if(!length)
+            continue;
+        input_ns = bench_real_ns();
+        if(!start_ns)
+            start_ns = input_ns;
+        for(uint i = 0; i < length; i++, received++)
+            if(block[i] != bench_pattern(received))
+                return received;
+    }
+    *elapsed_ns = bench_real_ns() - start_ns;
+    return received;
+}
+
+int main(int argc, char* argv[]) {
+    uint size = (argc > 1 ? atoi(argv[1]) : 1024) * 1024;
+    if(size == 0) {
+        fprintf(stderr, "Usage: transport-bench [kilobytes]\n");
+        return 2;
+    }
+    // sim_init() binds stdout to the terminal
+    FILE* report = fdopen(dup(STDOUT_FILENO), "w");
+    char link[64];
+    snprintf(link, sizeof(link), "/tmp/transport-bench-%d", (int)getpid());
+    sim_options sim = {.speed = 1.0, .link = link};
+    if(!report || !sim_init(&sim))
+        return 1;
+    fprintf(report, "%u bytes per path\n", size);
+    bool ok = true;
+    for(bench_path path = BENCH_STDIO; path <= BENCH_TRANSPORT_READ && ok; path++) {
+        pid_t writer = bench_writer(link, size);
+        if(writer < 0) {
+            ok = false;
+            break;
+        }
+        uint64_t elapsed_ns = 0;
+        uint received = bench_receive(path, size, &elapsed_ns);
+        if(received < size)
+            kill(writer, SIGTERM);
+        int status;
+        waitpid(writer, &status, 0);
+        if(received < size) {
+            fprintf(report, "%s received %u of %u bytes in order.\n", path_names[path], received, size);
+            ok = false;
+        } else {
+            fprintf(report, "%-26s %10.2f MB/s %8.1f ns/byte\n", path_names[path], size / (elapsed_ns / 1e3),
+                    (double)elapsed_ns / size);
+        }
+    }
+    const cdc_transport_stats* stats = cdc_transport_get_stats();
+    fprintf(report, "Transport: %u bytes in %u reads, %.1f bytes per read\n", stats->received, stats->reads,
+            stats->reads ? (double)stats->received / stats->reads : 0.0);
+    unlink(link);
+    fclose(report);
+    return ok ? 0 : 1;
+}
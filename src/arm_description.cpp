@@ -0,0 +1,322 @@
+#include "arm_description.h"
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <utility>
+
+namespace {
+
+constexpr float pi = 3.14159265358979f;
+
+// Largest PWM wrap value, SERVO_PWM_MAX_WRAP of servo_control.h
+constexpr uint64_t max_wrap = 65535;
+
+/**
+ * Datasheet of a servo model.
+ *
+ * @angle_range: Range of angle in degrees (float)
+ * @period: PWM period in microseconds (uint16_t)
+ * @min_duty: Pulse width at 0 degree in microseconds (uint16_t)
+ * @max_duty: Pulse width at angle_range in microseconds (uint16_t)
+ * @max_speed: Speed limit in degrees per second, 0 for none (float)
+ */
+struct servo_model {
+    float angle_range;
+    uint16_t period;
+    uint16_t min_duty;
+    uint16_t max_duty;
+    float max_speed;
+};
+
+/**
+ * One servo of an arm.
+ *
+ * @pin: GPIO pin, must support hardware PWM (uint8_t)
+ * @model: Servo model (servo_model)
+ * @lower: Lowest angle allowed (float)
+ * @upper: Highest angle allowed (float)
+ * @angle: Angle at start (float)
+ */
+struct joint {
+    uint8_t pin;
+    servo_model model;
+    float lower;
+    float upper;
+    float angle;
+};
+
+/**
+ * One link of the arm in the plane turned by the plane servo, see position_required.
+ *
+ * @servo: Servo turning the link (uint8_t)
+ * @length: Length in mm (float)
+ * @horizontal: Angle of the servo at which the link is horizontal (float)
+ * @rises: True if the link rises when the angle of its servo increases (bool)
+ */
+struct link {
+    uint8_t servo;
+    float length;
+    float horizontal;
+    bool rises;
+};
+
+/**
+ * Arm described at compile time.
+ *
+ * @joints: Every servo (std::array<joint, Servos>)
+ * @plane: Servo turning the plane of the links (uint8_t)
+ * @height: Height of the first joint in mm (float)
+ * @radius: Radius of the first joint in mm (float)
+ * @links: Links from the base to the tip (std::array<link, Links>)
+ */
+template <std::size_t Servos, std::size_t Links>
+struct arm {
+    std::array<joint, Servos> joints;
+    uint8_t plane;
+    float height;
+    float radius;
+    std::array<link, Links> links;
+};
+
+// MG996R of main.c: 180 degrees, 500 to 2500 us at 50 Hz, 60 degrees in about 0.17 s at 4.8 V
+constexpr servo_model mg996r{180.0f, 20000, 500, 2500, 300.0f};
+
+// Arm 0 on pins 16 to 21 like robotic_arm_starter() sets up, links of the reference arm in mm
+constexpr arm<6, 3> arm0{
+    {{
+        {16, mg996r, 0.0f, 180.0f, 90.0f},
+        {17, mg996r, 3.0f, 177.0f, 90.0f},
+        {18, mg996r, 0.0f, 180.0f, 90.0f},
+        {19, mg996r, 0.0f, 180.0f, 90.0f},
+        {20, mg996r, 0.0f, 180.0f, 90.0f},
+        {21, mg996r, 0.0f, 180.0f, 90.0f}
+    }},
+    0, 70.0f, 0.0f,
+    {{
+        {1, 105.0f, 0.0f, true},
+        {2, 98.0f, 90.0f, false},
+        {3, 150.0f, 90.0f, false}
+    }}
+};
+
+/**
+ * @return True if servos sharing a PWM slice have the same period
+ */
+template <std::size_t Servos, std::size_t Links>
+constexpr bool slices_agree(const arm<Servos, Links>& description) {
+    for(std::size_t i = 0; i < Servos; i++)
+        for(std::size_t j = i + 1; j < Servos; j++)
+            if((description.joints[i].pin >> 1 & 7) == (description.joints[j].pin >> 1 & 7)
+               && description.joints[i].model.period != description.joints[j].model.period)
+                return false;
+    return true;
+}
+
+/**
+ * @return True if the plane servo and every link servo exist
+ */
+template <std::size_t Servos, std::size_t Links>
+constexpr bool servos_exist(const arm<Servos, Links>& description) {
+    for(const link& each : description.links)
+        if(each.servo >= Servos)
+            return false;
+    return description.plane < Servos;
+}
+
+static_assert(arm0.joints.size() <= 16, "An arm has at most SERVO_BANK_MAX_CHANNELS servos");
+static_assert(arm0.links.size() >= 2, "Inverse kinematics needs at least two links");
+static_assert(slices_agree(arm0), "Servos sharing a PWM slice must have the same period");
+static_assert(servos_exist(arm0), "Links and plane must name servos of the arm");
+
+/**
+ * Sine by its Taylor series, for constants of the kinematics.
+ *
+ * @param x: Angle in radians, within -pi to pi
+ */
+constexpr double constant_sin(double x) {
+    double term = x;
+    double sum = x;
+    for(int n = 1; n < 12; n++) {
+        term *= -x * x / ((2 * n) * (2 * n + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+/**
+ * @param x: Angle in radians, within -pi / 2 to 3 * pi / 2
+ */
+constexpr double constant_cos(double x) {
+    return constant_sin(pi / 2 - x);
+}
+
+/**
+ * PWM settings of one servo, the divider and wrap servo_pwm_setup() computes at run time.
+ *
+ * @param servo: Servo of the description
+ */
+constexpr arm_description_servo describe(const joint& servo) {
+    uint64_t counts = (uint64_t)ARM_DESCRIPTION_CLOCK_HZ * servo.model.period / 1000000;
+    uint64_t divider = (counts * 16 + max_wrap - 1) / max_wrap;
+    divider = divider < 16 ? 16 : divider > 0xfff ? 0xfff : divider;
+    uint64_t wrap = (counts * 16 + divider / 2) / divider;
+    return {
+        servo.pin, (uint8_t)(servo.pin >> 1 & 7), (uint16_t)divider, (uint16_t)(wrap > max_wrap ? max_wrap : wrap),
+        servo.model.period, servo.model.min_duty, servo.model.max_duty, servo.model.angle_range, servo.lower,
+        servo.upper, servo.model.max_speed, servo.angle
+    };
+}
+
+template <std::size_t... I>
+constexpr std::array<arm_description_servo, sizeof...(I)> describe_all(std::index_sequence<I...>) {
+    return {{describe(arm0.joints[I])...}};
+}
+
+constexpr std::array<arm_description_servo, arm0.joints.size()> servo_settings
+    = describe_all(std::make_index_sequence<arm0.joints.size()>());
+
+// Radius and height the links after the second one add at ROBOTIC_ARM_TOOL_ELEVATION
+template <std::size_t I = 2>
+constexpr float tool_radius() {
+    if constexpr(I < arm0.links.size())
+        return arm0.links[I].length * constant_cos(ROBOTIC_ARM_TOOL_ELEVATION * pi / 180) + tool_radius<I + 1>();
+    else
+        return 0.0f;
+}
+
+template <std::size_t I = 2>
+constexpr float tool_height() {
+    if constexpr(I < arm0.links.size())
+        return arm0.links[I].length * constant_sin(ROBOTIC_ARM_TOOL_ELEVATION * pi / 180) + tool_height<I + 1>();
+    else
+        return 0.0f;
+}
+
+/**
+ * Set the servo angle of link I and the following ones from their elevations.
+ *
+ * @param elevations: Elevation of every link in radians
+ * @param previous: Elevation of the link before I
+ * @param indexes: Servo of every angle
+ * @param angles: Angles to set, link I at I + 1
+ */
+template <std::size_t I = 0>
+inline void link_angles(const float* elevations, float previous, uint8_t* indexes, float* angles) {
+    if constexpr(I < arm0.links.size()) {
+        constexpr link current = arm0.links[I];
+        float relative = (elevations[I] - previous) * (180 / pi);
+        relative -= 360.0f * std::floor((relative + 180.0f) * (1.0f / 360.0f));
+        indexes[I + 1] = current.servo;
+        if constexpr(current.rises)
+            angles[I + 1] = current.horizontal + relative;
+        else
+            angles[I + 1] = current.horizontal - relative;
+        link_angles<I + 1>(elevations, elevations[I], indexes, angles);
+    }
+}
+
+/**
+ * Add link I and the following ones to the position of the tip.
+ *
+ * @param angles: Angle of every servo in degrees
+ * @param elevation: Elevation of the link before I in radians
+ * @param radius: Radius to add to
+ * @param height: Height to add to
+ */
+template <std::size_t I = 0>
+inline void forward_links(const float* angles, float elevation, float& radius, float& height) {
+    if constexpr(I < arm0.links.size()) {
+        constexpr link current = arm0.links[I];
+        float relative = (angles[current.servo] - current.horizontal) * (pi / 180);
+        if constexpr(current.rises)
+            elevation += relative;
+        else
+            elevation -= relative;
+        radius += current.length * std::cos(elevation);
+        height += current.length * std::sin(elevation);
+        forward_links<I + 1>(angles, elevation, radius, height);
+    }
+}
+
+} // namespace
+
+extern "C" const uint8_t arm_description_number = arm0.joints.size();
+
+/**
+ * @return Settings of every servo of the described arm, arm_description_number entries
+ */
+extern "C" const arm_description_servo* arm_description_servos(void) {
+    return servo_settings.data();
+}
+
+/**
+ * Set a position_required to the geometry of the description, for the runtime path.
+ *
+ * @param required: Position required to set, its arrays point to constant data
+ */
+extern "C" void arm_description_position_required(position_required* required) {
+    static uint8_t servos[arm0.links.size()];
+    static float horizontal[arm0.links.size()];
+    static bool direction[arm0.links.size()];
+    static float lengths[arm0.links.size()];
+    for(std::size_t i = 0; i < arm0.links.size(); i++) {
+        servos[i] = arm0.links[i].servo;
+        horizontal[i] = arm0.links[i].horizontal;
+        direction[i] = arm0.links[i].rises;
+        lengths[i] = arm0.links[i].length;
+    }
+    required->offsets_height = arm0.height;
+    required->offsets_radius = arm0.radius;
+    required->servo_plane_angle = arm0.plane;
+    required->servos_from_base = servos;
+    required->servos_from_base_size = arm0.links.size();
+    required->servos_angles_horizontal = horizontal;
+    required->servos_direction = direction;
+    required->arm_lengths = lengths;
+}
+
+/**
+ * Solve the servo angles reaching a point, unrolled over the links of the description.
+ *
+ * @param point: Point to reach, angle in degrees, radius and height in mm
+ * @param indexes: Set to the servo of every angle, the plane servo first
+ * @param angles: Set to the target angles in degrees
+ * @return Number of angles set, 0 if the point is out of reach
+ */
+extern "C" uint8_t arm_description_inverse(const cylindrical_point* point, uint8_t* indexes, float* angles) {
+    constexpr float first = arm0.links[0].length;
+    constexpr float second = arm0.links[1].length;
+    constexpr float wrist_radius = arm0.radius + tool_radius();
+    constexpr float wrist_height = arm0.height + tool_height();
+    float radius = point->radius - wrist_radius;
+    float height = point->height - wrist_height;
+    // Law of cosines with constant lengths, the elbow bends up
+    float cosine = (radius * radius + height * height - (first * first + second * second)) * (1 / (2 * first * second));
+    if(cosine < -1.0f || cosine > 1.0f)
+        return 0;
+    float sine = -std::sqrt(1.0f - cosine * cosine);
+    float elevations[arm0.links.size()];
+    elevations[0] = std::atan2(height, radius) - std::atan2(second * sine, first + second * cosine);
+    elevations[1] = elevations[0] + std::atan2(sine, cosine);
+    for(std::size_t i = 2; i < arm0.links.size(); i++)
+        elevations[i] = ROBOTIC_ARM_TOOL_ELEVATION * (pi / 180);
+    indexes[0] = arm0.plane;
+    angles[0] = point->angle;
+    link_angles(elevations, 0.0f, indexes, angles);
+    return arm0.links.size() + 1;
+}
+
+/**
+ * Position of the tip of the arm, unrolled over the links of the description.
+ *
+ * @param angles: Angle of every servo in degrees
+ * @param point: Set to the position of the tip
+ */
+extern "C" void arm_description_forward(const float* angles, cylindrical_point* point) {
+    float radius = arm0.radius;
+    float height = arm0.height;
+    forward_links(angles, 0.0f, radius, height);
+    point->angle = angles[arm0.plane];
+    point->radius = radius;
+    point->height = height;
+}
@@ -0,0 +1,789 @@
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "arm_scheduler.h"
+#include "console.h"
+#include "profiler.h"
+#include "robotic_arm_servo.h"
+#include "trajectory_pack.h"
+#include "hardware/pwm.h"
+#include "hardware/sync.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Scheduler and GPIO of the emergency stop input, the GPIO callback has no user data
+static arm_scheduler* stop_input_scheduler;
+static uint stop_input_gpio;
+
+/**
+ * Timer callback raising a tick, runs in interrupt context.
+ *
+ * @param timer: Repeating timer with the scheduler as user data
+ */
+static bool arm_scheduler_timer_callback(repeating_timer_t* timer) {
+    arm_scheduler* scheduler = timer->user_data;
+    scheduler->pending_ticks++;
+    return true;
+}
+
+/**
+ * Update the state of an arm and publish it for readers, see arm_snapshot.h.
+ *
+ * @param arm: Arm to publish
+ * @param refresh: True to read every servo again, after a move started or finished
+ */
+static void arm_channel_publish(arm_channel* arm, bool refresh) {
+    arm_state* state = &arm->state;
+    robotic_arm* robot = arm->robot;
+    if(refresh) {
+        state->number = robot->number;
+        for(uint8_t i = 0; i < robot->number; i++) {
+            state->angles[i] = robot->servos[i].angle;
+            state->levels[i] = servo_angle_to_level(&robot->servos[i], robot->servos[i].angle);
+        }
+        state->move_number = 0;
+        if(arm->moving) {
+            arm_command* command = &arm->queue[arm->head];
+            state->move_number = command->number;
+            memcpy(state->move_indexes, command->indexes, command->number);
+            memcpy(state->move_targets, command->angles, command->number * sizeof(float));
+            state->steps = arm->bank.steps > UINT16_MAX ? UINT16_MAX : arm->bank.steps;
+            state->profile = arm->bank.profile;
+        }
+    }
+    state->time_us = time_us_64();
+    state->queued = arm->count;
+    state->moving = arm->moving;
+    state->feed = (arm->feed * 100 + SERVO_BANK_FEED_ONE / 2) >> SERVO_BANK_FEED_BITS;
+    state->step = 0;
+    if(arm->moving) {
+        // Servos of the move in progress report their interpolated state
+        for(uint8_t k = 0; k < arm->bank.number; k++) {
+            uint8_t index = arm->motors[k] - robot->servos;
+            state->levels[index] = arm->bank.levels[k];
+            state->angles[index] = servo_bank_angle(&arm->bank, k);
+        }
+        state->step = arm->bank.step > UINT16_MAX ? UINT16_MAX : arm->bank.step;
+    } else {
+        state->steps = 0;
+    }
+    arm_snapshot_publish(&arm->snapshot, state);
+}
+
+/**
+ * Initialize an empty scheduler.
+ *
+ * @param scheduler: Scheduler to initialize
+ * @param channel_budget: Number of channels one tick may update in time
+ */
+void arm_scheduler_init(arm_scheduler* scheduler, uint channel_budget) {
+    memset(scheduler, 0, sizeof(arm_scheduler));
+    scheduler->channel_budget = channel_budget;
+    scheduler->feed_percent = 100;
+}
+
+/**
+ * Add a started robotic arm to a scheduler.
+ *
+ * @param scheduler: Scheduler to add
+ * @param robot: Robotic arm, started by robotic_arm_start(), at most SERVO_BANK_MAX_CHANNELS servos
+ * @return Arm id used to address commands, -1 if the scheduler is full
+ *         or a servo shares a PWM slice with a servo of another arm at a different period
+ */
+int arm_scheduler_add_arm(arm_scheduler* scheduler, robotic_arm* robot) {
+    if(scheduler->number == ARM_SCHEDULER_MAX_ARMS) {
+        console_error("Arm scheduler is full.\n");
+        return -1;
+    }
+    if(robot->number > SERVO_BANK_MAX_CHANNELS) {
+        console_error("Too many servos for the arm scheduler.\n");
+        return -1;
+    }
+    // servos_init() only checks the slices within one arm
+    bool conflict = false;
+    for(uint8_t a = 0; a < scheduler->number; a++) {
+        robotic_arm* other = scheduler->arms[a].robot;
+        for(uint8_t i = 0; i < robot->number; i++) {
+            for(uint8_t j = 0; j < other->number; j++) {
+                if(pwm_gpio_to_slice_num(robot->servos[i].pin) == pwm_gpio_to_slice_num(other->servos[j].pin)
+                   && robot->servos[i].period != other->servos[j].period) {
+                    console_error("Servos on pins %u and %u of arms %d and %d share PWM slice %u with different periods.\n",
+                            other->servos[j].pin, robot->servos[i].pin, a, scheduler->number,
+                            pwm_gpio_to_slice_num(robot->servos[i].pin));
+                    conflict = true;
+                }
+            }
+        }
+    }
+    if(conflict)
+        return -1;
+    arm_channel* arm = &scheduler->arms[scheduler->number];
+    memset(arm, 0, sizeof(arm_channel));
+    arm->robot = robot;
+    arm->feed = scheduler->feed_percent * SERVO_BANK_FEED_ONE / 100;
+    arm->stop_acceleration = ARM_SCHEDULER_STOP_ACCELERATION;
+    arm_channel_publish(arm, true);
+    // Ticks follow the fastest servo of all arms
+    for(uint8_t i = 0; i < robot->number; i++) {
+        if(!scheduler->tick_us || robot->servos[i].period < scheduler->tick_us)
+            scheduler->tick_us = robot->servos[i].period;
+    }
+    return scheduler->number++;
+}
+
+/**
+ * Finish the moves of an arm on measured arrival instead of on their last tick.
+ * Moves ending at rest then wait until every servo with feedback is within tolerance of its target.
+ *
+ * @param scheduler: Scheduler of the arm
+ * @param arm: Arm id
+ * @param feedback: Started feedback of the servos of the arm, NULL to finish on the last tick again
+ * @return False if arm is invalid
+ */
+bool arm_scheduler_set_feedback(arm_scheduler* scheduler, uint8_t arm, servo_feedback* feedback) {
+    if(arm >= scheduler->number) {
+        console_error("Invalid arm id %d.\n", arm);
+        return false;
+    }
+    scheduler->arms[arm].feedback = feedback;
+    return true;
+}
+
+/**
+ * Set the deceleration of an arm in an emergency stop with ARM_STOP_DECELERATE.
+ * The feed ramps down so the fastest servo of the move in progress, at the peak speed of its
+ * profile, slows down by acceleration; the easing of the profile itself may add to it.
+ *
+ * @param scheduler: Scheduler of the arm
+ * @param arm: Arm id
+ * @param acceleration: Deceleration in degrees per second squared, ARM_SCHEDULER_STOP_ACCELERATION by default
+ * @return False if arm is invalid or acceleration is not positive
+ */
+bool arm_scheduler_set_stop_acceleration(arm_scheduler* scheduler, uint8_t arm, float acceleration) {
+    if(arm >= scheduler->number) {
+        console_error("Invalid arm id %d.\n", arm);
+        return false;
+    }
+    if(!(acceleration > 0.0f)) {
+        console_error("Stop acceleration must be positive.\n");
+        return false;
+    }
+    scheduler->arms[arm].stop_acceleration = acceleration;
+    return true;
+}
+
+/**
+ * Start the repeating timer raising ticks.
+ *
+ * @param scheduler: Scheduler to start
+ * @return False if no timer is available
+ */
+bool arm_scheduler_start(arm_scheduler* scheduler) {
+    scheduler->pending_ticks = 0;
+    // Negative delay keeps ticks evenly spaced regardless of callback time
+    return add_repeating_timer_us(-(int64_t)scheduler->tick_us, arm_scheduler_timer_callback,
+                                  scheduler, &scheduler->timer);
+}
+
+/**
+ * Stop the repeating timer raising ticks.
+ *
+ * @param scheduler: Scheduler to stop
+ */
+void arm_scheduler_stop(arm_scheduler* scheduler) {
+    cancel_repeating_timer(&scheduler->timer);
+}
+
+/**
+ * Set the feed rate override of all arms, moves in progress included.
+ * The remaining moves are scaled in time, the speed of every arm ramps to the new
+ * override by at most ARM_SCHEDULER_FEED_RAMP per tick and never passes the max_speed of a servo.
+ *
+ * @param scheduler: Scheduler to set
+ * @param percent: Speed in percent of the planned speed, ARM_SCHEDULER_FEED_MIN to ARM_SCHEDULER_FEED_MAX
+ * @return False if percent is out of range
+ */
+bool arm_scheduler_set_feed(arm_scheduler* scheduler, uint percent) {
+    if(percent < ARM_SCHEDULER_FEED_MIN || percent > ARM_SCHEDULER_FEED_MAX) {
+        console_error("Feed rate override out of range.\n");
+        return false;
+    }
+    scheduler->feed_percent = percent;
+    return true;
+}
+
+/**
+ * Request an emergency stop of all arms, safe from interrupts.
+ * A hold freezes the PWM levels before returning, whatever the main loop is doing.
+ * The next tick preempts every move in progress and drops all queued commands.
+ *
+ * @param scheduler: Scheduler to stop
+ * @param mode: ARM_STOP_HOLD or ARM_STOP_DECELERATE
+ */
+void arm_scheduler_emergency_stop(arm_scheduler* scheduler, arm_stop_mode mode) {
+    // The menu and the stop input may request at the same time
+    uint32_t interrupts = save_and_disable_interrupts();
+    if(mode > scheduler->stop_mode) {
+        if(scheduler->stop_mode == ARM_STOP_NONE)
+            scheduler->stop_request_us = time_us_64();
+        scheduler->stop_mode = mode;
+    }
+    restore_interrupts(interrupts);
+}
+
+/**
+ * GPIO interrupt callback of the emergency stop input.
+ *
+ * @param gpio: GPIO raising the interrupt
+ * @param events: Events of the GPIO
+ */
+static void arm_scheduler_stop_input_callback(uint gpio, uint32_t events) {
+    if(stop_input_scheduler && gpio == stop_input_gpio && (events & GPIO_IRQ_EDGE_FALL))
+        arm_scheduler_emergency_stop(stop_input_scheduler, ARM_STOP_HOLD);
+}
+
+/**
+ * Request an emergency stop holding all arms when a GPIO is pulled low, from its interrupt.
+ * Only one scheduler can have a stop input.
+ *
+ * @param scheduler: Scheduler to stop
+ * @param gpio: Input of the stop button, pulled up, the button pulls it low
+ */
+void arm_scheduler_set_stop_input(arm_scheduler* scheduler, uint gpio) {
+    stop_input_scheduler = scheduler;
+    stop_input_gpio = gpio;
+    gpio_init(gpio);
+    gpio_set_dir(gpio, GPIO_IN);
+    gpio_pull_up(gpio);
+    gpio_set_irq_enabled_with_callback(gpio, GPIO_IRQ_EDGE_FALL, true, arm_scheduler_stop_input_callback);
+    // A button pressed before the interrupt was enabled stops at once
+    sleep_us(10);
+    if(!gpio_get(gpio))
+        arm_scheduler_emergency_stop(scheduler, ARM_STOP_HOLD);
+}
+
+/**
+ * Accept commands again after an emergency stop.
+ *
+ * @param scheduler: Scheduler to release
+ * @return False if the arms are still stopping or no stop was requested
+ */
+bool arm_scheduler_release_stop(arm_scheduler* scheduler) {
+    if(scheduler->stop_mode == ARM_STOP_NONE) {
+        console_error("No emergency stop to release.\n");
+        return false;
+    }
+    if(!scheduler->stopped) {
+        console_error("Arms are still stopping.\n");
+        return false;
+    }
+    if(stop_input_scheduler == scheduler && !gpio_get(stop_input_gpio)) {
+        console_error("Emergency stop input is still pulled low.\n");
+        return false;
+    }
+    // Decelerated arms stopped at zero feed, the next moves start at the override
+    for(uint8_t i = 0; i < scheduler->number; i++)
+        scheduler->arms[i].feed = scheduler->feed_percent * SERVO_BANK_FEED_ONE / 100;
+    scheduler->preempted = false;
+    scheduler->stopped = false;
+    scheduler->stop_mode = ARM_STOP_NONE;
+    return true;
+}
+
+/**
+ * Queue a control signal for an arm.
+ *
+ * @param scheduler: Scheduler to queue
+ * @param arm: Arm id
+ * @param signal: Control signal, copied into the queue
+ * @return False if arm or signal is invalid, the queue is full or the arms are stopped
+ */
+bool arm_scheduler_submit(arm_scheduler* scheduler, uint8_t arm, robotic_arm_signal* signal) {
+    if(arm >= scheduler->number) {
+        console_error("Invalid arm id %d.\n", arm);
+        return false;
+    }
+    if(scheduler->stop_mode) {
+        console_error("Arms are stopped, release the emergency stop first.\n");
+        return false;
+    }
+    arm_channel* channel = &scheduler->arms[arm];
+    if(signal->number < 1 || signal->number > channel->robot->number) {
+        console_error("Invalid number of servos for arm %d.\n", arm);
+        return false;
+    }
+    for(uint8_t i = 0; i < signal->number; i++) {
+        if(signal->indexes[i] >= channel->robot->number) {
+            console_error("Index out of range for arm %d.\n", arm);
+            return false;
+        }
+    }
+    if(channel->count == ARM_SCHEDULER_QUEUE_SIZE) {
+        console_error("Command queue of arm %d is full.\n", arm);
+        return false;
+    }
+    arm_command* command = &channel->queue[(channel->head + channel->count) % ARM_SCHEDULER_QUEUE_SIZE];
+    command->number = signal->number;
+    memcpy(command->indexes, signal->indexes, signal->number * sizeof(uint8_t));
+    memcpy(command->angles, signal->angles, signal->number * sizeof(float));
+    command->options = signal->options;
+    channel->count++;
+    return true;
+}
+
+/**
+ * Queue a control signal from text.
+ *
+ * @param scheduler: Scheduler to queue
+ * @param str: Control signal string "[@arm] number index angle index angle ... [options]",
+ *             arm 0 if "@arm" is omitted
+ * @return False if the string is invalid or the queue is full
+ */
+bool arm_scheduler_submit_string(arm_scheduler* scheduler, char* str) {
+    uint8_t indexes[SERVO_BANK_MAX_CHANNELS];
+    float angles[SERVO_BANK_MAX_CHANNELS];
+    robotic_arm_signal signal = {
+        .indexes = indexes,
+        .angles = angles,
+        .number = 0
+    };
+    uint8_t arm = 0;
+    if(*str == '@') {
+        char* endptr;
+        unsigned long id = strtoul(str + 1, &endptr, 10);
+        if(endptr == str + 1 || *endptr != ' ' || id >= ARM_SCHEDULER_MAX_ARMS) {
+            console_error("Invalid arm id in signal string.\n");
+            return false;
+        }
+        arm = id;
+        str = endptr + 1;
+    }
+    if(!robotic_arm_signal_from_string(&signal, str, SERVO_BANK_MAX_CHANNELS))
+        return false;
+    return arm_scheduler_submit(scheduler, arm, &signal);
+}
+
+/**
+ * Queue a control signal from a binary frame.
+ * Frame: arm (uint8_t), number (uint8_t), number times index (uint8_t) and
+ * angle (uint16_t, hundredths of degree), duration_ms (uint16_t) and profile (uint8_t),
+ * multi-byte fields little-endian.
+ *
+ * @param scheduler: Scheduler to queue
+ * @param frame: Frame to parse
+ * @param length: Length of frame in bytes
+ * @return False if the frame is invalid or the queue is full
+ */
+bool arm_scheduler_submit_binary(arm_scheduler* scheduler, const uint8_t* frame, uint length) {
+    uint8_t indexes[SERVO_BANK_MAX_CHANNELS];
+    float angles[SERVO_BANK_MAX_CHANNELS];
+    robotic_arm_signal signal = {
+        .indexes = indexes,
+        .angles = angles,
+        .number = 0
+    };
+    if(length < 2 || frame[1] > SERVO_BANK_MAX_CHANNELS || length != 2 + frame[1] * 3u + 3) {
+        console_error("Invalid binary command frame.\n");
+        return false;
+    }
+    signal.number = frame[1];
+    const uint8_t* field = &frame[2];
+    for(uint8_t i = 0; i < signal.number; i++, field += 3) {
+        indexes[i] = field[0];
+        angles[i] = trajectory_pack_decode_angle(field[1] | field[2] << 8);
+    }
+    signal.options.duration_ms = field[0] | field[1] << 8;
+    signal.options.profile = field[2];
+    if(signal.options.profile > MOTION_PROFILE_SPLINE) {
+        console_error("Invalid profile in binary command frame.\n");
+        return false;
+    }
+    return arm_scheduler_submit(scheduler, frame[0], &signal);
+}
+
+/**
+ * Plan the spline segment of the head command of an arm.
+ * The slope at the end of the segment follows the next queued spline keyframe (Catmull-Rom),
+ * so streamed keyframes join without stopping. Without one the arm arrives at rest.
+ *
+ * @param arm: Arm with the head command planned into its bank
+ */
+static void arm_channel_plan_spline(arm_channel* arm) {
+    arm_command* command = &arm->queue[arm->head];
+    arm_command* next = arm->count > 1 ? &arm->queue[(arm->head + 1) % ARM_SCHEDULER_QUEUE_SIZE] : NULL;
+    // Keyframes need a duration to place the next one in time
+    if(next && (next->options.profile != MOTION_PROFILE_SPLINE || !next->options.duration_ms))
+        next = NULL;
+    uint64_t interval_us = (uint64_t)arm->bank.steps * arm->bank.tick_us
+                           + (next ? next->options.duration_ms * 1000ull : 0);
+    float tick_s = arm->bank.tick_us / 1e6f;
+    float start_slopes[SERVO_BANK_MAX_CHANNELS];
+    float end_slopes[SERVO_BANK_MAX_CHANNELS];
+    for(uint8_t i = 0; i < command->number; i++) {
+        start_slopes[i] = arm->slopes[command->indexes[i]] * tick_s;
+        end_slopes[i] = 0.0f;
+        for(uint8_t j = 0; next && j < next->number; j++) {
+            if(next->indexes[j] == command->indexes[i])
+                end_slopes[i] = servo_spline_slope(arm->bank.start_levels[i],
+                                                   servo_angle_to_level(arm->motors[i], next->angles[j]), interval_us);
+        }
+    }
+    // Servos left out of the segment stand still at its end
+    memset(arm->slopes, 0, sizeof(arm->slopes));
+    for(uint8_t i = 0; i < command->number; i++) {
+        arm->slopes[command->indexes[i]] = end_slopes[i];
+        end_slopes[i] *= tick_s;
+    }
+    servo_spline_plan(&arm->spline, &arm->bank, start_slopes, end_slopes);
+}
+
+/**
+ * Plan the feed decrease per tick of the head command of an arm in an emergency stop.
+ * Servo speeds scale with the feed, so the decrease follows from stop_acceleration and the
+ * peak speed of the fastest servo at full feed: its profile peak, or a joined spline slope if faster.
+ *
+ * @param arm: Arm with the head command planned into its bank
+ */
+static void arm_channel_plan_stop(arm_channel* arm) {
+    arm_command* command = &arm->queue[arm->head];
+    float tick_s = arm->bank.tick_us / 1e6f;
+    float duration_s = arm->bank.steps * tick_s;
+    float peak_factor = motion_profile_peak_factor(arm->bank.profile);
+    float peak_speed = 0.0f;
+    for(uint8_t i = 0; i < arm->bank.number; i++) {
+        float speed = duration_s > 0.0f ? peak_factor * abs(arm->bank.level_deltas[i]) / duration_s : 0.0f;
+        if(fabsf(arm->slopes[command->indexes[i]]) > speed)
+            speed = fabsf(arm->slopes[command->indexes[i]]);
+        speed /= fabsf(arm->bank.levels_per_degree[i]);
+        if(speed > peak_speed)
+            peak_speed = speed;
+    }
+    // A move this short or still stops within one tick from any feed
+    float ramp = SERVO_BANK_FEED_ONE * ARM_SCHEDULER_FEED_MAX / 100;
+    if(arm->stop_acceleration * tick_s < peak_speed * ARM_SCHEDULER_FEED_MAX / 100)
+        ramp = arm->stop_acceleration * tick_s / peak_speed * SERVO_BANK_FEED_ONE;
+    arm->stop_ramp = ramp >= 1.0f ? (uint)ramp : 1;
+}
+
+/**
+ * Start the head command of an idle arm.
+ *
+ * @param arm: Arm to start
+ * @param now_us: Start time of the tick, the first tick of the move runs in it
+ */
+static void arm_channel_start(arm_channel* arm, uint64_t now_us) {
+    arm_command* command = &arm->queue[arm->head];
+    SERVOS_PICK(arm->motors, arm->robot->servos, command->indexes, command->number);
+    if(!servos_smooth_plan(&arm->bank, command->number, arm->motors, command->angles, &command->options)) {
+        // Drop commands that cannot be planned
+        arm->head = (arm->head + 1) % ARM_SCHEDULER_QUEUE_SIZE;
+        arm->count--;
+        return;
+    }
+    // Only a spline keyframe joined to the previous one starts moving, any other move starts at rest
+    bool joined = false;
+    for(uint8_t i = 0; command->options.profile == MOTION_PROFILE_SPLINE && i < command->number; i++)
+        joined |= arm->slopes[command->indexes[i]] != 0.0f;
+    // A move from rest starts within the max_speed of its servos, whatever feed the last move ended with
+    if(!joined && arm->feed > arm->bank.feed_limit * SERVO_BANK_FEED_ONE)
+        arm->feed = (uint)(arm->bank.feed_limit * SERVO_BANK_FEED_ONE);
+    if(command->options.profile == MOTION_PROFILE_SPLINE)
+        arm_channel_plan_spline(arm);
+    else
+        memset(arm->slopes, 0, sizeof(arm->slopes));
+    arm_channel_plan_stop(arm);
+    arm->moving = true;
+    arm->next_tick_us = now_us;
+    arm_channel_publish(arm, true);
+}
+
+/**
+ * Remove the move in progress from the queue of an arm.
+ *
+ * @param arm: Arm to finish
+ */
+static void arm_channel_finish(arm_channel* arm) {
+    arm->head = (arm->head + 1) % ARM_SCHEDULER_QUEUE_SIZE;
+    arm->count--;
+    arm->moving = false;
+    arm->settling = false;
+    arm_channel_publish(arm, true);
+}
+
+/**
+ * Ramp the feed of a moving arm towards the feed override, within the max_speed of the servos of its move.
+ * The speed changes by at most ARM_SCHEDULER_FEED_RAMP per tick, so it never jumps, even when a
+ * spline keyframe flows into the next one.
+ *
+ * @param arm: Arm to ramp
+ * @param percent: Feed rate override in percent of the planned speed
+ */
+static void arm_channel_ramp_feed(arm_channel* arm, uint percent) {
+    float target = percent / 100.0f;
+    if(target > arm->bank.feed_limit)
+        target = arm->bank.feed_limit;
+    uint feed = (uint)(target * SERVO_BANK_FEED_ONE);
+    if(feed > arm->feed + ARM_SCHEDULER_FEED_RAMP)
+        feed = arm->feed + ARM_SCHEDULER_FEED_RAMP;
+    else if(feed + ARM_SCHEDULER_FEED_RAMP < arm->feed)
+        feed = arm->feed - ARM_SCHEDULER_FEED_RAMP;
+    arm->feed = feed;
+}
+
+/**
+ * Advance the move of an arm by one tick at its feed.
+ * After its last tick the move finishes, or settles if the arm has feedback and the move ends at rest;
+ * a spline keyframe flowing into the next one never waits for arrival.
+ *
+ * @param scheduler: Scheduler of the arm
+ * @param arm: Arm to advance
+ */
+static void arm_channel_advance(arm_scheduler* scheduler, arm_channel* arm) {
+    arm_command* command = &arm->queue[arm->head];
+    int32_t written[SERVO_BANK_MAX_CHANNELS];
+    memcpy(written, arm->bank.levels, arm->bank.number * sizeof(written[0]));
+    bool moving = arm->bank.profile == MOTION_PROFILE_SPLINE ? servo_spline_feed(&arm->spline, &arm->bank, arm->feed)
+                                                             : servos_smooth_feed(&arm->bank, arm->feed);
+    if(arm->dry_levels) {
+        for(uint8_t i = 0; i < command->number; i++)
+            arm->dry_levels[command->indexes[i]] = arm->bank.levels[i];
+    } else {
+        // A hold requested from an interrupt during the tick freezes the levels at once: the new levels
+        // are dropped, so the bank keeps the levels on the pins, and the next tick halts the arm there
+        uint32_t interrupts = save_and_disable_interrupts();
+        if(scheduler->stop_mode == ARM_STOP_HOLD) {
+            restore_interrupts(interrupts);
+            memcpy(arm->bank.levels, written, arm->bank.number * sizeof(written[0]));
+            return;
+        }
+        servo_bank_write(&arm->bank);
+        restore_interrupts(interrupts);
+    }
+    if(moving) {
+        arm->next_tick_us += arm->bank.tick_us;
+        arm_channel_publish(arm, false);
+        return;
+    }
+    servos_smooth_finish(command->number, arm->motors, command->angles);
+    if(arm->feedback) {
+        arm->settling = true;
+        for(uint8_t i = 0; i < command->number; i++) {
+            if(arm->slopes[command->indexes[i]] != 0.0f)
+                arm->settling = false;
+        }
+        if(arm->settling) {
+            arm->settle_start_us = time_us_64();
+            arm_channel_publish(arm, true);
+            return;
+        }
+    }
+    arm_channel_finish(arm);
+}
+
+/**
+ * Stop the move in progress of an arm where it is, the servos keep the levels written last.
+ *
+ * @param arm: Moving arm
+ */
+static void arm_channel_halt(arm_channel* arm) {
+    // A settling move already stored its targets
+    if(!arm->settling) {
+        for(uint8_t k = 0; k < arm->bank.number; k++)
+            arm->motors[k]->angle = servo_bank_angle(&arm->bank, k);
+    }
+    memset(arm->slopes, 0, sizeof(arm->slopes));
+    arm_channel_finish(arm);
+}
+
+/**
+ * Preempt all arms for an emergency stop: drop every queued command, moves in progress
+ * stay at the head of their queues until they stopped.
+ *
+ * @param scheduler: Scheduler to stop
+ * @param now_us: Time of the preempting tick
+ */
+static void arm_scheduler_preempt(arm_scheduler* scheduler, uint64_t now_us) {
+    scheduler->preempted = true;
+    scheduler->stops++;
+    scheduler->stop_latency_us = now_us - scheduler->stop_request_us;
+    if(scheduler->stop_latency_us > scheduler->max_stop_latency_us)
+        scheduler->max_stop_latency_us = scheduler->stop_latency_us;
+    for(uint8_t i = 0; i < scheduler->number; i++) {
+        arm_channel* arm = &scheduler->arms[i];
+        arm->count = arm->moving ? 1 : 0;
+    }
+}
+
+/**
+ * Finish the settling move of an arm once its servos arrived or the settle timeout passed.
+ *
+ * @param arm: Settling arm
+ * @param now_us: Current time
+ */
+static void arm_channel_settle(arm_channel* arm, uint64_t now_us) {
+    arm_command* command = &arm->queue[arm->head];
+    // Targets clamped to the bounds of the servos by servos_smooth_finish()
+    float angles[SERVO_BANK_MAX_CHANNELS];
+    for(uint8_t i = 0; i < command->number; i++)
+        angles[i] = arm->motors[i]->angle;
+    uint32_t elapsed_us = now_us - arm->settle_start_us;
+    if(servo_feedback_arrived(arm->feedback, command->number, command->indexes, angles)) {
+        arm->settled++;
+        if(elapsed_us > arm->max_settle_us)
+            arm->max_settle_us = elapsed_us;
+    } else if(elapsed_us < SERVO_FEEDBACK_SETTLE_TIMEOUT_US) {
+        return;
+    } else {
+        arm->settle_timeouts++;
+    }
+    arm_channel_finish(arm);
+}
+
+/**
+ * Run the ticks raised by the timer since the last call.
+ * Call often from the main loop.
+ *
+ * @param scheduler: Scheduler to run
+ */
+void arm_scheduler_poll(arm_scheduler* scheduler) {
+    if(!scheduler->pending_ticks)
+        return;
+    // The timer interrupt may raise a tick between reading and clearing
+    uint32_t interrupts = save_and_disable_interrupts();
+    uint pending = scheduler->pending_ticks;
+    scheduler->pending_ticks = 0;
+    restore_interrupts(interrupts);
+    // More than one pending tick means the loop fell behind the timer
+    scheduler->overruns += pending - 1;
+    arm_scheduler_tick(scheduler);
+}
+
+/**
+ * Run one tick: start queued commands of idle arms and advance every due move.
+ *
+ * @param scheduler: Scheduler to run
+ */
+void arm_scheduler_tick(arm_scheduler* scheduler) {
+    // Read before the time, a stop requested after it waits for the next tick
+    arm_stop_mode stop = scheduler->stop_mode;
+    uint64_t start_us = time_us_64();
+    arm_scheduler_tick_at(scheduler, stop, start_us);
+    uint32_t elapsed_us = time_us_64() - start_us;
+    PROFILER_LOOP_TIME(PROFILER_LOOP_TICK, elapsed_us);
+    // A tick longer than the period shows up as an overrun in the pending ticks of the next poll
+    if(elapsed_us > scheduler->max_tick_us)
+        scheduler->max_tick_us = elapsed_us;
+}
+
+/**
+ * Run one tick at a given time, arm_scheduler_tick() at the current time.
+ * Dry runs tick a private scheduler on their own clock.
+ *
+ * @param scheduler: Scheduler to run
+ * @param stop: Emergency stop mode read before start_us
+ * @param start_us: Time of the tick
+ */
+void arm_scheduler_tick_at(arm_scheduler* scheduler, arm_stop_mode stop, uint64_t start_us) {
+    uint channels = 0;
+    bool moving = false;
+    if(stop && !scheduler->preempted)
+        arm_scheduler_preempt(scheduler, start_us);
+    for(uint8_t i = 0; i < scheduler->number; i++) {
+        arm_channel* arm = &scheduler->arms[i];
+        if(arm->feedback)
+            servo_feedback_poll(arm->feedback);
+        if(arm->settling && stop)
+            arm_channel_finish(arm);
+        else if(arm->settling)
+            arm_channel_settle(arm, start_us);
+        if(!arm->moving && arm->count)
+            arm_channel_start(arm, start_us);
+        if(arm->moving && stop == ARM_STOP_HOLD) {
+            arm_channel_halt(arm);
+        } else if(arm->moving && !arm->settling && arm->next_tick_us <= start_us) {
+            channels += arm->bank.number;
+            if(stop)
+                arm->feed = arm->feed > arm->stop_ramp ? arm->feed - arm->stop_ramp : 0;
+            else
+                arm_channel_ramp_feed(arm, scheduler->feed_percent);
+            if(arm->feed) {
+                arm_channel_advance(scheduler, arm);
+                scheduler->write_us = time_us_64();
+            } else {
+                arm_channel_halt(arm);
+            }
+        }
+        moving |= arm->moving;
+    }
+    if(stop && !moving && !scheduler->stopped) {
+        scheduler->stopped = true;
+        scheduler->stop_time_us = time_us_64() - scheduler->stop_request_us;
+    }
+    if(channels > scheduler->channel_budget)
+        scheduler->budget_exceeded++;
+    scheduler->ticks++;
+}
+
+/**
+ * @param scheduler: Scheduler to check
+ * @return True if no arm is moving and all queues are empty
+ */
+bool arm_scheduler_idle(arm_scheduler* scheduler) {
+    for(uint8_t i = 0; i < scheduler->number; i++) {
+        if(scheduler->arms[i].count)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @param scheduler: Scheduler to check
+ * @param arm: Arm id
+ * @return Number of commands queued for arm, including the move in progress
+ */
+uint arm_scheduler_queue_depth(arm_scheduler* scheduler, uint8_t arm) {
+    return arm < scheduler->number ? scheduler->arms[arm].count : 0;
+}
+
+/**
+ * Copy the state of an arm published by the motion code, safe from any context.
+ *
+ * @param scheduler: Scheduler of the arm
+ * @param arm: Arm id
+ * @param state: Set to a consistent state of all servos and the move in progress
+ * @return False if arm is invalid or no consistent state could be copied
+ */
+bool arm_scheduler_snapshot(arm_scheduler* scheduler, uint8_t arm, arm_state* state) {
+    if(arm >= scheduler->number)
+        return false;
+    return arm_snapshot_read(&scheduler->arms[arm].snapshot, state);
+}
+
+/**
+ * Print queue depths and tick statistics of a scheduler.
+ *
+ * @param scheduler: Scheduler to print
+ */
+void arm_scheduler_print(arm_scheduler* scheduler) {
+    for(uint8_t i = 0; i < scheduler->number; i++) {
+        arm_channel* arm = &scheduler->arms[i];
+        console_printf("Arm %d: %s, %d queued, feed %d%%\n", i,
+                       arm->settling ? "settling" : arm->moving ? "moving" : "idle", arm->count, arm->state.feed);
+    }
+    console_printf("Feed rate override: %d%%\n", scheduler->feed_percent);
+    if(scheduler->stops)
+        console_printf("Emergency stops: %d%s, latency last %lu us, longest %lu us, at rest after %lu us\n",
+                       scheduler->stops, scheduler->stop_mode ? " (stopped)" : "",
+                       (unsigned long)scheduler->stop_latency_us, (unsigned long)scheduler->max_stop_latency_us,
+                       (unsigned long)scheduler->stop_time_us);
+    for(uint8_t i = 0; i < scheduler->number; i++) {
+        arm_channel* arm = &scheduler->arms[i];
+        if(arm->feedback)
+            console_printf("Feedback of arm %d: %d settled, %d timed out, longest settle %lu us\n", i, arm->settled,
+                           arm->settle_timeouts, (unsigned long)arm->max_settle_us);
+    }
+    console_printf("Ticks: %d every %d us, longest %lu us\n", scheduler->ticks, scheduler->tick_us,
+           (unsigned long)scheduler->max_tick_us);
+    console_printf("Tick overruns: %d, channel budget (%d) exceeded: %d\n", scheduler->overruns,
+           scheduler->channel_budget, scheduler->budget_exceeded);
+}
@@ -0,0 +1,52 @@
+#include "arm_snapshot.h"
+#include <string.h>
+
+
+/**
+ * Initialize a snapshot with a first state.
+ *
+ * @param snapshot: Snapshot to initialize
+ * @param state: First state
+ */
+void arm_snapshot_init(arm_snapshot* snapshot, const arm_state* state) {
+    memcpy(&snapshot->slots[0], state, sizeof(arm_state));
+    memcpy(&snapshot->slots[1], state, sizeof(arm_state));
+    atomic_store_explicit(&snapshot->sequence, 0, memory_order_release);
+}
+
+/**
+ * Publish a new state, never waits. Only one writer may publish to a snapshot.
+ *
+ * @param snapshot: Snapshot to publish to
+ * @param state: State to copy
+ */
+void arm_snapshot_publish(arm_snapshot* snapshot, const arm_state* state) {
+    uint sequence = atomic_load_explicit(&snapshot->sequence, memory_order_relaxed);
+    // Readers move to slot 1 before slot 0 changes
+    atomic_store_explicit(&snapshot->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(&snapshot->slots[0], state, sizeof(arm_state));
+    // Readers move back to slot 0, complete now, before slot 1 changes
+    atomic_store_explicit(&snapshot->sequence, sequence + 2, memory_order_release);
+    atomic_thread_fence(memory_order_release);
+    memcpy(&snapshot->slots[1], state, sizeof(arm_state));
+}
+
+/**
+ * Copy the last complete state, never blocks the writer.
+ *
+ * @param snapshot: Snapshot to read
+ * @param state: Set to the state
+ * @return False if the writer published during every one of ARM_SNAPSHOT_READ_TRIES copies
+ */
+bool arm_snapshot_read(const arm_snapshot* snapshot, arm_state* state) {
+    for(uint tries = 0; tries < ARM_SNAPSHOT_READ_TRIES; tries++) {
+        uint sequence = atomic_load_explicit(&snapshot->sequence, memory_order_acquire);
+        memcpy(state, &snapshot->slots[sequence & 1], sizeof(arm_state));
+        atomic_thread_fence(memory_order_acquire);
+        // The slot copied was not written while the sequence stayed the same
+        if(atomic_load_explicit(&snapshot->sequence, memory_order_relaxed) == sequence)
+            return true;
+    }
+    return false;
+}
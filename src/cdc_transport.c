@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "cdc_transport.h"
+#include "tusb.h"
+#include <string.h>
+
+// Ring buffer of received bytes, indexes run freely and wrap on the power of two size
+static uint8_t rx_buffer[CDC_TRANSPORT_RX_SIZE];
+static uint rx_head;
+static uint rx_tail;
+static cdc_transport_stats stats;
+
+_Static_assert((CDC_TRANSPORT_RX_SIZE & (CDC_TRANSPORT_RX_SIZE - 1)) == 0, "CDC_TRANSPORT_RX_SIZE must be a power of two");
+
+
+/**
+ * Move the bytes waiting in the CDC FIFO into the ring buffer, never blocks.
+ *
+ * @return Number of bytes moved
+ */
+uint cdc_transport_fill(void) {
+    uint moved = 0;
+    while(true) {
+        uint space = CDC_TRANSPORT_RX_SIZE - (rx_tail - rx_head);
+        uint waiting = tud_cdc_available();
+        if(!space || !waiting)
+            break;
+        // One contiguous block up to the end of the buffer
+        uint offset = rx_tail % CDC_TRANSPORT_RX_SIZE;
+        uint block = CDC_TRANSPORT_RX_SIZE - offset;
+        if(block > space)
+            block = space;
+        if(block > waiting)
+            block = waiting;
+        if(block > CDC_TRANSPORT_BLOCK)
+            block = CDC_TRANSPORT_BLOCK;
+        block = tud_cdc_read(&rx_buffer[offset], block);
+        if(!block)
+            break;
+        rx_tail += block;
+        moved += block;
+        stats.reads++;
+    }
+    stats.received += moved;
+    return moved;
+}
+
+/**
+ * @return Number of received bytes in the ring buffer
+ */
+uint cdc_transport_available(void) {
+    return rx_tail - rx_head;
+}
+
+/**
+ * Take the next received byte, filling the ring buffer when it is empty.
+ *
+ * @return Byte, PICO_ERROR_TIMEOUT if no input is available
+ */
+int cdc_transport_getc(void) {
+    if(rx_head == rx_tail && !cdc_transport_fill())
+        return PICO_ERROR_TIMEOUT;
+    return rx_buffer[rx_head++ % CDC_TRANSPORT_RX_SIZE];
+}
+
+/**
+ * Copy received bytes out of the ring buffer, filling it first.
+ *
+ * @param buffer: Buffer to copy to
+ * @param size: Size of the buffer
+ * @return Number of bytes copied, 0 if no input is available
+ */
+uint cdc_transport_read(uint8_t* buffer, uint size) {
+    cdc_transport_fill();
+    uint copied = 0;
+    while(copied < size && rx_head != rx_tail) {
+        uint offset = rx_head % CDC_TRANSPORT_RX_SIZE;
+        uint chunk = CDC_TRANSPORT_RX_SIZE - offset;
+        if(chunk > rx_tail - rx_head)
+            chunk = rx_tail - rx_head;
+        if(chunk > size - copied)
+            chunk = size - copied;
+        memcpy(&buffer[copied], &rx_buffer[offset], chunk);
+        rx_head += chunk;
+        copied += chunk;
+    }
+    return copied;
+}
+
+/**
+ * Send a frame as a whole or not at all, never blocks.
+ *
+ * @param frame: Frame to send
+ * @param length: Length of the frame
+ * @return False if the link is down or the CDC FIFO has no room for the frame
+ */
+bool cdc_transport_write_frame(const void* frame, uint length) {
+    if(!tud_cdc_connected() || tud_cdc_write_available() < length) {
+        stats.dropped++;
+        return false;
+    }
+    tud_cdc_write(frame, length);
+    tud_cdc_write_flush();
+    stats.sent += length;
+    return true;
+}
+
+/**
+ * @return Counters of the transport
+ */
+const cdc_transport_stats* cdc_transport_get_stats(void) {
+    return &stats;
+}
@@ -0,0 +1,319 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include "pico/stdlib.h"
+#include "console.h"
+#include "tusb.h"
+#include <string.h>
+
+// Ring buffer of text waiting for the USB link
+static char console_buffer[CONSOLE_BUFFER_SIZE];
+static uint console_head;
+static uint console_count;
+static uint console_lost_count;
+
+static const uint32_t powers_of_ten[] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+
+
+/**
+ * Format an unsigned integer in decimal.
+ *
+ * @param buffer: Buffer of at least 10 characters, not terminated
+ * @param value: Value to format
+ * @return Number of characters written
+ */
+int console_format_uint(char* buffer, uint32_t value) {
+    char digits[10];
+    int number = 0;
+    do {
+        digits[number++] = '0' + value % 10;
+        value /= 10;
+    } while(value);
+    for(int i = 0; i < number; i++)
+        buffer[i] = digits[number - 1 - i];
+    return number;
+}
+
+/**
+ * Format an unsigned long in decimal, 64 bits wide on the host.
+ *
+ * @param buffer: Buffer of at least 20 characters, not terminated
+ * @param value: Value to format
+ * @return Number of characters written
+ */
+static int console_format_ulong(char* buffer, unsigned long value) {
+    if((uint32_t)value == value)
+        return console_format_uint(buffer, value);
+    // Only a 64-bit long gets here: the high digits, then the low 9 digits with leading zeros
+    int length = console_format_ulong(buffer, value / 1000000000);
+    uint32_t low = value % 1000000000;
+    for(int i = 8; i >= 0; i--) {
+        buffer[length + i] = '0' + low % 10;
+        low /= 10;
+    }
+    return length + 9;
+}
+
+/**
+ * Format the integer and fraction parts of a fixed-point magnitude.
+ *
+ * @param buffer: Buffer to write
+ * @param negative: True to write a minus sign
+ * @param integer: Integer part
+ * @param fraction: Fraction part in units of 10^-decimals
+ * @param decimals: Number of decimals
+ * @return Number of characters written
+ */
+static int console_format_parts(char* buffer, bool negative, uint32_t integer, uint32_t fraction, uint decimals) {
+    int length = 0;
+    if(negative)
+        buffer[length++] = '-';
+    length += console_format_uint(&buffer[length], integer);
+    if(!decimals)
+        return length;
+    buffer[length++] = '.';
+    for(uint i = decimals; i; i--) {
+        buffer[length + i - 1] = '0' + fraction % 10;
+        fraction /= 10;
+    }
+    return length + decimals;
+}
+
+/**
+ * Format a fixed-point number, value / 10^decimals, without floating point.
+ *
+ * @param buffer: Buffer of at least 12 characters, not terminated
+ * @param value: Value in units of 10^-decimals
+ * @param decimals: Number of decimals, at most 6
+ * @return Number of characters written
+ */
+int console_format_fixed(char* buffer, int32_t value, uint decimals) {
+    if(decimals > 6)
+        decimals = 6;
+    uint32_t magnitude = value < 0 ? -(uint32_t)value : (uint32_t)value;
+    uint32_t scale = powers_of_ten[decimals];
+    return console_format_parts(buffer, value < 0, magnitude / scale, magnitude % scale, decimals);
+}
+
+/**
+ * Format a float with a fixed number of decimals, like "%.2f".
+ * Uses one float multiply instead of the soft-float printf path.
+ *
+ * @param buffer: Buffer of at least 20 characters, not terminated
+ * @param value: Value to format
+ * @param decimals: Number of decimals, at most 6
+ * @return Number of characters written
+ */
+int console_format_float(char* buffer, float value, uint decimals) {
+    if(value != value) {
+        memcpy(buffer, "nan", 3);
+        return 3;
+    }
+    if(decimals > 6)
+        decimals = 6;
+    bool negative = value < 0.0f;
+    float magnitude = negative ? -value : value;
+    if(magnitude >= 4294967296.0f) {
+        memcpy(buffer, negative ? "-inf" : "inf", 3 + negative);
+        return 3 + negative;
+    }
+    uint32_t scale = powers_of_ten[decimals];
+    uint32_t integer = (uint32_t)magnitude;
+    uint32_t fraction = (uint32_t)((magnitude - integer) * scale + 0.5f);
+    // Rounding the fraction up carries into the integer part
+    if(fraction >= scale) {
+        fraction -= scale;
+        integer++;
+    }
+    // No minus sign for values that round to zero
+    return console_format_parts(buffer, negative && (integer || fraction), integer, fraction, decimals);
+}
+
+#ifndef CONSOLE_DIRECT_STDIO
+/**
+ * Wait until the ring buffer has room or the USB link gives up.
+ *
+ * @return False if the USB link is not connected or did not take text in time
+ */
+static bool console_wait(void) {
+    uint64_t time_end = time_us_64() + CONSOLE_WAIT_US;
+    while(console_count == CONSOLE_BUFFER_SIZE) {
+        if(!tud_cdc_connected() || time_us_64() > time_end)
+            return false;
+        console_flush();
+    }
+    return true;
+}
+#endif
+
+/**
+ * Queue characters for the console.
+ *
+ * @param data: Characters to queue
+ * @param length: Number of characters
+ */
+void console_write(const char* data, uint length) {
+#ifdef CONSOLE_DIRECT_STDIO
+    // Unbuffered blocking output, to compare latencies with the ring buffer
+    fwrite(data, 1, length, stdout);
+#else
+    while(length) {
+        if(console_count == CONSOLE_BUFFER_SIZE && !console_wait()) {
+            console_lost_count += length;
+            return;
+        }
+        uint tail = (console_head + console_count) % CONSOLE_BUFFER_SIZE;
+        uint chunk = CONSOLE_BUFFER_SIZE - console_count;
+        if(chunk > CONSOLE_BUFFER_SIZE - tail)
+            chunk = CONSOLE_BUFFER_SIZE - tail;
+        if(chunk > length)
+            chunk = length;
+        memcpy(&console_buffer[tail], data, chunk);
+        console_count += chunk;
+        data += chunk;
+        length -= chunk;
+    }
+#endif
+}
+
+/**
+ * Queue formatted text for the console.
+ * Supports %d, %ld, %u, %lu, %x, %lx, %s, %c, %% and %f with an optional precision up to 6.
+ *
+ * @param format: Format string
+ */
+void console_printf(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    char field[24];
+    while(*format) {
+        const char* text = format;
+        while(*format && *format != '%')
+            format++;
+        if(format != text)
+            console_write(text, format - text);
+        if(!*format)
+            break;
+        format++;
+        uint decimals = 6;
+        if(*format == '.') {
+            decimals = 0;
+            while(*++format >= '0' && *format <= '9')
+                decimals = decimals * 10 + *format - '0';
+        }
+        bool is_long = *format == 'l';
+        if(is_long)
+            format++;
+        int length = 0;
+        switch(*format) {
+        case 'd': case 'i': {
+            long value = is_long ? va_arg(args, long) : va_arg(args, int);
+            unsigned long magnitude = value < 0 ? -(unsigned long)value : (unsigned long)value;
+            if(value < 0)
+                field[length++] = '-';
+            length += console_format_ulong(&field[length], magnitude);
+            break;
+        }
+        case 'u':
+            length = console_format_ulong(field, is_long ? va_arg(args, unsigned long) : va_arg(args, unsigned int));
+            break;
+        case 'x': {
+            unsigned long value = is_long ? va_arg(args, unsigned long) : va_arg(args, unsigned int);
+            char digits[2 * sizeof(unsigned long)];
+            int count = 0;
+            do {
+                digits[count++] = "0123456789abcdef"[value & 0xF];
+                value >>= 4;
+            } while(value);
+            while(count)
+                field[length++] = digits[--count];
+            break;
+        }
+        case 'f':
+            length = console_format_float(field, va_arg(args, double), decimals);
+            break;
+        case 'c':
+            field[length++] = va_arg(args, int);
+            break;
+        case 's': {
+            const char* str = va_arg(args, const char*);
+            if(!str)
+                str = "(null)";
+            console_write(str, strlen(str));
+            break;
+        }
+        case '%':
+            field[length++] = '%';
+            break;
+        case '\0':
+            va_end(args);
+            return;
+        default:
+            // Unsupported conversion, copied as is
+            field[length++] = '%';
+            field[length++] = *format;
+        }
+        console_write(field, length);
+        format++;
+    }
+    va_end(args);
+}
+
+/**
+ * Report an error on stderr after the queued console text.
+ * stderr shares the USB link with the console, so the queued text is sent first
+ * and both arrive in the order they were written. Not for interrupts.
+ *
+ * @param format: Format string of fprintf()
+ */
+void console_error(const char* format, ...) {
+    console_drain();
+    fflush(stdout);
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+/**
+ * Send as much queued text as the USB FIFO takes, never blocks.
+ * Call often from the main loop.
+ */
+void console_flush(void) {
+    if(!console_count || !tud_cdc_connected())
+        return;
+    uint sent = 0;
+    while(console_count) {
+        uint chunk = tud_cdc_write_available();
+        if(!chunk)
+            break;
+        if(chunk > console_count)
+            chunk = console_count;
+        if(chunk > CONSOLE_BUFFER_SIZE - console_head)
+            chunk = CONSOLE_BUFFER_SIZE - console_head;
+        chunk = tud_cdc_write(&console_buffer[console_head], chunk);
+        if(!chunk)
+            break;
+        console_head = (console_head + chunk) % CONSOLE_BUFFER_SIZE;
+        console_count -= chunk;
+        sent += chunk;
+    }
+    if(sent)
+        tud_cdc_write_flush();
+}
+
+/**
+ * Send all queued text, waiting at most CONSOLE_WAIT_US for the USB link.
+ * Call before writing to stdout directly.
+ */
+void console_drain(void) {
+    uint64_t time_end = time_us_64() + CONSOLE_WAIT_US;
+    while(console_count && tud_cdc_connected() && time_us_64() <= time_end)
+        console_flush();
+}
+
+/**
+ * @return Number of characters lost because the USB link did not keep up
+ */
+uint console_lost(void) {
+    return console_lost_count;
+}
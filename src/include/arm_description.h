@@ -0,0 +1,101 @@
+#ifndef ARM_DESCRIPTION_H
+#define ARM_DESCRIPTION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "struct_coordinate_system.h"
+#include "struct_position_required.h"
+
+/**
+ * Compile-time description of arm 0: pins, servo models, angle limits and links,
+ * written once as constexpr data in arm_description.cpp.
+ *
+ * The build turns it into a table of PWM settings computed for ARM_DESCRIPTION_CLOCK_HZ,
+ * the divider and wrap servo_init() would compute at run time, and into kinematics
+ * unrolled over the links with every length, offset and direction a constant.
+ * robotic_arm_start_description() starts an arm from the table; the runtime path,
+ * robotic_arm_starter() and cylindrical_to_robotic_arm_signal() with a position_required,
+ * stays for arms configured at run time.
+ */
+
+// System clock of the PWM settings, clk_sys of the Pico SDK at its default frequency
+#ifndef ARM_DESCRIPTION_CLOCK_HZ
+#define ARM_DESCRIPTION_CLOCK_HZ 125000000
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Settings of one servo computed by the build.
+ *
+ * @pin: GPIO pin of the servo (uint8_t)
+ * @slice: PWM slice of the pin (uint8_t)
+ * @divider: PWM clock divider in 1/16 steps, 8.4 fixed point (uint16_t)
+ * @wrap: PWM counts per period (uint16_t)
+ * @period: PWM period in microseconds (uint16_t)
+ * @min_duty: Pulse width at 0 degree in microseconds (uint16_t)
+ * @max_duty: Pulse width at angle_range in microseconds (uint16_t)
+ * @angle_range: Range of angle in degrees (float)
+ * @angle_lower_bound: Lowest angle allowed (float)
+ * @angle_upper_bound: Highest angle allowed (float)
+ * @max_speed: Speed limit in degrees per second, 0 for none (float)
+ * @angle: Angle at start (float)
+ */
+typedef struct arm_description_servo {
+    uint8_t pin;
+    uint8_t slice;
+    uint16_t divider;
+    uint16_t wrap;
+    uint16_t period;
+    uint16_t min_duty;
+    uint16_t max_duty;
+    float angle_range;
+    float angle_lower_bound;
+    float angle_upper_bound;
+    float max_speed;
+    float angle;
+} arm_description_servo;
+
+// Number of servos of the described arm
+extern const uint8_t arm_description_number;
+
+/**
+ * @return Settings of every servo of the described arm, arm_description_number entries
+ */
+const arm_description_servo* arm_description_servos(void);
+
+/**
+ * Set a position_required to the geometry of the description, for the runtime path.
+ *
+ * @param required Position required to set, its arrays point to constant data
+ */
+void arm_description_position_required(position_required* required);
+
+/**
+ * Solve the servo angles reaching a point, unrolled over the links of the description.
+ * Same solution as cylindrical_to_robotic_arm_signal(): links after the second one keep
+ * ROBOTIC_ARM_TOOL_ELEVATION and the elbow bends up.
+ *
+ * @param point Point to reach, angle in degrees, radius and height in mm
+ * @param indexes Set to the servo of every angle, the plane servo first
+ * @param angles Set to the target angles in degrees
+ * @return Number of angles set, 0 if the point is out of reach
+ */
+uint8_t arm_description_inverse(const cylindrical_point* point, uint8_t* indexes, float* angles);
+
+/**
+ * Position of the tip of the arm, unrolled over the links of the description.
+ *
+ * @param angles Angle of every servo in degrees
+ * @param point Set to the position of the tip
+ */
+void arm_description_forward(const float* angles, cylindrical_point* point);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // ARM_DESCRIPTION_H
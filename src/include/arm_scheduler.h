@@ -0,0 +1,345 @@
+#ifndef ARM_SCHEDULER_H
+#define ARM_SCHEDULER_H
+
+#include "pico/stdlib.h"
+#include "struct_robotic_arm.h"
+#include "servo_bank.h"
+#include "arm_snapshot.h"
+#include "servo_feedback.h"
+#include "servo_spline.h"
+
+// Maximum number of robotic arms in a scheduler
+#define ARM_SCHEDULER_MAX_ARMS 4
+
+// Number of commands each arm can queue
+#define ARM_SCHEDULER_QUEUE_SIZE 8
+
+// First byte of a binary command frame on the console, followed by length and frame
+#define ARM_SCHEDULER_FRAME_START 0xA5
+
+// Range of the feed rate override in percent of the planned speed
+#define ARM_SCHEDULER_FEED_MIN 10
+#define ARM_SCHEDULER_FEED_MAX 200
+
+// Largest change of the feed of an arm in one tick, the speed ramps to a new override
+#define ARM_SCHEDULER_FEED_RAMP (SERVO_BANK_FEED_ONE / 16)
+
+// Default deceleration of the fastest servo of an arm decelerating to an emergency stop (degrees per second squared)
+#define ARM_SCHEDULER_STOP_ACCELERATION 2000.0f
+
+// Reserved console byte outside binary frames: stop all arms where they are (CAN, Ctrl-X)
+#define ARM_SCHEDULER_STOP_HOLD_BYTE 0x18
+
+// Reserved console byte outside binary frames: stop all arms decelerating on their paths (ETX, Ctrl-C)
+#define ARM_SCHEDULER_STOP_DECELERATE_BYTE 0x03
+
+/**
+ * Emergency stop of all arms of a scheduler, stronger modes take over weaker ones.
+ */
+typedef enum arm_stop_mode {
+    ARM_STOP_NONE,          // Running
+    ARM_STOP_DECELERATE,    // Moves ramp their feed down at the stop acceleration of their arm, then stop
+    ARM_STOP_HOLD           // Moves stop at once, the servos keep the levels written last
+} arm_stop_mode;
+
+/**
+ * Control signal copied into a command queue.
+ *
+ * @number: Number of servos to move (uint8_t)
+ * @indexes: Indexes of servos to move (uint8_t[])
+ * @angles: Target angles (float[])
+ * @options: Duration, speed and profile of the move (motion_options)
+ */
+typedef struct arm_command {
+    uint8_t number;
+    uint8_t indexes[SERVO_BANK_MAX_CHANNELS];
+    float angles[SERVO_BANK_MAX_CHANNELS];
+    motion_options options;
+} arm_command;
+
+/**
+ * A robotic arm with its command queue and the move in progress.
+ *
+ * @robot: Robotic arm driven (robotic_arm*)
+ * @queue: Ring of queued commands, the head is the move in progress (arm_command[])
+ * @head: Index of the first command in queue (uint8_t)
+ * @count: Number of commands in queue (uint8_t)
+ * @moving: True if the head command is being executed (bool)
+ * @bank: Servo bank of the move in progress (servo_bank)
+ * @motors: Servos of the move in progress (servo*[])
+ * @next_tick_us: Time of the next tick of the move in progress (uint64_t)
+ * @spline: Segment of the move in progress if it is a spline keyframe (servo_spline)
+ * @slopes: Level changes per second of every servo at the end of the move in progress,
+ *          nonzero only if the next spline keyframe moves the servo on (float[])
+ * @feedback: Measured servo positions, NULL to finish moves on their last tick (servo_feedback*)
+ * @settling: True if the move in progress wrote its last tick and waits for the servos to arrive (bool)
+ * @settle_start_us: Time of the last tick of the settling move (uint64_t)
+ * @settled: Moves finished on measured arrival (uint)
+ * @settle_timeouts: Moves finished after SERVO_FEEDBACK_SETTLE_TIMEOUT_US without arrival (uint)
+ * @max_settle_us: Longest time from the last tick to measured arrival (uint32_t)
+ * @feed: Steps the move in progress advances per tick, ramped towards the feed override (uint)
+ * @stop_acceleration: Deceleration of the fastest servo in an emergency stop (degrees per second squared) (float)
+ * @stop_ramp: Feed decrease per tick of the move in progress decelerating at stop_acceleration (uint)
+ * @dry_levels: Levels of all servos of the arm written by a dry run instead of PWM, NULL to write PWM (uint16_t*)
+ * @state: State of the arm kept by the motion code, published to snapshot (arm_state)
+ * @snapshot: Consistent copies of state for readers, see arm_snapshot.h (arm_snapshot)
+ */
+typedef struct arm_channel {
+    robotic_arm* robot;
+    arm_command queue[ARM_SCHEDULER_QUEUE_SIZE];
+    uint8_t head;
+    uint8_t count;
+    bool moving;
+    servo_bank bank;
+    servo* motors[SERVO_BANK_MAX_CHANNELS];
+    uint64_t next_tick_us;
+    servo_spline spline;
+    float slopes[SERVO_BANK_MAX_CHANNELS];
+    servo_feedback* feedback;
+    bool settling;
+    uint64_t settle_start_us;
+    uint settled;
+    uint settle_timeouts;
+    uint32_t max_settle_us;
+    uint feed;
+    float stop_acceleration;
+    uint stop_ramp;
+    uint16_t* dry_levels;
+    arm_state state;
+    arm_snapshot snapshot;
+} arm_channel;
+
+/**
+ * Interleaves the interpolation ticks of several robotic arms in one timer-driven loop.
+ *
+ * @number: Number of arms (uint8_t)
+ * @arms: Arms driven (arm_channel[])
+ * @tick_us: Period of the timer ticks, the shortest servo period of all arms (uint)
+ * @channel_budget: Number of channels one tick may update in time (uint)
+ * @feed_percent: Feed rate override of all arms in percent of the planned speed (uint)
+ * @pending_ticks: Timer ticks not yet run by arm_scheduler_poll() (volatile uint)
+ * @ticks: Number of ticks run (uint)
+ * @overruns: Timer ticks missed because the loop or the previous tick took too long, counted by arm_scheduler_poll() (uint)
+ * @budget_exceeded: Ticks that updated more channels than channel_budget (uint)
+ * @max_tick_us: Longest time one tick took (uint32_t)
+ * @write_us: Time of the last PWM update of any arm (uint64_t)
+ * @stop_mode: Emergency stop requested, ARM_STOP_NONE if none, set from any context (volatile arm_stop_mode)
+ * @stop_request_us: Time the emergency stop was requested (volatile uint64_t)
+ * @preempted: True once a tick preempted the moves for the emergency stop (bool)
+ * @stopped: True once every arm is at rest after the emergency stop, until released (bool)
+ * @stops: Emergency stops (uint)
+ * @stop_latency_us: Time from the last request to the tick preempting the moves (uint32_t)
+ * @max_stop_latency_us: Longest stop_latency_us (uint32_t)
+ * @stop_time_us: Time from the last request to every arm at rest (uint32_t)
+ * @timer: Repeating timer raising the ticks (repeating_timer_t)
+ */
+typedef struct arm_scheduler {
+    uint8_t number;
+    arm_channel arms[ARM_SCHEDULER_MAX_ARMS];
+    uint tick_us;
+    uint channel_budget;
+    uint feed_percent;
+    volatile uint pending_ticks;
+    uint ticks;
+    uint overruns;
+    uint budget_exceeded;
+    uint32_t max_tick_us;
+    uint64_t write_us;
+    volatile arm_stop_mode stop_mode;
+    volatile uint64_t stop_request_us;
+    bool preempted;
+    bool stopped;
+    uint stops;
+    uint32_t stop_latency_us;
+    uint32_t max_stop_latency_us;
+    uint32_t stop_time_us;
+    repeating_timer_t timer;
+} arm_scheduler;
+
+/**
+ * Initialize an empty scheduler.
+ *
+ * @param scheduler Scheduler to initialize
+ * @param channel_budget Number of channels one tick may update in time
+ */
+void arm_scheduler_init(arm_scheduler* scheduler, uint channel_budget);
+
+/**
+ * Add a started robotic arm to a scheduler.
+ *
+ * @param scheduler Scheduler to add
+ * @param robot Robotic arm, started by robotic_arm_start(), at most SERVO_BANK_MAX_CHANNELS servos
+ * @return Arm id used to address commands, -1 if the scheduler is full
+ *         or a servo shares a PWM slice with a servo of another arm at a different period
+ */
+int arm_scheduler_add_arm(arm_scheduler* scheduler, robotic_arm* robot);
+
+/**
+ * Finish the moves of an arm on measured arrival instead of on their last tick.
+ * Moves ending at rest then wait until every servo with feedback is within tolerance of its target.
+ *
+ * @param scheduler Scheduler of the arm
+ * @param arm Arm id
+ * @param feedback Started feedback of the servos of the arm, NULL to finish on the last tick again
+ * @return False if arm is invalid
+ */
+bool arm_scheduler_set_feedback(arm_scheduler* scheduler, uint8_t arm, servo_feedback* feedback);
+
+/**
+ * Set the deceleration of an arm in an emergency stop with ARM_STOP_DECELERATE.
+ * The feed ramps down so the fastest servo of the move in progress, at the peak speed of its
+ * profile, slows down by acceleration; the easing of the profile itself may add to it.
+ *
+ * @param scheduler Scheduler of the arm
+ * @param arm Arm id
+ * @param acceleration Deceleration in degrees per second squared, ARM_SCHEDULER_STOP_ACCELERATION by default
+ * @return False if arm is invalid or acceleration is not positive
+ */
+bool arm_scheduler_set_stop_acceleration(arm_scheduler* scheduler, uint8_t arm, float acceleration);
+
+/**
+ * Start the repeating timer raising ticks.
+ *
+ * @param scheduler Scheduler to start
+ * @return False if no timer is available
+ */
+bool arm_scheduler_start(arm_scheduler* scheduler);
+
+/**
+ * Stop the repeating timer raising ticks.
+ *
+ * @param scheduler Scheduler to stop
+ */
+void arm_scheduler_stop(arm_scheduler* scheduler);
+
+/**
+ * Set the feed rate override of all arms, moves in progress included.
+ * The remaining moves are scaled in time, the speed of every arm ramps to the new
+ * override by at most ARM_SCHEDULER_FEED_RAMP per tick and never passes the max_speed of a servo.
+ *
+ * @param scheduler Scheduler to set
+ * @param percent Speed in percent of the planned speed, ARM_SCHEDULER_FEED_MIN to ARM_SCHEDULER_FEED_MAX
+ * @return False if percent is out of range
+ */
+bool arm_scheduler_set_feed(arm_scheduler* scheduler, uint percent);
+
+/**
+ * Request an emergency stop of all arms, safe from interrupts.
+ * A hold freezes the PWM levels before returning: moves advance and write their banks with
+ * interrupts disabled and never after a hold, even in a tick already running or a main loop
+ * round blocked for long. A deceleration ramps down from the next tick.
+ * The next tick preempts every move in progress and drops all queued commands.
+ * Commands are rejected until arm_scheduler_release_stop().
+ *
+ * @param scheduler Scheduler to stop
+ * @param mode ARM_STOP_HOLD or ARM_STOP_DECELERATE
+ */
+void arm_scheduler_emergency_stop(arm_scheduler* scheduler, arm_stop_mode mode);
+
+/**
+ * Request an emergency stop holding all arms when a GPIO is pulled low, from its interrupt.
+ * Only one scheduler can have a stop input.
+ *
+ * @param scheduler Scheduler to stop
+ * @param gpio Input of the stop button, pulled up, the button pulls it low
+ */
+void arm_scheduler_set_stop_input(arm_scheduler* scheduler, uint gpio);
+
+/**
+ * Accept commands again after an emergency stop.
+ *
+ * @param scheduler Scheduler to release
+ * @return False if the arms are still stopping or no stop was requested
+ */
+bool arm_scheduler_release_stop(arm_scheduler* scheduler);
+
+/**
+ * Queue a control signal for an arm.
+ *
+ * @param scheduler Scheduler to queue
+ * @param arm Arm id
+ * @param signal Control signal, copied into the queue
+ * @return False if arm or signal is invalid, the queue is full or the arms are stopped
+ */
+bool arm_scheduler_submit(arm_scheduler* scheduler, uint8_t arm, robotic_arm_signal* signal);
+
+/**
+ * Queue a control signal from text.
+ *
+ * @param scheduler Scheduler to queue
+ * @param str Control signal string "[@arm] number index angle index angle ... [options]",
+ *            arm 0 if "@arm" is omitted
+ * @return False if the string is invalid or the queue is full
+ */
+bool arm_scheduler_submit_string(arm_scheduler* scheduler, char* str);
+
+/**
+ * Queue a control signal from a binary frame.
+ * Frame: arm (uint8_t), number (uint8_t), number times index (uint8_t) and
+ * angle (uint16_t, hundredths of degree), duration_ms (uint16_t) and profile (uint8_t),
+ * multi-byte fields little-endian.
+ *
+ * @param scheduler Scheduler to queue
+ * @param frame Frame to parse
+ * @param length Length of frame in bytes
+ * @return False if the frame is invalid or the queue is full
+ */
+bool arm_scheduler_submit_binary(arm_scheduler* scheduler, const uint8_t* frame, uint length);
+
+/**
+ * Run the ticks raised by the timer since the last call.
+ * Call often from the main loop.
+ *
+ * @param scheduler Scheduler to run
+ */
+void arm_scheduler_poll(arm_scheduler* scheduler);
+
+/**
+ * Run one tick: start queued commands of idle arms and advance every due move.
+ *
+ * @param scheduler Scheduler to run
+ */
+void arm_scheduler_tick(arm_scheduler* scheduler);
+
+/**
+ * Run one tick at a given time, arm_scheduler_tick() at the current time.
+ * Dry runs tick a private scheduler on their own clock.
+ *
+ * @param scheduler Scheduler to run
+ * @param stop Emergency stop mode read before start_us
+ * @param start_us Time of the tick
+ */
+void arm_scheduler_tick_at(arm_scheduler* scheduler, arm_stop_mode stop, uint64_t start_us);
+
+/**
+ * @param scheduler Scheduler to check
+ * @return True if no arm is moving and all queues are empty
+ */
+bool arm_scheduler_idle(arm_scheduler* scheduler);
+
+/**
+ * @param scheduler Scheduler to check
+ * @param arm Arm id
+ * @return Number of commands queued for arm, including the move in progress
+ */
+uint arm_scheduler_queue_depth(arm_scheduler* scheduler, uint8_t arm);
+
+/**
+ * Copy the state of an arm published by the motion code, safe from any context.
+ *
+ * @param scheduler Scheduler of the arm
+ * @param arm Arm id
+ * @param state Set to a consistent state of all servos and the move in progress
+ * @return False if arm is invalid or no consistent state could be copied
+ */
+bool arm_scheduler_snapshot(arm_scheduler* scheduler, uint8_t arm, arm_state* state);
+
+/**
+ * Print queue depths and tick statistics of a scheduler.
+ *
+ * @param scheduler Scheduler to print
+ */
+void arm_scheduler_print(arm_scheduler* scheduler);
+
+
+#endif // ARM_SCHEDULER_H
@@ -0,0 +1,93 @@
+#ifndef ARM_SNAPSHOT_H
+#define ARM_SNAPSHOT_H
+
+#include <stdatomic.h>
+#include "pico/stdlib.h"
+#include "servo_control.h"
+#include "servo_bank.h"
+
+/**
+ * Consistent views of the state of an arm for readers outside the motion code.
+ *
+ * The motion code is the only writer and never waits: arm_snapshot_publish() copies the
+ * whole state into two slots behind a sequence counter, a seqlock latch. While one slot
+ * is written readers copy the other, so a reader interrupting the writer, in an interrupt
+ * or on the other core, still gets a complete state. A reader retries only if a whole
+ * publish completed while it copied, and gives up after ARM_SNAPSHOT_READ_TRIES.
+ * No interrupts are disabled and no lock is taken on either side.
+ */
+
+// Most copies a reader tries before giving up on a writer publishing faster than it reads
+#define ARM_SNAPSHOT_READ_TRIES 4
+
+/**
+ * State of an arm at one tick of the motion code.
+ *
+ * @time_us: Time the state was published (uint64_t)
+ * @number: Number of servos of the arm (uint8_t)
+ * @levels: PWM level of every servo (uint16_t[])
+ * @angles: Angle of every servo in degrees, interpolated during a move (float[])
+ * @queued: Number of commands queued, including the move in progress (uint8_t)
+ * @moving: True if a move is in progress (bool)
+ * @move_number: Number of servos of the move in progress (uint8_t)
+ * @move_indexes: Servos of the move in progress (uint8_t[])
+ * @move_targets: Target angles of the move in progress (float[])
+ * @step: Ticks of the move in progress done (uint16_t)
+ * @steps: Ticks of the move in progress (uint16_t)
+ * @profile: Easing of the move in progress (motion_profile)
+ * @feed: Speed of the arm in percent of the planned speed (uint8_t)
+ */
+typedef struct arm_state {
+    uint64_t time_us;
+    uint8_t number;
+    uint16_t levels[SERVO_BANK_MAX_CHANNELS];
+    float angles[SERVO_BANK_MAX_CHANNELS];
+    uint8_t queued;
+    bool moving;
+    uint8_t move_number;
+    uint8_t move_indexes[SERVO_BANK_MAX_CHANNELS];
+    float move_targets[SERVO_BANK_MAX_CHANNELS];
+    uint16_t step;
+    uint16_t steps;
+    motion_profile profile;
+    uint8_t feed;
+} arm_state;
+
+/**
+ * Two slots of arm state behind a sequence counter.
+ *
+ * @sequence: Number of slot writes started, odd while slot 0 is written (atomic_uint)
+ * @slots: Slot 1 is read while the sequence is odd, slot 0 while it is even (arm_state[])
+ */
+typedef struct arm_snapshot {
+    atomic_uint sequence;
+    arm_state slots[2];
+} arm_snapshot;
+
+/**
+ * Initialize a snapshot with a first state.
+ *
+ * @param snapshot Snapshot to initialize
+ * @param state First state
+ */
+void arm_snapshot_init(arm_snapshot* snapshot, const arm_state* state);
+
+/**
+ * Publish a new state, never waits. Only one writer may publish to a snapshot.
+ *
+ * @param snapshot Snapshot to publish to
+ * @param state State to copy
+ */
+void arm_snapshot_publish(arm_snapshot* snapshot, const arm_state* state);
+
+/**
+ * Copy the last complete state, never blocks the writer.
+ *
+ * @param snapshot Snapshot to read
+ * @param state Set to the state
+ * @return False if the writer published during every one of ARM_SNAPSHOT_READ_TRIES copies
+ */
+bool arm_snapshot_read(const arm_snapshot* snapshot, arm_state* state);
+
+
+#endif // ARM_SNAPSHOT_H
@@ -0,0 +1,84 @@
+#ifndef CDC_TRANSPORT_H
+#define CDC_TRANSPORT_H
+
+#include "pico/stdlib.h"
+
+/**
+ * Block transport of protocol traffic over the USB CDC endpoint, beside stdio.
+ *
+ * getchar_timeout_us() takes the stdio mutex, walks the stdio drivers and reads a single
+ * byte from TinyUSB per call, which caps binary frames and script uploads far below USB
+ * full speed. The transport reads the CDC FIFO a block at a time into its own ring buffer
+ * and writes frames straight to the endpoint. The interactive menu keeps reading stdio;
+ * bytes already taken into the ring buffer are handed out first, so input is never
+ * reordered when the menu leaves a protocol mode. In the simulator TinyUSB is backed by
+ * the pseudo-terminal, see sim/transport_bench.c for the throughput of both paths.
+ */
+
+// Size of the receive ring buffer in bytes, a power of two
+#ifndef CDC_TRANSPORT_RX_SIZE
+#define CDC_TRANSPORT_RX_SIZE 1024
+#endif
+
+// Most bytes taken from the CDC FIFO per read, one full-speed bulk packet
+#define CDC_TRANSPORT_BLOCK 64
+
+/**
+ * Counters of the transport.
+ *
+ * @reads: Number of block reads from the CDC FIFO (uint32_t)
+ * @received: Bytes received (uint32_t)
+ * @sent: Bytes sent (uint32_t)
+ * @dropped: Frames not sent because the CDC FIFO had no room (uint32_t)
+ */
+typedef struct cdc_transport_stats {
+    uint32_t reads;
+    uint32_t received;
+    uint32_t sent;
+    uint32_t dropped;
+} cdc_transport_stats;
+
+/**
+ * Move the bytes waiting in the CDC FIFO into the ring buffer, never blocks.
+ *
+ * @return Number of bytes moved
+ */
+uint cdc_transport_fill(void);
+
+/**
+ * @return Number of received bytes in the ring buffer
+ */
+uint cdc_transport_available(void);
+
+/**
+ * Take the next received byte, filling the ring buffer when it is empty.
+ *
+ * @return Byte, PICO_ERROR_TIMEOUT if no input is available
+ */
+int cdc_transport_getc(void);
+
+/**
+ * Copy received bytes out of the ring buffer, filling it first.
+ *
+ * @param buffer Buffer to copy to
+ * @param size Size of the buffer
+ * @return Number of bytes copied, 0 if no input is available
+ */
+uint cdc_transport_read(uint8_t* buffer, uint size);
+
+/**
+ * Send a frame as a whole or not at all, never blocks.
+ *
+ * @param frame Frame to send
+ * @param length Length of the frame
+ * @return False if the link is down or the CDC FIFO has no room for the frame
+ */
+bool cdc_transport_write_frame(const void* frame, uint length);
+
+/**
+ * @return Counters of the transport
+ */
+const cdc_transport_stats* cdc_transport_get_stats(void);
+
+
+#endif // CDC_TRANSPORT_H
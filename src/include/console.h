@@ -0,0 +1,87 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include "pico/stdlib.h"
+
+// Size of the console output ring buffer in bytes
+#ifndef CONSOLE_BUFFER_SIZE
+#define CONSOLE_BUFFER_SIZE 2048
+#endif
+
+// Longest time a write waits for the USB link when the ring buffer is full
+#define CONSOLE_WAIT_US 50000
+
+/**
+ * Format an unsigned integer in decimal.
+ *
+ * @param buffer Buffer of at least 10 characters, not terminated
+ * @param value Value to format
+ * @return Number of characters written
+ */
+int console_format_uint(char* buffer, uint32_t value);
+
+/**
+ * Format a fixed-point number, value / 10^decimals, without floating point.
+ *
+ * @param buffer Buffer of at least 12 characters, not terminated
+ * @param value Value in units of 10^-decimals
+ * @param decimals Number of decimals, at most 6
+ * @return Number of characters written
+ */
+int console_format_fixed(char* buffer, int32_t value, uint decimals);
+
+/**
+ * Format a float with a fixed number of decimals, like "%.2f".
+ * Uses one float multiply instead of the soft-float printf path.
+ *
+ * @param buffer Buffer of at least 20 characters, not terminated
+ * @param value Value to format
+ * @param decimals Number of decimals, at most 6
+ * @return Number of characters written
+ */
+int console_format_float(char* buffer, float value, uint decimals);
+
+/**
+ * Queue characters for the console.
+ *
+ * @param data Characters to queue
+ * @param length Number of characters
+ */
+void console_write(const char* data, uint length);
+
+/**
+ * Queue formatted text for the console.
+ * Supports %d, %ld, %u, %lu, %x, %lx, %s, %c, %% and %f with an optional precision up to 6.
+ *
+ * @param format Format string
+ */
+void console_printf(const char* format, ...);
+
+/**
+ * Report an error on stderr after the queued console text.
+ * stderr shares the USB link with the console, so the queued text is sent first
+ * and both arrive in the order they were written. Not for interrupts.
+ *
+ * @param format Format string of fprintf()
+ */
+void console_error(const char* format, ...);
+
+/**
+ * Send as much queued text as the USB FIFO takes, never blocks.
+ * Call often from the main loop.
+ */
+void console_flush(void);
+
+/**
+ * Send all queued text, waiting at most CONSOLE_WAIT_US for the USB link.
+ * Call before writing to stdout directly.
+ */
+void console_drain(void);
+
+/**
+ * @return Number of characters lost because the USB link did not keep up
+ */
+uint console_lost(void);
+
+
+#endif // CONSOLE_H
@@ -0,0 +1,228 @@
+#ifndef MOTION_SCRIPT_H
+#define MOTION_SCRIPT_H
+
+#include "pico/stdlib.h"
+#include "struct_robotic_arm.h"
+#include "servo_bank.h"
+
+/**
+ * Motion scripts, compiled line by line into bytecode when uploaded.
+ *
+ * # Pick 20 times, turning the base 5 degrees further each time
+ * pose pick 1 120 2 60
+ * var turn 30
+ * repeat 20
+ *     move pick 0 turn d400 plin
+ *     wait 200
+ *     move 1 90 2 90 0 turn d400
+ *     add turn 5
+ * end
+ *
+ * Statements:
+ *     pose <name> index angle ...    Name a pose, used by move
+ *     var <name> [value]             Declare a variable, 0 if value is omitted
+ *     set <name> <value>             Assign a variable
+ *     add <name> <value>             Add to a variable
+ *     move [pose] index value ... [d<ms>] [s<speed>] [p<profile>]
+ *                                    Queue a move to a pose, servos listed after it override the pose
+ *     wait <value>                   Wait until queued moves finish, then value milliseconds
+ *     repeat <value> ... end         Run the statements between value times
+ * Values are numbers, variables, or a variable plus or minus a number ("turn+15").
+ * Values are kept in hundredths, so 0.01 is the resolution of angles and variables.
+ */
+
+// Longest bytecode of a script in bytes
+#define MOTION_SCRIPT_MAX_CODE 1024
+
+// Most named poses and variables of a script
+#define MOTION_SCRIPT_MAX_POSES 16
+#define MOTION_SCRIPT_MAX_VARIABLES 16
+
+// Deepest nesting of repeat blocks
+#define MOTION_SCRIPT_MAX_DEPTH 8
+
+// Longest pose or variable name
+#define MOTION_SCRIPT_NAME_SIZE 12
+
+// Results of motion_script_run()
+#define MOTION_SCRIPT_RUNNING 0
+#define MOTION_SCRIPT_WAITING 1
+#define MOTION_SCRIPT_DONE 2
+#define MOTION_SCRIPT_FAILED 3
+
+/**
+ * Named pose of a script.
+ *
+ * @number: Number of servos of the pose (uint8_t)
+ * @indexes: Indexes of the servos (uint8_t[])
+ * @angles: Angles in hundredths of degree (int16_t[])
+ */
+typedef struct motion_script_pose {
+    uint8_t number;
+    uint8_t indexes[SERVO_BANK_MAX_CHANNELS];
+    int16_t angles[SERVO_BANK_MAX_CHANNELS];
+} motion_script_pose;
+
+/**
+ * Compiled script.
+ *
+ * @code: Bytecode, ends with an end instruction when compiled (uint8_t[])
+ * @length: Number of bytes of code (uint)
+ * @poses: Named poses (motion_script_pose[])
+ * @pose_count: Number of poses (uint8_t)
+ * @variable_count: Number of variables (uint8_t)
+ * @valid: True once compiled without errors (bool)
+ */
+typedef struct motion_script {
+    uint8_t code[MOTION_SCRIPT_MAX_CODE];
+    uint length;
+    motion_script_pose poses[MOTION_SCRIPT_MAX_POSES];
+    uint8_t pose_count;
+    uint8_t variable_count;
+    bool valid;
+} motion_script;
+
+/**
+ * Compiler state kept between the lines of an upload.
+ *
+ * @script: Script being compiled (motion_script*)
+ * @pose_names: Names of the poses (char[][])
+ * @variable_names: Names of the variables (char[][])
+ * @loops: Code offsets of the open repeat instructions (uint16_t[])
+ * @depth: Number of open repeat blocks (uint8_t)
+ * @line: Number of lines compiled (uint)
+ * @failed: True after an error, the script stays invalid until the next upload (bool)
+ */
+typedef struct motion_script_compiler {
+    motion_script* script;
+    char pose_names[MOTION_SCRIPT_MAX_POSES][MOTION_SCRIPT_NAME_SIZE];
+    char variable_names[MOTION_SCRIPT_MAX_VARIABLES][MOTION_SCRIPT_NAME_SIZE];
+    uint16_t loops[MOTION_SCRIPT_MAX_DEPTH];
+    uint8_t depth;
+    uint line;
+    bool failed;
+} motion_script_compiler;
+
+/**
+ * Queue a move of a running script.
+ *
+ * @param context Context of the callbacks
+ * @param signal Move to queue
+ * @return 1 if queued, 0 if the queue is full and the move is tried again later, -1 if invalid
+ */
+typedef int (*motion_script_submit)(void* context, robotic_arm_signal* signal);
+
+/**
+ * @param context Context of the callbacks
+ * @return True if all queued moves finished
+ */
+typedef bool (*motion_script_idle)(void* context);
+
+/**
+ * Repeat block being run.
+ *
+ * @start: Code offset of the first instruction of the block (uint16_t)
+ * @count: Number of runs left (int32_t)
+ */
+typedef struct motion_script_loop {
+    uint16_t start;
+    int32_t count;
+} motion_script_loop;
+
+/**
+ * Virtual machine running a compiled script.
+ *
+ * @script: Script run (const motion_script*)
+ * @submit: Callback queueing moves (motion_script_submit)
+ * @idle: Callback checking queued moves finished (motion_script_idle)
+ * @context: Context of the callbacks (void*)
+ * @pc: Code offset of the next instruction (uint)
+ * @variables: Values of the variables in hundredths (int32_t[])
+ * @loops: Repeat blocks being run, innermost last (motion_script_loop[])
+ * @depth: Number of repeat blocks being run (uint8_t)
+ * @indexes: Servos of the move being built (uint8_t[])
+ * @angles: Angles of the move being built (float[])
+ * @number: Number of servos of the move being built (uint8_t)
+ * @wait_until_us: End of a wait, 0 while waiting for the queued moves (uint64_t)
+ * @waiting: True during a wait instruction (bool)
+ * @running: True until the script ends, fails or is stopped (bool)
+ * @steps: Number of instructions run (uint)
+ * @moves: Number of moves queued (uint)
+ */
+typedef struct motion_script_vm {
+    const motion_script* script;
+    motion_script_submit submit;
+    motion_script_idle idle;
+    void* context;
+    uint pc;
+    int32_t variables[MOTION_SCRIPT_MAX_VARIABLES];
+    motion_script_loop loops[MOTION_SCRIPT_MAX_DEPTH];
+    uint8_t depth;
+    uint8_t indexes[SERVO_BANK_MAX_CHANNELS];
+    float angles[SERVO_BANK_MAX_CHANNELS];
+    uint8_t number;
+    uint64_t wait_until_us;
+    bool waiting;
+    bool running;
+    uint steps;
+    uint moves;
+} motion_script_vm;
+
+/**
+ * Start compiling a script, the previous code of script is dropped.
+ *
+ * @param compiler Compiler to start
+ * @param script Script to compile into
+ */
+void motion_script_compile_begin(motion_script_compiler* compiler, motion_script* script);
+
+/**
+ * Compile one line of a script.
+ *
+ * @param compiler Compiler started by motion_script_compile_begin()
+ * @param line Line without end of line, tokenized in place
+ * @return False if the line is invalid, the script stays invalid
+ */
+bool motion_script_compile_line(motion_script_compiler* compiler, char* line);
+
+/**
+ * Finish compiling a script.
+ *
+ * @param compiler Compiler started by motion_script_compile_begin()
+ * @return False if a line was invalid or a repeat block is not closed
+ */
+bool motion_script_compile_end(motion_script_compiler* compiler);
+
+/**
+ * Compile a whole script.
+ *
+ * @param script Script to compile into
+ * @param source Lines of the script, modified by tokenizing
+ * @return False if the script is invalid
+ */
+bool motion_script_compile(motion_script* script, char* source);
+
+/**
+ * Start running a compiled script.
+ *
+ * @param vm Virtual machine to start
+ * @param script Script compiled without errors
+ * @param submit Callback queueing moves
+ * @param idle Callback checking queued moves finished
+ * @param context Context of the callbacks
+ * @return False if the script is not valid
+ */
+bool motion_script_start(motion_script_vm* vm, const motion_script* script, motion_script_submit submit,
+                         motion_script_idle idle, void* context);
+
+/**
+ * Run instructions until the budget is spent, the script waits or ends.
+ *
+ * @param vm Virtual machine started by motion_script_start()
+ * @param budget Most instructions to run
+ * @return MOTION_SCRIPT_RUNNING, MOTION_SCRIPT_WAITING, MOTION_SCRIPT_DONE or MOTION_SCRIPT_FAILED
+ */
+int motion_script_run(motion_script_vm* vm, uint budget);
+
+
+#endif // MOTION_SCRIPT_H
@@ -0,0 +1,110 @@
+#ifndef MOTION_TIMELINE_H
+#define MOTION_TIMELINE_H
+
+#include <stdio.h>
+#include "struct_robotic_arm.h"
+
+/**
+ * Per-tick record of all servo levels and angles of a rendered motion.
+ * Rendered by the arm scheduler on its own clock, so durations and levels match a real run.
+ *
+ * @number: Number of servos of the robotic arm (uint8_t)
+ * @ticks: Number of recorded ticks (uint)
+ * @capacity: Number of ticks the buffers can hold (uint)
+ * @times_us: Time of every tick from the start of the motion (uint32_t*)
+ * @levels: PWM levels, number per tick (uint16_t*)
+ * @angles: Angles in degrees, number per tick (float*)
+ * @peak_velocities: Highest speed of every servo in degrees per second (float*)
+ * @clamp_events: Number of targets clamped to servo limits (uint)
+ */
+typedef struct motion_timeline {
+    uint8_t number;
+    uint ticks;
+    uint capacity;
+    uint32_t* times_us;
+    uint16_t* levels;
+    float* angles;
+    float* peak_velocities;
+    uint clamp_events;
+} motion_timeline;
+
+/**
+ * Create an empty timeline for a robotic arm.
+ *
+ * @param number Number of servos of the robotic arm
+ */
+motion_timeline* motion_timeline_create(uint8_t number);
+
+/**
+ * Clear all ticks and statistics of a timeline.
+ *
+ * @param timeline Timeline to clear
+ */
+void motion_timeline_clear(motion_timeline* timeline);
+
+/**
+ * Free memory malloced by motion_timeline_create().
+ *
+ * @param timeline Timeline to free
+ */
+void motion_timeline_free(motion_timeline* timeline);
+
+/**
+ * Render a sequence of control signals into a timeline without touching hardware.
+ * The signals run through a private arm scheduler on its own clock, so spline keyframes join,
+ * the feed ramps and the ticks fall as in a real run. The robotic arm is not changed,
+ * the sequence starts from its current angles.
+ *
+ * @param timeline Timeline to append, created for the number of servos of robot
+ * @param robot Robotic arm to render
+ * @param signals Control signals to render in order
+ * @param count Number of control signals
+ * @param pause_us Pause between control signals in microseconds, the next one starts on the tick after it
+ *                 as robotic_arm_custom_control_task() runs them; 0 queues all signals, so spline keyframes join
+ * @return False if a signal is invalid or malloc failed
+ */
+bool motion_timeline_render(motion_timeline* timeline, robotic_arm* robot,
+                            robotic_arm_signal* signals, uint count, uint pause_us);
+
+/**
+ * @param timeline Timeline to measure
+ * @return Duration of the timeline in microseconds
+ */
+uint32_t motion_timeline_duration_us(motion_timeline* timeline);
+
+/**
+ * Print duration, peak velocities and clamping events of a timeline.
+ *
+ * @param timeline Timeline to print
+ */
+void motion_timeline_print_report(motion_timeline* timeline);
+
+/**
+ * Write a timeline as CSV, one line per tick: "time_us,level0,...,angle0,...".
+ *
+ * @param timeline Timeline to write
+ * @param file File to write
+ */
+void motion_timeline_write_csv(motion_timeline* timeline, FILE* file);
+
+/**
+ * Write a timeline as binary: magic "MTL1", number (uint8_t), ticks (uint32_t),
+ * then per tick time (uint32_t), levels (uint16_t[number]) and angles (float[number]),
+ * all in native byte order.
+ *
+ * @param timeline Timeline to write
+ * @param file File to write
+ */
+void motion_timeline_write_binary(motion_timeline* timeline, FILE* file);
+
+/**
+ * Write a timeline as a trajectory pack, one sample per tick, see trajectory_pack.h.
+ * Host tools map the file and stream it like a recorded trajectory.
+ *
+ * @param timeline Timeline to write
+ * @param file File to write
+ */
+void motion_timeline_write_pack(motion_timeline* timeline, FILE* file);
+
+
+#endif // MOTION_TIMELINE_H
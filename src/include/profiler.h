@@ -0,0 +1,73 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "pico/stdlib.h"
+
+/**
+ * Sampling profiler and loop duration histograms, built with the SAMPLING_PROFILER option.
+ * A timer interrupt records the program counter it interrupted into a table of counts,
+ * tools/profile_symbolize.py maps the printed counts to functions of the ELF file.
+ * Without the option PROFILER_LOOP_TIME() compiles to nothing and no function exists.
+ */
+
+// Default time between samples, a prime number of microseconds so sampling does not lock to the servo tick
+#define PROFILER_PERIOD_US 1009
+
+// Sampled program counters kept, a power of 2; samples of other addresses are counted as dropped
+#define PROFILER_TABLE_BITS 8
+#define PROFILER_TABLE_SIZE (1 << PROFILER_TABLE_BITS)
+
+// Program counters printed by profiler_print(), most sampled first
+#define PROFILER_PRINT_MAX 64
+
+// Buckets of a loop histogram: 0 us, then [2^(i-1), 2^i) us, the last one open-ended
+#define PROFILER_BUCKETS 16
+
+/**
+ * Loops timed into a histogram.
+ */
+typedef enum profiler_loop {
+    PROFILER_LOOP_TICK = 0,     // One arm_scheduler_tick()
+    PROFILER_LOOP_ROUND,        // One round of task_runtime_poll()
+    PROFILER_LOOP_COUNT
+} profiler_loop;
+
+#ifdef SAMPLING_PROFILER
+
+/**
+ * Start sampling, the table and histograms keep their counts.
+ *
+ * @param period_us Time between samples
+ * @return False if no timer is available
+ */
+bool profiler_start(uint period_us);
+
+/**
+ * Stop sampling.
+ */
+void profiler_stop(void);
+
+/**
+ * Add a duration to the histogram of a loop.
+ *
+ * @param loop Loop timed
+ * @param us Duration of one pass in microseconds
+ */
+void profiler_loop_time(profiler_loop loop, uint32_t us);
+
+/**
+ * Print the most sampled program counters and the loop histograms, then clear them.
+ * The first line holds the address of profiler_print() so the host script can relocate the samples.
+ */
+void profiler_print(void);
+
+#define PROFILER_LOOP_TIME(loop, us) profiler_loop_time(loop, us)
+
+#else
+
+#define PROFILER_LOOP_TIME(loop, us) ((void)0)
+
+#endif // SAMPLING_PROFILER
+
+
+#endif // PROFILER_H
@@ -0,0 +1,109 @@
+#ifndef PWM_TRACE_H
+#define PWM_TRACE_H
+
+#include <stdio.h>
+#include "pico/stdlib.h"
+
+/**
+ * @time_us: Time of the PWM write in microseconds since boot (uint64_t)
+ * @pin: GPIO pin written (uint16_t)
+ * @level: PWM level written (uint16_t)
+ */
+typedef struct pwm_trace_record {
+    uint64_t time_us;
+    uint16_t pin;
+    uint16_t level;
+} pwm_trace_record;
+
+/**
+ * Recorded PWM writes of the servo control path.
+ * Recording needs the SERVO_PWM_TRACE build option.
+ *
+ * @number: Number of records (uint)
+ * @capacity: Number of records the buffer can hold (uint)
+ * @dropped: Writes not recorded because the buffer was full (uint)
+ * @records: Records in write order (pwm_trace_record*)
+ */
+typedef struct pwm_trace {
+    uint number;
+    uint capacity;
+    uint dropped;
+    pwm_trace_record* records;
+} pwm_trace;
+
+/**
+ * Allowed differences between two traces.
+ *
+ * @time_us: Largest difference of record times relative to the first record (uint32_t)
+ * @level: Largest difference of PWM levels (uint16_t)
+ */
+typedef struct pwm_trace_tolerance {
+    uint32_t time_us;
+    uint16_t level;
+} pwm_trace_tolerance;
+
+/**
+ * Create an empty trace.
+ *
+ * @param capacity Number of records the trace can hold
+ */
+pwm_trace* pwm_trace_create(uint capacity);
+
+/**
+ * Free memory malloced by pwm_trace_create().
+ *
+ * @param trace Trace to free
+ */
+void pwm_trace_free(pwm_trace* trace);
+
+/**
+ * Clear a trace and record all following PWM writes of servos into it.
+ *
+ * @param trace Trace to record, NULL to stop recording
+ */
+void pwm_trace_start(pwm_trace* trace);
+
+/**
+ * Stop recording PWM writes.
+ */
+void pwm_trace_stop(void);
+
+/**
+ * Record a PWM write into the trace being recorded, if any.
+ * Called by SERVO_PWM_SET_LEVEL.
+ *
+ * @param pin GPIO pin written
+ * @param level PWM level written
+ */
+void pwm_trace_add(uint pin, uint16_t level);
+
+/**
+ * Write a trace as CSV, one line per record: "time_us,pin,level".
+ * Times are relative to the first record.
+ *
+ * @param trace Trace to write
+ * @param file File to write
+ */
+void pwm_trace_write_csv(pwm_trace* trace, FILE* file);
+
+/**
+ * Read a trace written by pwm_trace_write_csv(), replacing its records.
+ *
+ * @param trace Trace to read into, records beyond capacity are dropped
+ * @param file File to read
+ * @return False if the file is not a trace CSV
+ */
+bool pwm_trace_read_csv(pwm_trace* trace, FILE* file);
+
+/**
+ * Compare a trace against an expected trace within tolerances.
+ *
+ * @param expected Expected trace, usually a golden trace read from file
+ * @param actual Recorded trace
+ * @param tolerance Allowed differences
+ * @return -1 if the traces match, otherwise index of the first mismatched record
+ */
+int pwm_trace_compare(pwm_trace* expected, pwm_trace* actual, pwm_trace_tolerance* tolerance);
+
+
+#endif // PWM_TRACE_H
@@ -0,0 +1,90 @@
+#ifndef REACH_MAP_H
+#define REACH_MAP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Reach map: voxels of the workspace of an arm whose center the tip can reach within the
+ * angle bounds of every servo, written by the arm_reach host tool and shared with the firmware.
+ *
+ * Voxel (x, y, z) has index x + size[0] * (y + size[1] * z) and is reachable if bit
+ * (index & 7) of byte index >> 3 is set, so a lookup is a few multiplications and one load.
+ * The file is the header, the bits at sizeof(reach_map_header), and if margins_offset is
+ * not 0 one byte per voxel there: the largest margin to the angle bounds of any pose
+ * reaching the voxel in degrees, REACH_MAP_UNREACHABLE if none does.
+ * The firmware embeds only the bits, as C source written by arm_reach -C.
+ * All fields are little-endian, the byte order of the RP2040 and common hosts.
+ */
+
+#define REACH_MAP_MAGIC "RCH1"
+
+// Margin of voxels no pose reaches, margins are clamped below it
+#define REACH_MAP_UNREACHABLE 0xFF
+
+/**
+ * First bytes of a reach map file, without padding.
+ *
+ * @magic: REACH_MAP_MAGIC, not terminated (char[4])
+ * @size: Number of voxels along x, y and z (uint16_t[])
+ * @reserved: Zero (uint16_t)
+ * @origin: Corner of voxel 0 in mm (float[])
+ * @voxel: Edge of a voxel in mm (float)
+ * @margins_offset: Offset of the margins from the start of the file, 0 if none (uint32_t)
+ */
+typedef struct reach_map_header {
+    char magic[4];
+    uint16_t size[3];
+    uint16_t reserved;
+    float origin[3];
+    float voxel;
+    uint32_t margins_offset;
+} reach_map_header;
+
+_Static_assert(sizeof(reach_map_header) == 32, "Reach map header must not be padded");
+
+/**
+ * Reach map in memory, the bits of a file or of embedded C source.
+ *
+ * @size: Number of voxels along x, y and z (uint16_t[])
+ * @origin: Corner of voxel 0 in mm (float[])
+ * @scale: Voxels per mm, 1 / voxel edge (float)
+ * @bits: One bit per voxel, set if reachable (const uint8_t*)
+ */
+typedef struct reach_map {
+    uint16_t size[3];
+    float origin[3];
+    float scale;
+    const uint8_t* bits;
+} reach_map;
+
+/**
+ * @param size Number of voxels along x, y and z
+ * @return Bytes of the bits of a map
+ */
+static inline uint32_t reach_map_bytes(const uint16_t* size) {
+    return ((uint32_t)size[0] * size[1] * size[2] + 7) / 8;
+}
+
+/**
+ * Check if the voxel of a point is reachable.
+ *
+ * @param map Reach map
+ * @param x X of the point in mm
+ * @param y Y of the point in mm
+ * @param z Height of the point in mm
+ * @return False if the point is unreachable or outside the map
+ */
+static inline bool reach_map_contains(const reach_map* map, float x, float y, float z) {
+    float voxel_x = (x - map->origin[0]) * map->scale;
+    float voxel_y = (y - map->origin[1]) * map->scale;
+    float voxel_z = (z - map->origin[2]) * map->scale;
+    if(voxel_x < 0.0f || voxel_y < 0.0f || voxel_z < 0.0f || voxel_x >= map->size[0] || voxel_y >= map->size[1]
+       || voxel_z >= map->size[2])
+        return false;
+    uint32_t index = (uint32_t)voxel_x + map->size[0] * ((uint32_t)voxel_y + map->size[1] * (uint32_t)voxel_z);
+    return map->bits[index >> 3] >> (index & 7) & 1;
+}
+
+
+#endif // REACH_MAP_H
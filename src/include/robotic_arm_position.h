@@ -4,9 +4,11 @@
 #include "struct_robotic_arm.h"
 #include "struct_position_required.h"
 #include "struct_coordinate_system.h"
+#include "reach_map.h"
 
 /**
  * Set position required for a robotic arm.
+ * The arrays are kept, the position required itself is freed by robotic_arm_free().
  * 
  * @param robot Robotic arm to set position required
  * @param offsets_height Offset height of the robotic arm
@@ -27,12 +29,22 @@ void robotic_arm_set_position_required(robotic_arm* robot, float offsets_height,
 /**
  * Translate cylindrical coordinate point to robotic arm control signal.
  * 
- * @param signal Robotic arm control signal to set
+ * @param signal Robotic arm control signal to set, indexes and angles must hold
+ *               servos_from_base_size + 1 entries; number is 0 if the point is out of reach
  * @param position_required Position required to translate
  * @param point Cylindrical coordinates to translate
  */
 void cylindrical_to_robotic_arm_signal(robotic_arm_signal* signal, position_required* position_required,
                                         cylindrical_point* point);
 
+/**
+ * Check if the tip of the arm can reach a point in O(1), so unreachable targets are
+ * rejected before solving for angles. Built with REACH_MAP_SOURCE, see reach_map.h.
+ * 
+ * @param point Point in mm, height from the ground
+ * @return False if the point is unreachable, always true without a reach map
+ */
+bool robotic_arm_reachable(const cartesian_point* point);
+
 
 #endif // ROBOTIC_ARM_POSITION_H
\ No newline at end of file
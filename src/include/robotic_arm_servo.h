@@ -48,6 +48,25 @@ void robotic_arm_set_servo_datasheet(robotic_arm* robot, uint8_t index, servo* s
  */
 void robotic_arm_set_servo_limits(robotic_arm* robot, uint8_t index, float angle_lower_bound, float angle_upper_bound);
 
+/**
+ * Get calibration of a robotic arm servo, create an empty one if the servo has none.
+ * The calibration is owned by the robotic arm and freed by robotic_arm_free().
+ * 
+ * @param robot Robotic arm to get
+ * @param index Index of servo in robotic arm to get
+ * @return Calibration of the servo, NULL if index is out of range or malloc failed
+ */
+servo_calibration* robotic_arm_get_servo_calibration(robotic_arm* robot, uint8_t index);
+
+/**
+ * Set speed limit of a robotic arm servo.
+ * 
+ * @param robot Robotic arm to set
+ * @param index Index of servo in robotic arm to set
+ * @param max_speed Highest speed (degrees per second) the servo tolerates, 0 for no limit
+ */
+void robotic_arm_set_servo_max_speed(robotic_arm* robot, uint8_t index, float max_speed);
+
 /**
  * Set a robotic arm servo to angle immediately.
  * 
@@ -62,25 +81,18 @@ void robotic_arm_set_servo_angle(robotic_arm* robot, uint8_t index, float angle)
  * Make sure all servos are properly set before calling this.
  * 
  * @param robot Robotic arm to start
+ * @return False if servos sharing a PWM slice have different periods
  */
-void robotic_arm_start(robotic_arm* robot);
+bool robotic_arm_start(robotic_arm* robot);
 
 /**
- * Smoothly move a robotic arm servo to angle.
+ * Start robotic arm from the description of the build, see arm_description.h.
+ * Pins, datasheets, limits and PWM settings all come from the description.
  * 
- * @param robot Robotic arm to move
- * @param index Index of servo in robotic arm to move
- * @param angle Target angle
- */
-void robotic_arm_move_servo(robotic_arm* robot, uint8_t index, float angle);
-
-/**
- * Smoothly move multiple robotic arm servos to angles at once.
- * 
- * @param robot Robotic arm to move
- * @param signal Control signal
+ * @param robot Robotic arm to start, created with arm_description_number servos
+ * @return False if the arm has a different number of servos
  */
-void robotic_arm_move(robotic_arm* robot, robotic_arm_signal* signal);
+bool robotic_arm_start_description(robotic_arm* robot);
 
 /**
  * Print index and angle of a robotic arm servo
@@ -109,17 +121,12 @@ void robotic_arm_free(robotic_arm* robot);
  * Make sure signal->indexes and signal->angles are allocated before calling this.
  * 
  * @param signal Robotic arm control signal to set
- * @param str String to transfer, format is "number index angle index angle ..."
- */
-void robotic_arm_signal_from_string(robotic_arm_signal* signal, char* str);
-
-/**
- * Smoothly move robotic arm servos by string.
- * 
- * @param robot Robotic arm to move
- * @param str String to move robotic arm, format is "number index angle index angle ..."
+ * @param str String to transfer, format is "number index angle index angle ... [d<ms>] [s<speed>] [p<profile>]",
+ *            optional duration (ms), peak speed (degrees per second) and profile (cos, lin, jerk or spline)
+ * @param capacity Number of entries signal->indexes and signal->angles can hold
+ * @return False if the string is invalid or has more servos than capacity
  */
-void robotic_arm_move_by_string(robotic_arm* robot, char* str);
+bool robotic_arm_signal_from_string(robotic_arm_signal* signal, char* str, uint8_t capacity);
 
 
 #endif  // ROBOTIC_ARM_SERVO_H
\ No newline at end of file
@@ -0,0 +1,110 @@
+#ifndef SERVO_BANK_H
+#define SERVO_BANK_H
+
+#include "pico/stdlib.h"
+#include "servo_control.h"
+
+// Maximum number of channels in a servo bank, must be a multiple of 4
+#ifndef SERVO_BANK_MAX_CHANNELS
+#define SERVO_BANK_MAX_CHANNELS 16
+#endif
+
+// Fixed-point one (Q15) for the interpolation ratio of servo_bank_update()
+#define SERVO_BANK_RATIO_ONE (1 << 15)
+
+// Fraction bits of the feed of a planned move, steps advanced per tick
+#define SERVO_BANK_FEED_BITS 16
+
+// Feed of one step per tick, the planned speed
+#define SERVO_BANK_FEED_ONE (1u << SERVO_BANK_FEED_BITS)
+
+/**
+ * Struct-of-arrays of servo channels moved together.
+ * Every array is indexed by channel, so the per-tick kernel runs over plain
+ * integer arrays instead of chasing servo pointers.
+ *
+ * @number: Number of active channels (uint8_t)
+ * @pins: GPIO pins of the channels (uint[])
+ * @start_levels: PWM levels at the start of the move (int32_t[])
+ * @level_deltas: PWM level differences from start to target (int32_t[])
+ * @min_levels: Lowest PWM levels allowed by angle limits (int32_t[])
+ * @max_levels: Highest PWM levels allowed by angle limits (int32_t[])
+ * @levels_per_degree: Scale factors from angle to PWM level (float[])
+ * @zero_levels: PWM levels at 0 degree (float[])
+ * @calibrations: Compiled calibrations replacing the scale factors, NULL if linear (servo_calibration*[])
+ * @levels: PWM levels computed by the last update (int32_t[])
+ * @clamped: Number of targets clamped to limits by the last servo_bank_target() (uint8_t)
+ * @steps: Number of ticks of the planned move (uint)
+ * @step: Ticks of the planned move done (uint)
+ * @fraction: Part of the next step done at a feed other than SERVO_BANK_FEED_ONE (uint)
+ * @feed_limit: Highest feed keeping every servo of the planned move within its max_speed,
+ *              relative to the planned speed (float)
+ * @tick_us: Time between ticks of the planned move in microseconds (uint)
+ * @profile: Easing of the planned move (motion_profile)
+ */
+typedef struct servo_bank {
+    uint8_t number;
+    uint pins[SERVO_BANK_MAX_CHANNELS];
+    int32_t start_levels[SERVO_BANK_MAX_CHANNELS] __attribute__((aligned(16)));
+    int32_t level_deltas[SERVO_BANK_MAX_CHANNELS] __attribute__((aligned(16)));
+    int32_t min_levels[SERVO_BANK_MAX_CHANNELS] __attribute__((aligned(16)));
+    int32_t max_levels[SERVO_BANK_MAX_CHANNELS] __attribute__((aligned(16)));
+    float levels_per_degree[SERVO_BANK_MAX_CHANNELS];
+    float zero_levels[SERVO_BANK_MAX_CHANNELS];
+    servo_calibration* calibrations[SERVO_BANK_MAX_CHANNELS];
+    int32_t levels[SERVO_BANK_MAX_CHANNELS] __attribute__((aligned(16)));
+    uint8_t clamped;
+    uint steps;
+    uint step;
+    uint fraction;
+    float feed_limit;
+    uint tick_us;
+    motion_profile profile;
+} servo_bank;
+
+/**
+ * Load servos into a bank and precompute their scale factors and limits.
+ * The current angles of the servos become the start of the next move.
+ *
+ * @param bank Bank to load
+ * @param number Number of servos, at most SERVO_BANK_MAX_CHANNELS
+ * @param motors Servos to load
+ * @return False if number is out of range
+ */
+bool servo_bank_load(servo_bank* bank, uint number, servo** motors);
+
+/**
+ * Set target angles of a bank, clamped to the limits of each channel.
+ * The levels of the last update become the start levels.
+ *
+ * @param bank Bank to set
+ * @param angles Target angles in degrees, one per channel
+ */
+void servo_bank_target(servo_bank* bank, float* angles);
+
+/**
+ * Update the levels of all channels for an interpolation ratio.
+ *
+ * @param bank Bank to update
+ * @param ratio Ratio from start to target levels (0 to SERVO_BANK_RATIO_ONE)
+ */
+void servo_bank_update(servo_bank* bank, int32_t ratio);
+
+/**
+ * Write the levels of all channels to PWM.
+ *
+ * @param bank Bank to write
+ */
+void servo_bank_write(servo_bank* bank);
+
+/**
+ * Convert the current level of a channel back to an angle.
+ *
+ * @param bank Bank to read
+ * @param index Index of channel
+ * @return Angle in degrees
+ */
+float servo_bank_angle(servo_bank* bank, uint index);
+
+
+#endif  // SERVO_BANK_H
@@ -3,13 +3,96 @@
 
 #include "pico/stdlib.h"
 
-// PWM wrap value for the servo control
+// Every PWM write of servos goes through SERVO_PWM_SET_LEVEL,
+// building with SERVO_PWM_TRACE records them for trace comparison
+#ifdef SERVO_PWM_TRACE
+#include "pwm_trace.h"
+#define SERVO_PWM_SET_LEVEL(pin, level)         \
+do{                                             \
+    pwm_trace_add((pin), (level));              \
+    pwm_set_gpio_level((pin), (level));         \
+}while(0)
+#else
+#define SERVO_PWM_SET_LEVEL(pin, level) pwm_set_gpio_level((pin), (level))
+#endif
+
+// Defined in servo_bank.h
+typedef struct servo_bank servo_bank;
+
+// PWM wrap value of servos not initialized yet
 #define SERVO_PWM_WRAP 40000
 
-// Default system clock frequency (Hz)
-#ifndef SYSTEM_CLOCK
-#define SYSTEM_CLOCK 125000000
-#endif
+// Largest PWM wrap value, counter top 65534 keeps every level within uint16_t
+#define SERVO_PWM_MAX_WRAP 65535
+
+/**
+ * PWM counts per period of a servo, derived from the system clock by servo_init.
+ *
+ * @param motor Servo (servo*)
+ */
+#define SERVO_WRAP(motor) ((motor)->pwm_wrap ? (motor)->pwm_wrap : SERVO_PWM_WRAP)
+
+// Number of entries in motion_presets
+#define MOTION_PRESET_COUNT 4
+
+/**
+ * Easing of a smooth move from start to target.
+ */
+typedef enum motion_profile {
+    MOTION_PROFILE_COSINE = 0,      // Cosine ease in and out, the default
+    MOTION_PROFILE_LINEAR,          // Constant speed
+    MOTION_PROFILE_MINIMUM_JERK,    // Quintic ease, smooth acceleration
+    MOTION_PROFILE_SPLINE           // Keyframe of a cubic spline through consecutive spline moves, see servo_spline.h
+} motion_profile;
+
+/**
+ * Options of a smooth move, zero for defaults.
+ * 
+ * @param duration_ms Duration of the move (ms), 0 to use speed or the selected preset
+ * @param speed Peak speed of the fastest servo (degrees per second), 0 to use the selected preset
+ * @param profile Easing of the move
+ */
+typedef struct motion_options {
+    uint duration_ms;
+    float speed;
+    motion_profile profile;
+} motion_options;
+
+/**
+ * Named speed preset of moves without duration or speed.
+ * 
+ * @param name Name of the preset
+ * @param full_range_ms Time (ms) of a move over the whole angle range
+ */
+typedef struct motion_preset {
+    const char* name;
+    uint full_range_ms;
+} motion_preset;
+
+extern const motion_preset motion_presets[MOTION_PRESET_COUNT];
+
+// Maximum number of measured points in a servo calibration
+#define SERVO_CALIBRATION_MAX_POINTS 16
+
+// Number of evenly spaced segments in a compiled calibration table
+#define SERVO_CALIBRATION_TABLE_SIZE 64
+
+/**
+ * Measured calibration curve of a servo and its compiled lookup table.
+ * 
+ * @param number Number of measured points
+ * @param angles Measured angles in degrees, sorted ascending
+ * @param pulses Pulse widths (us) measured at the angles
+ * @param levels PWM levels evenly spaced from 0 degree to angle_range, built by servo_calibration_compile
+ * @param positions_per_degree Scale from angle to table position in 1/256 segment, 0 if not compiled
+ */
+typedef struct servo_calibration {
+    uint8_t number;
+    float angles[SERVO_CALIBRATION_MAX_POINTS];
+    uint pulses[SERVO_CALIBRATION_MAX_POINTS];
+    uint16_t levels[SERVO_CALIBRATION_TABLE_SIZE + 1];
+    float positions_per_degree;
+} servo_calibration;
 
 /**
  * @param pin GPIO pin connected to the servo, must support hardware PWM
@@ -20,6 +103,9 @@
  * @param angle Current angle of the servo in degrees
  * @param angle_lower_bound Limit of the lowest angle the servo can move
  * @param angle_upper_bound Limit of the highest angle the servo can move
+ * @param calibration Optional measured curve replacing the linear min_duty to max_duty mapping
+ * @param pwm_wrap PWM counts per period, set by servo_init from the system clock
+ * @param max_speed Highest speed (degrees per second) the servo tolerates, 0 for no limit
  */
 typedef struct servo {
     uint pin;
@@ -30,6 +116,9 @@ typedef struct servo {
     float angle;
     float angle_lower_bound;
     float angle_upper_bound;
+    servo_calibration* calibration;
+    uint pwm_wrap;
+    float max_speed;
 } servo;
 
 /**
@@ -88,6 +177,14 @@ void servo_set_pin(servo* motor, uint pin);
  */
 void servo_set_datasheet(servo* motor, float angle_range, uint period, uint min_duty, uint max_duty);
 
+/**
+ * Set speed limit of a servo.
+ * 
+ * @param motor Servo to set speed limit
+ * @param max_speed Highest speed (degrees per second) the servo tolerates, 0 for no limit
+ */
+void servo_set_max_speed(servo* motor, float max_speed);
+
 /**
  * Set limits for servo angles.
  * 
@@ -98,29 +195,97 @@ void servo_set_datasheet(servo* motor, float angle_range, uint period, uint min_
 void servo_set_limits(servo* motor, float angle_lower_bound, float angle_upper_bound);
 
 /**
- * Set the angle of a single servo motor immediately.
+ * Add a measured point to a servo calibration.
+ * A point at an angle already measured replaces the old one.
  * 
- * @param motor Servo to set angle
- * @param angle Target angle in degrees
+ * @param calibration Calibration to add point
+ * @param angle Measured angle in degrees
+ * @param pulse Pulse width (us) that moves the servo to angle
+ * @return False if the calibration is full
  */
-void servo_set_angle(servo* motor, float angle);
+bool servo_calibration_add_point(servo_calibration* calibration, float angle, uint pulse);
+
+/**
+ * Compile the measured points of a servo calibration into its lookup table.
+ * Needs at least 2 points, angles outside the measured ones are extrapolated.
+ * 
+ * @param motor Servo with calibration to compile
+ * @return False if the servo has no calibration or too few points
+ */
+bool servo_calibration_compile(servo* motor);
+
+/**
+ * Look up the PWM level of an angle in a compiled calibration table.
+ * 
+ * @param calibration Compiled calibration
+ * @param angle Angle in degrees
+ * @return PWM level interpolated between the nearest table entries
+ */
+uint16_t servo_calibration_level(servo_calibration* calibration, float angle);
+
+/**
+ * Convert a PWM level back to angle through a compiled calibration table.
+ * 
+ * @param calibration Compiled calibration
+ * @param level PWM level
+ * @return Angle in degrees
+ */
+float servo_calibration_angle(servo_calibration* calibration, uint16_t level);
+
+/**
+ * Set the pulse width of a servo immediately, ignoring angle and limits.
+ * Used to find the pulse widths of measured angles.
+ * 
+ * @param motor Servo to set pulse width
+ * @param pulse Pulse width (us)
+ */
+void servo_set_pulse_us(servo* motor, uint pulse);
 
 /**
- * Move a single servo motor smoothly to the target angle.
+ * Convert an angle of a servo motor to PWM level.
  * 
- * @param motor Servo to move
+ * @param motor Servo to convert
+ * @param angle Angle in degrees
+ * @return PWM level of the angle
+ */
+uint16_t servo_angle_to_level(servo* motor, float angle);
+
+/**
+ * Convert a PWM level of a servo motor back to angle.
+ * 
+ * @param motor Servo to convert
+ * @param level PWM level
+ * @return Angle in degrees
+ */
+float servo_level_to_angle(servo* motor, uint16_t level);
+
+/**
+ * Set the angle of a single servo motor immediately.
+ * 
+ * @param motor Servo to set angle
  * @param angle Target angle in degrees
  */
-void servo_smooth(servo* motor, float angle);
+void servo_set_angle(servo* motor, float angle);
 
 /**
  * Initialize multiple servo motors.
  * Make sure all servo structs are properly set before calling this.
+ * Servos sharing a PWM slice must have the same period.
  * 
  * @param number Number of servos to initialize
  * @param motors Servos to initialize
+ * @return False if servos sharing a PWM slice have different periods, nothing is initialized
  */
-void servos_init(uint number, servo** motors);
+bool servos_init(uint number, servo** motors);
+
+/**
+ * Initialize multiple servo motors with PWM settings computed by the build, see arm_description.h.
+ * 
+ * @param number Number of servos to initialize
+ * @param motors Servos to initialize, pwm_wrap must be set
+ * @param dividers PWM clock divider of every servo in 1/16 steps (8.4 fixed point)
+ */
+void servos_init_precomputed(uint number, servo** motors, const uint16_t* dividers);
 
 /**
  * Set angles for multiple servos immediately.
@@ -132,13 +297,67 @@ void servos_init(uint number, servo** motors);
 void servos_set_angle(uint number, servo** motors, float *angles);
 
 /**
- * Smoothly move multiple servos to target angles.
+ * Peak speed of a motion profile relative to its average speed.
+ * 
+ * @param profile Motion profile
+ */
+float motion_profile_peak_factor(motion_profile profile);
+
+/**
+ * Select the speed preset of moves without duration or speed.
+ * 
+ * @param index Index of motion_presets
+ * @return False if index is out of range
+ */
+bool motion_select_preset(uint index);
+
+/**
+ * @return Index of the selected speed preset in motion_presets
+ */
+uint motion_selected_preset(void);
+
+/**
+ * Plan a smooth move of multiple servos into a bank without moving them.
+ * Duration comes from options, or from the selected speed preset if options has none,
+ * and is stretched so no servo exceeds its max_speed.
  * 
+ * @param bank Bank to plan the move, advanced by servos_smooth_tick()
  * @param number Number of servos to move
  * @param motors Servos to move
  * @param angles Target angles in degrees
+ * @param options Duration, speed and profile of the move, NULL for defaults
+ * @return False if the servos do not fit in a bank
+ */
+bool servos_smooth_plan(servo_bank* bank, uint number, servo** motors, float *angles, motion_options* options);
+
+/**
+ * Advance a planned move by one tick and update the levels of the bank.
+ * The arm scheduler writes the levels to PWM every bank->tick_us, benchmarks only time them.
+ * 
+ * @param bank Bank planned by servos_smooth_plan()
+ * @return True if the move continues after this tick, false if levels are at targets
+ */
+bool servos_smooth_tick(servo_bank* bank);
+
+/**
+ * Advance a planned move by a fraction of steps and update the levels of the bank.
+ * The remaining move is scaled in time: the easing stays the same, a feed of half
+ * SERVO_BANK_FEED_ONE takes twice the ticks. Ticking at SERVO_BANK_FEED_ONE is servos_smooth_tick().
+ * 
+ * @param bank Bank planned by servos_smooth_plan()
+ * @param feed Steps to advance, SERVO_BANK_FEED_ONE for one step
+ * @return True if the move continues after this tick, false if levels are at targets
+ */
+bool servos_smooth_feed(servo_bank* bank, uint feed);
+
+/**
+ * Store target angles of a finished move in the servos, clamped to their limits.
+ * 
+ * @param number Number of servos moved
+ * @param motors Servos moved
+ * @param angles Target angles in degrees
  */
-void servos_smooth(uint number, servo** motors, float *angles);
+void servos_smooth_finish(uint number, servo** motors, float *angles);
 
 
 #endif  // SERVO_CONTROL_H
\ No newline at end of file
@@ -0,0 +1,173 @@
+#ifndef SERVO_FEEDBACK_H
+#define SERVO_FEEDBACK_H
+
+#include "pico/stdlib.h"
+#include "servo_bank.h"
+
+/**
+ * Servo positions read back from their potentiometers.
+ * The ADC converts the feedback inputs round-robin and DMA writes every sample
+ * into a ring buffer, so sampling costs no CPU. servo_feedback_poll() filters the
+ * new samples and calibration maps them to angles, then the arm scheduler completes
+ * moves once the servos measurably arrived instead of when the last PWM level is written.
+ */
+
+// ADC inputs usable for feedback, on GPIO 26 to 29; on a Pico board input 3 measures VSYS
+#define SERVO_FEEDBACK_MAX_INPUTS 4
+#define SERVO_FEEDBACK_FIRST_GPIO 26
+
+// Size of the DMA ring buffer, 2^bits bytes of 16-bit samples, aligned to its size for DMA wrapping
+#define SERVO_FEEDBACK_RING_BITS 9
+#define SERVO_FEEDBACK_RING_SIZE ((1 << SERVO_FEEDBACK_RING_BITS) / 2)
+
+// Samples per second of every input
+#define SERVO_FEEDBACK_SAMPLE_HZ 1000
+
+// Weight of a new sample in the moving average, 1 / 2^shift
+#define SERVO_FEEDBACK_FILTER_SHIFT 2
+
+// Fraction bits of the filtered ADC counts
+#define SERVO_FEEDBACK_FILTER_BITS 4
+
+// Full scale of the 12-bit ADC
+#define SERVO_FEEDBACK_MAX_COUNT 4095
+
+// Most calibration points of an input
+#define SERVO_FEEDBACK_MAX_POINTS 8
+
+// Longest wait for a servo to arrive after its move, the move completes anyway then
+#define SERVO_FEEDBACK_SETTLE_TIMEOUT_US 500000
+
+/**
+ * Filter and calibration of one feedback input.
+ *
+ * @servo: Index of the servo of the input in its robotic arm (uint8_t)
+ * @filtered: Moving average of the ADC counts, SERVO_FEEDBACK_FILTER_BITS fraction bits (int32_t)
+ * @samples: Number of samples filtered (uint)
+ * @zero_angle: Angle at ADC count 0 (float)
+ * @degrees_per_count: Angle change of one ADC count (float)
+ * @angles: Measured angles of the calibration points (float[])
+ * @counts: Filtered ADC counts of the calibration points (uint16_t[])
+ * @point_count: Number of calibration points (uint8_t)
+ */
+typedef struct servo_feedback_input {
+    uint8_t servo;
+    int32_t filtered;
+    uint samples;
+    float zero_angle;
+    float degrees_per_count;
+    float angles[SERVO_FEEDBACK_MAX_POINTS];
+    uint16_t counts[SERVO_FEEDBACK_MAX_POINTS];
+    uint8_t point_count;
+} servo_feedback_input;
+
+/**
+ * Feedback of the servos of one robotic arm.
+ *
+ * @ring: Samples written by DMA, in ADC input order (uint16_t[])
+ * @number: Number of inputs sampled (uint8_t)
+ * @inputs: Filters and calibrations, in ADC input order (servo_feedback_input[])
+ * @adc_inputs: ADC input numbers sampled, ascending like the round-robin (uint8_t[])
+ * @servo_inputs: Index in inputs of every servo, -1 without feedback (int8_t[])
+ * @angle_range: Angle range of the servos, mapped to the full ADC scale until calibrated (float)
+ * @tolerance: Largest difference between measured and target angles of an arrived servo (float)
+ * @dma_channel: DMA channel writing the ring (int)
+ * @read_count: Samples filtered since DMA started (uint32_t)
+ * @overruns: Samples overwritten before poll read them (uint)
+ */
+typedef struct servo_feedback {
+    uint16_t ring[SERVO_FEEDBACK_RING_SIZE] __attribute__((aligned(1 << SERVO_FEEDBACK_RING_BITS)));
+    uint8_t number;
+    servo_feedback_input inputs[SERVO_FEEDBACK_MAX_INPUTS];
+    uint8_t adc_inputs[SERVO_FEEDBACK_MAX_INPUTS];
+    int8_t servo_inputs[SERVO_BANK_MAX_CHANNELS];
+    float angle_range;
+    float tolerance;
+    int dma_channel;
+    uint32_t read_count;
+    uint overruns;
+} servo_feedback;
+
+/**
+ * Start sampling the feedback of servos.
+ * Until calibrated, ADC counts 0 to SERVO_FEEDBACK_MAX_COUNT map linearly to the angle range of each servo.
+ *
+ * @param feedback Feedback to start
+ * @param adc_inputs ADC input of every servo, -1 without feedback
+ * @param number Number of servos
+ * @param angle_range Angle range of the servos in degrees
+ * @param tolerance Largest difference between measured and target angles of an arrived servo
+ * @return False if an input is invalid or used twice, or no DMA channel is free
+ */
+bool servo_feedback_start(servo_feedback* feedback, const int8_t* adc_inputs, uint number, float angle_range,
+                          float tolerance);
+
+/**
+ * Filter the samples DMA wrote since the last poll.
+ * Call at least every SERVO_FEEDBACK_RING_SIZE / number samples, the arm scheduler does every tick.
+ *
+ * @param feedback Feedback to poll
+ */
+void servo_feedback_poll(servo_feedback* feedback);
+
+/**
+ * @param feedback Feedback to read
+ * @param servo Servo index
+ * @return True if the servo has feedback
+ */
+bool servo_feedback_has(servo_feedback* feedback, uint8_t servo);
+
+/**
+ * @param feedback Feedback to read
+ * @param servo Servo index, with feedback
+ * @return Measured angle in degrees
+ */
+float servo_feedback_angle(servo_feedback* feedback, uint8_t servo);
+
+/**
+ * Check that the servos of a move with feedback are within tolerance of their targets.
+ *
+ * @param feedback Feedback to read
+ * @param number Number of servos of the move
+ * @param servos Servo indexes of the move
+ * @param angles Target angles of the move
+ * @return True if every servo with feedback arrived, also if none has feedback
+ */
+bool servo_feedback_arrived(servo_feedback* feedback, uint number, const uint8_t* servos, const float* angles);
+
+/**
+ * Record the current filtered reading of a servo as a calibration point.
+ *
+ * @param feedback Feedback to calibrate
+ * @param servo Servo index, with feedback
+ * @param angle Measured angle of the servo
+ * @return False if the servo has no feedback or the points are full
+ */
+bool servo_feedback_add_point(servo_feedback* feedback, uint8_t servo, float angle);
+
+/**
+ * Fit a line through the calibration points of a servo and use it for its angles.
+ *
+ * @param feedback Feedback to calibrate
+ * @param servo Servo index, with feedback
+ * @return False if the servo has no feedback or fewer than 2 distinct points
+ */
+bool servo_feedback_compile(servo_feedback* feedback, uint8_t servo);
+
+/**
+ * Drop the calibration points of a servo and return to the uncalibrated mapping.
+ *
+ * @param feedback Feedback to calibrate
+ * @param servo Servo index
+ */
+void servo_feedback_clear_points(servo_feedback* feedback, uint8_t servo);
+
+/**
+ * Print measured angles, ADC counts and overruns.
+ *
+ * @param feedback Feedback to print
+ */
+void servo_feedback_print(servo_feedback* feedback);
+
+
+#endif // SERVO_FEEDBACK_H
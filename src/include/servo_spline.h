@@ -0,0 +1,79 @@
+#ifndef SERVO_SPLINE_H
+#define SERVO_SPLINE_H
+
+#include "pico/stdlib.h"
+#include "servo_bank.h"
+
+// Fraction bits of the fixed-point levels and differences of a spline
+#define SERVO_SPLINE_FRACTION_BITS 32
+
+/**
+ * Cubic Hermite segment of every channel of a servo bank, evaluated by forward differencing.
+ * The cubic is solved once by servo_spline_plan(), then a tick costs three additions per channel
+ * and no floating point. Levels and differences are fixed point with SERVO_SPLINE_FRACTION_BITS
+ * fraction bits, so the error after thousands of ticks stays far below one PWM level.
+ * The arm scheduler joins queued MOTION_PROFILE_SPLINE moves with Catmull-Rom slopes, other
+ * callers of servos_smooth_tick() run a spline move as one segment at rest on both ends.
+ *
+ * @levels: Levels of the last tick, rounding offset included (int64_t[])
+ * @first: First forward differences, level change of the next tick (int64_t[])
+ * @second: Second forward differences (int64_t[])
+ * @third: Third forward differences, constant over the segment (int64_t[])
+ * @steps: Number of ticks of the segment (uint)
+ * @step: Ticks of the segment done (uint)
+ * @fraction: Part of the next step done at a feed other than SERVO_BANK_FEED_ONE (uint)
+ */
+typedef struct servo_spline {
+    int64_t levels[SERVO_BANK_MAX_CHANNELS];
+    int64_t first[SERVO_BANK_MAX_CHANNELS];
+    int64_t second[SERVO_BANK_MAX_CHANNELS];
+    int64_t third[SERVO_BANK_MAX_CHANNELS];
+    uint steps;
+    uint step;
+    uint fraction;
+} servo_spline;
+
+/**
+ * Plan a spline segment from the start to the target levels of a bank.
+ * Slopes are the level changes per tick at both ends, zero to start or arrive at rest.
+ *
+ * @param spline Spline to plan
+ * @param bank Bank planned by servos_smooth_plan(), its steps are the ticks of the segment
+ * @param start_slopes Slopes at the start levels, one per channel
+ * @param end_slopes Slopes at the target levels, one per channel
+ */
+void servo_spline_plan(servo_spline* spline, servo_bank* bank, const float* start_slopes, const float* end_slopes);
+
+/**
+ * Advance a spline segment by one tick and update the levels of the bank, clamped to limits.
+ *
+ * @param spline Spline planned by servo_spline_plan()
+ * @param bank Bank of the spline
+ * @return True if the segment continues after this tick, false if levels are at targets
+ */
+bool servo_spline_tick(servo_spline* spline, servo_bank* bank);
+
+/**
+ * Advance a spline segment by a fraction of steps and update the levels of the bank, clamped to limits.
+ * The differences still advance by whole steps, the level between two steps is interpolated
+ * on the same cubic, so the segment is scaled in time without changing its shape.
+ *
+ * @param spline Spline planned by servo_spline_plan()
+ * @param bank Bank of the spline
+ * @param feed Steps to advance, SERVO_BANK_FEED_ONE for one step
+ * @return True if the segment continues after this tick, false if levels are at targets
+ */
+bool servo_spline_feed(servo_spline* spline, servo_bank* bank, uint feed);
+
+/**
+ * Slope of a Catmull-Rom spline at a keyframe, from the levels of its neighbours.
+ *
+ * @param previous_level Level of the keyframe before
+ * @param next_level Level of the keyframe after
+ * @param interval_us Time from the keyframe before to the keyframe after
+ * @return Slope in levels per second
+ */
+float servo_spline_slope(int32_t previous_level, int32_t next_level, uint64_t interval_us);
+
+
+#endif // SERVO_SPLINE_H
@@ -4,6 +4,9 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+// Elevation in degrees of links after the second one when solving for a point, pointing at the ground
+#define ROBOTIC_ARM_TOOL_ELEVATION -90.0f
+
 /**
  * Struct to save data of a robotic arm to calculate position.
  * 
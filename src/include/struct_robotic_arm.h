@@ -19,11 +19,13 @@ typedef struct robotic_arm {
  * @number: Number of servos to move (uint8_t)
  * @indexes: Indexes of servos to move (uint8_t*)
  * @angles: Target angles (float*)
+ * @options: Duration, speed and profile of the move, zero for defaults (motion_options)
  */
 typedef struct robotic_arm_signal {
     uint8_t number;
     uint8_t* indexes;
     float* angles;
+    motion_options options;
 } robotic_arm_signal;
 
 
@@ -0,0 +1,144 @@
+#ifndef TASK_H
+#define TASK_H
+
+#include "pico/stdlib.h"
+
+/**
+ * Stackless coroutines in the style of protothreads.
+ * A task function resumes at the line it last returned from, so its local
+ * variables do not survive a yield: keep state in the data of the task.
+ * Only one TASK_* macro may be used per source line.
+ *
+ * int blink(task* self) {
+ *     TASK_BEGIN(self);
+ *     while(true) {
+ *         toggle_led();
+ *         TASK_SLEEP_US(self, 500000);
+ *     }
+ *     TASK_END(self);
+ * }
+ */
+
+// Results of a task function, set by the TASK_* macros
+#define TASK_YIELDED 0
+#define TASK_SLEEPING 1
+#define TASK_DONE 2
+
+#define TASK_BEGIN(t) switch((t)->line) { case 0:
+
+#define TASK_END(t) } (t)->line = 0; return TASK_DONE
+
+// Let the other ready tasks run, resume in the next round
+#define TASK_YIELD(t) do { (t)->line = __LINE__; return TASK_YIELDED; case __LINE__:; } while(0)
+
+// Yield until cond is true, cond is checked once per round
+#define TASK_WAIT_UNTIL(t, cond) do { (t)->line = __LINE__; __attribute__((fallthrough)); \
+                                      case __LINE__: if(!(cond)) return TASK_YIELDED; } while(0)
+
+// Sleep on the timer list until time_us_64() reaches time, for periodic tasks without drift
+#define TASK_SLEEP_UNTIL(t, time) do { (t)->wake_us = (time); (t)->line = __LINE__; \
+                                       return TASK_SLEEPING; case __LINE__:; } while(0)
+
+// Sleep on the timer list, no round runs the task before us microseconds passed
+#define TASK_SLEEP_US(t, us) TASK_SLEEP_UNTIL(t, time_us_64() + (us))
+
+typedef struct task task;
+
+typedef int (*task_function)(task* self);
+
+/**
+ * @name: Name shown by task_runtime_print() (const char*)
+ * @function: Coroutine of the task (task_function)
+ * @data: State of the task kept across yields (void*)
+ * @line: Resume point of function, 0 to start from the beginning (int)
+ * @wake_us: Time a sleeping task becomes ready (uint64_t)
+ * @next: Next task in the run queue or the timer list (task*)
+ * @runs: Number of times function ran (uint)
+ * @run_time_us: Time spent in function (uint64_t)
+ * @max_run_us: Longest single run of function (uint32_t)
+ */
+struct task {
+    const char* name;
+    task_function function;
+    void* data;
+    int line;
+    uint64_t wake_us;
+    task* next;
+    uint runs;
+    uint64_t run_time_us;
+    uint32_t max_run_us;
+};
+
+// Maximum number of tasks task_runtime_print() reports
+#define TASK_RUNTIME_MAX_TASKS 16
+
+/**
+ * Cooperative round-robin runtime.
+ *
+ * @ready: Run queue, first task runs first (task*)
+ * @sleeping: Timer list sorted by wake time (task*)
+ * @tasks: Every task started, for accounting (task*[])
+ * @number: Number of tasks started (uint8_t)
+ * @start_us: Time the accounting started (uint64_t)
+ * @rounds: Number of rounds run (uint)
+ */
+typedef struct task_runtime {
+    task* ready;
+    task* sleeping;
+    task* tasks[TASK_RUNTIME_MAX_TASKS];
+    uint8_t number;
+    uint64_t start_us;
+    uint rounds;
+} task_runtime;
+
+/**
+ * Initialize a task, it runs from the beginning once started.
+ *
+ * @param t Task to initialize
+ * @param name Name shown by task_runtime_print()
+ * @param function Coroutine of the task
+ * @param data State of the task
+ */
+void task_init(task* t, const char* name, task_function function, void* data);
+
+/**
+ * Initialize an empty runtime.
+ *
+ * @param runtime Runtime to initialize
+ */
+void task_runtime_init(task_runtime* runtime);
+
+/**
+ * Add a task to the end of the run queue.
+ * A task that returned TASK_DONE can be started again.
+ *
+ * @param runtime Runtime to run the task
+ * @param t Task to start, initialized by task_init(), not queued
+ * @return False if the runtime already has TASK_RUNTIME_MAX_TASKS tasks
+ */
+bool task_start(task_runtime* runtime, task* t);
+
+/**
+ * Run one round: wake due sleeping tasks, then run every ready task once.
+ * Call forever from the main loop.
+ *
+ * @param runtime Runtime to run
+ */
+void task_runtime_poll(task_runtime* runtime);
+
+/**
+ * Print runs, run time and CPU share of every task.
+ *
+ * @param runtime Runtime to print
+ */
+void task_runtime_print(task_runtime* runtime);
+
+/**
+ * Clear the run-time accounting of all tasks.
+ *
+ * @param runtime Runtime to clear
+ */
+void task_runtime_reset(task_runtime* runtime);
+
+
+#endif // TASK_H
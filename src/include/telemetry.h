@@ -0,0 +1,93 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "pico/stdlib.h"
+#include "arm_scheduler.h"
+
+// First byte of a telemetry frame on the console, followed by payload length (uint16_t),
+// payload and checksum (uint8_t, sum of the payload bytes)
+#define TELEMETRY_FRAME_START 0xA6
+
+// Fastest telemetry rate in frames per second
+#define TELEMETRY_MAX_RATE 200
+
+// Largest telemetry frame in bytes, one arm per frame so every frame fits in the CDC TX FIFO
+#define TELEMETRY_FRAME_SIZE (3 + 14 + 6 + SERVO_BANK_MAX_CHANNELS * 4 + 1)
+
+/**
+ * Periodic binary telemetry of all arms of a scheduler, one frame per arm and period.
+ * Payload, multi-byte fields little-endian:
+ * sequence (uint16_t, same for the frames of one period), time_us (uint32_t), longest and
+ * average loop time in microseconds (uint16_t each), dropped frames (uint16_t), arm id (uint8_t),
+ * number of arms (uint8_t), then queue depth (uint8_t), step and steps of the move in progress
+ * (uint16_t each, both 0 if idle), number of servos (uint8_t) and per servo
+ * PWM level (uint16_t) and angle (int16_t, hundredths of degree).
+ *
+ * @scheduler: Scheduler of the arms reported (arm_scheduler*)
+ * @period_us: Time between frames, 0 if telemetry is off (uint)
+ * @next_us: Time of the next frame (uint64_t)
+ * @sequence: Sequence number of the next frame (uint16_t)
+ * @frames: Number of frames sent (uint)
+ * @dropped: Number of frames dropped because the USB FIFO was full (uint)
+ * @loop_max_us: Longest main loop iteration since the last frame (uint32_t)
+ * @loop_total_us: Time of all main loop iterations since the last frame (uint32_t)
+ * @loop_count: Number of main loop iterations since the last frame (uint)
+ */
+typedef struct telemetry {
+    arm_scheduler* scheduler;
+    uint period_us;
+    uint64_t next_us;
+    uint16_t sequence;
+    uint frames;
+    uint dropped;
+    uint32_t loop_max_us;
+    uint32_t loop_total_us;
+    uint loop_count;
+} telemetry;
+
+/**
+ * Initialize telemetry, off until telemetry_set_rate().
+ *
+ * @param stream Telemetry to initialize
+ * @param scheduler Scheduler of the arms reported
+ */
+void telemetry_init(telemetry* stream, arm_scheduler* scheduler);
+
+/**
+ * Set the frame rate of telemetry.
+ *
+ * @param stream Telemetry to set
+ * @param rate Frames per second and arm, 0 to turn telemetry off
+ * @return False if rate is above TELEMETRY_MAX_RATE
+ */
+bool telemetry_set_rate(telemetry* stream, uint rate);
+
+/**
+ * Record the time of one main loop iteration.
+ *
+ * @param stream Telemetry to record
+ * @param elapsed_us Time of the iteration in microseconds
+ */
+void telemetry_record_loop(telemetry* stream, uint32_t elapsed_us);
+
+/**
+ * Build a telemetry frame of the current state of one arm.
+ *
+ * @param stream Telemetry to build
+ * @param arm Arm id
+ * @param frame Buffer of at least TELEMETRY_FRAME_SIZE bytes
+ * @return Length of frame in bytes
+ */
+uint telemetry_build_frame(telemetry* stream, uint8_t arm, uint8_t* frame);
+
+/**
+ * Send the frames of all arms if they are due, never blocks.
+ * Frames that do not fit in the USB FIFO are dropped and counted.
+ * Call often from the main loop.
+ *
+ * @param stream Telemetry to poll
+ */
+void telemetry_poll(telemetry* stream);
+
+
+#endif // TELEMETRY_H
@@ -0,0 +1,109 @@
+#ifndef TRAJECTORY_PACK_H
+#define TRAJECTORY_PACK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Trajectory pack: binary file of the moves of one arm, laid out so that a host can
+ * mmap it and read any move in place, shared by the firmware and the host tools.
+ *
+ * The file is the header, then sample_count samples of sample_size bytes, then the
+ * seek index at index_offset. A sample is the duration of the move in milliseconds
+ * (uint16_t) and the target angle of every servo of the header in hundredths of degree
+ * (uint16_t), the encoding of the binary command frames of arm_scheduler.h. Index entry k
+ * (uint64_t) is the time in milliseconds at which sample k << index_shift starts, so a seek
+ * is a binary search of the index and a scan of at most 1 << index_shift samples.
+ * All fields are little-endian, the byte order of the RP2040 and common hosts.
+ */
+
+#define TRAJECTORY_PACK_MAGIC "MTP1"
+
+// Most servos of a sample, SERVO_BANK_MAX_CHANNELS of the firmware
+#define TRAJECTORY_PACK_MAX_SERVOS 16
+
+// Default samples per index entry, 2^shift
+#define TRAJECTORY_PACK_INDEX_SHIFT 8
+
+// Angle units per degree of samples and binary command frames
+#define TRAJECTORY_PACK_ANGLE_SCALE 100
+
+/**
+ * First bytes of a trajectory pack, 8-byte aligned fields without padding.
+ *
+ * @magic: TRAJECTORY_PACK_MAGIC, not terminated (char[4])
+ * @number: Number of servos of every sample (uint8_t)
+ * @index_shift: Samples per index entry, 2^shift (uint8_t)
+ * @sample_size: Bytes of a sample, 2 + 2 * number (uint16_t)
+ * @indexes: Servo index of every angle of a sample (uint8_t[])
+ * @sample_count: Number of samples (uint64_t)
+ * @duration_ms: Sum of the durations of all samples (uint64_t)
+ * @index_offset: Offset of the seek index from the start of the file, 8-byte aligned (uint64_t)
+ * @index_count: Number of index entries, (sample_count >> index_shift) rounded up (uint64_t)
+ */
+typedef struct trajectory_pack_header {
+    char magic[4];
+    uint8_t number;
+    uint8_t index_shift;
+    uint16_t sample_size;
+    uint8_t indexes[TRAJECTORY_PACK_MAX_SERVOS];
+    uint64_t sample_count;
+    uint64_t duration_ms;
+    uint64_t index_offset;
+    uint64_t index_count;
+} trajectory_pack_header;
+
+_Static_assert(sizeof(trajectory_pack_header) == 56, "Trajectory pack header must not be padded");
+
+/**
+ * @param number Number of servos of a sample
+ * @return Bytes of a sample
+ */
+static inline uint16_t trajectory_pack_sample_size(uint8_t number) {
+    return 2 + 2 * number;
+}
+
+/**
+ * @param sample_count Number of samples
+ * @param number Number of servos of a sample
+ * @return Offset of the seek index of a pack
+ */
+static inline uint64_t trajectory_pack_index_offset(uint64_t sample_count, uint8_t number) {
+    uint64_t end = sizeof(trajectory_pack_header) + sample_count * trajectory_pack_sample_size(number);
+    return (end + 7) & ~(uint64_t)7;
+}
+
+/**
+ * Duration of the move between two absolute times in milliseconds.
+ * Rounding absolute times instead of differences keeps long trajectories from drifting.
+ *
+ * @param previous_us Time of the previous sample
+ * @param time_us Time of the sample
+ * @return Duration, at least 1 ms since 0 selects the speed preset of the firmware
+ */
+static inline uint16_t trajectory_pack_duration_ms(uint64_t previous_us, uint64_t time_us) {
+    uint64_t duration_ms = (time_us + 500) / 1000 - (previous_us + 500) / 1000;
+    if(duration_ms < 1)
+        return 1;
+    return duration_ms > UINT16_MAX ? UINT16_MAX : duration_ms;
+}
+
+/**
+ * @param angle Angle in degrees
+ * @return Angle in hundredths of degree, clamped to the range of uint16_t
+ */
+static inline uint16_t trajectory_pack_encode_angle(float angle) {
+    float scaled = angle * TRAJECTORY_PACK_ANGLE_SCALE + 0.5f;
+    return scaled < 0.0f ? 0 : scaled > UINT16_MAX ? UINT16_MAX : (uint16_t)scaled;
+}
+
+/**
+ * @param angle Angle in hundredths of degree
+ * @return Angle in degrees
+ */
+static inline float trajectory_pack_decode_angle(uint16_t angle) {
+    return (float)angle / TRAJECTORY_PACK_ANGLE_SCALE;
+}
+
+
+#endif // TRAJECTORY_PACK_H
@@ -0,0 +1,671 @@
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "motion_script.h"
+#include "console.h"
+#include "get_input_string.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Instructions, operands follow the opcode byte, multi-byte operands little-endian
+enum {
+    SCRIPT_OP_END,      // Stop the script
+    SCRIPT_OP_POSE,     // pose (uint8_t): start a move from a pose
+    SCRIPT_OP_ANGLE,    // index (uint8_t), value: set the angle of a servo of the move
+    SCRIPT_OP_MOVE,     // duration_ms (uint16_t), speed in tenths (uint16_t), profile (uint8_t): queue the move
+    SCRIPT_OP_WAIT,     // value: wait until queued moves finish, then value ms
+    SCRIPT_OP_SET,      // variable (uint8_t), value: assign a variable
+    SCRIPT_OP_ADD,      // variable (uint8_t), value: add to a variable
+    SCRIPT_OP_REPEAT,   // value, end (uint16_t): run the block value times, jump to end if none
+    SCRIPT_OP_NEXT      // start (uint16_t): jump back to start while runs are left
+};
+
+// A value is a variable (uint8_t) plus a constant in hundredths (int32_t)
+#define SCRIPT_VALUE_SIZE 5
+
+// Variable of values that are constants
+#define SCRIPT_NO_VARIABLE 0xFF
+
+// Length of the instructions with an operand of fixed size
+#define SCRIPT_POSE_SIZE 2
+#define SCRIPT_ANGLE_SIZE (2 + SCRIPT_VALUE_SIZE)
+#define SCRIPT_MOVE_SIZE 6
+#define SCRIPT_WAIT_SIZE (1 + SCRIPT_VALUE_SIZE)
+#define SCRIPT_SET_SIZE (2 + SCRIPT_VALUE_SIZE)
+#define SCRIPT_REPEAT_SIZE (1 + SCRIPT_VALUE_SIZE + 2)
+#define SCRIPT_NEXT_SIZE 3
+
+// Profile names of the move options, in order of motion_profile
+static const char* profile_names[] = {"cos", "lin", "jerk", "spline"};
+
+
+/**
+ * @param field: Operand to read, any alignment
+ * @return Operand read little-endian
+ */
+static uint16_t get_u16(const uint8_t* field) {
+    return field[0] | field[1] << 8;
+}
+
+/**
+ * @param field: Operand to read, any alignment
+ * @return Operand read little-endian
+ */
+static int32_t get_i32(const uint8_t* field) {
+    return (int32_t)(field[0] | field[1] << 8 | field[2] << 16 | (uint32_t)field[3] << 24);
+}
+
+/**
+ * @param field: Operand to write
+ * @param value: Value to write little-endian
+ */
+static void put_u16(uint8_t* field, uint16_t value) {
+    field[0] = value;
+    field[1] = value >> 8;
+}
+
+/**
+ * Report a compile error and keep the script invalid.
+ *
+ * @param compiler: Compiler failing
+ * @param message: Description of the error
+ * @return False
+ */
+static bool script_error(motion_script_compiler* compiler, const char* message) {
+    console_error("Script line %d: %s\n", compiler->line, message);
+    compiler->failed = true;
+    return false;
+}
+
+/**
+ * Split the next token off a line.
+ *
+ * @param cursor: Position in the line, moved after the token
+ * @return Token, NULL at the end of the line
+ */
+static char* script_token(char** cursor) {
+    char* token = *cursor;
+    while(is_space(*token))
+        token++;
+    if(*token == '\0')
+        return NULL;
+    char* end = token;
+    while(*end && !is_space(*end))
+        end++;
+    if(*end)
+        *end++ = '\0';
+    *cursor = end;
+    return token;
+}
+
+/**
+ * @param names: Names to search
+ * @param number: Number of names
+ * @param name: Name to find
+ * @return Index of name, -1 if not found
+ */
+static int script_find(char names[][MOTION_SCRIPT_NAME_SIZE], uint8_t number, const char* name) {
+    for(uint8_t i = 0; i < number; i++)
+        if(strcmp(names[i], name) == 0)
+            return i;
+    return -1;
+}
+
+/**
+ * Check a new name is valid and unused.
+ *
+ * @param compiler: Compiler checking
+ * @param name: Name of a new pose or variable
+ * @return False if the name is invalid or used
+ */
+static bool script_check_name(motion_script_compiler* compiler, const char* name) {
+    uint length = strlen(name);
+    bool valid = length > 0 && length < MOTION_SCRIPT_NAME_SIZE && !(name[0] >= '0' && name[0] <= '9');
+    for(uint i = 0; valid && i < length; i++)
+        valid = (name[i] >= 'a' && name[i] <= 'z') || (name[i] >= 'A' && name[i] <= 'Z')
+                || (name[i] >= '0' && name[i] <= '9') || name[i] == '_';
+    if(!valid)
+        return script_error(compiler, "Invalid name.");
+    motion_script* script = compiler->script;
+    if(script_find(compiler->pose_names, script->pose_count, name) >= 0
+       || script_find(compiler->variable_names, script->variable_count, name) >= 0)
+        return script_error(compiler, "Name already used.");
+    return true;
+}
+
+/**
+ * Parse a number into hundredths.
+ *
+ * @param token: Number, consumed entirely
+ * @param hundredths: Set to the number in hundredths
+ * @return False if token is not a number
+ */
+static bool script_parse_number(const char* token, int32_t* hundredths) {
+    char* endptr;
+    float number = strtof(token, &endptr);
+    if(endptr == token || *endptr != '\0' || number > 20000000.0f || number < -20000000.0f)
+        return false;
+    *hundredths = (int32_t)(number * 100.0f + (number < 0.0f ? -0.5f : 0.5f));
+    return true;
+}
+
+/**
+ * Parse a value and write its operand: a number, a variable, or a variable plus or minus a number.
+ *
+ * @param compiler: Compiler parsing
+ * @param token: Value to parse
+ * @param operand: Buffer of SCRIPT_VALUE_SIZE bytes
+ * @return False if the value is invalid
+ */
+static bool script_parse_value(motion_script_compiler* compiler, char* token, uint8_t* operand) {
+    int32_t constant = 0;
+    int variable = SCRIPT_NO_VARIABLE;
+    if(token == NULL)
+        return script_error(compiler, "Missing value.");
+    if((token[0] >= '0' && token[0] <= '9') || token[0] == '-' || token[0] == '+' || token[0] == '.') {
+        if(!script_parse_number(token, &constant))
+            return script_error(compiler, "Invalid number.");
+    } else {
+        char* sign = token + strcspn(token, "+-");
+        if(*sign && !script_parse_number(sign, &constant))
+            return script_error(compiler, "Invalid number after variable.");
+        char name[MOTION_SCRIPT_NAME_SIZE];
+        uint length = sign - token;
+        if(length >= MOTION_SCRIPT_NAME_SIZE)
+            return script_error(compiler, "Unknown variable.");
+        memcpy(name, token, length);
+        name[length] = '\0';
+        variable = script_find(compiler->variable_names, compiler->script->variable_count, name);
+        if(variable < 0)
+            return script_error(compiler, "Unknown variable.");
+    }
+    operand[0] = variable;
+    for(int i = 0; i < 4; i++)
+        operand[1 + i] = (uint32_t)constant >> (8 * i);
+    return true;
+}
+
+/**
+ * Reserve space for an instruction.
+ *
+ * @param compiler: Compiler emitting
+ * @param opcode: Opcode of the instruction
+ * @param length: Length of the instruction with its operands
+ * @return Instruction with its opcode set, NULL if the code is full
+ */
+static uint8_t* script_emit(motion_script_compiler* compiler, uint8_t opcode, uint length) {
+    motion_script* script = compiler->script;
+    // Keep room for the final end instruction
+    if(script->length + length + 1 > MOTION_SCRIPT_MAX_CODE) {
+        script_error(compiler, "Script too long.");
+        return NULL;
+    }
+    uint8_t* instruction = &script->code[script->length];
+    instruction[0] = opcode;
+    script->length += length;
+    return instruction;
+}
+
+/**
+ * Compile "pose <name> index angle ...".
+ *
+ * @param compiler: Compiler
+ * @param cursor: Rest of the line
+ * @return False if the statement is invalid
+ */
+static bool script_compile_pose(motion_script_compiler* compiler, char** cursor) {
+    motion_script* script = compiler->script;
+    char* name = script_token(cursor);
+    if(!name)
+        return script_error(compiler, "Missing pose name.");
+    if(!script_check_name(compiler, name))
+        return false;
+    if(script->pose_count == MOTION_SCRIPT_MAX_POSES)
+        return script_error(compiler, "Too many poses.");
+    motion_script_pose* pose = &script->poses[script->pose_count];
+    pose->number = 0;
+    char* token;
+    while((token = script_token(cursor))) {
+        char* angle = script_token(cursor);
+        int32_t hundredths;
+        char* endptr;
+        unsigned long index = strtoul(token, &endptr, 10);
+        if(*endptr != '\0' || index >= SERVO_BANK_MAX_CHANNELS || pose->number == SERVO_BANK_MAX_CHANNELS)
+            return script_error(compiler, "Invalid servo index in pose.");
+        if(!angle || !script_parse_number(angle, &hundredths) || hundredths > INT16_MAX || hundredths < INT16_MIN)
+            return script_error(compiler, "Invalid angle in pose.");
+        pose->indexes[pose->number] = index;
+        pose->angles[pose->number++] = hundredths;
+    }
+    if(pose->number == 0)
+        return script_error(compiler, "Pose without servos.");
+    strcpy(compiler->pose_names[script->pose_count++], name);
+    return true;
+}
+
+/**
+ * Compile "set <name> <value>" and "add <name> <value>".
+ *
+ * @param compiler: Compiler
+ * @param cursor: Rest of the line
+ * @param opcode: SCRIPT_OP_SET or SCRIPT_OP_ADD
+ * @return False if the statement is invalid
+ */
+static bool script_compile_assign(motion_script_compiler* compiler, char** cursor, uint8_t opcode) {
+    char* name = script_token(cursor);
+    int variable = name ? script_find(compiler->variable_names, compiler->script->variable_count, name) : -1;
+    if(variable < 0)
+        return script_error(compiler, "Unknown variable.");
+    uint8_t operand[SCRIPT_VALUE_SIZE];
+    if(!script_parse_value(compiler, script_token(cursor), operand))
+        return false;
+    uint8_t* instruction = script_emit(compiler, opcode, SCRIPT_SET_SIZE);
+    if(!instruction)
+        return false;
+    instruction[1] = variable;
+    memcpy(&instruction[2], operand, SCRIPT_VALUE_SIZE);
+    return true;
+}
+
+/**
+ * Compile "var <name> [value]".
+ *
+ * @param compiler: Compiler
+ * @param cursor: Rest of the line
+ * @return False if the statement is invalid
+ */
+static bool script_compile_var(motion_script_compiler* compiler, char** cursor) {
+    motion_script* script = compiler->script;
+    char* name = script_token(cursor);
+    if(!name)
+        return script_error(compiler, "Missing variable name.");
+    if(!script_check_name(compiler, name))
+        return false;
+    if(script->variable_count == MOTION_SCRIPT_MAX_VARIABLES)
+        return script_error(compiler, "Too many variables.");
+    uint8_t operand[SCRIPT_VALUE_SIZE] = {SCRIPT_NO_VARIABLE};
+    char* value = script_token(cursor);
+    if(value && !script_parse_value(compiler, value, operand))
+        return false;
+    uint8_t* instruction = script_emit(compiler, SCRIPT_OP_SET, SCRIPT_SET_SIZE);
+    if(!instruction)
+        return false;
+    instruction[1] = script->variable_count;
+    memcpy(&instruction[2], operand, SCRIPT_VALUE_SIZE);
+    strcpy(compiler->variable_names[script->variable_count++], name);
+    return true;
+}
+
+/**
+ * Compile "move [pose] index value ... [d<ms>] [s<speed>] [p<profile>]".
+ *
+ * @param compiler: Compiler
+ * @param cursor: Rest of the line
+ * @return False if the statement is invalid
+ */
+static bool script_compile_move(motion_script_compiler* compiler, char** cursor) {
+    motion_script* script = compiler->script;
+    uint duration_ms = 0;
+    uint speed = 0;
+    uint8_t profile = 0;
+    uint8_t number = 0;
+    char* token = script_token(cursor);
+    int pose = token ? script_find(compiler->pose_names, script->pose_count, token) : -1;
+    if(pose >= 0) {
+        uint8_t* instruction = script_emit(compiler, SCRIPT_OP_POSE, SCRIPT_POSE_SIZE);
+        if(!instruction)
+            return false;
+        instruction[1] = pose;
+        number = script->poses[pose].number;
+        token = script_token(cursor);
+    }
+    // Servo index and value pairs, then options
+    for(; token && token[0] >= '0' && token[0] <= '9'; token = script_token(cursor)) {
+        char* endptr;
+        unsigned long index = strtoul(token, &endptr, 10);
+        if(*endptr != '\0' || index >= SERVO_BANK_MAX_CHANNELS)
+            return script_error(compiler, "Invalid servo index.");
+        uint8_t operand[SCRIPT_VALUE_SIZE];
+        if(!script_parse_value(compiler, script_token(cursor), operand))
+            return false;
+        uint8_t* instruction = script_emit(compiler, SCRIPT_OP_ANGLE, SCRIPT_ANGLE_SIZE);
+        if(!instruction)
+            return false;
+        instruction[1] = index;
+        memcpy(&instruction[2], operand, SCRIPT_VALUE_SIZE);
+        number++;
+    }
+    for(; token; token = script_token(cursor)) {
+        char* endptr = token + 1;
+        switch(token[0]) {
+        case 'd':
+            duration_ms = strtoul(token + 1, &endptr, 10);
+            break;
+        case 's':
+            speed = (uint)(strtof(token + 1, &endptr) * 10.0f + 0.5f);
+            break;
+        case 'p':
+            while(profile < sizeof(profile_names) / sizeof(profile_names[0]) && strcmp(profile_names[profile], token + 1))
+                profile++;
+            endptr = profile < sizeof(profile_names) / sizeof(profile_names[0]) ? token + strlen(token) : token;
+            break;
+        }
+        if(endptr == token + 1 || *endptr != '\0' || duration_ms > UINT16_MAX || speed > UINT16_MAX)
+            return script_error(compiler, "Invalid move option, expected d<ms>, s<speed> or p<cos|lin|jerk|spline>.");
+    }
+    if(number == 0)
+        return script_error(compiler, "Move without servos.");
+    uint8_t* instruction = script_emit(compiler, SCRIPT_OP_MOVE, SCRIPT_MOVE_SIZE);
+    if(!instruction)
+        return false;
+    put_u16(&instruction[1], duration_ms);
+    put_u16(&instruction[3], speed);
+    instruction[5] = profile;
+    return true;
+}
+
+/**
+ * Compile "wait <value>".
+ *
+ * @param compiler: Compiler
+ * @param cursor: Rest of the line
+ * @return False if the statement is invalid
+ */
+static bool script_compile_wait(motion_script_compiler* compiler, char** cursor) {
+    uint8_t operand[SCRIPT_VALUE_SIZE];
+    if(!script_parse_value(compiler, script_token(cursor), operand))
+        return false;
+    uint8_t* instruction = script_emit(compiler, SCRIPT_OP_WAIT, SCRIPT_WAIT_SIZE);
+    if(!instruction)
+        return false;
+    memcpy(&instruction[1], operand, SCRIPT_VALUE_SIZE);
+    return true;
+}
+
+/**
+ * Compile "repeat <value>", the end of the block is patched by "end".
+ *
+ * @param compiler: Compiler
+ * @param cursor: Rest of the line
+ * @return False if the statement is invalid
+ */
+static bool script_compile_repeat(motion_script_compiler* compiler, char** cursor) {
+    if(compiler->depth == MOTION_SCRIPT_MAX_DEPTH)
+        return script_error(compiler, "Repeat blocks nested too deep.");
+    uint8_t operand[SCRIPT_VALUE_SIZE];
+    if(!script_parse_value(compiler, script_token(cursor), operand))
+        return false;
+    uint offset = compiler->script->length;
+    uint8_t* instruction = script_emit(compiler, SCRIPT_OP_REPEAT, SCRIPT_REPEAT_SIZE);
+    if(!instruction)
+        return false;
+    memcpy(&instruction[1], operand, SCRIPT_VALUE_SIZE);
+    compiler->loops[compiler->depth++] = offset;
+    return true;
+}
+
+/**
+ * Compile "end" of a repeat block.
+ *
+ * @param compiler: Compiler
+ * @return False if no repeat block is open
+ */
+static bool script_compile_end_block(motion_script_compiler* compiler) {
+    if(compiler->depth == 0)
+        return script_error(compiler, "End without repeat.");
+    motion_script* script = compiler->script;
+    uint offset = compiler->loops[compiler->depth - 1];
+    uint8_t* instruction = script_emit(compiler, SCRIPT_OP_NEXT, SCRIPT_NEXT_SIZE);
+    if(!instruction)
+        return false;
+    put_u16(&instruction[1], offset + SCRIPT_REPEAT_SIZE);
+    put_u16(&script->code[offset + 1 + SCRIPT_VALUE_SIZE], script->length);
+    compiler->depth--;
+    return true;
+}
+
+/**
+ * Start compiling a script, the previous code of script is dropped.
+ *
+ * @param compiler: Compiler to start
+ * @param script: Script to compile into
+ */
+void motion_script_compile_begin(motion_script_compiler* compiler, motion_script* script) {
+    memset(compiler, 0, sizeof(motion_script_compiler));
+    compiler->script = script;
+    script->length = 0;
+    script->pose_count = 0;
+    script->variable_count = 0;
+    script->valid = false;
+}
+
+/**
+ * Compile one line of a script.
+ *
+ * @param compiler: Compiler started by motion_script_compile_begin()
+ * @param line: Line without end of line, tokenized in place
+ * @return False if the line is invalid, the script stays invalid
+ */
+bool motion_script_compile_line(motion_script_compiler* compiler, char* line) {
+    compiler->line++;
+    line[strcspn(line, "#")] = '\0';
+    char* cursor = line;
+    char* keyword = script_token(&cursor);
+    bool compiled;
+    if(!keyword)
+        return true;
+    if(strcmp(keyword, "pose") == 0)
+        compiled = script_compile_pose(compiler, &cursor);
+    else if(strcmp(keyword, "var") == 0)
+        compiled = script_compile_var(compiler, &cursor);
+    else if(strcmp(keyword, "set") == 0)
+        compiled = script_compile_assign(compiler, &cursor, SCRIPT_OP_SET);
+    else if(strcmp(keyword, "add") == 0)
+        compiled = script_compile_assign(compiler, &cursor, SCRIPT_OP_ADD);
+    else if(strcmp(keyword, "move") == 0)
+        compiled = script_compile_move(compiler, &cursor);
+    else if(strcmp(keyword, "wait") == 0)
+        compiled = script_compile_wait(compiler, &cursor);
+    else if(strcmp(keyword, "repeat") == 0)
+        compiled = script_compile_repeat(compiler, &cursor);
+    else if(strcmp(keyword, "end") == 0)
+        compiled = script_compile_end_block(compiler);
+    else
+        return script_error(compiler, "Unknown statement.");
+    if(compiled && script_token(&cursor))
+        return script_error(compiler, "Unexpected text after statement.");
+    return compiled;
+}
+
+/**
+ * Finish compiling a script.
+ *
+ * @param compiler: Compiler started by motion_script_compile_begin()
+ * @return False if a line was invalid or a repeat block is not closed
+ */
+bool motion_script_compile_end(motion_script_compiler* compiler) {
+    motion_script* script = compiler->script;
+    if(compiler->depth)
+        script_error(compiler, "Repeat without end.");
+    script->code[script->length++] = SCRIPT_OP_END; // script_emit() kept room for it
+    script->valid = !compiler->failed;
+    return script->valid;
+}
+
+/**
+ * Compile a whole script.
+ *
+ * @param script: Script to compile into
+ * @param source: Lines of the script, modified by tokenizing
+ * @return False if the script is invalid
+ */
+bool motion_script_compile(motion_script* script, char* source) {
+    motion_script_compiler compiler;
+    motion_script_compile_begin(&compiler, script);
+    while(*source) {
+        char* line = source;
+        source += strcspn(source, "\r\n");
+        if(*source)
+            *source++ = '\0';
+        motion_script_compile_line(&compiler, line);
+    }
+    return motion_script_compile_end(&compiler);
+}
+
+/**
+ * Start running a compiled script.
+ *
+ * @param vm: Virtual machine to start
+ * @param script: Script compiled without errors
+ * @param submit: Callback queueing moves
+ * @param idle: Callback checking queued moves finished
+ * @param context: Context of the callbacks
+ * @return False if the script is not valid
+ */
+bool motion_script_start(motion_script_vm* vm, const motion_script* script, motion_script_submit submit,
+                         motion_script_idle idle, void* context) {
+    if(!script->valid) {
+        console_error("Script is not compiled.\n");
+        return false;
+    }
+    memset(vm, 0, sizeof(motion_script_vm));
+    vm->script = script;
+    vm->submit = submit;
+    vm->idle = idle;
+    vm->context = context;
+    vm->running = true;
+    return true;
+}
+
+/**
+ * @param vm: Virtual machine running
+ * @param operand: Value operand
+ * @return Value in hundredths
+ */
+static int32_t script_value(motion_script_vm* vm, const uint8_t* operand) {
+    int32_t value = get_i32(&operand[1]);
+    return operand[0] == SCRIPT_NO_VARIABLE ? value : value + vm->variables[operand[0]];
+}
+
+/**
+ * Run instructions until the budget is spent, the script waits or ends.
+ *
+ * @param vm: Virtual machine started by motion_script_start()
+ * @param budget: Most instructions to run
+ * @return MOTION_SCRIPT_RUNNING, MOTION_SCRIPT_WAITING, MOTION_SCRIPT_DONE or MOTION_SCRIPT_FAILED
+ */
+int motion_script_run(motion_script_vm* vm, uint budget) {
+    const uint8_t* code = vm->script->code;
+    for(; budget; budget--) {
+        if(!vm->running)
+            return MOTION_SCRIPT_DONE;
+        const uint8_t* instruction = &code[vm->pc];
+        switch(instruction[0]) {
+        case SCRIPT_OP_END:
+            vm->running = false;
+            return MOTION_SCRIPT_DONE;
+        case SCRIPT_OP_POSE: {
+            const motion_script_pose* pose = &vm->script->poses[instruction[1]];
+            for(uint8_t i = 0; i < pose->number; i++) {
+                vm->indexes[i] = pose->indexes[i];
+                vm->angles[i] = pose->angles[i] / 100.0f;
+            }
+            vm->number = pose->number;
+            vm->pc += SCRIPT_POSE_SIZE;
+            break;
+        }
+        case SCRIPT_OP_ANGLE: {
+            // Servos listed after a pose replace its angle
+            uint8_t i = 0;
+            while(i < vm->number && vm->indexes[i] != instruction[1])
+                i++;
+            if(i == SERVO_BANK_MAX_CHANNELS) {
+                vm->running = false;
+                console_error("Script move has too many servos.\n");
+                return MOTION_SCRIPT_FAILED;
+            }
+            vm->indexes[i] = instruction[1];
+            vm->angles[i] = script_value(vm, &instruction[2]) / 100.0f;
+            if(i == vm->number)
+                vm->number++;
+            vm->pc += SCRIPT_ANGLE_SIZE;
+            break;
+        }
+        case SCRIPT_OP_MOVE: {
+            robotic_arm_signal signal = {
+                .number = vm->number,
+                .indexes = vm->indexes,
+                .angles = vm->angles,
+                .options = {
+                    .duration_ms = get_u16(&instruction[1]),
+                    .speed = get_u16(&instruction[3]) / 10.0f,
+                    .profile = instruction[5]
+                }
+            };
+            int result = vm->submit(vm->context, &signal);
+            if(result == 0)
+                return MOTION_SCRIPT_WAITING; // Queue full, the move is submitted again
+            if(result < 0) {
+                vm->running = false;
+                console_error("Script move at %d rejected.\n", vm->pc);
+                return MOTION_SCRIPT_FAILED;
+            }
+            vm->number = 0;
+            vm->moves++;
+            vm->pc += SCRIPT_MOVE_SIZE;
+            break;
+        }
+        case SCRIPT_OP_WAIT:
+            if(!vm->waiting) {
+                vm->waiting = true;
+                vm->wait_until_us = 0;
+            }
+            if(!vm->wait_until_us) {
+                if(!vm->idle(vm->context))
+                    return MOTION_SCRIPT_WAITING;
+                int32_t wait = script_value(vm, &instruction[1]);
+                // Hundredths of a millisecond are tens of microseconds
+                vm->wait_until_us = time_us_64() + (wait > 0 ? wait * 10 : 0);
+            }
+            if(time_us_64() < vm->wait_until_us)
+                return MOTION_SCRIPT_WAITING;
+            vm->waiting = false;
+            vm->pc += SCRIPT_WAIT_SIZE;
+            break;
+        case SCRIPT_OP_SET:
+            vm->variables[instruction[1]] = script_value(vm, &instruction[2]);
+            vm->pc += SCRIPT_SET_SIZE;
+            break;
+        case SCRIPT_OP_ADD:
+            vm->variables[instruction[1]] += script_value(vm, &instruction[2]);
+            vm->pc += SCRIPT_SET_SIZE;
+            break;
+        case SCRIPT_OP_REPEAT: {
+            int32_t count = script_value(vm, &instruction[1]) / 100;
+            if(count <= 0) {
+                vm->pc = get_u16(&instruction[1 + SCRIPT_VALUE_SIZE]);
+                break;
+            }
+            vm->loops[vm->depth].start = vm->pc + SCRIPT_REPEAT_SIZE;
+            vm->loops[vm->depth++].count = count;
+            vm->pc += SCRIPT_REPEAT_SIZE;
+            break;
+        }
+        case SCRIPT_OP_NEXT: {
+            motion_script_loop* loop = &vm->loops[vm->depth - 1];
+            if(--loop->count > 0) {
+                vm->pc = loop->start;
+            } else {
+                vm->depth--;
+                vm->pc += SCRIPT_NEXT_SIZE;
+            }
+            break;
+        }
+        default:
+            vm->running = false;
+            console_error("Invalid script instruction at %d.\n", vm->pc);
+            return MOTION_SCRIPT_FAILED;
+        }
+        vm->steps++;
+    }
+    return MOTION_SCRIPT_RUNNING;
+}
@@ -0,0 +1,347 @@
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "motion_timeline.h"
+#include "arm_scheduler.h"
+#include "console.h"
+#include "servo_bank.h"
+#include "trajectory_pack.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+
+/**
+ * Create an empty timeline for a robotic arm.
+ *
+ * @param number: Number of servos of the robotic arm
+ */
+motion_timeline* motion_timeline_create(uint8_t number) {
+    motion_timeline* timeline = calloc(1, sizeof(motion_timeline));
+    if(!timeline) {
+        console_error("Motion timeline malloc failed.\n");
+        return NULL;
+    }
+    timeline->number = number;
+    timeline->peak_velocities = calloc(number, sizeof(float));
+    if(!timeline->peak_velocities) {
+        console_error("Motion timeline velocities malloc failed.\n");
+        free(timeline);
+        return NULL;
+    }
+    return timeline;
+}
+
+/**
+ * Clear all ticks and statistics of a timeline.
+ *
+ * @param timeline: Timeline to clear
+ */
+void motion_timeline_clear(motion_timeline* timeline) {
+    timeline->ticks = 0;
+    timeline->clamp_events = 0;
+    memset(timeline->peak_velocities, 0, timeline->number * sizeof(float));
+}
+
+/**
+ * Free memory malloced by motion_timeline_create().
+ *
+ * @param timeline: Timeline to free
+ */
+void motion_timeline_free(motion_timeline* timeline) {
+    free(timeline->times_us);
+    free(timeline->levels);
+    free(timeline->angles);
+    free(timeline->peak_velocities);
+    free(timeline);
+}
+
+/**
+ * Grow the buffers of a timeline to hold one more tick.
+ *
+ * @param timeline: Timeline to grow
+ * @return False if malloc failed
+ */
+static bool motion_timeline_reserve(motion_timeline* timeline) {
+    if(timeline->ticks < timeline->capacity)
+        return true;
+    uint capacity = timeline->capacity ? timeline->capacity * 2 : 256;
+    uint32_t* times_us = realloc(timeline->times_us, capacity * sizeof(uint32_t));
+    if(times_us)
+        timeline->times_us = times_us;
+    uint16_t* levels = realloc(timeline->levels, capacity * timeline->number * sizeof(uint16_t));
+    if(levels)
+        timeline->levels = levels;
+    float* angles = realloc(timeline->angles, capacity * timeline->number * sizeof(float));
+    if(angles)
+        timeline->angles = angles;
+    if(!times_us || !levels || !angles) {
+        console_error("Motion timeline realloc failed.\n");
+        return false;
+    }
+    timeline->capacity = capacity;
+    return true;
+}
+
+/**
+ * Append a tick to a timeline and update peak velocities.
+ *
+ * @param timeline: Timeline to append
+ * @param time_us: Time of the tick from the start of the motion
+ * @param levels: PWM levels of all servos
+ * @param servo_angles: Angles of all servos in degrees
+ * @return False if malloc failed
+ */
+static bool motion_timeline_record(motion_timeline* timeline, uint32_t time_us, uint16_t* levels, float* servo_angles) {
+    if(!motion_timeline_reserve(timeline))
+        return false;
+    uint8_t number = timeline->number;
+    float* angles = &timeline->angles[timeline->ticks * number];
+    memcpy(angles, servo_angles, number * sizeof(float));
+    memcpy(&timeline->levels[timeline->ticks * number], levels, number * sizeof(uint16_t));
+    if(timeline->ticks) {
+        uint32_t delta_us = time_us - timeline->times_us[timeline->ticks - 1];
+        float* last_angles = angles - number;
+        for(uint8_t i = 0; delta_us && i < number; i++) {
+            float velocity = fabsf(angles[i] - last_angles[i]) * 1e6f / delta_us;
+            if(velocity > timeline->peak_velocities[i])
+                timeline->peak_velocities[i] = velocity;
+        }
+    }
+    timeline->times_us[timeline->ticks++] = time_us;
+    return true;
+}
+
+/**
+ * Run one tick of the dry scheduler of a render and record it if the arm moved.
+ *
+ * @param timeline: Timeline to append
+ * @param scheduler: Dry scheduler driving one arm
+ * @param start_us: Time of the first tick of the render in the timeline
+ * @param now_us: Time of the tick from the start of the render, advanced to the next tick
+ * @return False if malloc failed
+ */
+static bool motion_timeline_tick(motion_timeline* timeline, arm_scheduler* scheduler, uint32_t start_us,
+                                 uint64_t* now_us) {
+    arm_channel* arm = &scheduler->arms[0];
+    uint64_t next_tick_us = arm->next_tick_us;
+    bool moving = arm->moving;
+    arm_scheduler_tick_at(scheduler, ARM_STOP_NONE, *now_us);
+    uint32_t time_us = start_us + *now_us;
+    *now_us += scheduler->tick_us;
+    // Moves of servos slower than the tick skip ticks, as on the pins
+    if(moving == arm->moving && next_tick_us == arm->next_tick_us)
+        return true;
+    float angles[timeline->number];
+    for(uint8_t i = 0; i < timeline->number; i++)
+        angles[i] = arm->robot->servos[i].angle;
+    // Servos of a move in progress store their angles once it finished
+    if(arm->moving) {
+        arm_command* command = &arm->queue[arm->head];
+        for(uint8_t i = 0; i < command->number; i++)
+            angles[command->indexes[i]] = servo_bank_angle(&arm->bank, i);
+    }
+    return motion_timeline_record(timeline, time_us, arm->dry_levels, angles);
+}
+
+/**
+ * @param servos: All servos of the robotic arm
+ * @param signal: Control signal
+ * @return Number of targets of signal clamped to servo limits
+ */
+static uint motion_timeline_clamps(servo* servos, robotic_arm_signal* signal) {
+    servo* motors[signal->number];
+    servo_bank bank;
+    SERVOS_PICK(motors, servos, signal->indexes, signal->number);
+    if(!servo_bank_load(&bank, signal->number, motors))
+        return 0;
+    servo_bank_target(&bank, signal->angles);
+    return bank.clamped;
+}
+
+/**
+ * Render a sequence of control signals into a timeline without touching hardware.
+ * The signals run through a private arm scheduler on its own clock, so spline keyframes join,
+ * the feed ramps and the ticks fall as in a real run. The robotic arm is not changed,
+ * the sequence starts from its current angles.
+ *
+ * @param timeline: Timeline to append, created for the number of servos of robot
+ * @param robot: Robotic arm to render
+ * @param signals: Control signals to render in order
+ * @param count: Number of control signals
+ * @param pause_us: Pause between control signals in microseconds, the next one starts on the tick after it
+ *                  as robotic_arm_custom_control_task() runs them; 0 queues all signals, so spline keyframes join
+ * @return False if a signal is invalid or malloc failed
+ */
+bool motion_timeline_render(motion_timeline* timeline, robotic_arm* robot,
+                            robotic_arm_signal* signals, uint count, uint pause_us) {
+    if(timeline->number != robot->number) {
+        console_error("Motion timeline does not match robotic arm.\n");
+        return false;
+    }
+    for(uint k = 0; k < count; k++) {
+        robotic_arm_signal* signal = &signals[k];
+        if(signal->number < 1 || signal->number > robot->number) {
+            console_error("Invalid number of servos in signal %d.\n", k);
+            return false;
+        }
+        for(uint8_t i = 0; i < signal->number; i++) {
+            if(signal->indexes[i] >= robot->number) {
+                console_error("Index out of range in signal %d.\n", k);
+                return false;
+            }
+        }
+    }
+    // Render on copies of the servos, the real arm keeps its state
+    servo shadow[robot->number];
+    uint16_t levels[robot->number];
+    memcpy(shadow, robot->servos, sizeof(shadow));
+    for(uint8_t i = 0; i < robot->number; i++)
+        levels[i] = servo_angle_to_level(&shadow[i], shadow[i].angle);
+    robotic_arm shadow_arm = {.number = robot->number, .servos = shadow};
+    // Too large for the stack of the RP2040
+    arm_scheduler* scheduler = malloc(sizeof(arm_scheduler));
+    if(!scheduler) {
+        console_error("Motion timeline scheduler malloc failed.\n");
+        return false;
+    }
+    arm_scheduler_init(scheduler, SERVO_BANK_MAX_CHANNELS);
+    bool ok = arm_scheduler_add_arm(scheduler, &shadow_arm) == 0;
+    arm_channel* arm = &scheduler->arms[0];
+    arm->dry_levels = levels;
+    uint32_t start_us = timeline->ticks ? timeline->times_us[timeline->ticks - 1] + pause_us : 0;
+    uint64_t now_us = 0;
+    for(uint k = 0; ok && k < count; k++) {
+        if(pause_us) {
+            while(ok && arm->count)
+                ok = motion_timeline_tick(timeline, scheduler, start_us, &now_us);
+            if(k)
+                now_us += pause_us / scheduler->tick_us * scheduler->tick_us;
+        } else {
+            while(ok && arm->count == ARM_SCHEDULER_QUEUE_SIZE)
+                ok = motion_timeline_tick(timeline, scheduler, start_us, &now_us);
+        }
+        timeline->clamp_events += motion_timeline_clamps(shadow, &signals[k]);
+        ok = ok && arm_scheduler_submit(scheduler, 0, &signals[k]);
+    }
+    while(ok && arm->count)
+        ok = motion_timeline_tick(timeline, scheduler, start_us, &now_us);
+    free(scheduler);
+    return ok;
+}
+
+/**
+ * @param timeline: Timeline to measure
+ * @return Duration of the timeline in microseconds
+ */
+uint32_t motion_timeline_duration_us(motion_timeline* timeline) {
+    return timeline->ticks ? timeline->times_us[timeline->ticks - 1] : 0;
+}
+
+/**
+ * Print duration, peak velocities and clamping events of a timeline.
+ *
+ * @param timeline: Timeline to print
+ */
+void motion_timeline_print_report(motion_timeline* timeline) {
+    console_printf("Dry run: %d ticks, %.3f s\n", timeline->ticks, motion_timeline_duration_us(timeline) / 1e6f);
+    for(uint8_t i = 0; i < timeline->number; i++)
+        console_printf("Servo %d peak velocity: %.2f degrees/s\n", i, timeline->peak_velocities[i]);
+    console_printf("Clamping events: %d\n", timeline->clamp_events);
+}
+
+/**
+ * Write a timeline as CSV, one line per tick: "time_us,level0,...,angle0,...".
+ *
+ * @param timeline: Timeline to write
+ * @param file: File to write
+ */
+void motion_timeline_write_csv(motion_timeline* timeline, FILE* file) {
+    uint8_t number = timeline->number;
+    fprintf(file, "time_us");
+    for(uint8_t i = 0; i < number; i++)
+        fprintf(file, ",level%d", i);
+    for(uint8_t i = 0; i < number; i++)
+        fprintf(file, ",angle%d", i);
+    fprintf(file, "\n");
+    for(uint tick = 0; tick < timeline->ticks; tick++) {
+        fprintf(file, "%lu", (unsigned long)timeline->times_us[tick]);
+        for(uint8_t i = 0; i < number; i++)
+            fprintf(file, ",%d", timeline->levels[tick * number + i]);
+        for(uint8_t i = 0; i < number; i++)
+            fprintf(file, ",%.2f", timeline->angles[tick * number + i]);
+        fprintf(file, "\n");
+    }
+}
+
+/**
+ * Write a timeline as binary: magic "MTL1", number (uint8_t), ticks (uint32_t),
+ * then per tick time (uint32_t), levels (uint16_t[number]) and angles (float[number]),
+ * all in native byte order.
+ *
+ * @param timeline: Timeline to write
+ * @param file: File to write
+ */
+void motion_timeline_write_binary(motion_timeline* timeline, FILE* file) {
+    uint8_t number = timeline->number;
+    uint32_t ticks = timeline->ticks;
+    fwrite("MTL1", 1, 4, file);
+    fwrite(&number, sizeof(number), 1, file);
+    fwrite(&ticks, sizeof(ticks), 1, file);
+    for(uint tick = 0; tick < ticks; tick++) {
+        fwrite(&timeline->times_us[tick], sizeof(uint32_t), 1, file);
+        fwrite(&timeline->levels[tick * number], sizeof(uint16_t), number, file);
+        fwrite(&timeline->angles[tick * number], sizeof(float), number, file);
+    }
+}
+
+/**
+ * @param timeline: Timeline to measure
+ * @param tick: Tick index
+ * @return Duration of the move to a tick in the samples of a trajectory pack
+ */
+static uint16_t motion_timeline_tick_ms(motion_timeline* timeline, uint tick) {
+    return trajectory_pack_duration_ms(tick ? timeline->times_us[tick - 1] : 0, timeline->times_us[tick]);
+}
+
+/**
+ * Write a timeline as a trajectory pack, one sample per tick, see trajectory_pack.h.
+ * Durations come from the rounded tick times, so the angles of tick k are reached
+ * at the sum of the durations of ticks 0..k.
+ *
+ * @param timeline: Timeline to write
+ * @param file: File to write
+ */
+void motion_timeline_write_pack(motion_timeline* timeline, FILE* file) {
+    uint8_t number = timeline->number;
+    trajectory_pack_header header = {
+        .number = number,
+        .index_shift = TRAJECTORY_PACK_INDEX_SHIFT,
+        .sample_size = trajectory_pack_sample_size(number),
+        .sample_count = timeline->ticks,
+        .index_offset = trajectory_pack_index_offset(timeline->ticks, number),
+        .index_count = (timeline->ticks + (1u << TRAJECTORY_PACK_INDEX_SHIFT) - 1) >> TRAJECTORY_PACK_INDEX_SHIFT
+    };
+    memcpy(header.magic, TRAJECTORY_PACK_MAGIC, 4);
+    for(uint8_t i = 0; i < number; i++)
+        header.indexes[i] = i;
+    for(uint tick = 0; tick < timeline->ticks; tick++)
+        header.duration_ms += motion_timeline_tick_ms(timeline, tick);
+    fwrite(&header, sizeof(header), 1, file);
+
+    uint16_t sample[1 + TRAJECTORY_PACK_MAX_SERVOS];
+    for(uint tick = 0; tick < timeline->ticks; tick++) {
+        sample[0] = motion_timeline_tick_ms(timeline, tick);
+        for(uint8_t i = 0; i < number; i++)
+            sample[1 + i] = trajectory_pack_encode_angle(timeline->angles[tick * number + i]);
+        fwrite(sample, sizeof(uint16_t), 1 + number, file);
+    }
+    uint64_t padding = 0;
+    fwrite(&padding, 1, header.index_offset - sizeof(header) - (uint64_t)timeline->ticks * header.sample_size, file);
+
+    uint64_t start_ms = 0;
+    for(uint tick = 0; tick < timeline->ticks; tick++) {
+        if(!(tick & ((1u << TRAJECTORY_PACK_INDEX_SHIFT) - 1)))
+            fwrite(&start_ms, sizeof(start_ms), 1, file);
+        start_ms += motion_timeline_tick_ms(timeline, tick);
+    }
+}
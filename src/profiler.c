@@ -0,0 +1,254 @@
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "profiler.h"
+
+#ifdef SAMPLING_PROFILER
+
+#include "console.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __ARM_ARCH_6M__
+#include "hardware/irq.h"
+#include "hardware/timer.h"
+#else
+// Host builds, like the simulator, sample with the profiling timer signal of the process
+#include <signal.h>
+#include <sys/time.h>
+#include <ucontext.h>
+#endif
+
+// Slots tried after the hashed one before a sample is dropped
+#define PROFILER_PROBES 8
+
+/**
+ * Number of samples of one program counter.
+ *
+ * @pc: Program counter, 0 if the slot is free (uintptr_t)
+ * @count: Number of samples (uint32_t)
+ */
+typedef struct profiler_entry {
+    uintptr_t pc;
+    uint32_t count;
+} profiler_entry;
+
+static profiler_entry table[PROFILER_TABLE_SIZE];
+static volatile bool running;
+static uint period;
+static uint32_t samples;
+static uint32_t dropped;
+static uint32_t histograms[PROFILER_LOOP_COUNT][PROFILER_BUCKETS];
+static uint32_t longest_us[PROFILER_LOOP_COUNT];
+
+/**
+ * Count a sample of a program counter, runs in interrupt context.
+ *
+ * @param pc: Interrupted program counter
+ */
+static void profiler_sample(uintptr_t pc) {
+    samples++;
+    // Fibonacci hashing, code addresses differ in their low bits
+    uint slot = ((uint32_t)pc * 2654435761u) >> (32 - PROFILER_TABLE_BITS);
+    for(uint probe = 0; probe < PROFILER_PROBES; probe++, slot = (slot + 1) & (PROFILER_TABLE_SIZE - 1)) {
+        if(table[slot].pc == pc || !table[slot].pc) {
+            table[slot].pc = pc;
+            table[slot].count++;
+            return;
+        }
+    }
+    dropped++;
+}
+
+#ifdef __ARM_ARCH_6M__
+
+static int profiler_alarm = -1;
+
+/**
+ * Sample the exception frame of the interrupted code and raise the next sample.
+ * Called by profiler_irq(), not static so the assembly can name it.
+ *
+ * @param frame: Registers stacked on exception entry: r0-r3, r12, lr, pc, xpsr
+ */
+void profiler_sample_frame(uint32_t* frame) {
+    hw_clear_bits(&timer_hw->intr, 1u << profiler_alarm);
+    if(!running)
+        return;
+    timer_hw->alarm[profiler_alarm] = timer_hw->timerawl + period;
+    profiler_sample(frame[6]);
+}
+
+/**
+ * Timer interrupt handler passing the stack of the interrupted code to profiler_sample_frame().
+ * Bit 2 of the exception return value in lr selects the process or main stack.
+ * The Cortex-M0+ cannot branch conditionally that far, so the jump goes through a register.
+ */
+static void __attribute__((naked)) profiler_irq(void) {
+    __asm volatile(
+        "movs r0, #4\n"
+        "mov r1, lr\n"
+        "tst r0, r1\n"
+        "beq 1f\n"
+        "mrs r0, psp\n"
+        "b 2f\n"
+        "1: mrs r0, msp\n"
+        "2: ldr r1, 3f\n"
+        "bx r1\n"
+        ".align 2\n"
+        "3: .word profiler_sample_frame\n"
+    );
+}
+
+/**
+ * Start sampling, the table and histograms keep their counts.
+ * Samples come from an alarm of its own at the highest priority, so other interrupts are sampled too.
+ *
+ * @param period_us: Time between samples
+ * @return False if no timer is available
+ */
+bool profiler_start(uint period_us) {
+    if(profiler_alarm < 0) {
+        profiler_alarm = hardware_alarm_claim_unused(false);
+        if(profiler_alarm < 0) {
+            console_error("No hardware alarm left for the profiler.\n");
+            return false;
+        }
+        uint irq = TIMER_IRQ_0 + profiler_alarm;
+        irq_set_exclusive_handler(irq, profiler_irq);
+        irq_set_priority(irq, PICO_HIGHEST_IRQ_PRIORITY);
+        hw_set_bits(&timer_hw->inte, 1u << profiler_alarm);
+        irq_set_enabled(irq, true);
+    }
+    period = period_us;
+    running = true;
+    timer_hw->alarm[profiler_alarm] = timer_hw->timerawl + period;
+    return true;
+}
+
+/**
+ * Stop sampling.
+ */
+void profiler_stop(void) {
+    running = false;
+    if(profiler_alarm >= 0)
+        timer_hw->armed = 1u << profiler_alarm;
+}
+
+#else
+
+/**
+ * Sample the program counter the profiling signal interrupted.
+ */
+static void profiler_signal(int signal_number, siginfo_t* info, void* context) {
+    (void)signal_number;
+    (void)info;
+    ucontext_t* interrupted = context;
+    if(!running)
+        return;
+#if defined(__x86_64__)
+    profiler_sample(interrupted->uc_mcontext.gregs[REG_RIP]);
+#elif defined(__aarch64__)
+    profiler_sample(interrupted->uc_mcontext.pc);
+#else
+#error "No program counter of interrupted code on this host"
+#endif
+}
+
+/**
+ * Start sampling, the table and histograms keep their counts.
+ * The profiling timer counts CPU time of the process, so a sleeping simulator is not sampled.
+ *
+ * @param period_us: Time between samples
+ * @return False if no timer is available
+ */
+bool profiler_start(uint period_us) {
+    struct sigaction action = {.sa_sigaction = profiler_signal, .sa_flags = SA_SIGINFO | SA_RESTART};
+    sigemptyset(&action.sa_mask);
+    struct itimerval timer = {.it_interval = {0, period_us}, .it_value = {0, period_us}};
+    period = period_us;
+    running = true;
+    if(sigaction(SIGPROF, &action, NULL) || setitimer(ITIMER_PROF, &timer, NULL)) {
+        fprintf(stderr, "No profiling timer.\n");
+        running = false;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Stop sampling.
+ */
+void profiler_stop(void) {
+    struct itimerval timer = {0};
+    running = false;
+    setitimer(ITIMER_PROF, &timer, NULL);
+}
+
+#endif // __ARM_ARCH_6M__
+
+/**
+ * Add a duration to the histogram of a loop.
+ *
+ * @param loop: Loop timed
+ * @param us: Duration of one pass in microseconds
+ */
+void profiler_loop_time(profiler_loop loop, uint32_t us) {
+    // Bucket i holds [2^(i-1), 2^i), the number of bits of us
+    uint bucket = us ? 32 - __builtin_clz(us) : 0;
+    if(bucket >= PROFILER_BUCKETS)
+        bucket = PROFILER_BUCKETS - 1;
+    histograms[loop][bucket]++;
+    if(us > longest_us[loop])
+        longest_us[loop] = us;
+}
+
+/**
+ * Order profiler entries by decreasing count.
+ */
+static int profiler_compare(const void* a, const void* b) {
+    uint32_t count_a = ((const profiler_entry*)a)->count;
+    uint32_t count_b = ((const profiler_entry*)b)->count;
+    return count_a < count_b ? 1 : count_a > count_b ? -1 : 0;
+}
+
+/**
+ * Print the most sampled program counters and the loop histograms, then clear them.
+ * The first line holds the address of profiler_print() so the host script can relocate the samples.
+ */
+void profiler_print(void) {
+    static const char* loop_names[] = {"Tick", "Round"};
+    bool was_running = running;
+    // Sorting breaks the hash table, no sample may land in it meanwhile
+    running = false;
+    qsort(table, PROFILER_TABLE_SIZE, sizeof(profiler_entry), profiler_compare);
+    console_printf("Profile: %lu samples every %u us, %lu dropped, base %lx\n", (unsigned long)samples, period,
+                   (unsigned long)dropped, (unsigned long)(uintptr_t)profiler_print);
+    for(uint i = 0; i < PROFILER_PRINT_MAX && table[i].count; i++)
+        console_printf("%lx %lu\n", (unsigned long)table[i].pc, (unsigned long)table[i].count);
+    for(uint loop = 0; loop < PROFILER_LOOP_COUNT; loop++) {
+        uint32_t passes = 0;
+        for(uint bucket = 0; bucket < PROFILER_BUCKETS; bucket++)
+            passes += histograms[loop][bucket];
+        console_printf("%s: %lu passes, longest %lu us\n", loop_names[loop], (unsigned long)passes,
+                       (unsigned long)longest_us[loop]);
+        for(uint bucket = 0; bucket < PROFILER_BUCKETS; bucket++) {
+            if(!histograms[loop][bucket])
+                continue;
+            uint32_t low = bucket ? 1u << (bucket - 1) : 0;
+            if(bucket == PROFILER_BUCKETS - 1)
+                console_printf("  >= %lu us: %lu\n", (unsigned long)low, (unsigned long)histograms[loop][bucket]);
+            else
+                console_printf("  %lu-%lu us: %lu\n", (unsigned long)low, (unsigned long)(bucket ? (1u << bucket) - 1 : 0),
+                               (unsigned long)histograms[loop][bucket]);
+        }
+    }
+    console_printf("End of profile.\n");
+    memset(table, 0, sizeof(table));
+    memset(histograms, 0, sizeof(histograms));
+    memset(longest_us, 0, sizeof(longest_us));
+    samples = 0;
+    dropped = 0;
+    if(was_running)
+        profiler_start(period);
+}
+
+#endif // SAMPLING_PROFILER
@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "console.h"
+#include "pwm_trace.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Trace being recorded, NULL if not recording
+static pwm_trace* recording = NULL;
+
+/**
+ * Create an empty trace.
+ *
+ * @param capacity: Number of records the trace can hold
+ */
+pwm_trace* pwm_trace_create(uint capacity) {
+    pwm_trace* trace = calloc(1, sizeof(pwm_trace));
+    if(!trace) {
+        console_error("PWM trace malloc failed.\n");
+        return NULL;
+    }
+    trace->records = malloc(capacity * sizeof(pwm_trace_record));
+    if(!trace->records) {
+        console_error("PWM trace records malloc failed.\n");
+        free(trace);
+        return NULL;
+    }
+    trace->capacity = capacity;
+    return trace;
+}
+
+/**
+ * Free memory malloced by pwm_trace_create().
+ *
+ * @param trace: Trace to free
+ */
+void pwm_trace_free(pwm_trace* trace) {
+    if(recording == trace)
+        recording = NULL;
+    free(trace->records);
+    free(trace);
+}
+
+/**
+ * Clear a trace and record all following PWM writes of servos into it.
+ *
+ * @param trace: Trace to record, NULL to stop recording
+ */
+void pwm_trace_start(pwm_trace* trace) {
+    if(trace) {
+        trace->number = 0;
+        trace->dropped = 0;
+    }
+    recording = trace;
+}
+
+/**
+ * Stop recording PWM writes.
+ */
+void pwm_trace_stop(void) {
+    recording = NULL;
+}
+
+/**
+ * Record a PWM write into the trace being recorded, if any.
+ * Called by SERVO_PWM_SET_LEVEL.
+ *
+ * @param pin: GPIO pin written
+ * @param level: PWM level written
+ */
+void pwm_trace_add(uint pin, uint16_t level) {
+    if(!recording)
+        return;
+    if(recording->number == recording->capacity) {
+        recording->dropped++;
+        return;
+    }
+    pwm_trace_record* record = &recording->records[recording->number++];
+    record->time_us = time_us_64();
+    record->pin = pin;
+    record->level = level;
+}
+
+/**
+ * Write a trace as CSV, one line per record: "time_us,pin,level".
+ * Times are relative to the first record.
+ *
+ * @param trace: Trace to write
+ * @param file: File to write
+ */
+void pwm_trace_write_csv(pwm_trace* trace, FILE* file) {
+    uint64_t start_us = trace->number ? trace->records[0].time_us : 0;
+    fprintf(file, "time_us,pin,level\n");
+    for(uint i = 0; i < trace->number; i++) {
+        pwm_trace_record* record = &trace->records[i];
+        fprintf(file, "%lu,%d,%d\n", (unsigned long)(record->time_us - start_us), record->pin, record->level);
+    }
+}
+
+/**
+ * Read a trace written by pwm_trace_write_csv(), replacing its records.
+ *
+ * @param trace: Trace to read into, records beyond capacity are dropped
+ * @param file: File to read
+ * @return False if the file is not a trace CSV
+ */
+bool pwm_trace_read_csv(pwm_trace* trace, FILE* file) {
+    char line[48];
+    if(!fgets(line, sizeof(line), file) || strncmp(line, "time_us,pin,level", 17))
+        return false;
+    trace->number = 0;
+    trace->dropped = 0;
+    while(fgets(line, sizeof(line), file)) {
+        unsigned long time_us;
+        unsigned int pin, level;
+        if(sscanf(line, "%lu,%u,%u", &time_us, &pin, &level) != 3)
+            return false;
+        if(trace->number == trace->capacity) {
+            trace->dropped++;
+            continue;
+        }
+        pwm_trace_record* record = &trace->records[trace->number++];
+        record->time_us = time_us;
+        record->pin = pin;
+        record->level = level;
+    }
+    return true;
+}
+
+/**
+ * Compare a trace against an expected trace within tolerances.
+ *
+ * @param expected: Expected trace, usually a golden trace read from file
+ * @param actual: Recorded trace
+ * @param tolerance: Allowed differences
+ * @return -1 if the traces match, otherwise index of the first mismatched record
+ */
+int pwm_trace_compare(pwm_trace* expected, pwm_trace* actual, pwm_trace_tolerance* tolerance) {
+    if(!expected->number || !actual->number)
+        return expected->number == actual->number ? -1 : 0;
+    uint64_t expected_start = expected->records[0].time_us;
+    uint64_t actual_start = actual->records[0].time_us;
+    uint number = expected->number < actual->number ? expected->number : actual->number;
+    for(uint i = 0; i < number; i++) {
+        pwm_trace_record* want = &expected->records[i];
+        pwm_trace_record* got = &actual->records[i];
+        int64_t time_difference = (int64_t)(got->time_us - actual_start) - (int64_t)(want->time_us - expected_start);
+        int level_difference = (int)got->level - want->level;
+        if(got->pin != want->pin
+           || llabs(time_difference) > tolerance->time_us
+           || abs(level_difference) > tolerance->level)
+            return i;
+    }
+    // A longer or shorter trace mismatches at its first extra record
+    return expected->number == actual->number ? -1 : (int)number;
+}
@@ -1,3 +1,110 @@
 #include "robotic_arm_position.h"
+#include "console.h"
 #include "pico/stdlib.h"
-#include <stdlib.h>
\ No newline at end of file
+#include <stdlib.h>
+#include <math.h>
+
+
+/**
+ * Set position required for a robotic arm, the arrays are kept and not copied.
+ * 
+ * @param robot: Robotic arm to set position required
+ * @param offsets_height: Offset height of the robotic arm
+ * @param offsets_radius: Offset radius of the robotic arm
+ * @param servo_plane_angle: Servo to control plane angle
+ * @param servos_from_base: Array of servos from ground to position
+ * @param servos_from_base_size: Size of servos_from_base array
+ * @param servos_angles_horizontal: Angles to set radius same as sum of arm_lengths and offsets_radius
+ * @param servos_direction: If true, arm move from horizontal(positive radius)
+ *                    to vertical(positive height) when angle increases
+ * @param arm_lengths: Array of arm lengths from ground to position
+ */
+void robotic_arm_set_position_required(robotic_arm* robot, float offsets_height, float offsets_radius,
+                                        uint8_t servo_plane_angle, uint8_t* servos_from_base,
+                                        uint8_t servos_from_base_size, float* servos_angles_horizontal,
+                                        bool* servos_direction, float* arm_lengths) {
+    if(!robot->position_required) {
+        robot->position_required = malloc(sizeof(position_required));
+        if(!robot->position_required) {
+            console_error("Failed to allocate memory for position required.\n");
+            return;
+        }
+    }
+    position_required* required = robot->position_required;
+    required->offsets_height = offsets_height;
+    required->offsets_radius = offsets_radius;
+    required->servo_plane_angle = servo_plane_angle;
+    required->servos_from_base = servos_from_base;
+    required->servos_from_base_size = servos_from_base_size;
+    required->servos_angles_horizontal = servos_angles_horizontal;
+    required->servos_direction = servos_direction;
+    required->arm_lengths = arm_lengths;
+}
+
+/**
+ * Translate cylindrical coordinate point to robotic arm control signal.
+ * Links after the second one keep ROBOTIC_ARM_TOOL_ELEVATION, the first two are solved
+ * by the law of cosines with the elbow bent up.
+ * 
+ * @param signal: Robotic arm control signal to set, indexes and angles must hold
+ *                servos_from_base_size + 1 entries; number is 0 if the point is out of reach
+ * @param position_required: Position required to translate
+ * @param point: Cylindrical coordinates to translate
+ */
+void cylindrical_to_robotic_arm_signal(robotic_arm_signal* signal, position_required* position_required,
+                                        cylindrical_point* point) {
+    uint8_t links = position_required->servos_from_base_size;
+    signal->number = 0;
+    if(links < 2)
+        return;
+    const float* lengths = position_required->arm_lengths;
+    float tool = ROBOTIC_ARM_TOOL_ELEVATION * (float)M_PI / 180.0f;
+    float radius = point->radius - position_required->offsets_radius;
+    float height = point->height - position_required->offsets_height;
+    for(uint8_t i = 2; i < links; i++) {
+        radius -= lengths[i] * cosf(tool);
+        height -= lengths[i] * sinf(tool);
+    }
+    float cosine = (radius * radius + height * height - lengths[0] * lengths[0] - lengths[1] * lengths[1])
+                   / (2.0f * lengths[0] * lengths[1]);
+    if(cosine < -1.0f || cosine > 1.0f)
+        return;
+    float sine = -sqrtf(1.0f - cosine * cosine);
+    float previous = 0.0f;
+    signal->indexes[0] = position_required->servo_plane_angle;
+    signal->angles[0] = point->angle;
+    for(uint8_t i = 0; i < links; i++) {
+        float elevation = tool;
+        if(i == 0)
+            elevation = atan2f(height, radius) - atan2f(lengths[1] * sine, lengths[0] + lengths[1] * cosine);
+        else if(i == 1)
+            elevation = previous + atan2f(sine, cosine);
+        float relative = (elevation - previous) * 180.0f / (float)M_PI;
+        relative -= 360.0f * floorf((relative + 180.0f) / 360.0f);
+        signal->indexes[i + 1] = position_required->servos_from_base[i];
+        signal->angles[i + 1] = position_required->servos_angles_horizontal[i]
+                                + (position_required->servos_direction[i] ? relative : -relative);
+        previous = elevation;
+    }
+    signal->number = links + 1;
+}
+
+#ifdef REACH_MAP
+// Written by arm_reach -C, added to the build by REACH_MAP_SOURCE
+extern const reach_map arm_reach_map;
+#endif
+
+/**
+ * Check if the tip of the arm can reach a point, a lookup in the reach map of the build.
+ * 
+ * @param point: Point in mm, height from the ground
+ * @return False if the point is unreachable, always true without a reach map
+ */
+bool robotic_arm_reachable(const cartesian_point* point) {
+#ifdef REACH_MAP
+    return reach_map_contains(&arm_reach_map, point->x, point->y, point->z);
+#else
+    (void)point;
+    return true;
+#endif
+}
@@ -1,7 +1,11 @@
 #include <stdio.h>
 #include "pico/stdlib.h"
 #include "robotic_arm_servo.h"
+#include "arm_description.h"
+#include "console.h"
+#include "hardware/clocks.h"
 #include <stdlib.h>
+#include <string.h>
 
 
 /**
@@ -12,16 +16,21 @@
 robotic_arm* robotic_arm_create(uint8_t number) {
     robotic_arm* robot = malloc(sizeof(robotic_arm));
     if(!robot) {
-        fprintf(stderr, "Robotic arm malloc failed.\n");
+        console_error("Robotic arm malloc failed.\n");
         return NULL;
     }
     robot->number = number;
     robot->servos = malloc(number * sizeof(servo));
     if(!robot->servos) {
-        fprintf(stderr, "Robotic arm servos malloc failed.\n");
+        console_error("Robotic arm servos malloc failed.\n");
         free(robot);
         return NULL;
     }
+    for(uint8_t i = 0; i < number; i++) {
+        robot->servos[i].calibration = NULL; // Servos are linear until calibrated
+        robot->servos[i].pwm_wrap = 0; // Set from system clock by robotic_arm_start
+        robot->servos[i].max_speed = 0.0f; // No speed limit until set
+    }
     robot->position_required = NULL; // Initialize position_required to NULL
     return robot;
 }
@@ -35,7 +44,7 @@ robotic_arm* robotic_arm_create(uint8_t number) {
  */
 void robotic_arm_set_servo_pin(robotic_arm* robot, uint8_t index, uint pin) {
     if(index >= robot->number) {
-        fprintf(stderr, "Index out of range.\n");
+        console_error("Index out of range.\n");
         return ;
     }
     robot->servos[index].pin = pin;
@@ -50,7 +59,7 @@ void robotic_arm_set_servo_pin(robotic_arm* robot, uint8_t index, uint pin) {
  */
 void robotic_arm_set_servo_datasheet(robotic_arm* robot, uint8_t index, servo* source) {
     if(index >= robot->number) {
-        fprintf(stderr, "Index out of range.\n");
+        console_error("Index out of range.\n");
         return ;
     }
     SERVO_DATASHEET_COPY(&robot->servos[index], source);
@@ -65,12 +74,48 @@ void robotic_arm_set_servo_datasheet(robotic_arm* robot, uint8_t index, servo* s
  */
 void robotic_arm_set_servo_limits(robotic_arm* robot, uint8_t index, float angle_lower_bound, float angle_upper_bound) {
     if(index >= robot->number) {
-        fprintf(stderr, "Index out of range.\n");
+        console_error("Index out of range.\n");
         return ;
     }
     servo_set_limits(&robot->servos[index], angle_lower_bound, angle_upper_bound);
 }
 
+/**
+ * Get calibration of a robotic arm servo, create an empty one if the servo has none.
+ * The calibration is owned by the robotic arm and freed by robotic_arm_free().
+ * 
+ * @param robot: Robotic arm to get
+ * @param index: Index of servo in robotic arm to get
+ * @return Calibration of the servo, NULL if index is out of range or malloc failed
+ */
+servo_calibration* robotic_arm_get_servo_calibration(robotic_arm* robot, uint8_t index) {
+    if(index >= robot->number) {
+        console_error("Index out of range.\n");
+        return NULL;
+    }
+    if(!robot->servos[index].calibration) {
+        robot->servos[index].calibration = calloc(1, sizeof(servo_calibration));
+        if(!robot->servos[index].calibration)
+            console_error("Servo calibration malloc failed.\n");
+    }
+    return robot->servos[index].calibration;
+}
+
+/**
+ * Set speed limit of a robotic arm servo.
+ * 
+ * @param robot: Robotic arm to set
+ * @param index: Index of servo in robotic arm to set
+ * @param max_speed: Highest speed (degrees per second) the servo tolerates, 0 for no limit
+ */
+void robotic_arm_set_servo_max_speed(robotic_arm* robot, uint8_t index, float max_speed) {
+    if(index >= robot->number) {
+        console_error("Index out of range.\n");
+        return ;
+    }
+    servo_set_max_speed(&robot->servos[index], max_speed);
+}
+
 /**
  * Set a robotic arm servo to angle immediately.
  * 
@@ -80,7 +125,7 @@ void robotic_arm_set_servo_limits(robotic_arm* robot, uint8_t index, float angle
  */
 void robotic_arm_set_servo_angle(robotic_arm* robot, uint8_t index, float angle) {
     if(index >= robot->number) {
-        fprintf(stderr, "Index out of range.\n");
+        console_error("Index out of range.\n");
         return ;
     }
     servo_set_angle(&robot->servos[index], angle);
@@ -91,41 +136,51 @@ void robotic_arm_set_servo_angle(robotic_arm* robot, uint8_t index, float angle)
  * Make sure all servos are properly set before calling this.
  * 
  * @param robot: Robotic arm to start
+ * @return False if servos sharing a PWM slice have different periods
  */
-void robotic_arm_start(robotic_arm* robot) {
+bool robotic_arm_start(robotic_arm* robot) {
     servo* servos[robot->number];
     for(uint8_t i = 0; i < robot->number; i++) {
         servos[i] = &robot->servos[i];
     }
     // Initialize all servos
-    servos_init(robot->number, servos);
+    return servos_init(robot->number, servos);
 }
 
 /**
- * Smoothly move a robotic arm servo to angle.
+ * Start robotic arm from the description of the build, see arm_description.h.
+ * Falls back to robotic_arm_start() if the system clock is not the one of the PWM settings.
  * 
- * @param robot: Robotic arm to move
- * @param index: Index of servo in robotic arm to move
- * @param angle: Target angle
+ * @param robot: Robotic arm to start, created with arm_description_number servos
+ * @return False if the arm has a different number of servos
  */
-void robotic_arm_move_servo(robotic_arm* robot, uint8_t index, float angle) {
-    if(index >= robot->number) {
-        fprintf(stderr, "Index out of range.\n");
-        return ;
+bool robotic_arm_start_description(robotic_arm* robot) {
+    if(robot->number != arm_description_number) {
+        console_error("Robotic arm has %d servos, its description %d.\n", robot->number, arm_description_number);
+        return false;
     }
-    servo_smooth(&robot->servos[index], angle);
-}
-
-/**
- * Smoothly move multiple robotic arm servos to angles at once.
- * 
- * @param robot: Robotic arm to move
- * @param signal: Control signal
- */
-void robotic_arm_move(robotic_arm* robot, robotic_arm_signal* signal) {
-    servo* action_servos[signal->number];
-    SERVOS_PICK(action_servos, robot->servos, signal->indexes, signal->number);
-    servos_smooth(signal->number, action_servos, signal->angles);
+    const arm_description_servo* settings = arm_description_servos();
+    servo* servos[robot->number];
+    uint16_t dividers[robot->number];
+    for(uint8_t i = 0; i < robot->number; i++) {
+        servo* motor = &robot->servos[i];
+        motor->pin = settings[i].pin;
+        motor->angle_range = settings[i].angle_range;
+        motor->period = settings[i].period;
+        motor->min_duty = settings[i].min_duty;
+        motor->max_duty = settings[i].max_duty;
+        motor->angle = settings[i].angle;
+        motor->angle_lower_bound = settings[i].angle_lower_bound;
+        motor->angle_upper_bound = settings[i].angle_upper_bound;
+        motor->max_speed = settings[i].max_speed;
+        motor->pwm_wrap = settings[i].wrap;
+        servos[i] = motor;
+        dividers[i] = settings[i].divider;
+    }
+    if(clock_get_hz(clk_sys) != ARM_DESCRIPTION_CLOCK_HZ)
+        return robotic_arm_start(robot);
+    servos_init_precomputed(robot->number, servos, dividers);
+    return true;
 }
 
 /**
@@ -136,10 +191,10 @@ void robotic_arm_move(robotic_arm* robot, robotic_arm_signal* signal) {
  */
 void robotic_arm_print_servo(robotic_arm* robot, uint8_t index) {
     if(index >= robot->number) {
-        fprintf(stderr, "Index out of range.\n");
+        console_error("Index out of range.\n");
         return ;
     }
-    printf("Robotic arm servo %d : %f degrees\n", index, robot->servos[index].angle);
+    console_printf("Robotic arm servo %d : %f degrees\n", index, robot->servos[index].angle);
 }
 
 /**
@@ -158,76 +213,107 @@ void robotic_arm_print(robotic_arm* robot) {
  * @param robot: Robotic arm to free
  */
 void robotic_arm_free(robotic_arm* robot) {
+    for(uint8_t i = 0; i < robot->number; i++)
+        free(robot->servos[i].calibration);
     free(robot->servos);
+    free(robot->position_required);
     free(robot);
 }
 
+/**
+ * Parse optional move fields of a control signal string.
+ * 
+ * @param options: Options to set
+ * @param str: Fields to parse, "d<ms>" duration, "s<degrees per second>" speed,
+ *             "p<cos|lin|jerk|spline>" profile, separated by spaces
+ * @return False if a field is invalid
+ */
+static bool motion_options_from_string(motion_options* options, char* str) {
+    char* endptr;
+    while(*str) {
+        switch(*str) {
+        case ' ':
+            str++;
+            continue;
+        case 'd':
+            options->duration_ms = strtoul(str + 1, &endptr, 10);
+            break;
+        case 's':
+            options->speed = strtof(str + 1, &endptr);
+            break;
+        case 'p': {
+            // Names in order of motion_profile
+            static const char* profile_names[] = {"cos", "lin", "jerk", "spline"};
+            uint8_t profile = 0;
+            endptr = str + 1;
+            while(*endptr && *endptr != ' ')
+                endptr++;
+            size_t length = endptr - str - 1;
+            while(profile < sizeof(profile_names) / sizeof(profile_names[0])
+                  && (strlen(profile_names[profile]) != length
+                      || strncmp(str + 1, profile_names[profile], length)))
+                profile++;
+            if(profile == sizeof(profile_names) / sizeof(profile_names[0]))
+                return false;
+            options->profile = profile;
+            break;
+        }
+        default:
+            return false;
+        }
+        if(endptr == str + 1 || (*endptr != ' ' && *endptr != '\0'))
+            return false;
+        str = endptr;
+    }
+    return true;
+}
+
 /**
  * Transfer string to robotic arm control signal.
  * Make sure signal->indexes and signal->angles are allocated before calling this.
  * 
  * @param signal: Robotic arm control signal to set
- * @param str: String to transfer, format is "number index angle index angle ..."
+ * @param str: String to transfer, format is "number index angle index angle ... [d<ms>] [s<speed>] [p<profile>]",
+ *             optional duration (ms), peak speed (degrees per second) and profile (cos, lin, jerk or spline)
+ * @param capacity: Number of entries signal->indexes and signal->angles can hold
+ * @return False if the string is invalid or has more servos than capacity
  */
-void robotic_arm_signal_from_string(robotic_arm_signal* signal, char* str) {
+bool robotic_arm_signal_from_string(robotic_arm_signal* signal, char* str, uint8_t capacity) {
     char* endptr;
-    signal->number = strtol(str, &endptr, 10);
+    signal->options = (motion_options){0};
+    signal->number = 0;
+    // Parsed wide, a negative or huge count must not wrap into the uint8_t
+    long number = strtol(str, &endptr, 10);
     if (endptr == str || *endptr != ' ') {
-        fprintf(stderr, "Invalid signal string format.\n");
-        return;
+        console_error("Invalid signal string format.\n");
+        return false;
     }
     str = endptr + 1; // Move to the next part of the string
-    if (signal->number <= 0) {
-        fprintf(stderr, "Invalid number in signal string.\n");
-        return;
+    if (number < 1 || number > capacity) {
+        console_error("Invalid number in signal string.\n");
+        return false;
     }
+    signal->number = number;
     for(int i = 0; i < signal->number; i++) {
-        signal->indexes[i] = strtol(str, &endptr, 10);
-        if (endptr == str || *endptr != ' ') {
-            fprintf(stderr, "Invalid index in signal string.\n");
-            return;
+        long index = strtol(str, &endptr, 10);
+        if (endptr == str || *endptr != ' ' || index < 0 || index > UINT8_MAX) {
+            console_error("Invalid index in signal string.\n");
+            return false;
         }
+        signal->indexes[i] = index;
         str = endptr + 1; // Move to the next part of the string
         signal->angles[i] = strtof(str, &endptr);
         if (endptr == str || (*endptr != ' ' && *endptr != '\0')) {
-            fprintf(stderr, "Invalid angle in signal string.\n");
-            return;
+            console_error("Invalid angle in signal string.\n");
+            return false;
         }
-        str = endptr + 1; // Move to the next part of the string
+        str = endptr; // Move to the separator before the next part of the string
+        if (*str)
+            str++;
     }
-}
-
-/**
- * Smoothly move robotic arm servos by string.
- * 
- * @param robot: Robotic arm to move
- * @param str: String to move robotic arm, format is "number index angle index angle ..."
- */
-void robotic_arm_move_by_string(robotic_arm* robot, char* str) {
-    robotic_arm_signal signal;
-    uint8_t servo_indexes[robot->number];
-    float angles[robot->number];
-    signal.indexes = servo_indexes;
-    signal.angles = angles;
-    robotic_arm_signal_from_string(&signal, str);
-    // Print the parsed signal for debugging
-    printf("Parsed robotic arm signal:\n");
-    printf("Number of servos: %d\n", signal.number);
-    for (int i = 0; i < signal.number; i++) {
-        printf("Servo %d: Index = %d, Angle = %.2f\n", i, signal.indexes[i], signal.angles[i]);
-    }
-    if (signal.number <= 0) {
-        fprintf(stderr, "No valid servos to move.\n");
-        return;
-    }
-    if (signal.number > robot->number) {
-        fprintf(stderr, "Too many servos specified in signal.\n");
-        return;
-    }
-    if (signal.number == 1) {
-        // If only one servo is specified, move it directly
-        robotic_arm_move_servo(robot, signal.indexes[0], signal.angles[0]);
-        return;
-    }
-    robotic_arm_move(robot, &signal);
+    if (!motion_options_from_string(&signal->options, str)) {
+        console_error("Invalid move option in signal string.\n");
+        return false;
+    }
+    return true;
 }
@@ -0,0 +1,129 @@
+#include "pico/stdlib.h"
+#include "hardware/pwm.h"
+#include "servo_bank.h"
+#include "console.h"
+#include <string.h>
+
+#if SERVO_BANK_MAX_CHANNELS % 4
+#error "SERVO_BANK_MAX_CHANNELS must be a multiple of 4"
+#endif
+
+// Host builds have SIMD units, the Cortex-M0+ only runs the integer loop
+#if defined(__GNUC__) && !defined(__ARM_ARCH_6M__)
+#define SERVO_BANK_VECTOR 1
+typedef int32_t servo_bank_vec __attribute__((vector_size(16)));
+#endif
+
+/**
+ * Load servos into a bank and precompute their scale factors and limits.
+ * The current angles of the servos become the start of the next move.
+ *
+ * @param bank: Bank to load
+ * @param number: Number of servos, at most SERVO_BANK_MAX_CHANNELS
+ * @param motors: Servos to load
+ * @return False if number is out of range
+ */
+bool servo_bank_load(servo_bank* bank, uint number, servo** motors) {
+    if(number > SERVO_BANK_MAX_CHANNELS) {
+        console_error("Too many servos for a servo bank.\n");
+        return false;
+    }
+    // Zero the padding channels so the vector kernel reads defined values
+    memset(bank, 0, sizeof(servo_bank));
+    bank->number = number;
+    for(uint i = 0; i < number; i++) {
+        servo* motor = motors[i];
+        // 1 degree of angle in PWM level
+        float duty_per_degree = (float)((int)motor->max_duty - (int)motor->min_duty) / motor->angle_range;
+        bank->pins[i] = motor->pin;
+        bank->levels_per_degree[i] = duty_per_degree / motor->period * SERVO_WRAP(motor);
+        bank->zero_levels[i] = (float)motor->min_duty / motor->period * SERVO_WRAP(motor);
+        if(motor->calibration && motor->calibration->positions_per_degree > 0.0f)
+            bank->calibrations[i] = motor->calibration;
+        int32_t lower = servo_angle_to_level(motor, motor->angle_lower_bound);
+        int32_t upper = servo_angle_to_level(motor, motor->angle_upper_bound);
+        // Servos with min_duty above max_duty map larger angles to lower levels
+        bank->min_levels[i] = lower < upper ? lower : upper;
+        bank->max_levels[i] = lower < upper ? upper : lower;
+        bank->levels[i] = servo_angle_to_level(motor, motor->angle);
+    }
+    return true;
+}
+
+/**
+ * Set target angles of a bank, clamped to the limits of each channel.
+ * The levels of the last update become the start levels.
+ *
+ * @param bank: Bank to set
+ * @param angles: Target angles in degrees, one per channel
+ */
+void servo_bank_target(servo_bank* bank, float* angles) {
+    bank->clamped = 0;
+    for(uint i = 0; i < bank->number; i++) {
+        int32_t target;
+        if(bank->calibrations[i])
+            target = servo_calibration_level(bank->calibrations[i], angles[i]);
+        else
+            target = bank->zero_levels[i] + angles[i] * bank->levels_per_degree[i];
+        if(target < bank->min_levels[i]) {
+            target = bank->min_levels[i];
+            bank->clamped++;
+        } else if(target > bank->max_levels[i]) {
+            target = bank->max_levels[i];
+            bank->clamped++;
+        }
+        bank->start_levels[i] = bank->levels[i];
+        bank->level_deltas[i] = target - bank->levels[i];
+    }
+}
+
+/**
+ * Update the levels of all channels for an interpolation ratio.
+ * Level deltas are within SERVO_PWM_MAX_WRAP and ratio is at most 2^15, so the products fit in int32_t.
+ *
+ * @param bank: Bank to update
+ * @param ratio: Ratio from start to target levels (0 to SERVO_BANK_RATIO_ONE)
+ */
+void servo_bank_update(servo_bank* bank, int32_t ratio) {
+#ifdef SERVO_BANK_VECTOR
+    // Round up to whole vectors, padding channels are zero
+    uint number = (bank->number + 3u) & ~3u;
+    servo_bank_vec ratios = {ratio, ratio, ratio, ratio};
+    for(uint i = 0; i < number; i += 4) {
+        servo_bank_vec start, delta;
+        memcpy(&start, &bank->start_levels[i], sizeof(start));
+        memcpy(&delta, &bank->level_deltas[i], sizeof(delta));
+        servo_bank_vec level = start + ((delta * ratios) >> 15);
+        memcpy(&bank->levels[i], &level, sizeof(level));
+    }
+#else
+    int32_t* start = bank->start_levels;
+    int32_t* delta = bank->level_deltas;
+    int32_t* level = bank->levels;
+    for(uint i = bank->number; i; i--)
+        *level++ = *start++ + ((*delta++ * ratio) >> 15);
+#endif
+}
+
+/**
+ * Write the levels of all channels to PWM.
+ *
+ * @param bank: Bank to write
+ */
+void servo_bank_write(servo_bank* bank) {
+    for(uint i = 0; i < bank->number; i++)
+        SERVO_PWM_SET_LEVEL(bank->pins[i], (uint16_t)bank->levels[i]);
+}
+
+/**
+ * Convert the current level of a channel back to an angle.
+ *
+ * @param bank: Bank to read
+ * @param index: Index of channel
+ * @return Angle in degrees
+ */
+float servo_bank_angle(servo_bank* bank, uint index) {
+    if(bank->calibrations[index])
+        return servo_calibration_angle(bank->calibrations[index], bank->levels[index]);
+    return (bank->levels[index] - bank->zero_levels[index]) / bank->levels_per_degree[index];
+}
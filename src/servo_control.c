@@ -1,20 +1,31 @@
 #include <stdio.h>
 #include "pico/stdlib.h"
 #include "hardware/pwm.h"
+#include "hardware/clocks.h"
 #include "servo_control.h"
+#include "servo_bank.h"
+#include "console.h"
 #include <math.h>
 
 
-const uint max_servo_move_ms = 5000;    // Maximum time (ms) for a servo smooth move
+// Speed presets, full_range_ms is the time (ms) of a smooth move over the whole angle range
+const motion_preset motion_presets[MOTION_PRESET_COUNT] = {
+    {"slow", 10000},
+    {"normal", 5000},
+    {"fast", 2000},
+    {"rapid", 600}
+};
+
+static uint selected_preset = 1;    // Preset for moves without duration or speed
 
 /**
  * Calculate the number of steps needed for the smooth transition.
  * 
- * @param angle_ratio: Ratio of difference and maximum angle (0 to 1)
- * @param period: Period of PWM signal (us)
+ * @param duration_ms: Duration of the transition (ms)
+ * @param period: Period of ticks (us), the PWM period of the fastest servo
  */
-uint calculate_steps(float angle_ratio, uint period) {
-    return (uint)fabs(angle_ratio * 1e3 * max_servo_move_ms / period);
+uint calculate_steps(float duration_ms, uint period) {
+    return (uint)fabs(duration_ms * 1e3 / period);
 }
 
 // Calculate the smooth transition ratio using a cosine function for easing effect
@@ -22,6 +33,91 @@ float calculate_smooth_ratio(float ratio_of_steps) {
     return 0.5 - cosf(M_PI * ratio_of_steps) / 2;
 }
 
+/**
+ * Calculate the transition ratio of a motion profile.
+ * 
+ * @param profile: Motion profile
+ * @param ratio_of_steps: Ratio of steps done (0 to 1)
+ */
+float calculate_profile_ratio(motion_profile profile, float ratio_of_steps) {
+    switch(profile) {
+    case MOTION_PROFILE_LINEAR:
+        return ratio_of_steps;
+    case MOTION_PROFILE_MINIMUM_JERK:
+        // 10r^3 - 15r^4 + 6r^5
+        return ratio_of_steps * ratio_of_steps * ratio_of_steps
+               * (10.0f + ratio_of_steps * (6.0f * ratio_of_steps - 15.0f));
+    case MOTION_PROFILE_SPLINE:
+        // Spline segment at rest on both ends: 3r^2 - 2r^3
+        return ratio_of_steps * ratio_of_steps * (3.0f - 2.0f * ratio_of_steps);
+    default:
+        return calculate_smooth_ratio(ratio_of_steps);
+    }
+}
+
+/**
+ * Peak speed of a motion profile relative to its average speed.
+ * 
+ * @param profile: Motion profile
+ */
+float motion_profile_peak_factor(motion_profile profile) {
+    switch(profile) {
+    case MOTION_PROFILE_LINEAR:
+        return 1.0f;
+    case MOTION_PROFILE_MINIMUM_JERK:
+        return 1.875f;
+    case MOTION_PROFILE_SPLINE:
+        return 1.5f;
+    default:
+        return (float)M_PI / 2;
+    }
+}
+
+/**
+ * Select the speed preset of moves without duration or speed.
+ * 
+ * @param index: Index of motion_presets
+ * @return False if index is out of range
+ */
+bool motion_select_preset(uint index) {
+    if(index >= MOTION_PRESET_COUNT)
+        return false;
+    selected_preset = index;
+    return true;
+}
+
+/**
+ * @return Index of the selected speed preset in motion_presets
+ */
+uint motion_selected_preset(void) {
+    return selected_preset;
+}
+
+/**
+ * Configure the PWM slice of a servo for its period from the current system clock.
+ * Uses the smallest clock divider that fits the period in the PWM counter,
+ * giving the highest level resolution for the period.
+ * 
+ * @param motor: Servo to configure, pwm_wrap is set
+ */
+static void servo_pwm_setup(servo* motor) {
+    uint slice_num = pwm_gpio_to_slice_num(motor->pin);
+    // System clock counts in a period, 1e6 for convert period (us) to seconds
+    uint64_t counts = (uint64_t)clock_get_hz(clk_sys) * motor->period / 1000000;
+    // Divider in 1/16 steps (8.4 fixed point), rounded up so wrap fits the counter
+    uint64_t divider = (counts * 16 + SERVO_PWM_MAX_WRAP - 1) / SERVO_PWM_MAX_WRAP;
+    if(divider < 16)
+        divider = 16;
+    else if(divider > 0xfff) {
+        console_error("Servo period %u us is too long for PWM.\n", motor->period);
+        divider = 0xfff;
+    }
+    uint64_t wrap = (counts * 16 + divider / 2) / divider;
+    motor->pwm_wrap = wrap > SERVO_PWM_MAX_WRAP ? SERVO_PWM_MAX_WRAP : wrap;
+    pwm_set_clkdiv_int_frac(slice_num, divider >> 4, divider & 0xf);
+    pwm_set_wrap(slice_num, motor->pwm_wrap - 1);
+}
+
 /**
  * Initialize a single servo motor.
  * Make sure all fields in motor are correctly set before calling this.
@@ -30,13 +126,10 @@ float calculate_smooth_ratio(float ratio_of_steps) {
  */
 void servo_init(servo* motor) {
     gpio_set_function(motor->pin, GPIO_FUNC_PWM);
-    uint slice_num = pwm_gpio_to_slice_num(motor->pin);
-    // 1e6 for convert period (us) to frequency (Hz)
-    float clock_devider = (float)SYSTEM_CLOCK / ((float)1e6 / motor->period) / SERVO_PWM_WRAP;
-    pwm_set_clkdiv(slice_num, clock_devider);
-    pwm_set_wrap(slice_num, SERVO_PWM_WRAP - 1);
+    servo_pwm_setup(motor);
+    servo_calibration_compile(motor);
     servo_set_angle(motor, motor->angle);
-    pwm_set_enabled(slice_num, true);
+    pwm_set_enabled(pwm_gpio_to_slice_num(motor->pin), true);
 }
 
 /**
@@ -65,6 +158,16 @@ void servo_set_datasheet(servo* motor, float angle_range, uint period, uint min_
     motor->max_duty = max_duty;
 }
 
+/**
+ * Set speed limit of a servo.
+ * 
+ * @param motor: Servo to set speed limit
+ * @param max_speed: Highest speed (degrees per second) the servo tolerates, 0 for no limit
+ */
+void servo_set_max_speed(servo* motor, float max_speed) {
+    motor->max_speed = max_speed;
+}
+
 /**
  * Set limits for servo angles.
  * 
@@ -77,6 +180,146 @@ void servo_set_limits(servo* motor, float angle_lower_bound, float angle_upper_b
     motor->angle_upper_bound = angle_upper_bound;
 }
 
+/**
+ * Add a measured point to a servo calibration.
+ * A point at an angle already measured replaces the old one.
+ * 
+ * @param calibration: Calibration to add point
+ * @param angle: Measured angle in degrees
+ * @param pulse: Pulse width (us) that moves the servo to angle
+ * @return False if the calibration is full
+ */
+bool servo_calibration_add_point(servo_calibration* calibration, float angle, uint pulse) {
+    uint8_t i = 0;
+    while(i < calibration->number && calibration->angles[i] < angle)
+        i++;
+    if(i < calibration->number && calibration->angles[i] == angle) {
+        calibration->pulses[i] = pulse;
+        return true;
+    }
+    if(calibration->number == SERVO_CALIBRATION_MAX_POINTS)
+        return false;
+    // Shift larger angles up to keep points sorted
+    for(uint8_t j = calibration->number; j > i; j--) {
+        calibration->angles[j] = calibration->angles[j - 1];
+        calibration->pulses[j] = calibration->pulses[j - 1];
+    }
+    calibration->angles[i] = angle;
+    calibration->pulses[i] = pulse;
+    calibration->number++;
+    return true;
+}
+
+/**
+ * Compile the measured points of a servo calibration into its lookup table.
+ * Needs at least 2 points, angles outside the measured ones are extrapolated.
+ * 
+ * @param motor: Servo with calibration to compile
+ * @return False if the servo has no calibration or too few points
+ */
+bool servo_calibration_compile(servo* motor) {
+    servo_calibration* calibration = motor->calibration;
+    if(!calibration || calibration->number < 2)
+        return false;
+    float degrees_per_segment = motor->angle_range / SERVO_CALIBRATION_TABLE_SIZE;
+    uint8_t point = 0;
+    for(uint i = 0; i <= SERVO_CALIBRATION_TABLE_SIZE; i++) {
+        float angle = i * degrees_per_segment;
+        // Find the measured segment around angle, the first and last segments extrapolate
+        while(point < calibration->number - 2 && angle > calibration->angles[point + 1])
+            point++;
+        float angle_0 = calibration->angles[point];
+        float pulse_0 = calibration->pulses[point];
+        float slope = (calibration->pulses[point + 1] - pulse_0) / (calibration->angles[point + 1] - angle_0);
+        float pulse = pulse_0 + (angle - angle_0) * slope;
+        if(pulse < 0.0f)
+            pulse = 0.0f;
+        else if(pulse > motor->period)
+            pulse = motor->period;
+        calibration->levels[i] = pulse / motor->period * SERVO_WRAP(motor);
+    }
+    calibration->positions_per_degree = 256.0f / degrees_per_segment;
+    return true;
+}
+
+/**
+ * Look up the PWM level of an angle in a compiled calibration table.
+ * 
+ * @param calibration: Compiled calibration
+ * @param angle: Angle in degrees
+ * @return PWM level interpolated between the nearest table entries
+ */
+uint16_t servo_calibration_level(servo_calibration* calibration, float angle) {
+    // Table position in 1/256 segment
+    int position = angle * calibration->positions_per_degree;
+    if(position <= 0)
+        return calibration->levels[0];
+    if(position >= SERVO_CALIBRATION_TABLE_SIZE << 8)
+        return calibration->levels[SERVO_CALIBRATION_TABLE_SIZE];
+    uint16_t* level = &calibration->levels[position >> 8];
+    return level[0] + ((((int)level[1] - level[0]) * (position & 0xff)) >> 8);
+}
+
+/**
+ * Convert a PWM level back to angle through a compiled calibration table.
+ * 
+ * @param calibration: Compiled calibration
+ * @param level: PWM level
+ * @return Angle in degrees
+ */
+float servo_calibration_angle(servo_calibration* calibration, uint16_t level) {
+    uint16_t* levels = calibration->levels;
+    uint i = 0;
+    // Table is monotonic, find the segment containing level
+    while(i < SERVO_CALIBRATION_TABLE_SIZE - 1
+          && !(level >= levels[i] && level <= levels[i + 1])
+          && !(level <= levels[i] && level >= levels[i + 1]))
+        i++;
+    float fraction = levels[i + 1] == levels[i] ? 0.0f : (float)(level - levels[i]) / (levels[i + 1] - levels[i]);
+    return (i + fraction) * 256.0f / calibration->positions_per_degree;
+}
+
+/**
+ * Set the pulse width of a servo immediately, ignoring angle and limits.
+ * Used to find the pulse widths of measured angles.
+ * 
+ * @param motor: Servo to set pulse width
+ * @param pulse: Pulse width (us)
+ */
+void servo_set_pulse_us(servo* motor, uint pulse) {
+    if(pulse > motor->period)
+        pulse = motor->period;
+    SERVO_PWM_SET_LEVEL(motor->pin, (uint16_t)((float)pulse / motor->period * SERVO_WRAP(motor)));
+}
+
+/**
+ * Convert an angle of a servo motor to PWM level.
+ * 
+ * @param motor: Servo to convert
+ * @param angle: Angle in degrees
+ * @return PWM level of the angle
+ */
+uint16_t servo_angle_to_level(servo* motor, float angle) {
+    if(motor->calibration && motor->calibration->positions_per_degree > 0.0f)
+        return servo_calibration_level(motor->calibration, angle);
+    float duty = (angle / motor->angle_range) * ((int)motor->max_duty - (int)motor->min_duty) + motor->min_duty;
+    return duty / motor->period * SERVO_WRAP(motor);
+}
+
+/**
+ * Convert a PWM level of a servo motor back to angle.
+ * 
+ * @param motor: Servo to convert
+ * @param level: PWM level
+ * @return Angle in degrees
+ */
+float servo_level_to_angle(servo* motor, uint16_t level) {
+    if(motor->calibration && motor->calibration->positions_per_degree > 0.0f)
+        return servo_calibration_angle(motor->calibration, level);
+    float duty = (float)level * motor->period / SERVO_WRAP(motor);
+    return (duty - motor->min_duty) / ((int)motor->max_duty - (int)motor->min_duty) * motor->angle_range;
+}
+
 /**
  * Set the angle of a single servo motor immediately.
  * 
@@ -88,30 +331,7 @@ void servo_set_angle(servo* motor, float angle) {
         angle = motor->angle_lower_bound;
     else if(angle > motor->angle_upper_bound)
         angle = motor->angle_upper_bound;
-    float duty = (motor->angle / motor->angle_range) * (motor->max_duty - motor->min_duty) + motor->min_duty;
-    uint16_t level = duty / motor->period * SERVO_PWM_WRAP;
-    pwm_set_gpio_level(motor->pin, level);
-    motor->angle = angle;
-}
-
-/**
- * Move a single servo motor smoothly to the target angle.
- * 
- * @param motor: Servo to move
- * @param angle: Target angle in degrees
- */
-void servo_smooth(servo* motor, float angle) {
-    float start_angle = motor->angle;
-    float angle_difference = angle - motor->angle;
-    uint steps = calculate_steps(angle_difference / motor->angle_range, motor->period);
-    for(uint step = 1; step < steps; step++) {
-        // Calculate the smooth transition ratio using a cosine function for easing effect
-        float ratio = calculate_smooth_ratio((float)step / steps);
-        float delta = angle_difference * ratio;
-        servo_set_angle(motor, start_angle + delta);
-        sleep_us(motor->period);
-    }
-    servo_set_angle(motor, angle);
+    SERVO_PWM_SET_LEVEL(motor->pin, servo_angle_to_level(motor, angle));
     motor->angle = angle;
 }
 
@@ -119,23 +339,60 @@ void servo_smooth(servo* motor, float angle) {
  * Initialize multiple servo motors.
  * Make sure all servo structs are properly set before calling this.
  * 
+ * Servos sharing a PWM slice must have the same period.
+ * 
  * @param number: Number of servos to initialize
  * @param motors: Servos to initialize
+ * @return False if servos sharing a PWM slice have different periods, nothing is initialized
  */
-void servos_init(uint number, servo** motors) {
+bool servos_init(uint number, servo** motors) {
+    // Both channels of a slice share its divider and wrap
+    bool conflict = false;
+    for(uint i = 0; i < number; i++) {
+        for(uint j = i + 1; j < number; j++) {
+            if(pwm_gpio_to_slice_num(motors[i]->pin) == pwm_gpio_to_slice_num(motors[j]->pin)
+               && motors[i]->period != motors[j]->period) {
+                console_error("Servos on pins %u and %u share PWM slice %u with different periods.\n",
+                        motors[i]->pin, motors[j]->pin, pwm_gpio_to_slice_num(motors[i]->pin));
+                conflict = true;
+            }
+        }
+    }
+    if(conflict)
+        return false;
     for(uint i = 0; i < number; i++) {
         gpio_set_function(motors[i]->pin, GPIO_FUNC_PWM);
-        uint slice_num = pwm_gpio_to_slice_num(motors[i]->pin);
-        // 1e6 for convert period (us) to frequency (Hz)
-        float clock_devider = (float)SYSTEM_CLOCK / ((float)1e6 / motors[i]->period) / SERVO_PWM_WRAP;
-        pwm_set_clkdiv(slice_num, clock_devider);
-        pwm_set_wrap(slice_num, SERVO_PWM_WRAP - 1);
+        servo_pwm_setup(motors[i]);
+        servo_calibration_compile(motors[i]);
         servo_set_angle(motors[i], motors[i]->angle);
     }
     for(uint i = 0; i < number; i++) {
         uint slice_num = pwm_gpio_to_slice_num(motors[i]->pin);
         pwm_set_enabled(slice_num, true);
     }
+    return true;
+}
+
+/**
+ * Initialize multiple servo motors with PWM settings computed by the build, see arm_description.h.
+ * Skips the slice period check and the divider search of servos_init(),
+ * the build checked the slices and computed the settings for the current system clock.
+ * 
+ * @param number: Number of servos to initialize
+ * @param motors: Servos to initialize, pwm_wrap must be set
+ * @param dividers: PWM clock divider of every servo in 1/16 steps (8.4 fixed point)
+ */
+void servos_init_precomputed(uint number, servo** motors, const uint16_t* dividers) {
+    for(uint i = 0; i < number; i++) {
+        uint slice_num = pwm_gpio_to_slice_num(motors[i]->pin);
+        gpio_set_function(motors[i]->pin, GPIO_FUNC_PWM);
+        pwm_set_clkdiv_int_frac(slice_num, dividers[i] >> 4, dividers[i] & 0xf);
+        pwm_set_wrap(slice_num, motors[i]->pwm_wrap - 1);
+        servo_calibration_compile(motors[i]);
+        servo_set_angle(motors[i], motors[i]->angle);
+    }
+    for(uint i = 0; i < number; i++)
+        pwm_set_enabled(pwm_gpio_to_slice_num(motors[i]->pin), true);
 }
 
 /**
@@ -152,38 +409,115 @@ void servos_set_angle(uint number, servo** motors, float *angles) {
 }
 
 /**
- * Smoothly move multiple servos to target angles.
+ * Plan a smooth move of multiple servos into a bank without moving them.
+ * 
+ * Duration comes from options, or from the selected speed preset if options has none,
+ * and is stretched so no servo exceeds its max_speed.
  * 
+ * @param bank: Bank to plan the move, advanced by servos_smooth_tick()
  * @param number: Number of servos to move
  * @param motors: Servos to move
  * @param angles: Target angles in degrees
+ * @param options: Duration, speed and profile of the move, NULL for defaults
+ * @return False if the servos do not fit in a bank
  */
-void servos_smooth(uint number, servo** motors, float *angles) {
-    float start_angles[number];
-    float angle_differences[number];
-    uint max_steps = 0;
-    uint max_period = 1;
-    // Store start angles and angle differences for each servo
-    // Determine the max steps and max period
+bool servos_smooth_plan(servo_bank* bank, uint number, servo** motors, float *angles, motion_options* options) {
+    static motion_options default_options;
+    float max_angle_ratio = 0.0f;
+    float max_angle_difference = 0.0f;
+    float max_limit_ms = 0.0f;
+    uint min_period = UINT32_MAX;
+    if(!options)
+        options = &default_options;
+    if(!servo_bank_load(bank, number, motors))
+        return false;
+    servo_bank_target(bank, angles);
+    // Determine the longest move and the fastest servo, ticks follow the fastest servo
     for(uint i = 0; i < number; i++) {
-        start_angles[i] = motors[i]->angle;
-        angle_differences[i] = angles[i] - start_angles[i];
-        uint steps = calculate_steps(angle_differences[i] / motors[i]->angle_range, motors[i]->period);
-        if(steps > max_steps)
-            max_steps = steps;
-        if(motors[i]->period > max_period)
-            max_period = motors[i]->period;
+        float angle_difference = fabsf(angles[i] - motors[i]->angle);
+        if(angle_difference / motors[i]->angle_range > max_angle_ratio)
+            max_angle_ratio = angle_difference / motors[i]->angle_range;
+        if(angle_difference > max_angle_difference)
+            max_angle_difference = angle_difference;
+        if(motors[i]->period < min_period)
+            min_period = motors[i]->period;
     }
-    // Perform the smooth transition in steps
-    for(uint step = 1; step < max_steps; step++) {
-        // Calculate the smooth transition ratio using a cosine function for easing effect
-        float ratio = calculate_smooth_ratio((float)step / max_steps);
-        // Set the servo angles based on the start angles and angle differences with ratio
-        for(uint i = 0; i < number; i++) {
-            float delta = angle_differences[i] * ratio;
-            servo_set_angle(motors[i], start_angles[i] + delta);
-        }
-        sleep_us(max_period);
+    if(min_period == 0 || min_period == UINT32_MAX)
+        min_period = 1;
+    float peak_factor = motion_profile_peak_factor(options->profile);
+    float duration_ms;
+    if(options->duration_ms)
+        duration_ms = options->duration_ms;
+    else if(options->speed > 0.0f)
+        duration_ms = peak_factor * max_angle_difference / options->speed * 1e3f;
+    else
+        duration_ms = max_angle_ratio * motion_presets[selected_preset].full_range_ms;
+    // Stretch the move so the peak speed of every servo stays within its limit
+    for(uint i = 0; i < number; i++) {
+        if(motors[i]->max_speed <= 0.0f)
+            continue;
+        float limit_ms = peak_factor * fabsf(angles[i] - motors[i]->angle) / motors[i]->max_speed * 1e3f;
+        if(limit_ms > max_limit_ms)
+            max_limit_ms = limit_ms;
+    }
+    if(max_limit_ms > duration_ms)
+        duration_ms = max_limit_ms;
+    bank->steps = calculate_steps(duration_ms, min_period);
+    bank->step = 0;
+    bank->fraction = 0;
+    bank->feed_limit = max_limit_ms > 0.0f ? duration_ms / max_limit_ms : HUGE_VALF;
+    bank->tick_us = min_period;
+    bank->profile = options->profile;
+    return true;
+}
+
+/**
+ * Advance a planned move by one tick and update the levels of the bank.
+ * 
+ * @param bank: Bank planned by servos_smooth_plan()
+ * @return True if the move continues after this tick, false if levels are at targets
+ */
+bool servos_smooth_tick(servo_bank* bank) {
+    return servos_smooth_feed(bank, SERVO_BANK_FEED_ONE);
+}
+
+/**
+ * Advance a planned move by a fraction of steps and update the levels of the bank.
+ * 
+ * @param bank: Bank planned by servos_smooth_plan()
+ * @param feed: Steps to advance, SERVO_BANK_FEED_ONE for one step
+ * @return True if the move continues after this tick, false if levels are at targets
+ */
+bool servos_smooth_feed(servo_bank* bank, uint feed) {
+    uint progress = bank->fraction + feed;
+    bank->step += progress >> SERVO_BANK_FEED_BITS;
+    bank->fraction = progress & (SERVO_BANK_FEED_ONE - 1);
+    if(bank->step >= bank->steps) {
+        servo_bank_update(bank, SERVO_BANK_RATIO_ONE);
+        return false;
     }
-    servos_set_angle(number, motors, angles);
-}
\ No newline at end of file
+    // Calculate the transition ratio with the easing of the motion profile
+    float steps_done = bank->step + (float)bank->fraction / SERVO_BANK_FEED_ONE;
+    float ratio = calculate_profile_ratio(bank->profile, steps_done / bank->steps);
+    // Update all channels of the bank at once with the fixed-point ratio
+    servo_bank_update(bank, (int32_t)(ratio * SERVO_BANK_RATIO_ONE + 0.5f));
+    return true;
+}
+
+/**
+ * Store target angles of a finished move in the servos, clamped to their limits.
+ * 
+ * @param number: Number of servos moved
+ * @param motors: Servos moved
+ * @param angles: Target angles in degrees
+ */
+void servos_smooth_finish(uint number, servo** motors, float *angles) {
+    for(uint i = 0; i < number; i++) {
+        float angle = angles[i];
+        if(angle < motors[i]->angle_lower_bound)
+            angle = motors[i]->angle_lower_bound;
+        else if(angle > motors[i]->angle_upper_bound)
+            angle = motors[i]->angle_upper_bound;
+        motors[i]->angle = angle;
+    }
+}
@@ -0,0 +1,258 @@
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "hardware/adc.h"
+#include "hardware/dma.h"
+#include "servo_feedback.h"
+#include "console.h"
+#include <math.h>
+#include <string.h>
+
+// Transfers of one DMA run, the ring wraps every SERVO_FEEDBACK_RING_SIZE of them
+#define SERVO_FEEDBACK_TRANSFERS 0xFFFFFFFFu
+
+// Samples after which DMA restarts, before the count of written samples wraps
+#define SERVO_FEEDBACK_RESTART_COUNT 0x80000000u
+
+// Clock of the ADC in Hz
+#define SERVO_FEEDBACK_ADC_CLOCK_HZ 48000000.0f
+
+/**
+ * Restart the ADC and the DMA channel from the first input and the start of the ring.
+ *
+ * @param feedback: Feedback to restart
+ */
+static void servo_feedback_restart(servo_feedback* feedback) {
+    adc_run(false);
+    dma_channel_abort(feedback->dma_channel);
+    // Let the conversion in progress finish so the round-robin starts over cleanly
+    while(!(adc_hw->cs & ADC_CS_READY_BITS))
+        tight_loop_contents();
+    adc_fifo_drain();
+    adc_select_input(feedback->adc_inputs[0]);
+    feedback->read_count = 0;
+    dma_channel_set_write_addr(feedback->dma_channel, feedback->ring, false);
+    dma_channel_set_trans_count(feedback->dma_channel, SERVO_FEEDBACK_TRANSFERS, true);
+    adc_run(true);
+}
+
+/**
+ * Start sampling the feedback of servos.
+ * Until calibrated, ADC counts 0 to SERVO_FEEDBACK_MAX_COUNT map linearly to the angle range of each servo.
+ *
+ * @param feedback: Feedback to start
+ * @param adc_inputs: ADC input of every servo, -1 without feedback
+ * @param number: Number of servos
+ * @param angle_range: Angle range of the servos in degrees
+ * @param tolerance: Largest difference between measured and target angles of an arrived servo
+ * @return False if an input is invalid or used twice, or no DMA channel is free
+ */
+bool servo_feedback_start(servo_feedback* feedback, const int8_t* adc_inputs, uint number, float angle_range,
+                          float tolerance) {
+    memset(feedback, 0, sizeof(servo_feedback));
+    memset(feedback->servo_inputs, -1, sizeof(feedback->servo_inputs));
+    uint mask = 0;
+    for(uint i = 0; i < number && i < SERVO_BANK_MAX_CHANNELS; i++) {
+        if(adc_inputs[i] < 0)
+            continue;
+        if(adc_inputs[i] >= SERVO_FEEDBACK_MAX_INPUTS || mask & 1u << adc_inputs[i]) {
+            console_error("Invalid or repeated ADC input %d.\n", adc_inputs[i]);
+            return false;
+        }
+        mask |= 1u << adc_inputs[i];
+    }
+    if(!mask) {
+        console_error("No ADC input for servo feedback.\n");
+        return false;
+    }
+    // The round-robin converts the inputs in ascending order
+    for(uint input = 0; input < SERVO_FEEDBACK_MAX_INPUTS; input++) {
+        if(!(mask & 1u << input))
+            continue;
+        for(uint i = 0; i < number; i++) {
+            if(adc_inputs[i] == (int8_t)input) {
+                feedback->servo_inputs[i] = feedback->number;
+                feedback->inputs[feedback->number].servo = i;
+            }
+        }
+        feedback->adc_inputs[feedback->number++] = input;
+    }
+    feedback->angle_range = angle_range;
+    feedback->tolerance = tolerance;
+    for(uint i = 0; i < feedback->number; i++)
+        servo_feedback_clear_points(feedback, feedback->inputs[i].servo);
+
+    feedback->dma_channel = dma_claim_unused_channel(false);
+    if(feedback->dma_channel < 0) {
+        console_error("No DMA channel left for servo feedback.\n");
+        return false;
+    }
+    adc_init();
+    for(uint i = 0; i < feedback->number; i++)
+        adc_gpio_init(SERVO_FEEDBACK_FIRST_GPIO + feedback->adc_inputs[i]);
+    adc_select_input(feedback->adc_inputs[0]);
+    adc_set_round_robin(mask);
+    // A sample request every DREQ, no error bit so the samples stay 12-bit counts
+    adc_fifo_setup(true, true, 1, false, false);
+    adc_set_clkdiv(SERVO_FEEDBACK_ADC_CLOCK_HZ / (SERVO_FEEDBACK_SAMPLE_HZ * feedback->number) - 1.0f);
+
+    dma_channel_config config = dma_channel_get_default_config(feedback->dma_channel);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_16);
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, true);
+    channel_config_set_ring(&config, true, SERVO_FEEDBACK_RING_BITS);
+    channel_config_set_dreq(&config, DREQ_ADC);
+    dma_channel_configure(feedback->dma_channel, &config, feedback->ring, &adc_hw->fifo,
+                          SERVO_FEEDBACK_TRANSFERS, false);
+    servo_feedback_restart(feedback);
+    return true;
+}
+
+/**
+ * Filter the samples DMA wrote since the last poll.
+ * Samples are in round-robin order, so the input of a sample follows from its count.
+ * If polling fell so far behind that DMA overwrote unread samples, the oldest are skipped.
+ *
+ * @param feedback: Feedback to poll
+ */
+void servo_feedback_poll(servo_feedback* feedback) {
+    uint32_t written = SERVO_FEEDBACK_TRANSFERS - dma_channel_hw_addr(feedback->dma_channel)->transfer_count;
+    // Keep clear of the slot DMA writes next
+    uint32_t readable = SERVO_FEEDBACK_RING_SIZE - SERVO_FEEDBACK_MAX_INPUTS;
+    if(written - feedback->read_count > readable) {
+        feedback->overruns += written - feedback->read_count - readable;
+        feedback->read_count = written - readable;
+    }
+    for(; feedback->read_count < written; feedback->read_count++) {
+        servo_feedback_input* input = &feedback->inputs[feedback->read_count % feedback->number];
+        int32_t sample = (int32_t)(feedback->ring[feedback->read_count & (SERVO_FEEDBACK_RING_SIZE - 1)]
+                                   & SERVO_FEEDBACK_MAX_COUNT) << SERVO_FEEDBACK_FILTER_BITS;
+        if(input->samples++)
+            input->filtered += (sample - input->filtered) >> SERVO_FEEDBACK_FILTER_SHIFT;
+        else
+            input->filtered = sample;
+    }
+    if(written >= SERVO_FEEDBACK_RESTART_COUNT)
+        servo_feedback_restart(feedback);
+}
+
+/**
+ * @param feedback: Feedback to read
+ * @param servo: Servo index
+ * @return True if the servo has feedback
+ */
+bool servo_feedback_has(servo_feedback* feedback, uint8_t servo) {
+    return servo < SERVO_BANK_MAX_CHANNELS && feedback->servo_inputs[servo] >= 0
+           && feedback->inputs[feedback->servo_inputs[servo]].samples;
+}
+
+/**
+ * @param feedback: Feedback to read
+ * @param servo: Servo index, with feedback
+ * @return Measured angle in degrees
+ */
+float servo_feedback_angle(servo_feedback* feedback, uint8_t servo) {
+    servo_feedback_input* input = &feedback->inputs[feedback->servo_inputs[servo]];
+    float count = (float)input->filtered / (1 << SERVO_FEEDBACK_FILTER_BITS);
+    return input->zero_angle + count * input->degrees_per_count;
+}
+
+/**
+ * Check that the servos of a move with feedback are within tolerance of their targets.
+ *
+ * @param feedback: Feedback to read
+ * @param number: Number of servos of the move
+ * @param servos: Servo indexes of the move
+ * @param angles: Target angles of the move
+ * @return True if every servo with feedback arrived, also if none has feedback
+ */
+bool servo_feedback_arrived(servo_feedback* feedback, uint number, const uint8_t* servos, const float* angles) {
+    for(uint i = 0; i < number; i++) {
+        if(servo_feedback_has(feedback, servos[i])
+           && fabsf(servo_feedback_angle(feedback, servos[i]) - angles[i]) > feedback->tolerance)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Record the current filtered reading of a servo as a calibration point.
+ *
+ * @param feedback: Feedback to calibrate
+ * @param servo: Servo index, with feedback
+ * @param angle: Measured angle of the servo
+ * @return False if the servo has no feedback or the points are full
+ */
+bool servo_feedback_add_point(servo_feedback* feedback, uint8_t servo, float angle) {
+    if(!servo_feedback_has(feedback, servo))
+        return false;
+    servo_feedback_input* input = &feedback->inputs[feedback->servo_inputs[servo]];
+    if(input->point_count == SERVO_FEEDBACK_MAX_POINTS)
+        return false;
+    input->angles[input->point_count] = angle;
+    input->counts[input->point_count] = input->filtered >> SERVO_FEEDBACK_FILTER_BITS;
+    input->point_count++;
+    return true;
+}
+
+/**
+ * Fit a line through the calibration points of a servo and use it for its angles.
+ * Least squares, so extra points average out the noise of single readings.
+ *
+ * @param feedback: Feedback to calibrate
+ * @param servo: Servo index, with feedback
+ * @return False if the servo has no feedback or fewer than 2 distinct points
+ */
+bool servo_feedback_compile(servo_feedback* feedback, uint8_t servo) {
+    if(!servo_feedback_has(feedback, servo))
+        return false;
+    servo_feedback_input* input = &feedback->inputs[feedback->servo_inputs[servo]];
+    float sum_counts = 0.0f, sum_angles = 0.0f, sum_squares = 0.0f, sum_products = 0.0f;
+    for(uint i = 0; i < input->point_count; i++) {
+        sum_counts += input->counts[i];
+        sum_angles += input->angles[i];
+        sum_squares += (float)input->counts[i] * input->counts[i];
+        sum_products += input->counts[i] * input->angles[i];
+    }
+    float n = input->point_count;
+    float denominator = n * sum_squares - sum_counts * sum_counts;
+    // Zero with fewer than 2 points or all points at one count
+    if(denominator < 1.0f)
+        return false;
+    input->degrees_per_count = (n * sum_products - sum_counts * sum_angles) / denominator;
+    input->zero_angle = (sum_angles - input->degrees_per_count * sum_counts) / n;
+    return true;
+}
+
+/**
+ * Drop the calibration points of a servo and return to the uncalibrated mapping.
+ *
+ * @param feedback: Feedback to calibrate
+ * @param servo: Servo index
+ */
+void servo_feedback_clear_points(servo_feedback* feedback, uint8_t servo) {
+    if(servo >= SERVO_BANK_MAX_CHANNELS || feedback->servo_inputs[servo] < 0)
+        return;
+    servo_feedback_input* input = &feedback->inputs[feedback->servo_inputs[servo]];
+    input->point_count = 0;
+    input->zero_angle = 0.0f;
+    input->degrees_per_count = feedback->angle_range / SERVO_FEEDBACK_MAX_COUNT;
+}
+
+/**
+ * Print measured angles, ADC counts and overruns.
+ *
+ * @param feedback: Feedback to print
+ */
+void servo_feedback_print(servo_feedback* feedback) {
+    for(uint i = 0; i < feedback->number; i++) {
+        servo_feedback_input* input = &feedback->inputs[i];
+        if(!input->samples) {
+            console_printf("Feedback of servo %d: ADC %d, no samples\n", input->servo, feedback->adc_inputs[i]);
+            continue;
+        }
+        console_printf("Feedback of servo %d: ADC %d, %.2f degrees at %d counts, %d points\n", input->servo,
+                       feedback->adc_inputs[i], servo_feedback_angle(feedback, input->servo),
+                       input->filtered >> SERVO_FEEDBACK_FILTER_BITS, input->point_count);
+    }
+    console_printf("Feedback overruns: %d\n", feedback->overruns);
+}
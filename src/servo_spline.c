@@ -0,0 +1,105 @@
+#include "pico/stdlib.h"
+#include "servo_spline.h"
+
+// One level in the fixed point of a spline
+#define SERVO_SPLINE_ONE ((float)(1ull << SERVO_SPLINE_FRACTION_BITS))
+
+/**
+ * Plan a spline segment from the start to the target levels of a bank.
+ * Over ticks k = 0..N the level is p(k) = a*k^3 + b*k^2 + c*k + start, with
+ * p(N) = start + delta, p'(0) = start slope and p'(N) = end slope.
+ *
+ * @param spline: Spline to plan
+ * @param bank: Bank planned by servos_smooth_plan(), its steps are the ticks of the segment
+ * @param start_slopes: Slopes at the start levels, one per channel
+ * @param end_slopes: Slopes at the target levels, one per channel
+ */
+void servo_spline_plan(servo_spline* spline, servo_bank* bank, const float* start_slopes, const float* end_slopes) {
+    spline->steps = bank->steps;
+    spline->step = 0;
+    spline->fraction = 0;
+    float n = bank->steps ? (float)bank->steps : 1.0f;
+    for(uint i = 0; i < bank->number; i++) {
+        float delta = bank->level_deltas[i];
+        float m0 = start_slopes[i];
+        float m1 = end_slopes[i];
+        float a = ((m0 + m1) * n - 2.0f * delta) / (n * n * n);
+        float b = (3.0f * delta - (2.0f * m0 + m1) * n) / (n * n);
+        // Start at half a level so the shift of servo_spline_tick() rounds
+        spline->levels[i] = ((int64_t)bank->start_levels[i] << SERVO_SPLINE_FRACTION_BITS)
+                            + (1ll << (SERVO_SPLINE_FRACTION_BITS - 1));
+        spline->first[i] = (int64_t)((a + b + m0) * SERVO_SPLINE_ONE);
+        spline->second[i] = (int64_t)((6.0f * a + 2.0f * b) * SERVO_SPLINE_ONE);
+        spline->third[i] = (int64_t)(6.0f * a * SERVO_SPLINE_ONE);
+    }
+}
+
+/**
+ * Advance a spline segment by one tick and update the levels of the bank, clamped to limits.
+ * The last tick lands exactly on the targets, whatever the rounding of the differences.
+ *
+ * @param spline: Spline planned by servo_spline_plan()
+ * @param bank: Bank of the spline
+ * @return True if the segment continues after this tick, false if levels are at targets
+ */
+bool servo_spline_tick(servo_spline* spline, servo_bank* bank) {
+    return servo_spline_feed(spline, bank, SERVO_BANK_FEED_ONE);
+}
+
+/**
+ * Advance a spline segment by a fraction of steps and update the levels of the bank, clamped to limits.
+ * Between two steps k and k + 1 the level is p(k + f) = p(k) + f*d1 + f(f - 1)/2*d2 + f(f - 1)(f - 2)/6*d3
+ * from the forward differences at k (Newton), exact for a cubic.
+ *
+ * @param spline: Spline planned by servo_spline_plan()
+ * @param bank: Bank of the spline
+ * @param feed: Steps to advance, SERVO_BANK_FEED_ONE for one step
+ * @return True if the segment continues after this tick, false if levels are at targets
+ */
+bool servo_spline_feed(servo_spline* spline, servo_bank* bank, uint feed) {
+    uint progress = spline->fraction + feed;
+    uint advance = progress >> SERVO_BANK_FEED_BITS;
+    spline->fraction = progress & (SERVO_BANK_FEED_ONE - 1);
+    spline->step += advance;
+    if(spline->step >= spline->steps) {
+        servo_bank_update(bank, SERVO_BANK_RATIO_ONE);
+        return false;
+    }
+    // Newton weights of the fraction, with SERVO_BANK_FEED_BITS fraction bits
+    int64_t f = spline->fraction;
+    int64_t w2 = f * (f - SERVO_BANK_FEED_ONE) / 2 >> SERVO_BANK_FEED_BITS;
+    int64_t w3 = w2 * (f - 2 * SERVO_BANK_FEED_ONE) / 3 >> SERVO_BANK_FEED_BITS;
+    for(uint i = 0; i < bank->number; i++) {
+        for(uint k = 0; k < advance; k++) {
+            spline->levels[i] += spline->first[i];
+            spline->first[i] += spline->second[i];
+            spline->second[i] += spline->third[i];
+        }
+        int64_t fixed = spline->levels[i];
+        if(f)
+            fixed += (spline->first[i] >> SERVO_BANK_FEED_BITS) * f + (spline->second[i] >> SERVO_BANK_FEED_BITS) * w2
+                     + (spline->third[i] >> SERVO_BANK_FEED_BITS) * w3;
+        // Slopes at keyframes can overshoot between them
+        int32_t level = fixed >> SERVO_SPLINE_FRACTION_BITS;
+        if(level < bank->min_levels[i])
+            level = bank->min_levels[i];
+        else if(level > bank->max_levels[i])
+            level = bank->max_levels[i];
+        bank->levels[i] = level;
+    }
+    return true;
+}
+
+/**
+ * Slope of a Catmull-Rom spline at a keyframe, from the levels of its neighbours.
+ *
+ * @param previous_level: Level of the keyframe before
+ * @param next_level: Level of the keyframe after
+ * @param interval_us: Time from the keyframe before to the keyframe after
+ * @return Slope in levels per second
+ */
+float servo_spline_slope(int32_t previous_level, int32_t next_level, uint64_t interval_us) {
+    if(!interval_us)
+        return 0.0f;
+    return (float)(next_level - previous_level) * 1e6f / interval_us;
+}
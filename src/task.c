@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "task.h"
+#include "console.h"
+#include "profiler.h"
+#include <string.h>
+
+
+/**
+ * Initialize a task, it runs from the beginning once started.
+ *
+ * @param t: Task to initialize
+ * @param name: Name shown by task_runtime_print()
+ * @param function: Coroutine of the task
+ * @param data: State of the task
+ */
+void task_init(task* t, const char* name, task_function function, void* data) {
+    memset(t, 0, sizeof(task));
+    t->name = name;
+    t->function = function;
+    t->data = data;
+}
+
+/**
+ * Initialize an empty runtime.
+ *
+ * @param runtime: Runtime to initialize
+ */
+void task_runtime_init(task_runtime* runtime) {
+    memset(runtime, 0, sizeof(task_runtime));
+    runtime->start_us = time_us_64();
+}
+
+/**
+ * Append a task to the run queue.
+ *
+ * @param runtime: Runtime to queue
+ * @param t: Task to queue
+ */
+static void task_queue(task_runtime* runtime, task* t) {
+    task** link = &runtime->ready;
+    while(*link)
+        link = &(*link)->next;
+    t->next = NULL;
+    *link = t;
+}
+
+/**
+ * Insert a task into the timer list by wake time.
+ *
+ * @param runtime: Runtime to queue
+ * @param t: Task to sleep
+ */
+static void task_sleep(task_runtime* runtime, task* t) {
+    task** link = &runtime->sleeping;
+    while(*link && (*link)->wake_us <= t->wake_us)
+        link = &(*link)->next;
+    t->next = *link;
+    *link = t;
+}
+
+/**
+ * Add a task to the end of the run queue.
+ * A task that returned TASK_DONE can be started again.
+ *
+ * @param runtime: Runtime to run the task
+ * @param t: Task to start, initialized by task_init(), not queued
+ * @return False if the runtime already has TASK_RUNTIME_MAX_TASKS tasks
+ */
+bool task_start(task_runtime* runtime, task* t) {
+    uint8_t i = 0;
+    while(i < runtime->number && runtime->tasks[i] != t)
+        i++;
+    if(i == TASK_RUNTIME_MAX_TASKS) {
+        console_error("Task runtime is full.\n");
+        return false;
+    }
+    if(i == runtime->number)
+        runtime->tasks[runtime->number++] = t; // Restarted tasks keep their accounting
+    t->line = 0;
+    task_queue(runtime, t);
+    return true;
+}
+
+/**
+ * Run one round: wake due sleeping tasks, then run every ready task once.
+ * Call forever from the main loop.
+ *
+ * @param runtime: Runtime to run
+ */
+void task_runtime_poll(task_runtime* runtime) {
+    uint64_t now_us = time_us_64();
+    while(runtime->sleeping && runtime->sleeping->wake_us <= now_us) {
+        task* t = runtime->sleeping;
+        runtime->sleeping = t->next;
+        task_queue(runtime, t);
+    }
+    // Tasks yielding in this round run again in the next one
+    task* t = runtime->ready;
+    runtime->ready = NULL;
+    while(t) {
+        task* next = t->next;
+        uint64_t start_us = time_us_64();
+        int result = t->function(t);
+        uint32_t elapsed_us = time_us_64() - start_us;
+        t->runs++;
+        t->run_time_us += elapsed_us;
+        if(elapsed_us > t->max_run_us)
+            t->max_run_us = elapsed_us;
+        if(result == TASK_YIELDED)
+            task_queue(runtime, t);
+        else if(result == TASK_SLEEPING)
+            task_sleep(runtime, t);
+        t = next;
+    }
+    PROFILER_LOOP_TIME(PROFILER_LOOP_ROUND, time_us_64() - now_us);
+    runtime->rounds++;
+}
+
+/**
+ * Print runs, run time and CPU share of every task.
+ *
+ * @param runtime: Runtime to print
+ */
+void task_runtime_print(task_runtime* runtime) {
+    uint64_t total_us = time_us_64() - runtime->start_us;
+    uint64_t busy_us = 0;
+    console_printf("Tasks over %lu ms, %d rounds:\n", (unsigned long)(total_us / 1000), runtime->rounds);
+    for(uint8_t i = 0; i < runtime->number; i++) {
+        task* t = runtime->tasks[i];
+        busy_us += t->run_time_us;
+        console_printf("%s: %d runs, %lu us, longest %lu us, %.1f%% CPU\n", t->name, t->runs,
+                       (unsigned long)t->run_time_us, (unsigned long)t->max_run_us,
+                       total_us ? 100.0f * t->run_time_us / total_us : 0.0f);
+    }
+    // Time outside task functions is spent idling in rounds and in the runtime itself
+    console_printf("Idle and runtime: %.1f%% CPU\n", total_us ? 100.0f * (total_us - busy_us) / total_us : 0.0f);
+}
+
+/**
+ * Clear the run-time accounting of all tasks.
+ *
+ * @param runtime: Runtime to clear
+ */
+void task_runtime_reset(task_runtime* runtime) {
+    for(uint8_t i = 0; i < runtime->number; i++) {
+        task* t = runtime->tasks[i];
+        t->runs = 0;
+        t->run_time_us = 0;
+        t->max_run_us = 0;
+    }
+    runtime->rounds = 0;
+    runtime->start_us = time_us_64();
+}
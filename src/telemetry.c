@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "telemetry.h"
+#include "console.h"
+#include "cdc_transport.h"
+#include "tusb.h"
+#include <string.h>
+
+// A frame larger than the CDC TX FIFO of pico_stdio_usb never fits and is always dropped
+_Static_assert(TELEMETRY_FRAME_SIZE <= CFG_TUD_CDC_TX_BUFSIZE, "Telemetry frame larger than the CDC TX FIFO");
+
+
+/**
+ * @param field: Buffer to write
+ * @param value: Value to write little-endian
+ * @return Buffer after the field
+ */
+static uint8_t* put_u16(uint8_t* field, uint16_t value) {
+    field[0] = value;
+    field[1] = value >> 8;
+    return field + 2;
+}
+
+/**
+ * @param field: Buffer to write
+ * @param value: Value to write little-endian
+ * @return Buffer after the field
+ */
+static uint8_t* put_u32(uint8_t* field, uint32_t value) {
+    field = put_u16(field, value);
+    return put_u16(field, value >> 16);
+}
+
+/**
+ * @param value: Value to saturate
+ * @return Value limited to uint16_t
+ */
+static uint16_t saturate_u16(uint32_t value) {
+    return value > UINT16_MAX ? UINT16_MAX : value;
+}
+
+/**
+ * Initialize telemetry, off until telemetry_set_rate().
+ *
+ * @param stream: Telemetry to initialize
+ * @param scheduler: Scheduler of the arms reported
+ */
+void telemetry_init(telemetry* stream, arm_scheduler* scheduler) {
+    memset(stream, 0, sizeof(telemetry));
+    stream->scheduler = scheduler;
+}
+
+/**
+ * Set the frame rate of telemetry.
+ *
+ * @param stream: Telemetry to set
+ * @param rate: Frames per second and arm, 0 to turn telemetry off
+ * @return False if rate is above TELEMETRY_MAX_RATE
+ */
+bool telemetry_set_rate(telemetry* stream, uint rate) {
+    if(rate > TELEMETRY_MAX_RATE) {
+        console_error("Telemetry rate is at most %d frames per second.\n", TELEMETRY_MAX_RATE);
+        return false;
+    }
+    stream->period_us = rate ? 1000000 / rate : 0;
+    stream->next_us = time_us_64();
+    return true;
+}
+
+/**
+ * Record the time of one main loop iteration.
+ *
+ * @param stream: Telemetry to record
+ * @param elapsed_us: Time of the iteration in microseconds
+ */
+void telemetry_record_loop(telemetry* stream, uint32_t elapsed_us) {
+    if(elapsed_us > stream->loop_max_us)
+        stream->loop_max_us = elapsed_us;
+    stream->loop_total_us += elapsed_us;
+    stream->loop_count++;
+}
+
+/**
+ * Build a telemetry frame of the current state of one arm.
+ * Fields are packed as integers, nothing is formatted as text.
+ *
+ * @param stream: Telemetry to build
+ * @param arm: Arm id
+ * @param frame: Buffer of at least TELEMETRY_FRAME_SIZE bytes
+ * @return Length of frame in bytes
+ */
+uint telemetry_build_frame(telemetry* stream, uint8_t arm, uint8_t* frame) {
+    arm_scheduler* scheduler = stream->scheduler;
+    uint8_t* payload = &frame[3];
+    uint8_t* field = payload;
+    field = put_u16(field, stream->sequence);
+    field = put_u32(field, time_us_64());
+    field = put_u16(field, saturate_u16(stream->loop_max_us));
+    field = put_u16(field, saturate_u16(stream->loop_count ? stream->loop_total_us / stream->loop_count : 0));
+    field = put_u16(field, saturate_u16(stream->dropped));
+    *field++ = arm;
+    *field++ = scheduler->number;
+    // One consistent state even if the motion code ticks in between
+    arm_state state;
+    if(!arm_scheduler_snapshot(scheduler, arm, &state))
+        memset(&state, 0, sizeof(arm_state));
+    *field++ = state.queued;
+    field = put_u16(field, state.step);
+    field = put_u16(field, state.steps);
+    *field++ = state.number;
+    for(uint8_t k = 0; k < state.number; k++) {
+        field = put_u16(field, state.levels[k]);
+        field = put_u16(field, (int16_t)(state.angles[k] * 100.0f));
+    }
+    uint length = field - payload;
+    uint8_t checksum = 0;
+    for(uint i = 0; i < length; i++)
+        checksum += payload[i];
+    *field++ = checksum;
+    frame[0] = TELEMETRY_FRAME_START;
+    put_u16(&frame[1], length);
+    return field - frame;
+}
+
+/**
+ * Send the frames of all arms if they are due, never blocks.
+ * Frames that do not fit in the USB FIFO are dropped and counted.
+ * Call often from the main loop.
+ *
+ * @param stream: Telemetry to poll
+ */
+void telemetry_poll(telemetry* stream) {
+    if(!stream->period_us)
+        return;
+    uint64_t now_us = time_us_64();
+    if(now_us < stream->next_us)
+        return;
+    // Skip frames missed while the loop was busy instead of sending a burst
+    do {
+        stream->next_us += stream->period_us;
+    } while(stream->next_us <= now_us);
+    uint8_t frame[TELEMETRY_FRAME_SIZE];
+    for(uint8_t i = 0; i < stream->scheduler->number; i++) {
+        uint length = telemetry_build_frame(stream, i, frame);
+        if(cdc_transport_write_frame(frame, length))
+            stream->frames++;
+        else
+            stream->dropped++;
+    }
+    stream->sequence++;
+    stream->loop_max_us = 0;
+    stream->loop_total_us = 0;
+    stream->loop_count = 0;
+}
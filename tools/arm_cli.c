@@ -0,0 +1,210 @@
+#include "arm_link.h"
+#include "trajectory.h"
+#include "trajectory_map.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char usage[] =
+    "Usage: arm_cli [options] <device> <command> [argument]\n"
+    "Commands:\n"
+    "    send '<signal>'  Queue one control signal, e.g. '3 0 60 1 60 2 60 d500'\n"
+    "    upload <file>    Queue the control signal lines of a file\n"
+    "    stream <file>    Stream a CSV, binary (MTL1) or pack (MTP1) trajectory\n"
+    "    ping [count]     Measure round trips with queue status requests\n"
+    "Options:\n"
+    "    -a <arm>         Arm id of the commands (default 0)\n"
+    "    -b               Send trajectories as binary frames instead of text\n"
+    "    -w <window>      Most commands in flight per arm (default 8)\n"
+    "    -p <profile>     Velocity profile of trajectories: 0 cos, 1 lin, 2 jerk, 3 spline (default 1)\n"
+    "    -k <ms>          Stream one keyframe per interval of trajectories, with -p 3\n"
+    "    -s <seconds>     Start streaming a pack at this time of the trajectory\n"
+    "    -t <ms>          Longest wait for room in a queue (default 30000)\n"
+    "    -n               The firmware is already in multiple arm mode\n"
+    "    -v               Echo the firmware output\n"
+    "<device> is a serial port or a pseudo-terminal, e.g. /dev/ttyACM0 or /dev/pts/3.\n";
+
+
+/**
+ * Stream a trajectory pack straight from its mapping, from a start time on.
+ * Moves are decoded one at a time, so memory does not grow with the length of the recording.
+ * Decimation keeps one move per interval like trajectory_decimate().
+ *
+ * @param link: Link to the firmware
+ * @param map: Mapped pack
+ * @param arm: Arm id
+ * @param profile: Velocity profile of the moves
+ * @param interval_ms: Shortest duration of the streamed moves, 0 streams every move
+ * @param start_ms: Time of the trajectory to start at
+ * @param timeout_ms: Longest wait for room in the queue
+ * @return False on failure
+ */
+static bool arm_cli_stream_pack(arm_link* link, const trajectory_map* map, uint8_t arm, uint8_t profile,
+                                int interval_ms, uint64_t start_ms, int timeout_ms) {
+    uint64_t sample_start_ms;
+    uint64_t first = trajectory_map_seek(map, start_ms, &sample_start_ms);
+    fprintf(stderr, "Streaming samples %llu to %llu of a pack, %.3f s of motion from %.3f s.\n",
+            (unsigned long long)first, (unsigned long long)map->header->sample_count,
+            (map->header->duration_ms - sample_start_ms) / 1e3, sample_start_ms / 1e3);
+    bool ok = true;
+    uint32_t duration_ms = 0;
+    arm_link_command command;
+    for(uint64_t sample = first; ok && sample < map->header->sample_count; sample++) {
+        duration_ms += trajectory_map_duration_ms(map, sample);
+        if(duration_ms < (uint32_t)interval_ms && sample + 1 < map->header->sample_count)
+            continue;
+        trajectory_map_command(map, sample, arm, profile, &command);
+        command.duration_ms = duration_ms > UINT16_MAX ? UINT16_MAX : duration_ms;
+        duration_ms = 0;
+        ok = arm_link_submit(link, &command, timeout_ms);
+    }
+    return ok;
+}
+
+/**
+ * Stream the moves of a trajectory file, keeping the queue of the arm filled.
+ * Packs are streamed from their mapping, other files are loaded first.
+ *
+ * @param link: Link to the firmware
+ * @param path: Trajectory file
+ * @param arm: Arm id
+ * @param profile: Velocity profile of the moves
+ * @param interval_ms: Shortest duration of the streamed moves, 0 streams every move
+ * @param start_ms: Time of a pack to start at
+ * @param timeout_ms: Longest wait for room in the queue
+ * @return False on failure
+ */
+static bool arm_cli_stream(arm_link* link, const char* path, uint8_t arm, uint8_t profile, int interval_ms,
+                           uint64_t start_ms, int timeout_ms) {
+    char magic[4] = {0};
+    FILE* file = fopen(path, "rb");
+    if(file) {
+        if(fread(magic, 1, 4, file) != 4)
+            magic[0] = 0;
+        fclose(file);
+    }
+    if(memcmp(magic, TRAJECTORY_PACK_MAGIC, 4) == 0) {
+        trajectory_map map;
+        if(!trajectory_map_open(&map, path))
+            return false;
+        bool ok = arm_cli_stream_pack(link, &map, arm, profile, interval_ms, start_ms, timeout_ms);
+        trajectory_map_close(&map);
+        return ok;
+    }
+    trajectory moves;
+    if(!trajectory_load(&moves, path, arm, profile))
+        return false;
+    trajectory_decimate(&moves, interval_ms);
+    uint64_t total_ms = 0;
+    for(size_t i = 0; i < moves.number; i++)
+        total_ms += moves.commands[i].duration_ms;
+    fprintf(stderr, "Streaming %zu moves, %.3f s of motion.\n", moves.number, total_ms / 1e3);
+    bool ok = true;
+    for(size_t i = 0; ok && i < moves.number; i++)
+        ok = arm_link_submit(link, &moves.commands[i], timeout_ms);
+    trajectory_free(&moves);
+    return ok;
+}
+
+/**
+ * Queue the control signal lines of a file.
+ *
+ * @param link: Link to the firmware
+ * @param path: File of control signal lines
+ * @param arm: Arm id
+ * @param timeout_ms: Longest wait for room in the queue
+ * @return False on failure
+ */
+static bool arm_cli_upload(arm_link* link, const char* path, uint8_t arm, int timeout_ms) {
+    char** lines;
+    int number = trajectory_load_lines(path, &lines);
+    if(number < 0)
+        return false;
+    bool ok = true;
+    for(int i = 0; ok && i < number; i++)
+        ok = arm_link_wait_credit(link, arm, timeout_ms) && arm_link_send_string(link, arm, lines[i])
+             && arm_link_poll(link, 0) >= 0;
+    trajectory_free_lines(lines, number);
+    return ok;
+}
+
+/**
+ * Measure round trips with status requests, one at a time.
+ *
+ * @param link: Link to the firmware
+ * @param count: Number of requests
+ * @return False if the firmware did not answer
+ */
+static bool arm_cli_ping(arm_link* link, int count) {
+    for(int i = 0; i < count; i++)
+        if(!arm_link_request_status(link) || !arm_link_drain(link, 1000))
+            return false;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    int arm = 0;
+    bool binary = false;
+    int window = ARM_LINK_QUEUE_SIZE;
+    int profile = 1;
+    int timeout_ms = 30000;
+    int interval_ms = 0;
+    double start_s = 0.0;
+    bool enter = true;
+    bool verbose = false;
+    int option;
+    while((option = getopt(argc, argv, "a:bw:p:k:s:t:nvh")) != -1) {
+        switch(option) {
+        case 'a': arm = atoi(optarg); break;
+        case 'b': binary = true; break;
+        case 'w': window = atoi(optarg); break;
+        case 'p': profile = atoi(optarg); break;
+        case 'k': interval_ms = atoi(optarg); break;
+        case 's': start_s = atof(optarg); break;
+        case 't': timeout_ms = atoi(optarg); break;
+        case 'n': enter = false; break;
+        case 'v': verbose = true; break;
+        default:
+            fputs(usage, option == 'h' ? stdout : stderr);
+            return option == 'h' ? 0 : 2;
+        }
+    }
+    if(argc - optind < 2 || arm < 0 || arm >= ARM_LINK_MAX_ARMS || window < 1 || window > ARM_LINK_MAX_IN_FLIGHT
+       || profile < 0 || profile > 3 || interval_ms < 0 || start_s < 0.0) {
+        fputs(usage, stderr);
+        return 2;
+    }
+    const char* device = argv[optind];
+    const char* command = argv[optind + 1];
+    const char* argument = argc - optind > 2 ? argv[optind + 2] : NULL;
+
+    arm_link link;
+    if(!arm_link_open(&link, device))
+        return 1;
+    link.binary = binary;
+    link.window = window;
+    link.verbose = verbose ? stdout : NULL;
+    if(enter ? !arm_link_enter_scheduler(&link, 2000) : !arm_link_sync(&link, 2000)) {
+        arm_link_close(&link);
+        return 1;
+    }
+
+    bool ok;
+    if(strcmp(command, "send") == 0 && argument) {
+        ok = arm_link_wait_credit(&link, arm, timeout_ms) && arm_link_send_string(&link, arm, argument);
+    } else if(strcmp(command, "upload") == 0 && argument) {
+        ok = arm_cli_upload(&link, argument, arm, timeout_ms);
+    } else if(strcmp(command, "stream") == 0 && argument) {
+        ok = arm_cli_stream(&link, argument, arm, profile, interval_ms, (uint64_t)(start_s * 1000.0), timeout_ms);
+    } else if(strcmp(command, "ping") == 0) {
+        ok = arm_cli_ping(&link, argument ? atoi(argument) : 10);
+    } else {
+        fputs(usage, stderr);
+        arm_link_close(&link);
+        return 2;
+    }
+    ok = arm_link_drain(&link, 2000) && ok;
+    arm_link_print_stats(&link, stderr);
+    arm_link_close(&link);
+    return ok && link.rejected == 0 ? 0 : 1;
+}
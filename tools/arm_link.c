@@ -0,0 +1,511 @@
+#include "arm_link.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+// Shortest time between two status requests while waiting for room
+#define ARM_LINK_STATUS_INTERVAL_US 5000
+
+// Profile names of the text options, in order of motion_profile
+static const char* profile_names[] = {"cos", "lin", "jerk", "spline"};
+
+
+/**
+ * @return Monotonic time in microseconds
+ */
+uint64_t arm_link_time_us(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/**
+ * Open a serial device or pseudo-terminal in raw mode.
+ *
+ * @param link: Link to open
+ * @param path: Path of the device, e.g. /dev/ttyACM0 or /dev/pts/3
+ * @return False if the device cannot be opened
+ */
+bool arm_link_open(arm_link* link, const char* path) {
+    memset(link, 0, sizeof(arm_link));
+    link->window = ARM_LINK_QUEUE_SIZE;
+    link->fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if(link->fd < 0) {
+        fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    // USB CDC ignores the baud rate, pseudo-terminals only need raw mode
+    struct termios attributes;
+    if(tcgetattr(link->fd, &attributes) == 0) {
+        cfmakeraw(&attributes);
+        cfsetspeed(&attributes, B115200);
+        attributes.c_cc[VMIN] = 0;
+        attributes.c_cc[VTIME] = 0;
+        tcsetattr(link->fd, TCSANOW, &attributes);
+    }
+    return true;
+}
+
+/**
+ * Close the device of a link.
+ *
+ * @param link: Link to close
+ */
+void arm_link_close(arm_link* link) {
+    if(link->fd >= 0)
+        close(link->fd);
+    link->fd = -1;
+}
+
+/**
+ * Write all bytes, waiting while the device is busy.
+ *
+ * @param link: Link to write
+ * @param data: Bytes to write
+ * @param length: Number of bytes
+ * @return False if the write failed
+ */
+static bool arm_link_write(arm_link* link, const void* data, size_t length) {
+    const uint8_t* bytes = data;
+    while(length) {
+        ssize_t written = write(link->fd, bytes, length);
+        if(written < 0) {
+            if(errno != EAGAIN && errno != EINTR) {
+                fprintf(stderr, "Write failed: %s\n", strerror(errno));
+                return false;
+            }
+            struct pollfd device = {.fd = link->fd, .events = POLLOUT};
+            poll(&device, 1, 100);
+            continue;
+        }
+        bytes += written;
+        length -= written;
+    }
+    return true;
+}
+
+/**
+ * Record a request waiting for its answer.
+ *
+ * @param link: Link to record
+ * @param arm: Arm id of a command, -1 for a status request
+ * @return False if too many requests are in flight
+ */
+static bool arm_link_push(arm_link* link, int arm) {
+    if(link->count == ARM_LINK_MAX_IN_FLIGHT) {
+        fprintf(stderr, "Too many requests in flight.\n");
+        return false;
+    }
+    arm_link_request* request = &link->requests[(link->head + link->count) % ARM_LINK_MAX_IN_FLIGHT];
+    request->arm = arm;
+    request->sent_us = arm_link_time_us();
+    if(!link->start_us)
+        link->start_us = request->sent_us;
+    link->count++;
+    return true;
+}
+
+/**
+ * @param link: Link to check
+ * @param arm: Arm id, -1 for status requests
+ * @return Number of requests of arm in flight after the oldest one
+ */
+static int arm_link_in_flight_after_head(arm_link* link, int arm) {
+    int number = 0;
+    for(unsigned i = 1; i < link->count; i++)
+        if(link->requests[(link->head + i) % ARM_LINK_MAX_IN_FLIGHT].arm == arm)
+            number++;
+    return number;
+}
+
+/**
+ * @param link: Link to check
+ * @param arm: Arm id, -1 for status requests
+ * @return Number of requests of arm in flight
+ */
+static int arm_link_in_flight(arm_link* link, int arm) {
+    int number = 0;
+    for(unsigned i = 0; i < link->count; i++)
+        if(link->requests[(link->head + i) % ARM_LINK_MAX_IN_FLIGHT].arm == arm)
+            number++;
+    return number;
+}
+
+/**
+ * Remove the oldest request and record its round trip.
+ *
+ * @param link: Link to update
+ */
+static void arm_link_pop(arm_link* link) {
+    uint64_t now_us = arm_link_time_us();
+    uint64_t rtt_us = now_us - link->requests[link->head].sent_us;
+    if(!link->rtt_count || rtt_us < link->rtt_min_us)
+        link->rtt_min_us = rtt_us;
+    if(rtt_us > link->rtt_max_us)
+        link->rtt_max_us = rtt_us;
+    link->rtt_total_us += rtt_us;
+    link->rtt_count++;
+    link->last_us = now_us;
+    link->head = (link->head + 1) % ARM_LINK_MAX_IN_FLIGHT;
+    link->count--;
+}
+
+/**
+ * @param link: Link to check
+ * @return Arm id of the oldest request, -1 for a status request, -2 if none is in flight
+ */
+static int arm_link_head_arm(arm_link* link) {
+    return link->count ? link->requests[link->head].arm : -2;
+}
+
+/**
+ * Handle one line of firmware output.
+ *
+ * @param link: Link to update
+ * @param line: Line without end of line
+ * @return 1 if the line answered a request, else 0
+ */
+static int arm_link_handle_line(arm_link* link, const char* line) {
+    int arm, depth, size;
+    char state[16];
+    int head_arm = arm_link_head_arm(link);
+    if(sscanf(line, "Command queued for arm %d, %d of %d", &arm, &depth, &size) == 3) {
+        if(head_arm < 0)
+            return 0; // Answer of a command another client sent
+        // Commands still in flight are queued behind the acknowledged one
+        if(head_arm < ARM_LINK_MAX_ARMS)
+            link->depth[head_arm] = depth + arm_link_in_flight_after_head(link, head_arm);
+        link->acked++;
+        arm_link_pop(link);
+        return 1;
+    }
+    if(strcmp(line, "Binary command rejected.") == 0 || strncmp(line, "Enter 'p' to print queues", 25) == 0) {
+        // The tip also ends the mode entry, only a command waiting for an answer is rejected
+        if(head_arm < 0)
+            return 0;
+        if(link->verbose == NULL)
+            fprintf(stderr, "Command %u rejected by the firmware.\n", link->acked + link->rejected);
+        link->depth[head_arm]--;
+        link->rejected++;
+        arm_link_pop(link);
+        return 1;
+    }
+    if(sscanf(line, "Arm %d: %15[a-z], %d queued", &arm, state, &depth) == 3) {
+        if(head_arm == -1 && arm >= 0 && arm < ARM_LINK_MAX_ARMS)
+            link->depth[arm] = depth + arm_link_in_flight_after_head(link, arm);
+        return 0;
+    }
+    if(strncmp(line, "Tick overruns:", 14) == 0 && head_arm == -1) {
+        arm_link_pop(link);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Handle one byte of firmware output.
+ * Telemetry frames are skipped, text is split into lines.
+ *
+ * @param link: Link to update
+ * @param byte: Byte received
+ * @return Number of requests answered
+ */
+static int arm_link_handle_byte(arm_link* link, uint8_t byte) {
+    if(link->skip_header) {
+        link->header[2 - link->skip_header--] = byte;
+        if(!link->skip_header)
+            link->skip = (link->header[0] | link->header[1] << 8) + 1; // Payload and checksum
+        return 0;
+    }
+    if(link->skip) {
+        link->skip--;
+        return 0;
+    }
+    if(byte == ARM_LINK_TELEMETRY_START) {
+        // Console text is ASCII, telemetry frames may start anywhere in a line
+        link->skip_header = 2;
+        return 0;
+    }
+    if(link->verbose && byte != '\r')
+        fputc(byte, link->verbose);
+    if(byte == '\n' || byte == '\r') {
+        if(!link->line_length)
+            return 0;
+        link->line[link->line_length] = '\0';
+        link->line_length = 0;
+        return arm_link_handle_line(link, link->line);
+    }
+    if(link->line_length < sizeof(link->line) - 1)
+        link->line[link->line_length++] = byte;
+    return 0;
+}
+
+/**
+ * Read and handle the firmware output.
+ *
+ * @param link: Link to the firmware
+ * @param timeout_ms: Longest time to wait for output, 0 to not wait
+ * @return Number of answers received, -1 if the device failed
+ */
+int arm_link_poll(arm_link* link, int timeout_ms) {
+    struct pollfd device = {.fd = link->fd, .events = POLLIN};
+    int ready = poll(&device, 1, timeout_ms);
+    if(ready < 0 && errno != EINTR) {
+        fprintf(stderr, "Poll failed: %s\n", strerror(errno));
+        return -1;
+    }
+    if(ready <= 0)
+        return 0;
+    if(device.revents & (POLLERR | POLLHUP) && !(device.revents & POLLIN)) {
+        fprintf(stderr, "Device closed.\n");
+        return -1;
+    }
+    int answers = 0;
+    uint8_t buffer[512];
+    ssize_t length;
+    while((length = read(link->fd, buffer, sizeof(buffer))) > 0)
+        for(ssize_t i = 0; i < length; i++)
+            answers += arm_link_handle_byte(link, buffer[i]);
+    if(length < 0 && errno != EAGAIN && errno != EINTR) {
+        fprintf(stderr, "Read failed: %s\n", strerror(errno));
+        return -1;
+    }
+    if(link->verbose)
+        fflush(link->verbose);
+    return answers;
+}
+
+/**
+ * Bring the firmware from any menu to the multiple arm mode and read the queue depths.
+ *
+ * @param link: Link to the firmware
+ * @param timeout_ms: Longest time to wait for the mode tip
+ * @return False if the firmware did not answer
+ */
+bool arm_link_enter_scheduler(arm_link* link, int timeout_ms) {
+    // "q" ends every mode, or is an invalid command in the main menu
+    for(int i = 0; i < 3; i++) {
+        if(!arm_link_write(link, "q\n", 2))
+            return false;
+        usleep(20000);
+    }
+    while(arm_link_poll(link, 100) > 0 || link->line_length)
+        ;
+    link->line_length = 0;
+    if(!arm_link_write(link, "a", 1))
+        return false;
+    uint64_t end_us = arm_link_time_us() + timeout_ms * 1000ull;
+    while(arm_link_time_us() < end_us) {
+        struct pollfd device = {.fd = link->fd, .events = POLLIN};
+        if(poll(&device, 1, 10) <= 0)
+            continue;
+        uint8_t byte;
+        while(read(link->fd, &byte, 1) == 1) {
+            arm_link_handle_byte(link, byte);
+            if(byte == '\n' && strncmp(link->line, "Enter 'p' to print queues", 25) == 0)
+                return arm_link_sync(link, timeout_ms);
+        }
+    }
+    fprintf(stderr, "Firmware did not enter multiple arm mode.\n");
+    return false;
+}
+
+/**
+ * Read the queue depths of all arms, moves queued before the link opened still fill the queues.
+ *
+ * @param link: Link to the firmware, in multiple arm mode
+ * @param timeout_ms: Longest time to wait for the answer
+ * @return False if the firmware did not answer
+ */
+bool arm_link_sync(arm_link* link, int timeout_ms) {
+    return arm_link_request_status(link) && arm_link_drain(link, timeout_ms);
+}
+
+/**
+ * Send a command without waiting for its answer.
+ * Check arm_link_credit() first, a command sent to a full queue is rejected.
+ *
+ * @param link: Link to the firmware
+ * @param command: Command to send
+ * @return False if the command is invalid, too many requests are in flight or the write failed
+ */
+bool arm_link_send(arm_link* link, const arm_link_command* command) {
+    if(command->arm >= ARM_LINK_MAX_ARMS || command->number == 0 || command->number > ARM_LINK_MAX_SERVOS) {
+        fprintf(stderr, "Invalid command.\n");
+        return false;
+    }
+    uint8_t frame[2 + 2 + ARM_LINK_MAX_SERVOS * 3 + 3];
+    char text[16 + ARM_LINK_MAX_SERVOS * 12 + 24];
+    size_t length = 0;
+    if(link->binary) {
+        frame[length++] = ARM_LINK_FRAME_START;
+        length++; // Frame length, set below
+        frame[length++] = command->arm;
+        frame[length++] = command->number;
+        for(uint8_t i = 0; i < command->number; i++) {
+            if(command->angles[i] < 0.0f || command->angles[i] > 655.35f) {
+                fprintf(stderr, "Angle %.2f does not fit a binary frame.\n", command->angles[i]);
+                return false;
+            }
+            uint16_t centidegrees = (uint16_t)(command->angles[i] * 100.0f + 0.5f);
+            frame[length++] = command->indexes[i];
+            frame[length++] = centidegrees;
+            frame[length++] = centidegrees >> 8;
+        }
+        frame[length++] = command->duration_ms;
+        frame[length++] = command->duration_ms >> 8;
+        frame[length++] = command->profile;
+        frame[1] = length - 2;
+    } else {
+        length = sprintf(text, "@%d %d", command->arm, command->number);
+        for(uint8_t i = 0; i < command->number; i++)
+            length += sprintf(&text[length], " %d %.2f", command->indexes[i], command->angles[i]);
+        if(command->duration_ms)
+            length += sprintf(&text[length], " d%d", command->duration_ms);
+        if(command->profile && command->profile < sizeof(profile_names) / sizeof(profile_names[0]))
+            length += sprintf(&text[length], " p%s", profile_names[command->profile]);
+        text[length++] = '\n';
+    }
+    if(!arm_link_push(link, command->arm))
+        return false;
+    if(!arm_link_write(link, link->binary ? (const void*)frame : (const void*)text, length))
+        return false;
+    link->depth[command->arm]++;
+    link->sent++;
+    return true;
+}
+
+/**
+ * Send a command as text, e.g. "3 0 60 1 60 2 60 d500", without waiting for its answer.
+ *
+ * @param link: Link to the firmware
+ * @param arm: Arm id
+ * @param signal: Control signal string without the "@arm" prefix
+ * @return False if too many requests are in flight or the write failed
+ */
+bool arm_link_send_string(arm_link* link, uint8_t arm, const char* signal) {
+    char text[300];
+    int length = snprintf(text, sizeof(text), "@%d %s\n", arm, signal);
+    if(arm >= ARM_LINK_MAX_ARMS || length >= (int)sizeof(text)) {
+        fprintf(stderr, "Invalid command.\n");
+        return false;
+    }
+    if(!arm_link_push(link, arm) || !arm_link_write(link, text, length))
+        return false;
+    link->depth[arm]++;
+    link->sent++;
+    return true;
+}
+
+/**
+ * Ask the firmware for the queue depths of all arms.
+ *
+ * @param link: Link to the firmware
+ * @return False if too many requests are in flight or the write failed
+ */
+bool arm_link_request_status(arm_link* link) {
+    return arm_link_push(link, -1) && arm_link_write(link, "p", 1);
+}
+
+/**
+ * @param link: Link to the firmware
+ * @param arm: Arm id
+ * @return Number of commands that can be sent to arm without overfilling its queue
+ */
+int arm_link_credit(arm_link* link, uint8_t arm) {
+    int credit = ARM_LINK_QUEUE_SIZE - link->depth[arm];
+    int window = (int)link->window - arm_link_in_flight(link, arm);
+    return credit < window ? credit : window;
+}
+
+/**
+ * Wait until an arm has room for a command, asking for the queue depths while waiting.
+ *
+ * @param link: Link to the firmware
+ * @param arm: Arm id
+ * @param timeout_ms: Longest time to wait for room
+ * @return False if the queue stayed full or the device failed
+ */
+bool arm_link_wait_credit(arm_link* link, uint8_t arm, int timeout_ms) {
+    uint64_t end_us = arm_link_time_us() + timeout_ms * 1000ull;
+    uint64_t status_us = 0;
+    while(arm_link_credit(link, arm) <= 0) {
+        uint64_t now_us = arm_link_time_us();
+        if(now_us > end_us) {
+            fprintf(stderr, "Queue of arm %d stayed full.\n", arm);
+            return false;
+        }
+        // Answers of commands in flight refresh the depth, ask only when none is coming
+        if(arm_link_in_flight(link, arm) == 0 && arm_link_in_flight(link, -1) == 0
+           && now_us - status_us >= ARM_LINK_STATUS_INTERVAL_US) {
+            if(!arm_link_request_status(link))
+                return false;
+            status_us = now_us;
+        }
+        if(arm_link_poll(link, 2) < 0)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Send a command once its arm has room.
+ *
+ * @param link: Link to the firmware
+ * @param command: Command to send
+ * @param timeout_ms: Longest time to wait for room
+ * @return False if the queue stayed full or the device failed
+ */
+bool arm_link_submit(arm_link* link, const arm_link_command* command, int timeout_ms) {
+    if(command->arm >= ARM_LINK_MAX_ARMS) {
+        fprintf(stderr, "Invalid command.\n");
+        return false;
+    }
+    if(!arm_link_wait_credit(link, command->arm, timeout_ms) || !arm_link_send(link, command))
+        return false;
+    // Handle answers already received without waiting
+    return arm_link_poll(link, 0) >= 0;
+}
+
+/**
+ * Wait for the answers of all requests in flight.
+ *
+ * @param link: Link to the firmware
+ * @param timeout_ms: Longest time to wait
+ * @return False if answers are missing after timeout_ms
+ */
+bool arm_link_drain(arm_link* link, int timeout_ms) {
+    uint64_t end_us = arm_link_time_us() + timeout_ms * 1000ull;
+    while(link->count) {
+        if(arm_link_time_us() > end_us) {
+            fprintf(stderr, "%u requests not answered.\n", link->count);
+            return false;
+        }
+        if(arm_link_poll(link, 10) < 0)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Print the command rate and round-trip latencies of a link.
+ *
+ * @param link: Link to print
+ * @param file: File to print to
+ */
+void arm_link_print_stats(arm_link* link, FILE* file) {
+    double elapsed_s = link->last_us > link->start_us ? (link->last_us - link->start_us) / 1e6 : 0.0;
+    fprintf(file, "Commands: %u sent, %u queued, %u rejected in %.3f s (%s)\n", link->sent, link->acked,
+            link->rejected, elapsed_s, link->binary ? "binary" : "text");
+    if(elapsed_s > 0.0 && link->acked)
+        fprintf(file, "Command rate: %.1f commands per second\n", link->acked / elapsed_s);
+    if(link->rtt_count)
+        fprintf(file, "Round trip: min %.3f ms, avg %.3f ms, max %.3f ms over %u answers\n",
+                link->rtt_min_us / 1e3, link->rtt_total_us / 1e3 / link->rtt_count, link->rtt_max_us / 1e3,
+                link->rtt_count);
+}
@@ -0,0 +1,232 @@
+#ifndef ARM_LINK_H
+#define ARM_LINK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * Host side of the multiple arm mode of the firmware ('a' in the main menu).
+ * Commands are sent as text lines or binary frames, see arm_scheduler.h.
+ * The firmware answers every command in order with
+ * "Command queued for arm <arm>, <depth> of <size>." or a rejection, and the
+ * link keeps at most as many commands in flight as the queue of each arm has room for.
+ */
+
+// Limits of the firmware, see arm_scheduler.h and servo_bank.h
+#define ARM_LINK_MAX_ARMS 4
+#define ARM_LINK_QUEUE_SIZE 8
+#define ARM_LINK_MAX_SERVOS 16
+
+// First byte of a binary command frame
+#define ARM_LINK_FRAME_START 0xA5
+
+// First byte of a telemetry frame mixed into the console output
+#define ARM_LINK_TELEMETRY_START 0xA6
+
+// Longest unanswered request kept, commands and status requests
+#define ARM_LINK_MAX_IN_FLIGHT 64
+
+/**
+ * One move of an arm.
+ *
+ * @arm: Arm id (uint8_t)
+ * @number: Number of servos to move (uint8_t)
+ * @indexes: Indexes of servos to move (uint8_t[])
+ * @angles: Target angles in degrees (float[])
+ * @duration_ms: Duration of the move, 0 for the speed preset of the firmware (uint16_t)
+ * @profile: Velocity profile, see motion_profile (uint8_t)
+ */
+typedef struct arm_link_command {
+    uint8_t arm;
+    uint8_t number;
+    uint8_t indexes[ARM_LINK_MAX_SERVOS];
+    float angles[ARM_LINK_MAX_SERVOS];
+    uint16_t duration_ms;
+    uint8_t profile;
+} arm_link_command;
+
+/**
+ * Request waiting for its answer.
+ *
+ * @arm: Arm id of a command, -1 for a status request (int)
+ * @sent_us: Time the request was written (uint64_t)
+ */
+typedef struct arm_link_request {
+    int arm;
+    uint64_t sent_us;
+} arm_link_request;
+
+/**
+ * Connection to the firmware.
+ *
+ * @fd: Serial device or pseudo-terminal (int)
+ * @binary: True to send binary frames instead of text lines (bool)
+ * @window: Most commands in flight, at most ARM_LINK_MAX_IN_FLIGHT (uint)
+ * @verbose: Stream to echo the firmware output to, NULL for none (FILE*)
+ * @line: Line of firmware output being received (char[])
+ * @line_length: Number of characters in line (uint)
+ * @skip: Bytes of a telemetry frame still to skip (uint)
+ * @skip_header: Bytes of a telemetry frame header still to read (uint)
+ * @header: Length field of the telemetry frame being skipped (uint8_t[])
+ * @requests: Ring of requests in flight, oldest first (arm_link_request[])
+ * @head: Index of the oldest request (uint)
+ * @count: Number of requests in flight (uint)
+ * @depth: Upper bound of the queue depth of each arm (int[])
+ * @sent: Number of commands sent (uint)
+ * @acked: Number of commands queued by the firmware (uint)
+ * @rejected: Number of commands rejected by the firmware (uint)
+ * @start_us: Time of the first request (uint64_t)
+ * @last_us: Time of the last answer (uint64_t)
+ * @rtt_min_us: Shortest round trip (uint64_t)
+ * @rtt_max_us: Longest round trip (uint64_t)
+ * @rtt_total_us: Sum of round trips (uint64_t)
+ * @rtt_count: Number of round trips measured (uint)
+ */
+typedef struct arm_link {
+    int fd;
+    bool binary;
+    unsigned window;
+    FILE* verbose;
+    char line[256];
+    unsigned line_length;
+    unsigned skip;
+    unsigned skip_header;
+    uint8_t header[2];
+    arm_link_request requests[ARM_LINK_MAX_IN_FLIGHT];
+    unsigned head;
+    unsigned count;
+    int depth[ARM_LINK_MAX_ARMS];
+    unsigned sent;
+    unsigned acked;
+    unsigned rejected;
+    uint64_t start_us;
+    uint64_t last_us;
+    uint64_t rtt_min_us;
+    uint64_t rtt_max_us;
+    uint64_t rtt_total_us;
+    unsigned rtt_count;
+} arm_link;
+
+/**
+ * @return Monotonic time in microseconds
+ */
+uint64_t arm_link_time_us(void);
+
+/**
+ * Open a serial device or pseudo-terminal in raw mode.
+ *
+ * @param link Link to open
+ * @param path Path of the device, e.g. /dev/ttyACM0 or /dev/pts/3
+ * @return False if the device cannot be opened
+ */
+bool arm_link_open(arm_link* link, const char* path);
+
+/**
+ * Close the device of a link.
+ *
+ * @param link Link to close
+ */
+void arm_link_close(arm_link* link);
+
+/**
+ * Bring the firmware from any menu to the multiple arm mode and read the queue depths.
+ *
+ * @param link Link to the firmware
+ * @param timeout_ms Longest time to wait for the mode tip
+ * @return False if the firmware did not answer
+ */
+bool arm_link_enter_scheduler(arm_link* link, int timeout_ms);
+
+/**
+ * Read the queue depths of all arms, moves queued before the link opened still fill the queues.
+ *
+ * @param link Link to the firmware, in multiple arm mode
+ * @param timeout_ms Longest time to wait for the answer
+ * @return False if the firmware did not answer
+ */
+bool arm_link_sync(arm_link* link, int timeout_ms);
+
+/**
+ * Send a command without waiting for its answer.
+ * Check arm_link_credit() first, a command sent to a full queue is rejected.
+ *
+ * @param link Link to the firmware
+ * @param command Command to send
+ * @return False if the command is invalid, too many requests are in flight or the write failed
+ */
+bool arm_link_send(arm_link* link, const arm_link_command* command);
+
+/**
+ * Send a command as text, e.g. "3 0 60 1 60 2 60 d500", without waiting for its answer.
+ *
+ * @param link Link to the firmware
+ * @param arm Arm id
+ * @param signal Control signal string without the "@arm" prefix
+ * @return False if too many requests are in flight or the write failed
+ */
+bool arm_link_send_string(arm_link* link, uint8_t arm, const char* signal);
+
+/**
+ * Ask the firmware for the queue depths of all arms.
+ *
+ * @param link Link to the firmware
+ * @return False if too many requests are in flight or the write failed
+ */
+bool arm_link_request_status(arm_link* link);
+
+/**
+ * Read and handle the firmware output.
+ *
+ * @param link Link to the firmware
+ * @param timeout_ms Longest time to wait for output, 0 to not wait
+ * @return Number of answers received, -1 if the device failed
+ */
+int arm_link_poll(arm_link* link, int timeout_ms);
+
+/**
+ * @param link Link to the firmware
+ * @param arm Arm id
+ * @return Number of commands that can be sent to arm without overfilling its queue
+ */
+int arm_link_credit(arm_link* link, uint8_t arm);
+
+/**
+ * Wait until an arm has room for a command, asking for the queue depths while waiting.
+ *
+ * @param link Link to the firmware
+ * @param arm Arm id
+ * @param timeout_ms Longest time to wait for room
+ * @return False if the queue stayed full or the device failed
+ */
+bool arm_link_wait_credit(arm_link* link, uint8_t arm, int timeout_ms);
+
+/**
+ * Send a command once its arm has room.
+ *
+ * @param link Link to the firmware
+ * @param command Command to send
+ * @param timeout_ms Longest time to wait for room
+ * @return False if the queue stayed full or the device failed
+ */
+bool arm_link_submit(arm_link* link, const arm_link_command* command, int timeout_ms);
+
+/**
+ * Wait for the answers of all requests in flight.
+ *
+ * @param link Link to the firmware
+ * @param timeout_ms Longest time to wait
+ * @return False if answers are missing after timeout_ms
+ */
+bool arm_link_drain(arm_link* link, int timeout_ms);
+
+/**
+ * Print the command rate and round-trip latencies of a link.
+ *
+ * @param link Link to print
+ * @param file File to print to
+ */
+void arm_link_print_stats(arm_link* link, FILE* file);
+
+
+#endif // ARM_LINK_H
@@ -0,0 +1,253 @@
+#include "trajectory.h"
+#include "trajectory_optimizer.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char usage[] =
+    "Usage: arm_optimize [options] <waypoints> [output]\n"
+    "Time the control signal lines \"number index angle ...\" of a file as fast as the limits\n"
+    "of the arm allow and write them with d<ms> and p<profile> for arm_cli upload.\n"
+    "Options:\n"
+    "    -c <file>     Arm description, see trajectory_optimizer.h (default 6 MG996R servos)\n"
+    "    -v <deg/s>    Speed limit of every servo (default 300)\n"
+    "    -a <deg/s^2>  Acceleration limit of every servo, 0 for none (default 3000)\n"
+    "    -t <mm/s>     Speed limit of the tip, needs links in the arm description\n"
+    "    -P <ms>       Full range time of the preset of the default timing (default 5000, normal)\n"
+    "    -j <threads>  Threads of the search (default: online CPUs)\n"
+    "    -B <moves>    Benchmark random moves with 1 to -j threads, no waypoints\n";
+
+
+/**
+ * @return Monotonic time in seconds
+ */
+static double arm_optimize_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * Read the waypoints of a file of control signal lines.
+ *
+ * @param path: Path of the file
+ * @param number_of_servos: Number of servos of the arm
+ * @param waypoints: Set to the moves read, free with free()
+ * @return Number of moves, -1 on failure
+ */
+static long arm_optimize_load(const char* path, uint8_t number_of_servos, arm_link_command** waypoints) {
+    char** lines;
+    int number = trajectory_load_lines(path, &lines);
+    if(number < 0)
+        return -1;
+    *waypoints = malloc((number ? number : 1) * sizeof(arm_link_command));
+    if(!*waypoints) {
+        fprintf(stderr, "Out of memory.\n");
+        trajectory_free_lines(lines, number);
+        return -1;
+    }
+    for(int i = 0; i < number; i++) {
+        if(!optimizer_parse_waypoint(lines[i], number_of_servos, &(*waypoints)[i])) {
+            fprintf(stderr, "%s: invalid waypoint \"%s\".\n", path, lines[i]);
+            free(*waypoints);
+            trajectory_free_lines(lines, number);
+            return -1;
+        }
+    }
+    trajectory_free_lines(lines, number);
+    return number;
+}
+
+/**
+ * Write the timed moves as control signal lines.
+ *
+ * @param file: File to write
+ * @param waypoints: Moves
+ * @param moves: Timing of every move
+ * @param number: Number of moves
+ */
+static void arm_optimize_write(FILE* file, const arm_link_command* waypoints, const optimizer_move* moves,
+                               size_t number) {
+    for(size_t i = 0; i < number; i++) {
+        fprintf(file, "%d", waypoints[i].number);
+        for(uint8_t j = 0; j < waypoints[i].number; j++)
+            fprintf(file, " %d %.2f", waypoints[i].indexes[j], waypoints[i].angles[j]);
+        fprintf(file, " d%u p%s\n", moves[i].duration_ms, optimizer_profile_name(moves[i].profile));
+    }
+}
+
+/**
+ * Print the cycle time of the default and the optimized timing.
+ *
+ * @param arm: Arm of the moves
+ * @param moves: Timing of every move
+ * @param number: Number of moves
+ */
+static void arm_optimize_report(const optimizer_arm* arm, const optimizer_move* moves, size_t number) {
+    uint64_t default_ms = 0;
+    uint64_t optimized_ms = 0;
+    size_t infeasible = 0;
+    size_t default_infeasible = 0;
+    size_t profiles[3] = {0};
+    float tip_speed = 0.0f;
+    float lowest_tip = 0.0f;
+    for(size_t i = 0; i < number; i++) {
+        default_ms += moves[i].default_ms;
+        optimized_ms += moves[i].duration_ms;
+        infeasible += !moves[i].feasible;
+        default_infeasible += !moves[i].default_feasible;
+        profiles[moves[i].profile < 3 ? moves[i].profile : 0]++;
+        if(moves[i].tip_speed > tip_speed)
+            tip_speed = moves[i].tip_speed;
+        if(i == 0 || moves[i].lowest_tip < lowest_tip)
+            lowest_tip = moves[i].lowest_tip;
+    }
+    fprintf(stderr, "Moves: %zu, profiles %zu jerk, %zu cos, %zu lin\n", number, profiles[2], profiles[0],
+            profiles[1]);
+    fprintf(stderr, "Default timing:   %10.3f s, preset %u ms, %zu moves break the limits\n", default_ms / 1e3,
+            arm->full_range_ms, default_infeasible);
+    fprintf(stderr, "Optimized timing: %10.3f s, %.2fx faster, %.1f%% shorter\n", optimized_ms / 1e3,
+            optimized_ms ? (double)default_ms / optimized_ms : 0.0,
+            default_ms ? 100.0 * (1.0 - (double)optimized_ms / default_ms) : 0.0);
+    if(infeasible)
+        fprintf(stderr, "%zu moves cannot meet the limits and keep the default timing.\n", infeasible);
+    if(arm->has_geometry) {
+        fprintf(stderr, "Tip: %.0f mm/s at most, %.1f mm lowest\n", tip_speed, lowest_tip);
+        if(lowest_tip < arm->floor)
+            fprintf(stderr, "The path of the tip goes below the floor at %.1f mm.\n", arm->floor);
+    }
+}
+
+/**
+ * Time random moves with 1, 2, 4 ... threads up to a maximum, results must agree.
+ *
+ * @param arm: Arm of the moves
+ * @param number: Number of moves
+ * @param max_threads: Most threads
+ * @return False on failure
+ */
+static bool arm_optimize_bench(const optimizer_arm* arm, size_t number, unsigned max_threads) {
+    arm_link_command* waypoints = malloc(number * sizeof(arm_link_command));
+    optimizer_move* reference = malloc(number * sizeof(optimizer_move));
+    optimizer_move* moves = malloc(number * sizeof(optimizer_move));
+    bool ok = waypoints && reference && moves;
+    if(!ok)
+        fprintf(stderr, "Out of memory.\n");
+    srand(1);
+    for(size_t i = 0; ok && i < number; i++) {
+        memset(&waypoints[i], 0, sizeof(arm_link_command));
+        // Most moves turn a few servos, some turn all of them
+        uint8_t servos = rand() % 4 ? 1 + rand() % 3 : arm->number;
+        for(uint8_t j = 0; j < arm->number && waypoints[i].number < servos; j++) {
+            if(servos < arm->number && rand() % arm->number >= servos)
+                continue;
+            waypoints[i].indexes[waypoints[i].number] = j;
+            waypoints[i].angles[waypoints[i].number++] = 10.0f + rand() % 16000 / 100.0f;
+        }
+        if(!waypoints[i].number) {
+            waypoints[i].number = 1;
+            waypoints[i].angles[0] = 10.0f + rand() % 16000 / 100.0f;
+        }
+    }
+    printf("%zu moves of %d servos%s\n", number, arm->number, arm->has_geometry ? " with tip limits" : "");
+    printf("%8s %12s %10s\n", "threads", "seconds", "speedup");
+    double single_s = 0.0;
+    for(unsigned threads = 1; ok; threads = threads * 2 < max_threads ? threads * 2 : max_threads) {
+        double start = arm_optimize_now();
+        ok = trajectory_optimize(arm, waypoints, number, threads, threads == 1 ? reference : moves);
+        double elapsed_s = arm_optimize_now() - start;
+        if(threads == 1)
+            single_s = elapsed_s;
+        else if(ok && memcmp(reference, moves, number * sizeof(optimizer_move)) != 0) {
+            fprintf(stderr, "Timing with %u threads differs from one thread.\n", threads);
+            ok = false;
+        }
+        if(ok)
+            printf("%8u %12.3f %9.2fx\n", threads, elapsed_s, single_s / elapsed_s);
+        if(threads >= max_threads)
+            break;
+    }
+    fflush(stdout);
+    if(ok)
+        arm_optimize_report(arm, reference, number);
+    free(moves);
+    free(reference);
+    free(waypoints);
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    const char* description = NULL;
+    float max_speed = -1.0f;
+    float max_accel = -1.0f;
+    float tip_speed = -1.0f;
+    long full_range_ms = -1;
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = online > 0 ? online : 1;
+    long bench_moves = 0;
+    int option;
+    while((option = getopt(argc, argv, "c:v:a:t:P:j:B:h")) != -1) {
+        switch(option) {
+        case 'c': description = optarg; break;
+        case 'v': max_speed = atof(optarg); break;
+        case 'a': max_accel = atof(optarg); break;
+        case 't': tip_speed = atof(optarg); break;
+        case 'P': full_range_ms = atol(optarg); break;
+        case 'j': threads = atoi(optarg); break;
+        case 'B': bench_moves = atol(optarg); break;
+        default:
+            fputs(usage, option == 'h' ? stdout : stderr);
+            return option == 'h' ? 0 : 2;
+        }
+    }
+    if((argc - optind < 1 && !bench_moves) || max_speed == 0.0f || threads < 1 || threads > 1024 || bench_moves < 0
+       || full_range_ms == 0) {
+        fputs(usage, stderr);
+        return 2;
+    }
+
+    optimizer_arm arm;
+    optimizer_arm_default(&arm, 6);
+    if(description && !optimizer_arm_load(&arm, description))
+        return 1;
+    for(uint8_t i = 0; i < ARM_LINK_MAX_SERVOS; i++) {
+        if(max_speed > 0.0f)
+            arm.max_speed[i] = max_speed;
+        if(max_accel >= 0.0f)
+            arm.max_accel[i] = max_accel;
+    }
+    if(tip_speed >= 0.0f)
+        arm.tip_speed = tip_speed;
+    if(full_range_ms > 0)
+        arm.full_range_ms = full_range_ms;
+    if(arm.tip_speed > 0.0f && !arm.has_geometry)
+        fprintf(stderr, "No links in the arm description, the tip speed is not limited.\n");
+    if(bench_moves)
+        return arm_optimize_bench(&arm, bench_moves, threads) ? 0 : 1;
+
+    arm_link_command* waypoints;
+    long number = arm_optimize_load(argv[optind], arm.number, &waypoints);
+    if(number < 0)
+        return 1;
+    optimizer_move* moves = malloc((number ? number : 1) * sizeof(optimizer_move));
+    double start = arm_optimize_now();
+    bool ok = moves && trajectory_optimize(&arm, waypoints, number, threads, moves);
+    double elapsed_s = arm_optimize_now() - start;
+    if(ok) {
+        FILE* output = argc - optind > 1 ? fopen(argv[optind + 1], "w") : stdout;
+        if(!output) {
+            fprintf(stderr, "Cannot create %s.\n", argv[optind + 1]);
+            ok = false;
+        } else {
+            arm_optimize_write(output, waypoints, moves, number);
+            if(output != stdout)
+                ok = fclose(output) == 0;
+            arm_optimize_report(&arm, moves, number);
+            fprintf(stderr, "Optimized in %.3f s with %d threads.\n", elapsed_s, threads);
+        }
+    }
+    free(moves);
+    free(waypoints);
+    return ok ? 0 : 1;
+}
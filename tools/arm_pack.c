@@ -0,0 +1,273 @@
+#include "trajectory.h"
+#include "trajectory_map.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Seeks of the loaded CSV trajectory in the benchmark, each one scans from the start
+#define ARM_PACK_CSV_SEEKS 100
+
+static const char usage[] =
+    "Usage: arm_pack [options] <command> <arguments>\n"
+    "Commands:\n"
+    "    convert <in> <out>  Convert a CSV or binary (MTL1) trajectory to a pack (MTP1)\n"
+    "    info <pack>         Print the header of a pack and the move at -s\n"
+    "    bench <directory>   Write a long recording as CSV and pack, time loading and seeking both\n"
+    "Options:\n"
+    "    -i <shift>          Samples per index entry of converted packs, 2^shift (default 8)\n"
+    "    -s <seconds>        Time of the move printed by info (default 0)\n"
+    "    -H <hours>          Length of the benchmark recording (default 4)\n"
+    "    -r <hz>             Samples per second of the benchmark recording (default 50)\n"
+    "    -n <servos>         Servos of the benchmark recording (default 6)\n"
+    "    -q <seeks>          Seeks of the pack in the benchmark (default 1000000)\n";
+
+
+/**
+ * @return Monotonic time in seconds
+ */
+static double arm_pack_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * @param path: Path of a file
+ * @return Size of the file in MB, 0 if it cannot be read
+ */
+static double arm_pack_file_mb(const char* path) {
+    struct stat status;
+    return stat(path, &status) ? 0.0 : status.st_size / 1e6;
+}
+
+/**
+ * Convert a trajectory file to a pack.
+ *
+ * @param input: CSV or binary trajectory
+ * @param output: Pack to write
+ * @param index_shift: Samples per index entry, 2^shift
+ * @return False on failure
+ */
+static bool arm_pack_convert(const char* input, const char* output, uint8_t index_shift) {
+    trajectory moves;
+    if(!trajectory_load(&moves, input, 0, 0))
+        return false;
+    bool ok = trajectory_pack_write(&moves, output, index_shift);
+    if(ok)
+        fprintf(stderr, "Packed %zu moves, %.1f MB to %.1f MB.\n", moves.number, arm_pack_file_mb(input),
+                arm_pack_file_mb(output));
+    trajectory_free(&moves);
+    return ok;
+}
+
+/**
+ * Print the header of a pack and the move in progress at a time.
+ *
+ * @param path: Pack to print
+ * @param time_ms: Time of the move to print
+ * @return False if the pack is invalid
+ */
+static bool arm_pack_info(const char* path, uint64_t time_ms) {
+    trajectory_map map;
+    if(!trajectory_map_open(&map, path))
+        return false;
+    const trajectory_pack_header* header = map.header;
+    printf("%llu samples of %d servos, %.3f s, %d bytes per sample\n", (unsigned long long)header->sample_count,
+           header->number, header->duration_ms / 1e3, header->sample_size);
+    printf("Index: %llu entries of %u samples at offset %llu\n", (unsigned long long)header->index_count,
+           1u << header->index_shift, (unsigned long long)header->index_offset);
+    uint64_t start_ms;
+    uint64_t sample = trajectory_map_seek(&map, time_ms, &start_ms);
+    if(sample < header->sample_count) {
+        arm_link_command command;
+        trajectory_map_command(&map, sample, 0, 0, &command);
+        printf("Sample %llu from %.3f s, %d ms:", (unsigned long long)sample, start_ms / 1e3, command.duration_ms);
+        for(uint8_t i = 0; i < command.number; i++)
+            printf(" %d:%.2f", command.indexes[i], command.angles[i]);
+        printf("\n");
+    }
+    trajectory_map_close(&map);
+    return true;
+}
+
+/**
+ * Write a recording of smooth motion of every servo as CSV.
+ *
+ * @param path: CSV file to write
+ * @param samples: Number of rows
+ * @param rate: Rows per second
+ * @param servos: Number of servos
+ * @return False if the file cannot be written
+ */
+static bool arm_pack_write_recording(const char* path, uint64_t samples, double rate, int servos) {
+    FILE* file = fopen(path, "w");
+    if(!file) {
+        fprintf(stderr, "Cannot create %s.\n", path);
+        return false;
+    }
+    fprintf(file, "time_ms");
+    for(int i = 0; i < servos; i++)
+        fprintf(file, ",angle%d", i);
+    fprintf(file, "\n");
+    for(uint64_t row = 1; row <= samples; row++) {
+        double time_s = row / rate;
+        fprintf(file, "%.3f", time_s * 1e3);
+        for(int i = 0; i < servos; i++)
+            fprintf(file, ",%.2f", 90.0 + 60.0 * sin(time_s * (0.5 + 0.13 * i) + i));
+        fprintf(file, "\n");
+    }
+    return fclose(file) == 0;
+}
+
+/**
+ * Move in progress at a time, scanning a loaded trajectory from its start.
+ *
+ * @param moves: Loaded trajectory
+ * @param time_ms: Time to find
+ * @return Move index, number of moves if time_ms is past the end
+ */
+static size_t arm_pack_scan(const trajectory* moves, uint64_t time_ms) {
+    uint64_t time = 0;
+    size_t move = 0;
+    for(; move < moves->number; move++) {
+        time += moves->commands[move].duration_ms;
+        if(time > time_ms)
+            break;
+    }
+    return move;
+}
+
+/**
+ * Compare loading and seeking a long recording as CSV and as pack.
+ *
+ * @param directory: Directory of the benchmark files
+ * @param hours: Length of the recording
+ * @param rate: Samples per second
+ * @param servos: Number of servos
+ * @param seeks: Number of pack seeks
+ * @param index_shift: Samples per index entry, 2^shift
+ * @return False on failure
+ */
+static bool arm_pack_bench(const char* directory, double hours, double rate, int servos, long seeks,
+                           uint8_t index_shift) {
+    char csv[1024];
+    char pack[1024];
+    snprintf(csv, sizeof(csv), "%s/arm_pack_bench.csv", directory);
+    snprintf(pack, sizeof(pack), "%s/arm_pack_bench.mtp", directory);
+    uint64_t samples = (uint64_t)(hours * 3600.0 * rate);
+    printf("Recording: %.2f h, %llu samples of %d servos at %.0f Hz\n", hours, (unsigned long long)samples, servos,
+           rate);
+
+    double start = arm_pack_now();
+    if(!arm_pack_write_recording(csv, samples, rate, servos))
+        return false;
+    printf("%-24s %10.3f s  %8.1f MB\n", "Write CSV", arm_pack_now() - start, arm_pack_file_mb(csv));
+
+    trajectory moves;
+    start = arm_pack_now();
+    if(!trajectory_load(&moves, csv, 0, 0))
+        return false;
+    printf("%-24s %10.3f s  %8.1f MB in memory\n", "Load CSV", arm_pack_now() - start,
+           moves.capacity * sizeof(arm_link_command) / 1e6);
+
+    start = arm_pack_now();
+    bool ok = trajectory_pack_write(&moves, pack, index_shift);
+    printf("%-24s %10.3f s  %8.1f MB\n", "Convert to pack", arm_pack_now() - start, arm_pack_file_mb(pack));
+
+    trajectory_map map;
+    start = arm_pack_now();
+    ok = ok && trajectory_map_open(&map, pack);
+    if(!ok) {
+        trajectory_free(&moves);
+        return false;
+    }
+    printf("%-24s %10.6f s\n", "Open pack", arm_pack_now() - start);
+
+    // The same random times on both, the answers must agree
+    uint64_t duration_ms = map.header->duration_ms;
+    srand(1);
+    uint64_t times_ms[ARM_PACK_CSV_SEEKS];
+    for(int i = 0; i < ARM_PACK_CSV_SEEKS; i++)
+        times_ms[i] = ((uint64_t)rand() << 31 | rand()) % duration_ms;
+    size_t found = 0;
+    start = arm_pack_now();
+    for(int i = 0; i < ARM_PACK_CSV_SEEKS; i++)
+        found += arm_pack_scan(&moves, times_ms[i]);
+    double scan_s = (arm_pack_now() - start) / ARM_PACK_CSV_SEEKS;
+    printf("%-24s %10.3f us per seek\n", "Seek loaded CSV", scan_s * 1e6);
+    for(int i = 0; i < ARM_PACK_CSV_SEEKS; i++)
+        found -= trajectory_map_seek(&map, times_ms[i], NULL);
+    if(found) {
+        fprintf(stderr, "Pack and CSV seeks disagree.\n");
+        ok = false;
+    }
+
+    uint64_t checksum = 0;
+    start = arm_pack_now();
+    for(long i = 0; i < seeks; i++)
+        checksum += trajectory_map_seek(&map, ((uint64_t)rand() << 31 | rand()) % duration_ms, NULL);
+    double seek_s = (arm_pack_now() - start) / (seeks > 0 ? seeks : 1);
+    printf("%-24s %10.3f us per seek, %.0fx faster\n", "Seek pack", seek_s * 1e6, scan_s / seek_s);
+
+    arm_link_command command;
+    float angles = 0.0f;
+    start = arm_pack_now();
+    for(uint64_t sample = 0; sample < map.header->sample_count; sample++) {
+        trajectory_map_command(&map, sample, 0, 0, &command);
+        angles += command.angles[0];
+    }
+    double decode_s = arm_pack_now() - start;
+    printf("%-24s %10.3f s  %8.1f M samples/s\n", "Decode whole pack", decode_s,
+           map.header->sample_count / decode_s / 1e6);
+    // Keep the loops from being optimized out
+    if(checksum == 1 && angles == 0.0f)
+        printf("\n");
+
+    trajectory_map_close(&map);
+    trajectory_free(&moves);
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    int index_shift = TRAJECTORY_PACK_INDEX_SHIFT;
+    double time_s = 0.0;
+    double hours = 4.0;
+    double rate = 50.0;
+    int servos = 6;
+    long seeks = 1000000;
+    int option;
+    while((option = getopt(argc, argv, "i:s:H:r:n:q:h")) != -1) {
+        switch(option) {
+        case 'i': index_shift = atoi(optarg); break;
+        case 's': time_s = atof(optarg); break;
+        case 'H': hours = atof(optarg); break;
+        case 'r': rate = atof(optarg); break;
+        case 'n': servos = atoi(optarg); break;
+        case 'q': seeks = atol(optarg); break;
+        default:
+            fputs(usage, option == 'h' ? stdout : stderr);
+            return option == 'h' ? 0 : 2;
+        }
+    }
+    if(argc - optind < 2 || index_shift < 0 || index_shift > 32 || time_s < 0.0 || hours <= 0.0 || rate <= 0.0
+       || rate > 1000.0 || servos < 1 || servos > TRAJECTORY_PACK_MAX_SERVOS || seeks < 0) {
+        fputs(usage, stderr);
+        return 2;
+    }
+    const char* command = argv[optind];
+    bool ok;
+    if(strcmp(command, "convert") == 0 && argc - optind == 3) {
+        ok = arm_pack_convert(argv[optind + 1], argv[optind + 2], index_shift);
+    } else if(strcmp(command, "info") == 0) {
+        ok = arm_pack_info(argv[optind + 1], (uint64_t)(time_s * 1000.0));
+    } else if(strcmp(command, "bench") == 0) {
+        ok = arm_pack_bench(argv[optind + 1], hours, rate, servos, seeks, index_shift);
+    } else {
+        fputs(usage, stderr);
+        return 2;
+    }
+    return ok ? 0 : 1;
+}
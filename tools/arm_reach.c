@@ -0,0 +1,170 @@
+#include "workspace_map.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char usage[] =
+    "Usage: arm_reach [options] <command> <arguments>\n"
+    "Commands:\n"
+    "    build <map>        Compute the reach map of the arm and write it with margins\n"
+    "    query <map> x y z  Print if a point in mm is reachable and its margin to the angle bounds\n"
+    "    bench              Compute the reach map with 1 to -j threads, results must agree\n"
+    "Options:\n"
+    "    -c <file>          Arm description with links, see trajectory_optimizer.h\n"
+    "    -v <mm>            Edge of a voxel (default 10)\n"
+    "    -e <degrees>       Elevation step of links after the second one (default 5)\n"
+    "    -j <threads>       Threads of the search (default: online CPUs)\n"
+    "    -C <file>          Also write the bits as C source for the firmware, see REACH_MAP_SOURCE\n"
+    "    -N <name>          Name of the reach_map of the C source (default arm_reach_map)\n";
+
+
+/**
+ * @return Monotonic time in seconds
+ */
+static double arm_reach_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * @param map: Map to describe
+ * @param file: File to print to
+ */
+static void arm_reach_print(const workspace_map* map, FILE* file) {
+    size_t voxels = (size_t)map->size[0] * map->size[1] * map->size[2];
+    fprintf(file, "%u x %u x %u voxels of %g mm from (%.1f, %.1f, %.1f), %zu reachable (%.1f%%), %u bytes of bits\n",
+            map->size[0], map->size[1], map->size[2], map->voxel, map->origin[0], map->origin[1], map->origin[2],
+            map->reachable, 100.0 * map->reachable / voxels, reach_map_bytes(map->size));
+}
+
+/**
+ * Look up a point in a reach map file.
+ *
+ * @param path: Reach map file
+ * @param point: X, y and height in mm
+ * @return False if the map cannot be read
+ */
+static bool arm_reach_query(const char* path, const float* point) {
+    workspace_map map;
+    if(!workspace_map_load(&map, path))
+        return false;
+    reach_map view;
+    workspace_map_view(&map, &view);
+    if(!reach_map_contains(&view, point[0], point[1], point[2])) {
+        printf("(%.1f, %.1f, %.1f) is unreachable\n", point[0], point[1], point[2]);
+    } else {
+        uint32_t index = (uint32_t)((point[0] - map.origin[0]) / map.voxel)
+                         + map.size[0] * ((uint32_t)((point[1] - map.origin[1]) / map.voxel)
+                                          + map.size[1] * (uint32_t)((point[2] - map.origin[2]) / map.voxel));
+        printf("(%.1f, %.1f, %.1f) is reachable, margin %d degrees\n", point[0], point[1], point[2],
+               map.margins[index]);
+    }
+    workspace_map_free(&map);
+    return true;
+}
+
+/**
+ * Compute the reach map with 1, 2, 4 ... threads up to a maximum, results must agree.
+ *
+ * @param arm: Arm with links
+ * @param voxel: Edge of a voxel in mm
+ * @param elevation_step: Elevation step in degrees
+ * @param max_threads: Most threads
+ * @return False on failure
+ */
+static bool arm_reach_bench(const optimizer_arm* arm, float voxel, float elevation_step, unsigned max_threads) {
+    workspace_map reference;
+    workspace_map map;
+    double single_s = 0.0;
+    bool ok = true;
+    printf("%8s %12s %10s\n", "threads", "seconds", "speedup");
+    for(unsigned threads = 1; ok; threads = threads * 2 < max_threads ? threads * 2 : max_threads) {
+        double start = arm_reach_now();
+        ok = workspace_map_build(threads == 1 ? &reference : &map, arm, voxel, elevation_step, threads);
+        double elapsed_s = arm_reach_now() - start;
+        if(threads == 1) {
+            single_s = elapsed_s;
+        } else if(ok) {
+            size_t voxels = (size_t)map.size[0] * map.size[1] * map.size[2];
+            if(memcmp(reference.margins, map.margins, voxels) != 0) {
+                fprintf(stderr, "Map of %u threads differs from one thread.\n", threads);
+                ok = false;
+            }
+            workspace_map_free(&map);
+        }
+        if(ok)
+            printf("%8u %12.3f %9.2fx\n", threads, elapsed_s, single_s / elapsed_s);
+        if(threads >= max_threads)
+            break;
+    }
+    if(reference.margins) {
+        arm_reach_print(&reference, stdout);
+        workspace_map_free(&reference);
+    }
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    const char* description = NULL;
+    const char* source = NULL;
+    const char* name = "arm_reach_map";
+    float voxel = 10.0f;
+    float elevation_step = 5.0f;
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = online > 0 ? online : 1;
+    int option;
+    while((option = getopt(argc, argv, "+c:v:e:j:C:N:h")) != -1) {
+        switch(option) {
+        case 'c': description = optarg; break;
+        case 'v': voxel = atof(optarg); break;
+        case 'e': elevation_step = atof(optarg); break;
+        case 'j': threads = atoi(optarg); break;
+        case 'C': source = optarg; break;
+        case 'N': name = optarg; break;
+        default:
+            fputs(usage, option == 'h' ? stdout : stderr);
+            return option == 'h' ? 0 : 2;
+        }
+    }
+    if(argc - optind < 1 || voxel <= 0.0f || elevation_step <= 0.0f || elevation_step > 360.0f || threads < 1
+       || threads > 1024) {
+        fputs(usage, stderr);
+        return 2;
+    }
+    const char* command = argv[optind];
+    if(strcmp(command, "query") == 0) {
+        if(argc - optind != 5) {
+            fputs(usage, stderr);
+            return 2;
+        }
+        float point[3] = {atof(argv[optind + 2]), atof(argv[optind + 3]), atof(argv[optind + 4])};
+        return arm_reach_query(argv[optind + 1], point) ? 0 : 1;
+    }
+
+    optimizer_arm arm;
+    optimizer_arm_default(&arm, 6);
+    if(description && !optimizer_arm_load(&arm, description))
+        return 1;
+    bool ok;
+    if(strcmp(command, "build") == 0 && argc - optind == 2) {
+        workspace_map map;
+        double start = arm_reach_now();
+        ok = workspace_map_build(&map, &arm, voxel, elevation_step, threads);
+        if(ok) {
+            fprintf(stderr, "Computed in %.3f s with %d threads.\n", arm_reach_now() - start, threads);
+            arm_reach_print(&map, stderr);
+            ok = workspace_map_write(&map, argv[optind + 1]);
+            if(ok && source)
+                ok = workspace_map_write_source(&map, source, name);
+            workspace_map_free(&map);
+        }
+    } else if(strcmp(command, "bench") == 0) {
+        ok = arm_reach_bench(&arm, voxel, elevation_step, threads);
+    } else {
+        fputs(usage, stderr);
+        return 2;
+    }
+    return ok ? 0 : 1;
+}
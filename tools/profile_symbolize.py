@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+"""Map a profile printed by 'f' in the main menu to the functions of the firmware ELF file.
+
+Usage: profile_symbolize.py [-n nm] [-t top] <elf> [profile.txt]
+
+The profile is read from the file or stdin, from the "Profile:" line to "End of profile.".
+Samples are relocated by the address of profiler_print() on its first line, so the
+position-independent simulator works as well as the firmware. Symbols come from nm,
+arm-none-eabi-nm for the firmware and nm for the simulator.
+"""
+
+import argparse
+import bisect
+import re
+import subprocess
+import sys
+
+
+def read_symbols(nm, elf):
+    """Sorted (address, size, name) of the functions of an ELF file."""
+    output = subprocess.run([nm, "--defined-only", "--print-size", "--numeric-sort", elf],
+                            check=True, capture_output=True, text=True).stdout
+    symbols = []
+    for line in output.splitlines():
+        fields = line.split()
+        if len(fields) == 4 and fields[2].lower() == "t":
+            # Thumb function symbols have bit 0 set
+            symbols.append((int(fields[0], 16) & ~1, int(fields[1], 16), fields[3]))
+    return symbols
+
+
+def read_profile(lines):
+    """Base address, samples, dropped count, {pc: count} and histogram lines of a printed profile."""
+    header = None
+    counts = {}
+    histograms = []
+    for line in lines:
+        line = line.rstrip()
+        if header is None:
+            match = re.match(r"Profile: (\d+) samples every (\d+) us, (\d+) dropped, base ([0-9a-f]+)", line)
+            if match:
+                header = match
+            continue
+        if line.strip() == "End of profile.":
+            break
+        match = re.fullmatch(r"\s*([0-9a-f]+) (\d+)", line)
+        if match:
+            counts[int(match.group(1), 16)] = int(match.group(2))
+        else:
+            histograms.append(line)
+    if header is None:
+        sys.exit("No profile found, print one with 'f' in the main menu.")
+    return int(header.group(4), 16), int(header.group(1)), int(header.group(3)), counts, histograms
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("-n", "--nm", default="arm-none-eabi-nm", help="nm of the ELF file (default arm-none-eabi-nm)")
+    parser.add_argument("-t", "--top", type=int, default=20, help="functions printed (default 20)")
+    parser.add_argument("elf", help="ELF file of the profiled build")
+    parser.add_argument("profile", nargs="?", help="printed profile (default stdin)")
+    options = parser.parse_args()
+
+    symbols = read_symbols(options.nm, options.elf)
+    addresses = [symbol[0] for symbol in symbols]
+    base = next((symbol[0] for symbol in symbols if symbol[2] == "profiler_print"), None)
+    if base is None:
+        sys.exit("No profiler_print in %s, build with SAMPLING_PROFILER." % options.elf)
+    with open(options.profile) if options.profile else sys.stdin as file:
+        runtime_base, samples, dropped, counts, histograms = read_profile(file)
+    offset = runtime_base - base
+
+    functions = {}
+    for pc, count in counts.items():
+        address = pc - offset
+        index = bisect.bisect_right(addresses, address) - 1
+        name = "(outside %s)" % options.elf
+        if index >= 0 and address < symbols[index][0] + max(symbols[index][1], 1):
+            name = symbols[index][2]
+        functions[name] = functions.get(name, 0) + count
+
+    listed = sum(counts.values())
+    print("%d samples, %d in the printed program counters, %d dropped" % (samples, listed, dropped))
+    for name, count in sorted(functions.items(), key=lambda item: -item[1])[:options.top]:
+        print("%6.1f%% %7d  %s" % (100.0 * count / max(samples, 1), count, name))
+    for line in histograms:
+        print(line)
+
+
+if __name__ == "__main__":
+    main()
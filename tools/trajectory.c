@@ -0,0 +1,290 @@
+#include "trajectory.h"
+#include "trajectory_map.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+/**
+ * Append a move to a trajectory.
+ *
+ * @param moves: Trajectory to append
+ * @return Move to fill, NULL if out of memory
+ */
+static arm_link_command* trajectory_append(trajectory* moves) {
+    if(moves->number == moves->capacity) {
+        size_t capacity = moves->capacity ? moves->capacity * 2 : 256;
+        arm_link_command* commands = realloc(moves->commands, capacity * sizeof(arm_link_command));
+        if(!commands) {
+            fprintf(stderr, "Out of memory.\n");
+            return NULL;
+        }
+        moves->commands = commands;
+        moves->capacity = capacity;
+    }
+    arm_link_command* command = &moves->commands[moves->number++];
+    memset(command, 0, sizeof(arm_link_command));
+    return command;
+}
+
+/**
+ * Read a binary timeline of motion_timeline_write_binary().
+ *
+ * @param moves: Trajectory to fill
+ * @param file: File after the magic
+ * @param arm: Arm id of the moves
+ * @param profile: Velocity profile of the moves
+ * @return False if the file is truncated or invalid
+ */
+static bool trajectory_load_binary(trajectory* moves, FILE* file, uint8_t arm, uint8_t profile) {
+    uint8_t number;
+    uint32_t ticks;
+    if(fread(&number, sizeof(number), 1, file) != 1 || fread(&ticks, sizeof(ticks), 1, file) != 1
+       || number == 0 || number > ARM_LINK_MAX_SERVOS) {
+        fprintf(stderr, "Invalid binary timeline header.\n");
+        return false;
+    }
+    uint64_t previous_us = 0;
+    for(uint32_t tick = 0; tick < ticks; tick++) {
+        uint32_t time_us;
+        uint16_t levels[ARM_LINK_MAX_SERVOS];
+        float angles[ARM_LINK_MAX_SERVOS];
+        if(fread(&time_us, sizeof(time_us), 1, file) != 1 || fread(levels, sizeof(uint16_t), number, file) != number
+           || fread(angles, sizeof(float), number, file) != number) {
+            fprintf(stderr, "Binary timeline truncated at tick %u.\n", tick);
+            return false;
+        }
+        arm_link_command* command = trajectory_append(moves);
+        if(!command)
+            return false;
+        command->arm = arm;
+        command->number = number;
+        for(uint8_t i = 0; i < number; i++) {
+            command->indexes[i] = i;
+            command->angles[i] = angles[i];
+        }
+        command->duration_ms = trajectory_pack_duration_ms(previous_us, time_us);
+        command->profile = profile;
+        previous_us = time_us;
+    }
+    return true;
+}
+
+/**
+ * Read a CSV trajectory with a header.
+ *
+ * @param moves: Trajectory to fill
+ * @param file: File to read
+ * @param arm: Arm id of the moves
+ * @param profile: Velocity profile of the moves
+ * @return False if the header or a row is invalid
+ */
+static bool trajectory_load_csv(trajectory* moves, FILE* file, uint8_t arm, uint8_t profile) {
+    // Column kinds: -1 ignored, -2 time in us, -3 time in ms, -4 duration in ms, else servo index
+    int columns[64];
+    int number_columns = 0;
+    int time_column = -1;
+    uint8_t number = 0;
+    char line[2048];
+    if(!fgets(line, sizeof(line), file)) {
+        fprintf(stderr, "Empty trajectory file.\n");
+        return false;
+    }
+    for(char* name = strtok(line, ",\r\n"); name && number_columns < 64; name = strtok(NULL, ",\r\n")) {
+        int kind = -1;
+        int index;
+        if(strcmp(name, "time_us") == 0)
+            kind = -2;
+        else if(strcmp(name, "time_ms") == 0)
+            kind = -3;
+        else if(strcmp(name, "duration_ms") == 0)
+            kind = -4;
+        else if(sscanf(name, "angle%d", &index) == 1 && index >= 0 && index < ARM_LINK_MAX_SERVOS && number < ARM_LINK_MAX_SERVOS) {
+            kind = index;
+            number++;
+        }
+        if(kind < -1 && kind > -5)
+            time_column = number_columns;
+        columns[number_columns++] = kind;
+    }
+    if(time_column < 0 || number == 0) {
+        fprintf(stderr, "Trajectory header needs time_us, time_ms or duration_ms and angle<index> columns.\n");
+        return false;
+    }
+    uint64_t previous_us = 0;
+    int row = 1;
+    while(fgets(line, sizeof(line), file)) {
+        row++;
+        if(line[0] == '\n' || line[0] == '\r' || line[0] == '#')
+            continue;
+        arm_link_command* command = trajectory_append(moves);
+        if(!command)
+            return false;
+        command->arm = arm;
+        command->profile = profile;
+        char* field = line;
+        for(int column = 0; column < number_columns; column++) {
+            char* endptr;
+            double value = strtod(field, &endptr);
+            if(endptr == field) {
+                fprintf(stderr, "Invalid value in row %d, column %d.\n", row, column + 1);
+                return false;
+            }
+            int kind = columns[column];
+            if(kind >= 0) {
+                command->indexes[command->number] = kind;
+                command->angles[command->number++] = value;
+            } else if(kind == -4) {
+                command->duration_ms = value < 1.0 ? 1 : value > UINT16_MAX ? UINT16_MAX : (uint16_t)(value + 0.5);
+            } else if(kind != -1) {
+                uint64_t time_us = kind == -2 ? (uint64_t)value : (uint64_t)(value * 1000.0);
+                command->duration_ms = trajectory_pack_duration_ms(previous_us, time_us);
+                previous_us = time_us;
+            }
+            field = strchr(endptr, ',');
+            if(!field)
+                break;
+            field++;
+        }
+        if(command->number != number) {
+            fprintf(stderr, "Missing angles in row %d.\n", row);
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Copy the samples of a mapped trajectory pack.
+ *
+ * @param moves: Trajectory to fill
+ * @param path: Path of the pack
+ * @param arm: Arm id of the moves
+ * @param profile: Velocity profile of the moves
+ * @return False if the pack is invalid
+ */
+static bool trajectory_load_pack(trajectory* moves, const char* path, uint8_t arm, uint8_t profile) {
+    trajectory_map map;
+    if(!trajectory_map_open(&map, path))
+        return false;
+    for(uint64_t sample = 0; sample < map.header->sample_count; sample++) {
+        arm_link_command* command = trajectory_append(moves);
+        if(!command) {
+            trajectory_map_close(&map);
+            return false;
+        }
+        trajectory_map_command(&map, sample, arm, profile, command);
+    }
+    trajectory_map_close(&map);
+    return true;
+}
+
+/**
+ * Read a trajectory: a pack if the file starts with "MTP1", binary if with "MTL1", else CSV.
+ *
+ * @param moves: Trajectory to read, free with trajectory_free()
+ * @param path: Path of the file
+ * @param arm: Arm id of the moves
+ * @param profile: Velocity profile of the moves
+ * @return False if the file cannot be read
+ */
+bool trajectory_load(trajectory* moves, const char* path, uint8_t arm, uint8_t profile) {
+    memset(moves, 0, sizeof(trajectory));
+    FILE* file = fopen(path, "rb");
+    if(!file) {
+        fprintf(stderr, "Cannot open %s.\n", path);
+        return false;
+    }
+    char magic[4];
+    bool loaded;
+    if(fread(magic, 1, 4, file) == 4 && memcmp(magic, TRAJECTORY_PACK_MAGIC, 4) == 0) {
+        loaded = trajectory_load_pack(moves, path, arm, profile);
+    } else if(memcmp(magic, "MTL1", 4) == 0) {
+        loaded = trajectory_load_binary(moves, file, arm, profile);
+    } else {
+        rewind(file);
+        loaded = trajectory_load_csv(moves, file, arm, profile);
+    }
+    fclose(file);
+    if(!loaded)
+        trajectory_free(moves);
+    return loaded;
+}
+
+/**
+ * Keep one move per interval, e.g. spline keyframes out of a dense trajectory.
+ * Each kept move reaches the angles of the last move it replaces in their summed duration.
+ *
+ * @param moves: Trajectory to thin out
+ * @param interval_ms: Shortest duration of the kept moves, 0 keeps every move
+ */
+void trajectory_decimate(trajectory* moves, unsigned interval_ms) {
+    size_t kept = 0;
+    uint32_t duration_ms = 0;
+    for(size_t i = 0; i < moves->number; i++) {
+        duration_ms += moves->commands[i].duration_ms;
+        if(duration_ms < interval_ms && i + 1 < moves->number)
+            continue;
+        moves->commands[kept] = moves->commands[i];
+        moves->commands[kept++].duration_ms = duration_ms > UINT16_MAX ? UINT16_MAX : duration_ms;
+        duration_ms = 0;
+    }
+    moves->number = kept;
+}
+
+/**
+ * Read control signal lines "number index angle ... [options]" as text commands.
+ * Empty lines and lines starting with '#' are skipped.
+ *
+ * @param path: Path of the file
+ * @param lines: Set to the lines read, free with trajectory_free_lines()
+ * @return Number of lines read, -1 if the file cannot be read
+ */
+int trajectory_load_lines(const char* path, char*** lines) {
+    FILE* file = fopen(path, "r");
+    if(!file) {
+        fprintf(stderr, "Cannot open %s.\n", path);
+        return -1;
+    }
+    int number = 0;
+    int capacity = 0;
+    *lines = NULL;
+    char line[256];
+    while(fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        char* start = line + strspn(line, " \t");
+        if(*start == '\0' || *start == '#')
+            continue;
+        if(number == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            char** grown = realloc(*lines, capacity * sizeof(char*));
+            if(!grown) {
+                fprintf(stderr, "Out of memory.\n");
+                trajectory_free_lines(*lines, number);
+                fclose(file);
+                return -1;
+            }
+            *lines = grown;
+        }
+        (*lines)[number++] = strdup(start);
+    }
+    fclose(file);
+    return number;
+}
+
+/**
+ * @param lines: Lines of trajectory_load_lines()
+ * @param number: Number of lines
+ */
+void trajectory_free_lines(char** lines, int number) {
+    for(int i = 0; i < number; i++)
+        free(lines[i]);
+    free(lines);
+}
+
+/**
+ * @param moves: Trajectory to free
+ */
+void trajectory_free(trajectory* moves) {
+    free(moves->commands);
+    memset(moves, 0, sizeof(trajectory));
+}
@@ -0,0 +1,69 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include "arm_link.h"
+
+/**
+ * Moves of one arm read from a file.
+ *
+ * @commands: Moves in order (arm_link_command*)
+ * @number: Number of moves (size_t)
+ * @capacity: Number of moves commands can hold (size_t)
+ */
+typedef struct trajectory {
+    arm_link_command* commands;
+    size_t number;
+    size_t capacity;
+} trajectory;
+
+/**
+ * Read a trajectory: a pack if the file starts with "MTP1", binary if with "MTL1", else CSV.
+ *
+ * CSV needs a header naming the columns: "time_us" or "time_ms" for the time
+ * the row is reached, or "duration_ms" for the duration of the move to the row,
+ * and "angle<index>" for the angle of each servo. Other columns, like the levels
+ * of motion_timeline_write_csv(), are ignored.
+ * Binary files are written by motion_timeline_write_binary(), packs by
+ * trajectory_pack_write() or motion_timeline_write_pack(); trajectory_map_open()
+ * streams a pack without copying it.
+ *
+ * @param moves Trajectory to read, free with trajectory_free()
+ * @param path Path of the file
+ * @param arm Arm id of the moves
+ * @param profile Velocity profile of the moves
+ * @return False if the file cannot be read
+ */
+bool trajectory_load(trajectory* moves, const char* path, uint8_t arm, uint8_t profile);
+
+/**
+ * Keep one move per interval, e.g. spline keyframes out of a dense trajectory.
+ * Each kept move reaches the angles of the last move it replaces in their summed duration.
+ *
+ * @param moves Trajectory to thin out
+ * @param interval_ms Shortest duration of the kept moves, 0 keeps every move
+ */
+void trajectory_decimate(trajectory* moves, unsigned interval_ms);
+
+/**
+ * Read control signal lines "number index angle ... [options]" as text commands.
+ * Empty lines and lines starting with '#' are skipped.
+ *
+ * @param path Path of the file
+ * @param lines Set to the lines read, free with trajectory_free_lines()
+ * @return Number of lines read, -1 if the file cannot be read
+ */
+int trajectory_load_lines(const char* path, char*** lines);
+
+/**
+ * @param lines Lines of trajectory_load_lines()
+ * @param number Number of lines
+ */
+void trajectory_free_lines(char** lines, int number);
+
+/**
+ * @param moves Trajectory to free
+ */
+void trajectory_free(trajectory* moves);
+
+
+#endif // TRAJECTORY_H
@@ -0,0 +1,223 @@
+#include "trajectory_map.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/**
+ * Check that the header of a mapped file describes a pack that fits in the file.
+ *
+ * @param map: Map with data and size set
+ * @return False if the pack is invalid
+ */
+static bool trajectory_map_validate(trajectory_map* map) {
+    const trajectory_pack_header* header = (const trajectory_pack_header*)map->data;
+    if(map->size < sizeof(trajectory_pack_header) || memcmp(header->magic, TRAJECTORY_PACK_MAGIC, 4) != 0)
+        return false;
+    if(header->number < 1 || header->number > TRAJECTORY_PACK_MAX_SERVOS || header->index_shift > 32
+       || header->sample_size != trajectory_pack_sample_size(header->number))
+        return false;
+    // Bound the sample count first so the offsets below cannot overflow
+    if(header->sample_count > map->size / header->sample_size
+       || header->index_offset != trajectory_pack_index_offset(header->sample_count, header->number))
+        return false;
+    uint64_t index_count = (header->sample_count + ((1ull << header->index_shift) - 1)) >> header->index_shift;
+    if(header->index_count != index_count || header->index_offset + index_count * sizeof(uint64_t) > map->size)
+        return false;
+    map->header = header;
+    map->samples = map->data + sizeof(trajectory_pack_header);
+    map->index = (const uint64_t*)(map->data + header->index_offset);
+    return true;
+}
+
+/**
+ * Map a trajectory pack.
+ *
+ * @param map: Map to open, close with trajectory_map_close()
+ * @param path: Path of the pack
+ * @return False if the file cannot be mapped or is not a valid pack
+ */
+bool trajectory_map_open(trajectory_map* map, const char* path) {
+    memset(map, 0, sizeof(trajectory_map));
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        fprintf(stderr, "Cannot open %s.\n", path);
+        return false;
+    }
+    struct stat status;
+    if(fstat(fd, &status) || status.st_size == 0) {
+        fprintf(stderr, "Cannot read %s.\n", path);
+        close(fd);
+        return false;
+    }
+    map->size = status.st_size;
+    void* data = mmap(NULL, map->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps the file open
+    close(fd);
+    if(data == MAP_FAILED) {
+        fprintf(stderr, "Cannot map %s.\n", path);
+        map->size = 0;
+        return false;
+    }
+    map->data = data;
+    if(!trajectory_map_validate(map)) {
+        fprintf(stderr, "%s is not a valid trajectory pack.\n", path);
+        trajectory_map_close(map);
+        return false;
+    }
+    // Streaming reads the samples front to back
+    madvise(data, map->size, MADV_SEQUENTIAL);
+    return true;
+}
+
+/**
+ * @param map: Map to close
+ */
+void trajectory_map_close(trajectory_map* map) {
+    if(map->data)
+        munmap((void*)map->data, map->size);
+    memset(map, 0, sizeof(trajectory_map));
+}
+
+/**
+ * @param map: Open map
+ * @param sample: Sample index
+ * @return Duration of the move of the sample in milliseconds
+ */
+uint16_t trajectory_map_duration_ms(const trajectory_map* map, uint64_t sample) {
+    uint16_t duration_ms;
+    memcpy(&duration_ms, map->samples + sample * map->header->sample_size, sizeof(duration_ms));
+    return duration_ms;
+}
+
+/**
+ * Find the sample in progress at a time: the first one that ends after it.
+ * The index narrows the search to one block, the block is scanned.
+ *
+ * @param map: Open map
+ * @param time_ms: Time from the start of the trajectory
+ * @param start_ms: Set to the time the found sample starts, may be NULL
+ * @return Sample index, sample_count if time_ms is past the end
+ */
+uint64_t trajectory_map_seek(const trajectory_map* map, uint64_t time_ms, uint64_t* start_ms) {
+    const trajectory_pack_header* header = map->header;
+    uint64_t sample = 0;
+    uint64_t time = 0;
+    if(header->index_count) {
+        // Last block starting at or before time_ms
+        uint64_t low = 0;
+        uint64_t high = header->index_count;
+        while(high - low > 1) {
+            uint64_t middle = low + (high - low) / 2;
+            if(map->index[middle] <= time_ms)
+                low = middle;
+            else
+                high = middle;
+        }
+        sample = low << header->index_shift;
+        time = map->index[low];
+    }
+    for(uint16_t duration_ms; sample < header->sample_count; sample++, time += duration_ms) {
+        duration_ms = trajectory_map_duration_ms(map, sample);
+        if(time + duration_ms > time_ms)
+            break;
+    }
+    if(start_ms)
+        *start_ms = time;
+    return sample;
+}
+
+/**
+ * Decode a sample into a move.
+ *
+ * @param map: Open map
+ * @param sample: Sample index, below sample_count
+ * @param arm: Arm id of the move
+ * @param profile: Velocity profile of the move
+ * @param command: Move to fill
+ */
+void trajectory_map_command(const trajectory_map* map, uint64_t sample, uint8_t arm, uint8_t profile,
+                            arm_link_command* command) {
+    const trajectory_pack_header* header = map->header;
+    uint16_t fields[1 + TRAJECTORY_PACK_MAX_SERVOS];
+    memcpy(fields, map->samples + sample * header->sample_size, header->sample_size);
+    command->arm = arm;
+    command->number = header->number;
+    for(uint8_t i = 0; i < header->number; i++) {
+        command->indexes[i] = header->indexes[i];
+        command->angles[i] = trajectory_pack_decode_angle(fields[1 + i]);
+    }
+    command->duration_ms = fields[0];
+    command->profile = profile;
+}
+
+/**
+ * Write a trajectory as a pack. Every move must set the same servos in the same order.
+ * The header is written last, so an interrupted conversion leaves no valid pack.
+ *
+ * @param moves: Trajectory to write, like one read from CSV by trajectory_load()
+ * @param path: Path of the pack to write
+ * @param index_shift: Samples per index entry, 2^shift
+ * @return False if the moves differ in their servos or the file cannot be written
+ */
+bool trajectory_pack_write(const trajectory* moves, const char* path, uint8_t index_shift) {
+    if(!moves->number || index_shift > 32) {
+        fprintf(stderr, "Nothing to pack.\n");
+        return false;
+    }
+    const arm_link_command* first = &moves->commands[0];
+    for(size_t i = 1; i < moves->number; i++) {
+        if(moves->commands[i].number != first->number
+           || memcmp(moves->commands[i].indexes, first->indexes, first->number) != 0) {
+            fprintf(stderr, "Move %zu sets other servos than move 0, a pack needs the same servos "
+                    "in every move.\n", i);
+            return false;
+        }
+    }
+    FILE* file = fopen(path, "wb");
+    if(!file) {
+        fprintf(stderr, "Cannot create %s.\n", path);
+        return false;
+    }
+    trajectory_pack_header header = {
+        .number = first->number,
+        .index_shift = index_shift,
+        .sample_size = trajectory_pack_sample_size(first->number),
+        .sample_count = moves->number,
+        .index_offset = trajectory_pack_index_offset(moves->number, first->number),
+        .index_count = (moves->number + ((1ull << index_shift) - 1)) >> index_shift
+    };
+    memcpy(header.indexes, first->indexes, first->number);
+    uint64_t* index = malloc(header.index_count * sizeof(uint64_t));
+    if(!index) {
+        fprintf(stderr, "Out of memory.\n");
+        fclose(file);
+        return false;
+    }
+    // Placeholder header, the magic stays zero until everything else is written
+    fwrite(&header, sizeof(header), 1, file);
+    uint16_t sample[1 + TRAJECTORY_PACK_MAX_SERVOS];
+    for(size_t i = 0; i < moves->number; i++) {
+        const arm_link_command* command = &moves->commands[i];
+        if(!(i & ((1ull << index_shift) - 1)))
+            index[i >> index_shift] = header.duration_ms;
+        sample[0] = command->duration_ms;
+        for(uint8_t j = 0; j < command->number; j++)
+            sample[1 + j] = trajectory_pack_encode_angle(command->angles[j]);
+        fwrite(sample, header.sample_size, 1, file);
+        header.duration_ms += command->duration_ms;
+    }
+    uint64_t padding = 0;
+    fwrite(&padding, 1, header.index_offset - sizeof(header) - header.sample_count * header.sample_size, file);
+    fwrite(index, sizeof(uint64_t), header.index_count, file);
+    free(index);
+    memcpy(header.magic, TRAJECTORY_PACK_MAGIC, 4);
+    bool ok = !ferror(file) && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = fclose(file) == 0 && ok;
+    if(!ok)
+        fprintf(stderr, "Cannot write %s.\n", path);
+    return ok;
+}
@@ -0,0 +1,80 @@
+#ifndef TRAJECTORY_MAP_H
+#define TRAJECTORY_MAP_H
+
+#include "trajectory.h"
+#include "trajectory_pack.h"
+
+/**
+ * Trajectory pack mapped into memory, see trajectory_pack.h.
+ * Opening validates the header and maps the file, samples are decoded in place
+ * when they are read, so a recording of hours opens in the same time as one of seconds.
+ *
+ * @data: Mapping of the whole file (const uint8_t*)
+ * @size: Size of the file in bytes (size_t)
+ * @header: Header at the start of the mapping (const trajectory_pack_header*)
+ * @samples: First sample (const uint8_t*)
+ * @index: Seek index (const uint64_t*)
+ */
+typedef struct trajectory_map {
+    const uint8_t* data;
+    size_t size;
+    const trajectory_pack_header* header;
+    const uint8_t* samples;
+    const uint64_t* index;
+} trajectory_map;
+
+/**
+ * Map a trajectory pack.
+ *
+ * @param map Map to open, close with trajectory_map_close()
+ * @param path Path of the pack
+ * @return False if the file cannot be mapped or is not a valid pack
+ */
+bool trajectory_map_open(trajectory_map* map, const char* path);
+
+/**
+ * @param map Map to close
+ */
+void trajectory_map_close(trajectory_map* map);
+
+/**
+ * Find the sample in progress at a time: the first one that ends after it.
+ *
+ * @param map Open map
+ * @param time_ms Time from the start of the trajectory
+ * @param start_ms Set to the time the found sample starts, may be NULL
+ * @return Sample index, sample_count if time_ms is past the end
+ */
+uint64_t trajectory_map_seek(const trajectory_map* map, uint64_t time_ms, uint64_t* start_ms);
+
+/**
+ * @param map Open map
+ * @param sample Sample index
+ * @return Duration of the move of the sample in milliseconds
+ */
+uint16_t trajectory_map_duration_ms(const trajectory_map* map, uint64_t sample);
+
+/**
+ * Decode a sample into a move.
+ *
+ * @param map Open map
+ * @param sample Sample index, below sample_count
+ * @param arm Arm id of the move
+ * @param profile Velocity profile of the move
+ * @param command Move to fill
+ */
+void trajectory_map_command(const trajectory_map* map, uint64_t sample, uint8_t arm, uint8_t profile,
+                            arm_link_command* command);
+
+/**
+ * Write a trajectory as a pack. Every move must set the same servos in the same order.
+ *
+ * @param moves Trajectory to write, like one read from CSV by trajectory_load()
+ * @param path Path of the pack to write
+ * @param index_shift Samples per index entry, 2^shift
+ * @return False if the moves differ in their servos or the file cannot be written
+ */
+bool trajectory_pack_write(const trajectory* moves, const char* path, uint8_t index_shift);
+
+
+#endif // TRAJECTORY_MAP_H
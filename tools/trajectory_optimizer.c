@@ -0,0 +1,562 @@
+#include "trajectory_optimizer.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Acceleration limit of the default arm, a loaded MG996R reaches its top speed in about 0.1 s
+#define OPTIMIZER_DEFAULT_ACCEL 3000.0f
+
+// Relative slack of the limit checks for rounding of float angles
+#define OPTIMIZER_SLACK 1e-3f
+
+// Values of motion_profile
+#define OPTIMIZER_PROFILE_COSINE 0
+#define OPTIMIZER_PROFILE_LINEAR 1
+#define OPTIMIZER_PROFILE_MINIMUM_JERK 2
+
+// Profiles in order of preference when they reach the same duration, smoothest first
+static const uint8_t optimizer_profiles[OPTIMIZER_PROFILES] = {
+    OPTIMIZER_PROFILE_MINIMUM_JERK, OPTIMIZER_PROFILE_COSINE, OPTIMIZER_PROFILE_LINEAR
+};
+
+/**
+ * Search state shared by the threads.
+ *
+ * @arm: Limits and geometry of the arm (const optimizer_arm*)
+ * @number: Number of moves (size_t)
+ * @starts: Angles of every servo at the start of every move (float(*)[])
+ * @targets: Angles of every servo at the end of every move (float(*)[])
+ * @lower_ticks: Shortest candidate of every move and profile (uint32_t*)
+ * @best_ticks: Shortest feasible candidate found of every move and profile, UINT32_MAX if none (atomic_uint*)
+ * @jobs: Number of jobs, OPTIMIZER_WINDOWS for every move and profile (size_t)
+ * @next_job: Next job to take (atomic_size_t)
+ */
+typedef struct optimizer_search {
+    const optimizer_arm* arm;
+    size_t number;
+    float (*starts)[ARM_LINK_MAX_SERVOS];
+    float (*targets)[ARM_LINK_MAX_SERVOS];
+    uint32_t* lower_ticks;
+    atomic_uint* best_ticks;
+    size_t jobs;
+    atomic_size_t next_job;
+} optimizer_search;
+
+
+/**
+ * @param arm: Arm to set
+ * @param number: Number of servos
+ */
+void optimizer_arm_default(optimizer_arm* arm, uint8_t number) {
+    memset(arm, 0, sizeof(optimizer_arm));
+    arm->number = number > ARM_LINK_MAX_SERVOS ? ARM_LINK_MAX_SERVOS : number;
+    for(uint8_t i = 0; i < ARM_LINK_MAX_SERVOS; i++) {
+        arm->angle_range[i] = 180.0f;
+        arm->upper[i] = 180.0f;
+        arm->max_speed[i] = 300.0f;
+        arm->max_accel[i] = OPTIMIZER_DEFAULT_ACCEL;
+        arm->initial[i] = 90.0f;
+    }
+    arm->floor = -HUGE_VALF;
+    arm->tick_us = 20000;
+    // "normal" preset of servo_control.c
+    arm->full_range_ms = 5000;
+    arm->geometry.servos_from_base = arm->chain;
+    arm->geometry.servos_angles_horizontal = arm->horizontal;
+    arm->geometry.servos_direction = arm->direction;
+    arm->geometry.arm_lengths = arm->lengths;
+}
+
+/**
+ * Read the servo field of an arm description line.
+ *
+ * @param arm: Arm of the line
+ * @param field: Index or "*"
+ * @param first: Set to the first servo
+ * @param end: Set past the last servo
+ * @return False if the index is out of range
+ */
+static bool optimizer_parse_servo(const optimizer_arm* arm, const char* field, uint8_t* first, uint8_t* end) {
+    if(strcmp(field, "*") == 0) {
+        *first = 0;
+        *end = arm->number;
+        return true;
+    }
+    char* endptr;
+    long index = strtol(field, &endptr, 10);
+    if(endptr == field || *endptr || index < 0 || index >= arm->number)
+        return false;
+    *first = index;
+    *end = index + 1;
+    return true;
+}
+
+/**
+ * Apply one line of an arm description.
+ *
+ * @param arm: Arm to set
+ * @param line: Line without comment
+ * @return False if the line is invalid
+ */
+static bool optimizer_arm_line(optimizer_arm* arm, const char* line) {
+    char key[16];
+    char servo[8];
+    float values[3];
+    uint8_t first;
+    uint8_t end;
+    int fields = sscanf(line, "%15s", key);
+    if(fields < 1)
+        return true;
+    if(strcmp(key, "servos") == 0 || strcmp(key, "tick_us") == 0 || strcmp(key, "preset_ms") == 0) {
+        unsigned value;
+        if(sscanf(line, "%*s %u", &value) != 1 || value < 1)
+            return false;
+        if(key[0] == 's') {
+            if(value > ARM_LINK_MAX_SERVOS)
+                return false;
+            arm->number = value;
+        } else if(key[0] == 't')
+            arm->tick_us = value;
+        else
+            arm->full_range_ms = value;
+        return true;
+    }
+    if(strcmp(key, "tip_speed") == 0)
+        return sscanf(line, "%*s %f", &arm->tip_speed) == 1 && arm->tip_speed >= 0.0f;
+    if(strcmp(key, "floor") == 0)
+        return sscanf(line, "%*s %f", &arm->floor) == 1;
+    if(strcmp(key, "height") == 0)
+        return sscanf(line, "%*s %f", &arm->geometry.offsets_height) == 1;
+    if(strcmp(key, "radius") == 0)
+        return sscanf(line, "%*s %f", &arm->geometry.offsets_radius) == 1;
+    fields = sscanf(line, "%*s %7s %f %f %f", servo, &values[0], &values[1], &values[2]);
+    if(fields < 1 || !optimizer_parse_servo(arm, servo, &first, &end))
+        return false;
+    if(strcmp(key, "plane") == 0 && fields == 1 && end - first == 1) {
+        arm->geometry.servo_plane_angle = first;
+        return true;
+    }
+    if(strcmp(key, "link") == 0 && fields == 4 && end - first == 1
+       && arm->geometry.servos_from_base_size < ARM_LINK_MAX_SERVOS) {
+        uint8_t link = arm->geometry.servos_from_base_size++;
+        arm->chain[link] = first;
+        arm->lengths[link] = values[0];
+        arm->horizontal[link] = values[1];
+        arm->direction[link] = values[2] != 0.0f;
+        arm->has_geometry = true;
+        return true;
+    }
+    for(uint8_t i = first; i < end; i++) {
+        if(strcmp(key, "range") == 0 && fields == 2 && values[0] > 0.0f)
+            arm->angle_range[i] = values[0];
+        else if(strcmp(key, "bounds") == 0 && fields == 3 && values[0] <= values[1]) {
+            arm->lower[i] = values[0];
+            arm->upper[i] = values[1];
+        } else if(strcmp(key, "limit") == 0 && fields == 3 && values[0] > 0.0f && values[1] >= 0.0f) {
+            arm->max_speed[i] = values[0];
+            arm->max_accel[i] = values[1];
+        } else if(strcmp(key, "initial") == 0 && fields == 2)
+            arm->initial[i] = values[0];
+        else
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Read an arm description over the defaults of optimizer_arm_default().
+ *
+ * @param arm: Arm to set
+ * @param path: Path of the description
+ * @return False if the file cannot be read or a line is invalid
+ */
+bool optimizer_arm_load(optimizer_arm* arm, const char* path) {
+    FILE* file = fopen(path, "r");
+    if(!file) {
+        fprintf(stderr, "Cannot open %s.\n", path);
+        return false;
+    }
+    char line[256];
+    int line_number = 0;
+    bool ok = true;
+    while(ok && fgets(line, sizeof(line), file)) {
+        line_number++;
+        line[strcspn(line, "#\r\n")] = '\0';
+        ok = optimizer_arm_line(arm, line);
+        if(!ok)
+            fprintf(stderr, "%s:%d: invalid arm description \"%s\".\n", path, line_number, line);
+    }
+    fclose(file);
+    return ok;
+}
+
+/**
+ * Read a control signal line "number index angle ... [options]", options are ignored.
+ *
+ * @param line: Line to read
+ * @param number_of_servos: Number of servos of the arm
+ * @param command: Move to fill, duration and profile cleared
+ * @return False if the line is invalid
+ */
+bool optimizer_parse_waypoint(const char* line, uint8_t number_of_servos, arm_link_command* command) {
+    memset(command, 0, sizeof(arm_link_command));
+    char* endptr;
+    long number = strtol(line, &endptr, 10);
+    if(endptr == line || number < 1 || number > number_of_servos)
+        return false;
+    for(long i = 0; i < number; i++) {
+        line = endptr;
+        long index = strtol(line, &endptr, 10);
+        if(endptr == line || index < 0 || index >= number_of_servos)
+            return false;
+        line = endptr;
+        command->angles[i] = strtof(line, &endptr);
+        if(endptr == line)
+            return false;
+        command->indexes[i] = index;
+    }
+    command->number = number;
+    return true;
+}
+
+/**
+ * @param profile: Velocity profile, see motion_profile
+ * @return Name of the profile in control signal options
+ */
+const char* optimizer_profile_name(uint8_t profile) {
+    switch(profile) {
+    case OPTIMIZER_PROFILE_LINEAR:
+        return "lin";
+    case OPTIMIZER_PROFILE_MINIMUM_JERK:
+        return "jerk";
+    default:
+        return "cos";
+    }
+}
+
+/**
+ * Transition ratio of a profile, calculate_profile_ratio() of servo_control.c.
+ *
+ * @param profile: Velocity profile
+ * @param ratio_of_steps: Ratio of steps done (0 to 1)
+ */
+static float optimizer_profile_ratio(uint8_t profile, float ratio_of_steps) {
+    switch(profile) {
+    case OPTIMIZER_PROFILE_LINEAR:
+        return ratio_of_steps;
+    case OPTIMIZER_PROFILE_MINIMUM_JERK:
+        return ratio_of_steps * ratio_of_steps * ratio_of_steps
+               * (10.0f + ratio_of_steps * (6.0f * ratio_of_steps - 15.0f));
+    default:
+        return 0.5f - cosf((float)M_PI * ratio_of_steps) / 2;
+    }
+}
+
+/**
+ * Peak speed of a profile relative to its average speed, motion_profile_peak_factor() of servo_control.c.
+ *
+ * @param profile: Velocity profile
+ */
+static float optimizer_peak_factor(uint8_t profile) {
+    switch(profile) {
+    case OPTIMIZER_PROFILE_LINEAR:
+        return 1.0f;
+    case OPTIMIZER_PROFILE_MINIMUM_JERK:
+        return 1.875f;
+    default:
+        return (float)M_PI / 2;
+    }
+}
+
+/**
+ * Peak acceleration of a profile for a move of one degree in one second.
+ * A linear move jumps to its speed, its acceleration depends on the tick only.
+ *
+ * @param profile: Velocity profile
+ */
+static float optimizer_accel_factor(uint8_t profile) {
+    switch(profile) {
+    case OPTIMIZER_PROFILE_LINEAR:
+        return 0.0f;
+    case OPTIMIZER_PROFILE_MINIMUM_JERK:
+        // 10 / sqrt(3)
+        return 5.7735f;
+    default:
+        return (float)(M_PI * M_PI / 2);
+    }
+}
+
+/**
+ * Position of the tip of the arm, planar links turned by the plane servo.
+ *
+ * @param arm: Arm with geometry
+ * @param angles: Angle of every servo
+ * @param tip: Set to x, y and height in mm
+ */
+static void optimizer_tip(const optimizer_arm* arm, const float* angles, float* tip) {
+    const position_required* geometry = &arm->geometry;
+    float radius = geometry->offsets_radius;
+    float height = geometry->offsets_height;
+    float elevation = 0.0f;
+    for(uint8_t i = 0; i < geometry->servos_from_base_size; i++) {
+        float angle = angles[geometry->servos_from_base[i]] - geometry->servos_angles_horizontal[i];
+        elevation += (geometry->servos_direction[i] ? angle : -angle) * (float)M_PI / 180.0f;
+        radius += geometry->arm_lengths[i] * cosf(elevation);
+        height += geometry->arm_lengths[i] * sinf(elevation);
+    }
+    float plane = angles[geometry->servo_plane_angle] * (float)M_PI / 180.0f;
+    tip[0] = radius * cosf(plane);
+    tip[1] = radius * sinf(plane);
+    tip[2] = height;
+}
+
+/**
+ * Check the firmware writes of a move of a number of ticks against the limits.
+ *
+ * @param search: Search of the move
+ * @param move: Move index
+ * @param profile: Velocity profile
+ * @param steps: Duration in ticks, at least 1
+ * @param tip_speed: Set to the highest tip speed if not NULL, the whole move is then checked
+ * @param lowest_tip: Set to the lowest tip height if not NULL
+ * @return True if no limit is broken
+ */
+static bool optimizer_feasible(const optimizer_search* search, size_t move, uint8_t profile, uint32_t steps,
+                               float* tip_speed, float* lowest_tip) {
+    const optimizer_arm* arm = search->arm;
+    const float* start = search->starts[move];
+    const float* target = search->targets[move];
+    bool geometry = arm->has_geometry && (arm->tip_speed > 0.0f || tip_speed || lowest_tip);
+    float tick_s = arm->tick_us / 1e6f;
+    float angles[ARM_LINK_MAX_SERVOS];
+    float previous[ARM_LINK_MAX_SERVOS];
+    float speeds[ARM_LINK_MAX_SERVOS] = {0};
+    float tip[3];
+    float previous_tip[3];
+    memcpy(previous, start, sizeof(previous));
+    memcpy(angles, start, sizeof(angles));
+    if(geometry)
+        optimizer_tip(arm, start, previous_tip);
+    float peak_tip_speed = 0.0f;
+    float lowest = geometry ? previous_tip[2] : 0.0f;
+    bool feasible = true;
+    // Tick steps + 1 holds the target, the servos come to rest
+    for(uint32_t step = 1; step <= steps + 1; step++) {
+        float ratio = step >= steps ? 1.0f : optimizer_profile_ratio(profile, (float)step / steps);
+        for(uint8_t i = 0; i < arm->number; i++) {
+            if(target[i] == start[i])
+                continue;
+            angles[i] = start[i] + (target[i] - start[i]) * ratio;
+            float speed = (angles[i] - previous[i]) / tick_s;
+            float accel = (speed - speeds[i]) / tick_s;
+            if(fabsf(speed) > arm->max_speed[i] * (1.0f + OPTIMIZER_SLACK)
+               || (arm->max_accel[i] > 0.0f && fabsf(accel) > arm->max_accel[i] * (1.0f + OPTIMIZER_SLACK)))
+                feasible = false;
+            speeds[i] = speed;
+            previous[i] = angles[i];
+        }
+        if(geometry && step <= steps) {
+            optimizer_tip(arm, angles, tip);
+            float distance = sqrtf((tip[0] - previous_tip[0]) * (tip[0] - previous_tip[0])
+                                   + (tip[1] - previous_tip[1]) * (tip[1] - previous_tip[1])
+                                   + (tip[2] - previous_tip[2]) * (tip[2] - previous_tip[2]));
+            if(distance / tick_s > peak_tip_speed)
+                peak_tip_speed = distance / tick_s;
+            if(arm->tip_speed > 0.0f && peak_tip_speed > arm->tip_speed * (1.0f + OPTIMIZER_SLACK))
+                feasible = false;
+            if(tip[2] < lowest)
+                lowest = tip[2];
+            memcpy(previous_tip, tip, sizeof(tip));
+        }
+        if(!feasible && !tip_speed && !lowest_tip)
+            return false;
+    }
+    if(tip_speed)
+        *tip_speed = peak_tip_speed;
+    if(lowest_tip)
+        *lowest_tip = lowest;
+    return feasible;
+}
+
+/**
+ * Lower the shortest feasible candidate of a move and profile.
+ *
+ * @param best: Shortest candidate found
+ * @param steps: Feasible candidate
+ */
+static void optimizer_offer(atomic_uint* best, uint32_t steps) {
+    unsigned current = atomic_load(best);
+    while(steps < current && !atomic_compare_exchange_weak(best, &current, steps))
+        ;
+}
+
+/**
+ * Check the candidates of one job, from the shortest, and stop at the first feasible one.
+ *
+ * @param search: Search of the job
+ * @param job: Job index, move, profile and window from the most significant
+ */
+static void optimizer_run_job(optimizer_search* search, size_t job) {
+    size_t pair = job / OPTIMIZER_WINDOWS;
+    size_t move = pair / OPTIMIZER_PROFILES;
+    uint8_t profile = optimizer_profiles[pair % OPTIMIZER_PROFILES];
+    uint32_t first = search->lower_ticks[pair] + (job % OPTIMIZER_WINDOWS) * OPTIMIZER_WINDOW;
+    for(uint32_t steps = first; steps < first + OPTIMIZER_WINDOW; steps++) {
+        // Another job of the move and profile found a shorter one
+        if(atomic_load_explicit(&search->best_ticks[pair], memory_order_relaxed) <= steps)
+            return;
+        if(optimizer_feasible(search, move, profile, steps, NULL, NULL)) {
+            optimizer_offer(&search->best_ticks[pair], steps);
+            return;
+        }
+    }
+}
+
+/**
+ * Take jobs until none are left.
+ *
+ * @param argument: Search (optimizer_search*)
+ */
+static void* optimizer_worker(void* argument) {
+    optimizer_search* search = argument;
+    size_t job;
+    while((job = atomic_fetch_add_explicit(&search->next_job, 1, memory_order_relaxed)) < search->jobs)
+        optimizer_run_job(search, job);
+    return NULL;
+}
+
+/**
+ * Set the start and target angles of every move, its default timing and the shortest
+ * candidate of every profile: the duration the firmware would stretch a move to,
+ * or half the duration of the continuous profile at the acceleration limit.
+ *
+ * @param search: Search with arm and number set and arrays allocated
+ * @param waypoints: Moves in order
+ * @param moves: Timing of every move, default_ms set
+ */
+static void optimizer_prepare(optimizer_search* search, const arm_link_command* waypoints, optimizer_move* moves) {
+    const optimizer_arm* arm = search->arm;
+    float tick_ms = arm->tick_us / 1e3f;
+    float angles[ARM_LINK_MAX_SERVOS];
+    memcpy(angles, arm->initial, sizeof(angles));
+    for(size_t move = 0; move < search->number; move++) {
+        const arm_link_command* command = &waypoints[move];
+        memcpy(search->starts[move], angles, sizeof(angles));
+        for(uint8_t i = 0; i < command->number; i++) {
+            uint8_t index = command->indexes[i];
+            float angle = command->angles[i];
+            angles[index] = angle < arm->lower[index] ? arm->lower[index]
+                            : angle > arm->upper[index] ? arm->upper[index] : angle;
+        }
+        memcpy(search->targets[move], angles, sizeof(angles));
+
+        // servos_smooth_plan() without options
+        float max_angle_ratio = 0.0f;
+        float limit_ms = 0.0f;
+        for(uint8_t i = 0; i < arm->number; i++) {
+            float difference = fabsf(search->targets[move][i] - search->starts[move][i]);
+            if(difference / arm->angle_range[i] > max_angle_ratio)
+                max_angle_ratio = difference / arm->angle_range[i];
+            if(optimizer_peak_factor(OPTIMIZER_PROFILE_COSINE) * difference / arm->max_speed[i] * 1e3f > limit_ms)
+                limit_ms = optimizer_peak_factor(OPTIMIZER_PROFILE_COSINE) * difference / arm->max_speed[i] * 1e3f;
+        }
+        float default_ms = max_angle_ratio * arm->full_range_ms;
+        if(limit_ms > default_ms)
+            default_ms = limit_ms;
+        uint32_t default_steps = (uint32_t)(default_ms / tick_ms);
+        if(default_steps < 1)
+            default_steps = 1;
+        moves[move].default_ms = (default_steps * arm->tick_us + 999) / 1000;
+        moves[move].default_feasible = optimizer_feasible(search, move, OPTIMIZER_PROFILE_COSINE, default_steps,
+                                                          NULL, NULL);
+
+        for(uint8_t p = 0; p < OPTIMIZER_PROFILES; p++) {
+            uint8_t profile = optimizer_profiles[p];
+            float lower_ms = 0.0f;
+            for(uint8_t i = 0; i < arm->number; i++) {
+                float difference = fabsf(search->targets[move][i] - search->starts[move][i]);
+                float speed_ms = optimizer_peak_factor(profile) * difference / arm->max_speed[i] * 1e3f;
+                float accel_ms = arm->max_accel[i] > 0.0f
+                                 ? 0.5f * sqrtf(optimizer_accel_factor(profile) * difference / arm->max_accel[i]) * 1e3f
+                                 : 0.0f;
+                if(speed_ms > lower_ms)
+                    lower_ms = speed_ms;
+                if(accel_ms > lower_ms)
+                    lower_ms = accel_ms;
+            }
+            // Whole ticks the firmware does not stretch
+            uint32_t lower_steps = (uint32_t)ceilf(lower_ms / tick_ms * (1.0f - OPTIMIZER_SLACK));
+            search->lower_ticks[move * OPTIMIZER_PROFILES + p] = lower_steps < 1 ? 1 : lower_steps;
+            atomic_init(&search->best_ticks[move * OPTIMIZER_PROFILES + p], UINT32_MAX);
+        }
+    }
+}
+
+/**
+ * Find the fastest timing of every waypoint move.
+ *
+ * @param arm: Limits and geometry of the arm
+ * @param waypoints: Moves in order, each one starts where the previous one ends
+ * @param number: Number of moves
+ * @param threads: Number of threads, at least 1
+ * @param moves: Timing of every move, number entries
+ * @return False if out of memory
+ */
+bool trajectory_optimize(const optimizer_arm* arm, const arm_link_command* waypoints, size_t number,
+                         unsigned threads, optimizer_move* moves) {
+    optimizer_search search = {.arm = arm, .number = number, .jobs = number * OPTIMIZER_PROFILES * OPTIMIZER_WINDOWS};
+    atomic_init(&search.next_job, 0);
+    search.starts = malloc(number * sizeof(*search.starts));
+    search.targets = malloc(number * sizeof(*search.targets));
+    search.lower_ticks = malloc(number * OPTIMIZER_PROFILES * sizeof(uint32_t));
+    search.best_ticks = malloc(number * OPTIMIZER_PROFILES * sizeof(atomic_uint));
+    pthread_t* workers = malloc((threads > 1 ? threads - 1 : 1) * sizeof(pthread_t));
+    bool ok = search.starts && search.targets && search.lower_ticks && search.best_ticks && workers;
+    if(!ok)
+        fprintf(stderr, "Out of memory.\n");
+    unsigned started = 0;
+    if(ok) {
+        memset(moves, 0, number * sizeof(optimizer_move));
+        optimizer_prepare(&search, waypoints, moves);
+        // The calling thread is one of the workers
+        for(; started + 1 < threads; started++) {
+            if(pthread_create(&workers[started], NULL, optimizer_worker, &search)) {
+                fprintf(stderr, "Cannot start thread %u.\n", started + 1);
+                break;
+            }
+        }
+        optimizer_worker(&search);
+        for(unsigned i = 0; i < started; i++)
+            pthread_join(workers[i], NULL);
+    }
+    for(size_t move = 0; ok && move < number; move++) {
+        optimizer_move* result = &moves[move];
+        uint32_t best = UINT32_MAX;
+        for(uint8_t p = 0; p < OPTIMIZER_PROFILES; p++) {
+            uint32_t steps = atomic_load(&search.best_ticks[move * OPTIMIZER_PROFILES + p]);
+            if(steps < best) {
+                best = steps;
+                result->profile = optimizer_profiles[p];
+            }
+        }
+        result->feasible = best != UINT32_MAX;
+        if(result->feasible)
+            result->duration_ms = (best * arm->tick_us + 999) / 1000;
+        else {
+            // Keep what the firmware would do without a duration
+            result->profile = OPTIMIZER_PROFILE_COSINE;
+            result->duration_ms = result->default_ms;
+            best = result->default_ms * 1000 / arm->tick_us;
+        }
+        if(arm->has_geometry)
+            optimizer_feasible(&search, move, result->profile, best, &result->tip_speed, &result->lowest_tip);
+    }
+    free(workers);
+    free(search.best_ticks);
+    free(search.lower_ticks);
+    free(search.targets);
+    free(search.starts);
+    return ok;
+}
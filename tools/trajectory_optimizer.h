@@ -0,0 +1,148 @@
+#ifndef TRAJECTORY_OPTIMIZER_H
+#define TRAJECTORY_OPTIMIZER_H
+
+#include "arm_link.h"
+#include "struct_position_required.h"
+
+/**
+ * Offline timing of waypoint moves: the shortest duration of every move that keeps
+ * each servo within its speed and acceleration limits and the tip of the arm within
+ * its speed limit, and the velocity profile reaching it.
+ *
+ * The firmware plays a move rest to rest: it writes start + (target - start) * ratio(step / steps)
+ * once per tick, see servos_smooth_tick(). Every candidate duration is checked on exactly
+ * these writes, speed and acceleration are their first and second differences.
+ * A candidate is a whole number of ticks, starting at the duration the firmware would
+ * stretch the move to (servos_smooth_plan()), so the firmware plays the result unchanged.
+ *
+ * The search is split into jobs of OPTIMIZER_WINDOW candidates of one move and profile,
+ * run by a pool of threads; a job is skipped once a shorter candidate of its move and
+ * profile is known to be feasible.
+ */
+
+// Rest to rest velocity profiles tried for every move, see motion_profile
+#define OPTIMIZER_PROFILES 3
+
+// Candidate durations of one job, in ticks
+#define OPTIMIZER_WINDOW 4
+
+// Jobs per move and profile, candidates beyond them leave the profile infeasible
+#define OPTIMIZER_WINDOWS 64
+
+/**
+ * Limits and geometry of one arm.
+ *
+ * @number: Number of servos (uint8_t)
+ * @angle_range: Angle range of every servo in degrees (float[])
+ * @lower: Lowest angle of every servo, targets are clamped like the firmware does (float[])
+ * @upper: Highest angle of every servo (float[])
+ * @max_speed: Speed limit of every servo in degrees per second, the max_speed of the firmware (float[])
+ * @max_accel: Acceleration limit of every servo in degrees per second squared, 0 for none (float[])
+ * @initial: Angle of every servo before the first move (float[])
+ * @tick_us: Tick of the moves, the PWM period of the servos (uint32_t)
+ * @full_range_ms: Full range time of the speed preset of moves without duration (uint32_t)
+ * @tip_speed: Speed limit of the tip in mm per second, 0 for none, needs a geometry (float)
+ * @floor: Lowest height of the tip, reported when a path goes below it, -HUGE_VALF for none (float)
+ * @has_geometry: True if geometry is set (bool)
+ * @geometry: Links of the arm, its arrays point to the arrays below (position_required)
+ * @chain: Servos from the base to the tip (uint8_t[])
+ * @horizontal: Angle of every chain servo at which its link is horizontal (float[])
+ * @direction: True if the link of a chain servo rises when its angle increases (bool[])
+ * @lengths: Length of every link in mm (float[])
+ */
+typedef struct optimizer_arm {
+    uint8_t number;
+    float angle_range[ARM_LINK_MAX_SERVOS];
+    float lower[ARM_LINK_MAX_SERVOS];
+    float upper[ARM_LINK_MAX_SERVOS];
+    float max_speed[ARM_LINK_MAX_SERVOS];
+    float max_accel[ARM_LINK_MAX_SERVOS];
+    float initial[ARM_LINK_MAX_SERVOS];
+    uint32_t tick_us;
+    uint32_t full_range_ms;
+    float tip_speed;
+    float floor;
+    bool has_geometry;
+    position_required geometry;
+    uint8_t chain[ARM_LINK_MAX_SERVOS];
+    float horizontal[ARM_LINK_MAX_SERVOS];
+    bool direction[ARM_LINK_MAX_SERVOS];
+    float lengths[ARM_LINK_MAX_SERVOS];
+} optimizer_arm;
+
+/**
+ * Timing of one waypoint move.
+ *
+ * @feasible: False if no candidate met the limits, duration_ms is then the default timing (bool)
+ * @profile: Velocity profile, see motion_profile (uint8_t)
+ * @duration_ms: Optimized duration (uint32_t)
+ * @default_ms: Duration the firmware gives the move without options, cosine profile (uint32_t)
+ * @default_feasible: False if the default timing breaks the limits (bool)
+ * @tip_speed: Highest tip speed of the optimized move in mm per second, 0 without geometry (float)
+ * @lowest_tip: Lowest height of the tip during the move, 0 without geometry (float)
+ */
+typedef struct optimizer_move {
+    bool feasible;
+    uint8_t profile;
+    uint32_t duration_ms;
+    uint32_t default_ms;
+    bool default_feasible;
+    float tip_speed;
+    float lowest_tip;
+} optimizer_move;
+
+/**
+ * Limits of an arm of MG996R servos like main.c sets up, without geometry.
+ *
+ * @param arm Arm to set
+ * @param number Number of servos
+ */
+void optimizer_arm_default(optimizer_arm* arm, uint8_t number);
+
+/**
+ * Read an arm description over the defaults of optimizer_arm_default().
+ * Lines are "<key> <values>", '#' starts a comment, <servo> is an index or '*' for all:
+ *   servos <number>, tick_us <us>, preset_ms <ms>, range <servo> <degrees>,
+ *   bounds <servo> <lower> <upper>, limit <servo> <deg/s> <deg/s^2>, initial <servo> <angle>,
+ *   tip_speed <mm/s>, floor <mm>, height <mm>, radius <mm>, plane <servo>,
+ *   link <servo> <mm> <horizontal angle> <1 if the link rises with the angle, else 0>.
+ * Links are listed from the base to the tip, height and radius are the offsets of
+ * position_required.
+ *
+ * @param arm Arm to set
+ * @param path Path of the description
+ * @return False if the file cannot be read or a line is invalid
+ */
+bool optimizer_arm_load(optimizer_arm* arm, const char* path);
+
+/**
+ * Read a control signal line "number index angle ... [options]", options are ignored.
+ *
+ * @param line Line to read
+ * @param number_of_servos Number of servos of the arm
+ * @param command Move to fill, duration and profile cleared
+ * @return False if the line is invalid
+ */
+bool optimizer_parse_waypoint(const char* line, uint8_t number_of_servos, arm_link_command* command);
+
+/**
+ * Find the fastest timing of every waypoint move.
+ *
+ * @param arm Limits and geometry of the arm
+ * @param waypoints Moves in order, each one starts where the previous one ends
+ * @param number Number of moves
+ * @param threads Number of threads, at least 1
+ * @param moves Timing of every move, number entries
+ * @return False if out of memory
+ */
+bool trajectory_optimize(const optimizer_arm* arm, const arm_link_command* waypoints, size_t number,
+                         unsigned threads, optimizer_move* moves);
+
+/**
+ * @param profile Velocity profile, see motion_profile
+ * @return Name of the profile in control signal options
+ */
+const char* optimizer_profile_name(uint8_t profile);
+
+
+#endif // TRAJECTORY_OPTIMIZER_H
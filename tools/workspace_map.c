@@ -0,0 +1,398 @@
+#include "workspace_map.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Most bytes of the margins of a map
+#define WORKSPACE_MAP_MAX_VOXELS (1u << 30)
+
+/**
+ * Search state shared by the threads.
+ *
+ * @arm: Arm with links (const optimizer_arm*)
+ * @map: Map to fill, margins allocated (workspace_map*)
+ * @steps: Number of elevations of the sweep (unsigned)
+ * @cosines: Cosine of every elevation of the sweep (float*)
+ * @sines: Sine of every elevation of the sweep (float*)
+ * @rows: Number of rows of voxels along x (size_t)
+ * @next_row: Next row to take (atomic_size_t)
+ */
+typedef struct workspace_search {
+    const optimizer_arm* arm;
+    workspace_map* map;
+    unsigned steps;
+    float* cosines;
+    float* sines;
+    size_t rows;
+    atomic_size_t next_row;
+} workspace_search;
+
+/**
+ * Pose being solved for one voxel.
+ *
+ * @plane_margin: Margin of the plane servo (float)
+ * @elevations: Elevation of every link from the horizontal in radians (float[])
+ * @best: Largest margin of the poses found, negative if none (float)
+ */
+typedef struct workspace_pose {
+    float plane_margin;
+    float elevations[ARM_LINK_MAX_SERVOS];
+    float best;
+} workspace_pose;
+
+
+/**
+ * Margin of a servo angle to its bounds.
+ *
+ * @param arm: Arm of the servo
+ * @param index: Servo index
+ * @param angle: Angle in degrees
+ * @return Distance to the nearest bound, negative if out of bounds
+ */
+static float workspace_margin(const optimizer_arm* arm, uint8_t index, float angle) {
+    float lower = angle - arm->lower[index];
+    float upper = arm->upper[index] - angle;
+    return lower < upper ? lower : upper;
+}
+
+/**
+ * Take the margin of the link elevations of a pose, kept if it is the best one.
+ *
+ * @param arm: Arm with links
+ * @param pose: Pose with all elevations set
+ */
+static void workspace_evaluate(const optimizer_arm* arm, workspace_pose* pose) {
+    const position_required* geometry = &arm->geometry;
+    float margin = pose->plane_margin;
+    float previous = 0.0f;
+    for(uint8_t i = 0; i < geometry->servos_from_base_size && margin > pose->best; i++) {
+        float relative = (pose->elevations[i] - previous) * 180.0f / (float)M_PI;
+        relative -= 360.0f * floorf((relative + 180.0f) / 360.0f);
+        float angle = geometry->servos_angles_horizontal[i] + (geometry->servos_direction[i] ? relative : -relative);
+        float servo_margin = workspace_margin(arm, geometry->servos_from_base[i], angle);
+        if(servo_margin < margin)
+            margin = servo_margin;
+        previous = pose->elevations[i];
+    }
+    if(margin > pose->best)
+        pose->best = margin;
+}
+
+/**
+ * Solve the links up to one of them for a point in the plane of the arm: links after
+ * the second are swept over their elevation, the first two are solved in closed form.
+ *
+ * @param search: Search of the pose
+ * @param pose: Pose with the elevations of the links after link set
+ * @param link: Last link to solve
+ * @param radius: Radius of the point from the first joint
+ * @param height: Height of the point from the first joint
+ * @param tolerance: Distance from the point a single link may end at
+ */
+static void workspace_solve(const workspace_search* search, workspace_pose* pose, uint8_t link, float radius,
+                            float height, float tolerance) {
+    const float* lengths = search->arm->geometry.arm_lengths;
+    if(link == 0) {
+        if(fabsf(sqrtf(radius * radius + height * height) - lengths[0]) > tolerance)
+            return;
+        pose->elevations[0] = atan2f(height, radius);
+        workspace_evaluate(search->arm, pose);
+        return;
+    }
+    if(link > 1) {
+        for(unsigned step = 0; step < search->steps; step++) {
+            pose->elevations[link] = (float)(2 * M_PI) * step / search->steps - (float)M_PI;
+            workspace_solve(search, pose, link - 1, radius - lengths[link] * search->cosines[step],
+                            height - lengths[link] * search->sines[step], tolerance);
+        }
+        return;
+    }
+    // Two links: the elbow angle from the law of cosines, both bends
+    float distance_squared = radius * radius + height * height;
+    float cosine = (distance_squared - lengths[0] * lengths[0] - lengths[1] * lengths[1])
+                   / (2.0f * lengths[0] * lengths[1]);
+    if(cosine < -1.0f || cosine > 1.0f)
+        return;
+    float elbow = acosf(cosine);
+    float direction = atan2f(height, radius);
+    for(int bend = 0; bend < (elbow > 0.0f ? 2 : 1); bend++) {
+        float angle = bend ? -elbow : elbow;
+        pose->elevations[0] = direction - atan2f(lengths[1] * sinf(angle), lengths[0] + lengths[1] * cosf(angle));
+        pose->elevations[1] = pose->elevations[0] + angle;
+        workspace_evaluate(search->arm, pose);
+    }
+}
+
+/**
+ * Largest margin of the poses reaching a point.
+ *
+ * @param search: Search of the map
+ * @param x: X of the point in mm
+ * @param y: Y of the point in mm
+ * @param z: Height of the point in mm
+ * @return Margin in degrees, negative if no pose reaches the point
+ */
+static float workspace_reach(const workspace_search* search, float x, float y, float z) {
+    const optimizer_arm* arm = search->arm;
+    const position_required* geometry = &arm->geometry;
+    uint8_t plane = geometry->servo_plane_angle;
+    workspace_pose pose = {.best = -1.0f};
+    float radius = sqrtf(x * x + y * y);
+    float direction = atan2f(y, x) * 180.0f / (float)M_PI;
+    // Facing the point, or turned away with the links reaching back over the base
+    for(int back = 0; back < 2; back++) {
+        float angle = direction + (back ? 180.0f : 0.0f);
+        angle = arm->lower[plane] + fmodf(angle - arm->lower[plane] + 720.0f, 360.0f);
+        pose.plane_margin = workspace_margin(arm, plane, angle);
+        // No pose of this plane beats the best one
+        if(pose.plane_margin <= pose.best)
+            continue;
+        workspace_solve(search, &pose, geometry->servos_from_base_size - 1,
+                        (back ? -radius : radius) - geometry->offsets_radius, z - geometry->offsets_height,
+                        search->map->voxel / 2);
+    }
+    return pose.best;
+}
+
+/**
+ * Take rows of voxels until none are left.
+ *
+ * @param argument: Search (workspace_search*)
+ */
+static void* workspace_worker(void* argument) {
+    workspace_search* search = argument;
+    workspace_map* map = search->map;
+    size_t row;
+    while((row = atomic_fetch_add_explicit(&search->next_row, 1, memory_order_relaxed)) < search->rows) {
+        float y = map->origin[1] + (row % map->size[1] + 0.5f) * map->voxel;
+        float z = map->origin[2] + (row / map->size[1] + 0.5f) * map->voxel;
+        uint8_t* margins = map->margins + row * map->size[0];
+        for(uint16_t i = 0; i < map->size[0]; i++) {
+            float margin = workspace_reach(search, map->origin[0] + (i + 0.5f) * map->voxel, y, z);
+            margins[i] = margin < 0.0f ? REACH_MAP_UNREACHABLE
+                         : margin >= REACH_MAP_UNREACHABLE - 1 ? REACH_MAP_UNREACHABLE - 1 : (uint8_t)margin;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Set the bits and the reachable count of a map from its margins.
+ *
+ * @param map: Map with margins set and bits allocated
+ */
+static void workspace_map_pack(workspace_map* map) {
+    size_t voxels = (size_t)map->size[0] * map->size[1] * map->size[2];
+    memset(map->bits, 0, reach_map_bytes(map->size));
+    map->reachable = 0;
+    for(size_t i = 0; i < voxels; i++) {
+        if(map->margins[i] != REACH_MAP_UNREACHABLE) {
+            map->bits[i >> 3] |= 1 << (i & 7);
+            map->reachable++;
+        }
+    }
+}
+
+/**
+ * Compute the reachability of the bounding box of every pose of an arm.
+ *
+ * @param map: Map to fill, free with workspace_map_free()
+ * @param arm: Arm with links
+ * @param voxel: Edge of a voxel in mm
+ * @param elevation_step: Step of the elevation sweep of links after the second one, in degrees
+ * @param threads: Number of threads, at least 1
+ * @return False if the arm has no links, the map is too large or out of memory
+ */
+bool workspace_map_build(workspace_map* map, const optimizer_arm* arm, float voxel, float elevation_step,
+                         unsigned threads) {
+    memset(map, 0, sizeof(workspace_map));
+    const position_required* geometry = &arm->geometry;
+    if(!arm->has_geometry) {
+        fprintf(stderr, "No links in the arm description.\n");
+        return false;
+    }
+    float length = 0.0f;
+    for(uint8_t i = 0; i < geometry->servos_from_base_size; i++)
+        length += geometry->arm_lengths[i];
+    float reach = fabsf(geometry->offsets_radius) + length;
+    float bottom = geometry->offsets_height - length;
+    if(bottom < arm->floor)
+        bottom = arm->floor;
+    float extents[3] = {2.0f * reach, 2.0f * reach, geometry->offsets_height + length - bottom};
+    float voxels = 1.0f;
+    for(int i = 0; i < 3; i++) {
+        float size = ceilf(extents[i] / voxel);
+        voxels *= size;
+        map->size[i] = size < 1.0f ? 1 : size > UINT16_MAX ? UINT16_MAX : size;
+    }
+    if(voxels > WORKSPACE_MAP_MAX_VOXELS) {
+        fprintf(stderr, "%.0f voxels are too many, use larger voxels.\n", voxels);
+        return false;
+    }
+    map->origin[0] = -reach;
+    map->origin[1] = -reach;
+    map->origin[2] = bottom;
+    map->voxel = voxel;
+
+    workspace_search search = {.arm = arm, .map = map, .rows = (size_t)map->size[1] * map->size[2]};
+    atomic_init(&search.next_row, 0);
+    search.steps = (unsigned)ceilf(360.0f / elevation_step);
+    search.cosines = malloc(search.steps * sizeof(float));
+    search.sines = malloc(search.steps * sizeof(float));
+    map->margins = malloc((size_t)voxels);
+    map->bits = malloc(reach_map_bytes(map->size));
+    pthread_t* workers = malloc((threads > 1 ? threads - 1 : 1) * sizeof(pthread_t));
+    bool ok = search.cosines && search.sines && map->margins && map->bits && workers;
+    if(ok) {
+        for(unsigned step = 0; step < search.steps; step++) {
+            float elevation = (float)(2 * M_PI) * step / search.steps - (float)M_PI;
+            search.cosines[step] = cosf(elevation);
+            search.sines[step] = sinf(elevation);
+        }
+        // The calling thread is one of the workers
+        unsigned started = 0;
+        for(; started + 1 < threads; started++) {
+            if(pthread_create(&workers[started], NULL, workspace_worker, &search)) {
+                fprintf(stderr, "Cannot start thread %u.\n", started + 1);
+                break;
+            }
+        }
+        workspace_worker(&search);
+        for(unsigned i = 0; i < started; i++)
+            pthread_join(workers[i], NULL);
+        workspace_map_pack(map);
+    } else {
+        fprintf(stderr, "Out of memory.\n");
+        workspace_map_free(map);
+    }
+    free(workers);
+    free(search.sines);
+    free(search.cosines);
+    return ok;
+}
+
+/**
+ * Write a map as a reach map file with margins.
+ *
+ * @param map: Map to write
+ * @param path: Path of the file
+ * @return False if the file cannot be written
+ */
+bool workspace_map_write(const workspace_map* map, const char* path) {
+    FILE* file = fopen(path, "wb");
+    if(!file) {
+        fprintf(stderr, "Cannot create %s.\n", path);
+        return false;
+    }
+    uint32_t bytes = reach_map_bytes(map->size);
+    reach_map_header header = {
+        .size = {map->size[0], map->size[1], map->size[2]},
+        .origin = {map->origin[0], map->origin[1], map->origin[2]},
+        .voxel = map->voxel,
+        .margins_offset = sizeof(reach_map_header) + bytes
+    };
+    memcpy(header.magic, REACH_MAP_MAGIC, 4);
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(map->bits, 1, bytes, file);
+    fwrite(map->margins, 1, (size_t)map->size[0] * map->size[1] * map->size[2], file);
+    bool ok = !ferror(file);
+    ok = fclose(file) == 0 && ok;
+    if(!ok)
+        fprintf(stderr, "Cannot write %s.\n", path);
+    return ok;
+}
+
+/**
+ * Write the bits of a map as C source defining a const reach_map for the firmware.
+ *
+ * @param map: Map to write
+ * @param path: Path of the source file
+ * @param name: Name of the reach_map variable
+ * @return False if the file cannot be written
+ */
+bool workspace_map_write_source(const workspace_map* map, const char* path, const char* name) {
+    FILE* file = fopen(path, "w");
+    if(!file) {
+        fprintf(stderr, "Cannot create %s.\n", path);
+        return false;
+    }
+    uint32_t bytes = reach_map_bytes(map->size);
+    fprintf(file, "// Reach map written by arm_reach: %u x %u x %u voxels of %g mm, %zu reachable\n",
+            map->size[0], map->size[1], map->size[2], map->voxel, map->reachable);
+    fprintf(file, "#include \"reach_map.h\"\n\n");
+    fprintf(file, "static const uint8_t %s_bits[%u] = {", name, bytes);
+    for(uint32_t i = 0; i < bytes; i++)
+        fprintf(file, "%s0x%02x%s", i % 16 ? " " : "\n    ", map->bits[i], i + 1 < bytes ? "," : "");
+    fprintf(file, "\n};\n\n");
+    fprintf(file, "const reach_map %s = {\n", name);
+    fprintf(file, "    .size = {%u, %u, %u},\n", map->size[0], map->size[1], map->size[2]);
+    fprintf(file, "    .origin = {%#.9gf, %#.9gf, %#.9gf},\n", map->origin[0], map->origin[1], map->origin[2]);
+    fprintf(file, "    .scale = %#.9gf,\n", 1.0f / map->voxel);
+    fprintf(file, "    .bits = %s_bits\n};\n", name);
+    bool ok = !ferror(file);
+    ok = fclose(file) == 0 && ok;
+    if(!ok)
+        fprintf(stderr, "Cannot write %s.\n", path);
+    return ok;
+}
+
+/**
+ * Read a reach map file.
+ *
+ * @param map: Map to fill, free with workspace_map_free()
+ * @param path: Path of the file
+ * @return False if the file cannot be read or is not a valid reach map
+ */
+bool workspace_map_load(workspace_map* map, const char* path) {
+    memset(map, 0, sizeof(workspace_map));
+    FILE* file = fopen(path, "rb");
+    if(!file) {
+        fprintf(stderr, "Cannot open %s.\n", path);
+        return false;
+    }
+    reach_map_header header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, REACH_MAP_MAGIC, 4) == 0
+              && header.size[0] && header.size[1] && header.size[2] && header.voxel > 0.0f
+              && header.margins_offset == sizeof(header) + reach_map_bytes(header.size);
+    size_t voxels = (size_t)header.size[0] * header.size[1] * header.size[2];
+    if(ok) {
+        memcpy(map->size, header.size, sizeof(map->size));
+        memcpy(map->origin, header.origin, sizeof(map->origin));
+        map->voxel = header.voxel;
+        map->bits = malloc(reach_map_bytes(header.size));
+        map->margins = malloc(voxels);
+        ok = map->bits && map->margins && fread(map->bits, 1, reach_map_bytes(header.size), file)
+             == reach_map_bytes(header.size) && fread(map->margins, 1, voxels, file) == voxels;
+    }
+    fclose(file);
+    if(!ok) {
+        fprintf(stderr, "%s is not a valid reach map.\n", path);
+        workspace_map_free(map);
+        return false;
+    }
+    for(size_t i = 0; i < voxels; i++)
+        map->reachable += map->margins[i] != REACH_MAP_UNREACHABLE;
+    return true;
+}
+
+/**
+ * @param map: Map to look into
+ * @param view: Set to a reach_map of the bits of the map, valid until the map is freed
+ */
+void workspace_map_view(const workspace_map* map, reach_map* view) {
+    memcpy(view->size, map->size, sizeof(view->size));
+    memcpy(view->origin, map->origin, sizeof(view->origin));
+    view->scale = 1.0f / map->voxel;
+    view->bits = map->bits;
+}
+
+/**
+ * @param map: Map to free
+ */
+void workspace_map_free(workspace_map* map) {
+    free(map->margins);
+    free(map->bits);
+    memset(map, 0, sizeof(workspace_map));
+}
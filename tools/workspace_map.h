@@ -0,0 +1,86 @@
+#ifndef WORKSPACE_MAP_H
+#define WORKSPACE_MAP_H
+
+#include "reach_map.h"
+#include "trajectory_optimizer.h"
+
+/**
+ * Reachability of the workspace of an arm, voxel by voxel, see reach_map.h.
+ *
+ * The center of every voxel goes through inverse kinematics of the arm description:
+ * the plane servo turns towards the point or away from it with the links reaching back,
+ * links after the second one are swept over their elevation, and the first two links
+ * are solved in closed form with both elbow solutions. The margin of a pose is its
+ * smallest distance to the angle bounds of its servos, the margin of a voxel the largest
+ * margin of its poses. Rows of voxels are computed by a pool of threads.
+ *
+ * @size: Number of voxels along x, y and z (uint16_t[])
+ * @origin: Corner of voxel 0 in mm (float[])
+ * @voxel: Edge of a voxel in mm (float)
+ * @margins: Margin of every voxel in degrees, REACH_MAP_UNREACHABLE if none (uint8_t*)
+ * @bits: One bit per voxel, set if reachable (uint8_t*)
+ * @reachable: Number of reachable voxels (size_t)
+ */
+typedef struct workspace_map {
+    uint16_t size[3];
+    float origin[3];
+    float voxel;
+    uint8_t* margins;
+    uint8_t* bits;
+    size_t reachable;
+} workspace_map;
+
+/**
+ * Compute the reachability of the bounding box of every pose of an arm.
+ *
+ * @param map Map to fill, free with workspace_map_free()
+ * @param arm Arm with links
+ * @param voxel Edge of a voxel in mm
+ * @param elevation_step Step of the elevation sweep of links after the second one, in degrees
+ * @param threads Number of threads, at least 1
+ * @return False if the arm has no links, the map is too large or out of memory
+ */
+bool workspace_map_build(workspace_map* map, const optimizer_arm* arm, float voxel, float elevation_step,
+                         unsigned threads);
+
+/**
+ * Write a map as a reach map file with margins.
+ *
+ * @param map Map to write
+ * @param path Path of the file
+ * @return False if the file cannot be written
+ */
+bool workspace_map_write(const workspace_map* map, const char* path);
+
+/**
+ * Write the bits of a map as C source defining a const reach_map for the firmware.
+ *
+ * @param map Map to write
+ * @param path Path of the source file
+ * @param name Name of the reach_map variable
+ * @return False if the file cannot be written
+ */
+bool workspace_map_write_source(const workspace_map* map, const char* path, const char* name);
+
+/**
+ * Read a reach map file.
+ *
+ * @param map Map to fill, free with workspace_map_free()
+ * @param path Path of the file
+ * @return False if the file cannot be read or is not a valid reach map
+ */
+bool workspace_map_load(workspace_map* map, const char* path);
+
+/**
+ * @param map Map to look into
+ * @param view Set to a reach_map of the bits of the map, valid until the map is freed
+ */
+void workspace_map_view(const workspace_map* map, reach_map* view);
+
+/**
+ * @param map Map to free
+ */
+void workspace_map_free(workspace_map* map);
+
+
+#endif // WORKSPACE_MAP_H